@@ -0,0 +1,107 @@
+#include "Advertiser.h"
+#include "QueueStats.h"
+#include "ble/BLE.h"
+
+Advertiser::Advertiser(events::EventQueue *queue)
+: _queue(queue), _handle(0), _phase(PHASE_OFF), _startUs(0) {
+    memset(stats, 0, sizeof(stats));
+    memset(_intervalMs, 0, sizeof(_intervalMs));
+    memset(_durationMs, 0, sizeof(_durationMs));
+    setPhase(PHASE_FAST, ADV_FAST_INTERVAL_MS, ADV_FAST_MS);
+    setPhase(PHASE_SLOW, ADV_SLOW_INTERVAL_MS, ADV_SLOW_MS);
+}
+
+void Advertiser::setPhase(Phase phase, uint16_t intervalMs, uint32_t durationMs) {
+    if (phase == PHASE_OFF || phase >= PHASES) {
+        return;
+    }
+    _intervalMs[phase] = intervalMs;
+    _durationMs[phase] = durationMs;
+}
+
+void Advertiser::start() {
+    _startUs = us_ticker_read();
+    enter(PHASE_FAST);
+}
+
+void Advertiser::stop() {
+    if (_handle) {
+        _queue->cancel(_handle);
+        _handle = 0;
+    }
+    if (_phase != PHASE_OFF) {
+        BLE::Instance().gap().stopAdvertising();
+        _phase = PHASE_OFF;
+    }
+}
+
+void Advertiser::connected() {
+    if (_phase == PHASE_OFF) {
+        return;
+    }
+    // The stack stops advertising by itself when a connection is made
+    uint32_t elapsedMs = (us_ticker_read() - _startUs) / 1000;
+    PhaseStats &phase = stats[_phase];
+    phase.connections++;
+    phase.totalMs += elapsedMs;
+    if (elapsedMs > phase.maxMs) {
+        phase.maxMs = elapsedMs;
+    }
+
+    if (_handle) {
+        _queue->cancel(_handle);
+        _handle = 0;
+    }
+    _phase = PHASE_OFF;
+}
+
+const char *Advertiser::phaseName(Phase phase) {
+    static const char *const names[PHASES] = {"off", "fast", "slow"};
+    return phase < PHASES ? names[phase] : "?";
+}
+
+void Advertiser::enter(Phase phase) {
+    Gap &gap = BLE::Instance().gap();
+    if (_handle) {
+        _queue->cancel(_handle);
+        _handle = 0;
+    }
+    if (_phase != PHASE_OFF) {
+        gap.stopAdvertising();
+    }
+    _phase = phase;
+    if (phase == PHASE_OFF) {
+        return;
+    }
+
+    gap.setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+    gap.setAdvertisingInterval(_intervalMs[phase]);
+    // Phases end on our own timer rather than the stack's
+    gap.setAdvertisingTimeout(0);
+
+    stats[phase].entered++;
+    printf("Advertising: %s\r\n", phaseName(phase));
+    if (gap.startAdvertising()) {
+        printf("Error during Gap::startAdvertising.\r\n");
+        // Carry on with the next phase rather than not advertising at all
+        if (phase != PHASE_SLOW) {
+            _handle = QueueStats::call(_queue, QueueStats::EVENT_ADVERTISING, this, &Advertiser::next);
+        }
+        return;
+    }
+
+    if (_durationMs[phase]) {
+        _handle = QueueStats::call_in(_queue, QueueStats::EVENT_ADVERTISING, _durationMs[phase], this,
+                                     &Advertiser::next);
+    }
+}
+
+void Advertiser::next() {
+    _handle = 0;
+    if (_phase == PHASE_FAST) {
+        enter(PHASE_SLOW);
+    } else {
+        // Past the last phase with a duration; stay where we are
+        enter(_phase);
+    }
+}
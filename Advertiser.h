@@ -0,0 +1,81 @@
+#ifndef ADVERTISER_H
+#define ADVERTISER_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+
+/* Advertising phases after boot or a disconnection; a duration of 0 means until connected */
+#ifndef ADV_FAST_INTERVAL_MS
+#define ADV_FAST_INTERVAL_MS 20
+#endif
+#ifndef ADV_FAST_MS
+#define ADV_FAST_MS 30000
+#endif
+#ifndef ADV_SLOW_INTERVAL_MS
+#define ADV_SLOW_INTERVAL_MS 1022
+#endif
+#ifndef ADV_SLOW_MS
+#define ADV_SLOW_MS 0
+#endif
+
+/**
+ * Advertising state machine: fast, then slow.
+ *
+ * Advertising starts undirected at a short interval so a host, bonded or not, can find the
+ * gamepad quickly, and continues at a long interval to save power until a host connects. Each
+ * phase's interval and duration can be changed at runtime.
+ *
+ * There is no directed phase: the legacy Gap API takes no peer address for directed
+ * advertising, and the nRF5x port refuses ADV_CONNECTABLE_DIRECTED.
+ */
+class Advertiser {
+    public:
+        enum Phase {
+            PHASE_OFF = 0,
+            PHASE_FAST,
+            PHASE_SLOW,
+            PHASES
+        };
+
+        struct PhaseStats {
+            /** Times the phase was entered */
+            uint32_t entered;
+            /** Connections made in this phase, and the time from start() to each of them */
+            uint32_t connections;
+            uint32_t totalMs;
+            uint32_t maxMs;
+        };
+
+        Advertiser(events::EventQueue *queue);
+
+        void setPhase(Phase phase, uint16_t intervalMs, uint32_t durationMs);
+
+        /** Advertise from the first phase that applies; the payload must already be set */
+        void start();
+        void stop();
+
+        /** Call from the connection callback */
+        void connected();
+
+        Phase phase() const {
+            return _phase;
+        }
+
+        static const char *phaseName(Phase phase);
+
+        PhaseStats stats[PHASES];
+
+    private:
+        void enter(Phase phase);
+        void next();
+
+        events::EventQueue *_queue;
+        int _handle;
+        Phase _phase;
+        uint32_t _startUs;
+
+        uint16_t _intervalMs[PHASES];
+        uint32_t _durationMs[PHASES];
+};
+
+#endif // ADVERTISER_H
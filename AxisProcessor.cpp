@@ -0,0 +1,221 @@
+#include "AxisProcessor.h"
+
+namespace {
+
+struct CurveTable {
+    uint16_t points[AxisProcessor::CURVE_POINTS];
+};
+
+constexpr CurveTable makeCurve(AxisProcessor::Curve curve) {
+    CurveTable table = {};
+    for (unsigned i = 0; i < AxisProcessor::CURVE_POINTS; i++) {
+        uint32_t x = i * 256;
+        if (x > AxisProcessor::FULL_SCALE) {
+            x = AxisProcessor::FULL_SCALE;
+        }
+
+        uint32_t y = x;
+        if (curve == AxisProcessor::CURVE_SQUARE) {
+            y = x * x / AxisProcessor::FULL_SCALE;
+        } else if (curve == AxisProcessor::CURVE_CUBE) {
+            y = (x * x / AxisProcessor::FULL_SCALE) * x / AxisProcessor::FULL_SCALE;
+        } else if (curve == AxisProcessor::CURVE_SQRT) {
+            y = AxisProcessor::isqrt(x * AxisProcessor::FULL_SCALE);
+        }
+        table.points[i] = y;
+    }
+    return table;
+}
+
+constexpr CurveTable CURVES[AxisProcessor::CURVE_COUNT] = {
+    makeCurve(AxisProcessor::CURVE_LINEAR),
+    makeCurve(AxisProcessor::CURVE_SQUARE),
+    makeCurve(AxisProcessor::CURVE_CUBE),
+    makeCurve(AxisProcessor::CURVE_SQRT),
+};
+
+/*
+ * Square roots of m * 2^24 for m = 64..255, rounded at the middle of each step; seeds one
+ * Newton step in sqrt() below. Entries under 64 are never used.
+ */
+struct SqrtTable {
+    uint16_t roots[256];
+};
+
+constexpr SqrtTable makeSqrtTable() {
+    SqrtTable table = {};
+    for (unsigned m = 64; m < 256; m++) {
+        table.roots[m] = AxisProcessor::isqrt((m << 24) + (1 << 23));
+    }
+    return table;
+}
+
+constexpr SqrtTable SQRT_SEEDS = makeSqrtTable();
+
+static_assert(CURVES[AxisProcessor::CURVE_LINEAR].points[64] == 16384, "linear curve");
+static_assert(CURVES[AxisProcessor::CURVE_SQUARE].points[64] == 8192, "square curve");
+static_assert(CURVES[AxisProcessor::CURVE_SQRT].points[64] == 23170, "sqrt curve");
+static_assert(CURVES[AxisProcessor::CURVE_CUBE].points[AxisProcessor::CURVE_POINTS - 1] ==
+              AxisProcessor::FULL_SCALE, "curves reach full scale");
+
+} // namespace
+
+AxisProcessor::AxisProcessor()
+: _learning(false), _deadzone(0), _curveType(CURVE_LINEAR), _curve(CURVES[CURVE_LINEAR].points) {
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        setCalibration(axis, 0, 32768, 65535);
+    }
+    setDeadzone(STICK_DEADZONE);
+    setCurve(STICK_CURVE);
+}
+
+bool AxisProcessor::setCalibration(unsigned axis, uint16_t min, uint16_t centre, uint16_t max) {
+    // In int32 so nothing wraps at either end of the 16-bit range
+    int32_t low = min;
+    int32_t mid = centre;
+    int32_t high = max;
+    if (mid < STICK_MIN_SPAN) {
+        mid = STICK_MIN_SPAN;
+    } else if (mid > 0xFFFF - STICK_MIN_SPAN) {
+        mid = 0xFFFF - STICK_MIN_SPAN;
+    }
+    if (mid - low < STICK_MIN_SPAN) {
+        low = mid - STICK_MIN_SPAN;
+    }
+    if (high - mid < STICK_MIN_SPAN) {
+        high = mid + STICK_MIN_SPAN;
+    }
+    _min[axis] = low;
+    _centre[axis] = mid;
+    _max[axis] = high;
+    updateScale(axis);
+    return low == min && mid == centre && high == max;
+}
+
+void AxisProcessor::setCentre(unsigned axis, uint16_t centre) {
+    setCalibration(axis, _min[axis], centre, _max[axis]);
+}
+
+void AxisProcessor::calibration(unsigned axis, uint16_t *min, uint16_t *centre, uint16_t *max) const {
+    *min = _min[axis];
+    *centre = _centre[axis];
+    *max = _max[axis];
+}
+
+void AxisProcessor::learnRange(bool enable) {
+    if (enable && !_learning) {
+        // Start from the narrowest range around the centre
+        for (unsigned axis = 0; axis < AXES; axis++) {
+            setCalibration(axis, _centre[axis], _centre[axis], _centre[axis]);
+        }
+    }
+    _learning = enable;
+}
+
+void AxisProcessor::setDeadzone(uint16_t deadzone) {
+    if (deadzone >= FULL_SCALE) {
+        deadzone = FULL_SCALE - 1;
+    }
+    _deadzone = deadzone;
+    _deadzoneSquared = deadzone * deadzone;
+    _deadzoneScale = scale(FULL_SCALE - deadzone);
+    _identity = !_deadzone && _curve == CURVES[CURVE_LINEAR].points;
+}
+
+void AxisProcessor::setCurve(Curve curve) {
+    _curveType = curve < CURVE_COUNT ? curve : CURVE_LINEAR;
+    _curve = CURVES[_curveType].points;
+    _identity = !_deadzone && _curve == CURVES[CURVE_LINEAR].points;
+}
+
+void AxisProcessor::process(const uint16_t raw[AXES], int32_t out[AXES]) {
+    if (_learning) {
+        for (unsigned axis = 0; axis < AXES; axis++) {
+            if (raw[axis] < _min[axis] || raw[axis] > _max[axis]) {
+                setCalibration(axis, raw[axis] < _min[axis] ? raw[axis] : _min[axis], _centre[axis],
+                               raw[axis] > _max[axis] ? raw[axis] : _max[axis]);
+            }
+        }
+    }
+
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        out[axis] = normalise(axis, raw[axis]);
+    }
+    if (_identity) {
+        return;
+    }
+    for (unsigned stick = 0; stick < AXES; stick += 2) {
+        shape(&out[stick], &out[stick + 1]);
+    }
+}
+
+uint32_t AxisProcessor::sqrt(uint32_t value) {
+    if (value < 2) {
+        return value;
+    }
+    // Normalise by an even shift into [2^30, 2^32) so the top byte indexes the table
+    unsigned shift = __builtin_clz(value) & ~1u;
+    uint32_t normalised = value << shift;
+    uint32_t root = SQRT_SEEDS.roots[normalised >> 24];
+    root = (root + normalised / root) >> 1;
+    return root >> (shift / 2);
+}
+
+uint32_t AxisProcessor::scale(uint32_t range) {
+    // Rounded up, so the end of the range reaches full scale
+    return (((uint32_t)FULL_SCALE << 16) + range - 1) / range;
+}
+
+int32_t AxisProcessor::clamp(int32_t value) {
+    if (value > FULL_SCALE) {
+        return FULL_SCALE;
+    } else if (value < -FULL_SCALE) {
+        return -FULL_SCALE;
+    }
+    return value;
+}
+
+int32_t AxisProcessor::normalise(unsigned axis, uint16_t raw) const {
+    int32_t offset = (int32_t)raw - _centre[axis];
+    int32_t value;
+    if (offset >= 0) {
+        value = ((int64_t)offset * _scaleAbove[axis]) >> 16;
+    } else {
+        value = -(int32_t)(((int64_t)-offset * _scaleBelow[axis]) >> 16);
+    }
+
+    return clamp(value);
+}
+
+void AxisProcessor::shape(int32_t *x, int32_t *y) const {
+    uint32_t squared = (uint32_t)(*x * *x) + (uint32_t)(*y * *y);
+    if (squared <= _deadzoneSquared) {
+        *x = 0;
+        *y = 0;
+        return;
+    }
+
+    // Stretch what lies outside the deadzone back to full scale
+    uint32_t radius = sqrt(squared);
+    uint32_t magnitude = ((uint64_t)(radius - _deadzone) * _deadzoneScale) >> 16;
+
+    // Interpolate between the two nearest curve points. Past full scale, towards the corners of
+    // a square gate, the curve continues linearly and each axis saturates on its own.
+    uint32_t shaped = magnitude;
+    if (magnitude < FULL_SCALE) {
+        unsigned index = magnitude >> 8;
+        uint32_t low = _curve[index];
+        uint32_t high = _curve[index + 1];
+        shaped = low + (((high - low) * (magnitude & 0xFF)) >> 8);
+    }
+
+    // One division per stick: scale both axes by shaped / radius in 16.16 fixed point
+    int32_t gain = ((uint64_t)shaped << 16) / radius;
+    *x = clamp(((int64_t)*x * gain) >> 16);
+    *y = clamp(((int64_t)*y * gain) >> 16);
+}
+
+void AxisProcessor::updateScale(unsigned axis) {
+    _scaleBelow[axis] = scale((int32_t)_centre[axis] - _min[axis]);
+    _scaleAbove[axis] = scale((int32_t)_max[axis] - _centre[axis]);
+}
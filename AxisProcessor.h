@@ -0,0 +1,137 @@
+#ifndef AXIS_PROCESSOR_H
+#define AXIS_PROCESSOR_H
+
+#include "mbed.h"
+
+/* Radial deadzone, as a fraction of full deflection in 1/32767 */
+#ifndef STICK_DEADZONE
+#define STICK_DEADZONE 0
+#endif
+
+/*
+ * Smallest calibrated travel either side of the centre, in raw counts. Narrower calibrations are
+ * widened, so one count of noise can never swing an axis across its range.
+ */
+#ifndef STICK_MIN_SPAN
+#define STICK_MIN_SPAN 256
+#endif
+
+/* Response curve applied to both sticks, one of AxisProcessor::Curve */
+#ifndef STICK_CURVE
+#define STICK_CURVE AxisProcessor::CURVE_LINEAR
+#endif
+
+/**
+ * Integer processing of the stick axes between the filter and the report.
+ *
+ * Each axis is first mapped from its calibrated min/centre/max to -32767..32767 with a separate
+ * scale either side of the centre. The two axes of each stick are then treated as a vector: a
+ * radial deadzone zeroes small deflections in any direction, the remaining range is stretched
+ * back to full scale, and the magnitude goes through a response curve looked up in a table
+ * computed at compile time. Only integer arithmetic is used. With no deadzone and the linear
+ * curve, positions pass through unchanged.
+ */
+class AxisProcessor {
+    public:
+        static const unsigned AXES = 4;
+        static const int32_t FULL_SCALE = 32767;
+
+        enum Curve {
+            CURVE_LINEAR = 0,
+            /** Finer control near the centre */
+            CURVE_SQUARE,
+            CURVE_CUBE,
+            /** Faster response near the centre */
+            CURVE_SQRT,
+            CURVE_COUNT
+        };
+
+        /** Curve tables hold CURVE_POINTS points, spaced 256 apart from 0 to FULL_SCALE */
+        static const unsigned CURVE_POINTS = 129;
+
+        AxisProcessor();
+
+        /**
+         * Set the raw readings at full deflection either way and at rest. The centre is kept
+         * STICK_MIN_SPAN from either end of the 16-bit range, and min and max at least
+         * STICK_MIN_SPAN from it.
+         *
+         * @return false if the calibration had to be fixed up that way
+         */
+        bool setCalibration(unsigned axis, uint16_t min, uint16_t centre, uint16_t max);
+        void setCentre(unsigned axis, uint16_t centre);
+        void calibration(unsigned axis, uint16_t *min, uint16_t *centre, uint16_t *max) const;
+
+        /**
+         * While learning, every reading outside an axis' min/max widens it. Start with the
+         * sticks at rest, then move them around their full range.
+         */
+        void learnRange(bool enable);
+
+        void setDeadzone(uint16_t deadzone);
+        void setCurve(Curve curve);
+
+        uint16_t deadzone() const {
+            return _deadzone;
+        }
+
+        Curve curve() const {
+            return _curveType;
+        }
+
+        /**
+         * Process one reading of every axis
+         *
+         * @param raw 16-bit readings in report order: x0, y0, x1, y1
+         * @param out Signed positions, -32767 to 32767
+         */
+        void process(const uint16_t raw[AXES], int32_t out[AXES]);
+
+        /** Square root within one of isqrt(), using a table lookup and one division */
+        static uint32_t sqrt(uint32_t value);
+
+        /** Exact integer square root, used to build the tables at compile time */
+        static constexpr uint32_t isqrt(uint32_t value) {
+            uint32_t root = 0;
+            uint32_t bit = 1u << 30;
+            while (bit > value) {
+                bit >>= 2;
+            }
+            // Branch-free digit-by-digit method, one result bit per iteration
+            while (bit) {
+                uint32_t trial = root + bit;
+                uint32_t take = -(uint32_t)(value >= trial);
+                value -= trial & take;
+                root = (root >> 1) + (bit & take);
+                bit >>= 2;
+            }
+            return root;
+        }
+
+    private:
+        /** FULL_SCALE / range in 16.16 fixed point */
+        static uint32_t scale(uint32_t range);
+        static int32_t clamp(int32_t value);
+        int32_t normalise(unsigned axis, uint16_t raw) const;
+        void shape(int32_t *x, int32_t *y) const;
+        void updateScale(unsigned axis);
+
+        uint16_t _min[AXES];
+        uint16_t _centre[AXES];
+        uint16_t _max[AXES];
+        /* 32767 / half-range, in 16.16 fixed point */
+        uint32_t _scaleBelow[AXES];
+        uint32_t _scaleAbove[AXES];
+        bool _learning;
+
+        uint32_t _deadzone;
+        uint32_t _deadzoneSquared;
+        /* 32767 / (32767 - deadzone), in 16.16 fixed point */
+        uint32_t _deadzoneScale;
+        Curve _curveType;
+        const uint16_t *_curve;
+        /* No deadzone and the linear curve, so shaping can be skipped */
+        bool _identity;
+};
+
+#endif // AXIS_PROCESSOR_H
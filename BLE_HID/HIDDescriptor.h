@@ -0,0 +1,591 @@
+#ifndef HID_DESCRIPTOR_H
+#define HID_DESCRIPTOR_H
+
+#include <stdint.h>
+#include "USBHID_Types.h"
+
+/**
+ * Compile-time HID report descriptors.
+ *
+ * A report is declared once as a list of fields; the descriptor bytes and the bit offset of
+ * every field are both derived from that list, so the report map sent to the host and the code
+ * that fills in reports cannot disagree:
+ *
+ *     typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+ *                         hid::Buttons<12>, hid::HatSwitch, hid::Axes<hid::USAGE_X, hid::USAGE_Y> > Layout;
+ *
+ * Axes are 8-bit; WideAxes<Bits, ...> and Triggers<Bits> carry up to 16 bits per value.
+ *
+ *     Layout::DESCRIPTOR.bytes, Layout::DESCRIPTOR_LENGTH    the report map
+ *     Layout::LENGTH                                         report size in bytes
+ *     hid::ReportPacker<Layout, Target>                      writes fields into a Target
+ *
+ * Fields are laid out in declaration order from bit 0 of byte 0 upwards, as hosts read them.
+ * A Usage Page item is only emitted where a field's page differs from the one in effect.
+ *
+ * ReportId<Id> fields split the layout into several input reports, each running up to the next
+ * ReportId. Over BLE the ID travels in the characteristic's Report Reference rather than in the
+ * report, so the fields keep the same offsets either way: the whole layout is one buffer, and
+ * report i is the reportLength(i) bytes of it from reportOffset(i).
+ */
+namespace hid {
+
+enum {
+    PAGE_GENERIC_DESKTOP = 0x01,
+    PAGE_SIMULATION = 0x02,
+    PAGE_BUTTON = 0x09,
+    PAGE_VENDOR = 0xFF00,
+};
+
+enum {
+    USAGE_GAME_PAD = 0x05,
+    USAGE_X = 0x30,
+    USAGE_Y = 0x31,
+    USAGE_Z = 0x32,
+    USAGE_RX = 0x33,
+    USAGE_RY = 0x34,
+    USAGE_RZ = 0x35,
+    USAGE_HAT_SWITCH = 0x39,
+};
+
+/* Simulation Controls page; hosts map these to the left and right triggers */
+enum {
+    USAGE_ACCELERATOR = 0xC4,
+    USAGE_BRAKE = 0xC5,
+};
+
+enum {
+    COLLECTION_PHYSICAL = 0x00,
+    COLLECTION_APPLICATION = 0x01,
+};
+
+/* Main item data bits */
+enum {
+    DATA_VAR_ABS = 0x02,
+    CONST_VAR_ABS = 0x03,
+    DATA_VAR_ABS_NULL = 0x42,
+};
+
+enum FieldKind {
+    FIELD_BUTTONS,
+    FIELD_HAT,
+    FIELD_AXES,
+    FIELD_TRIGGERS,
+    FIELD_PADDING,
+    FIELD_REPORT_ID,
+    FIELD_VENDOR,
+};
+
+/** Main items of the reports the host sends */
+enum VendorReportType {
+    VENDOR_OUTPUT,
+    VENDOR_FEATURE,
+};
+
+/** Descriptor bytes being assembled, with the usage page in effect */
+template <unsigned Capacity>
+struct DescriptorWriter {
+    uint8_t bytes[Capacity];
+    unsigned length;
+    int page;
+
+    constexpr DescriptorWriter() : bytes(), length(0), page(-1) {
+    }
+
+    /** A short item with no data, e.g. END_COLLECTION(0) */
+    constexpr void item(uint8_t tag) {
+        bytes[length++] = tag;
+    }
+
+    /** A short item with one byte of data; tag is e.g. REPORT_SIZE(1) */
+    constexpr void item(uint8_t tag, uint8_t value) {
+        bytes[length++] = tag;
+        bytes[length++] = value;
+    }
+
+    /** A short item with two bytes of data, little endian; tag is e.g. PHYSICAL_MAXIMUM(2) */
+    constexpr void item16(uint8_t tag, uint16_t value) {
+        bytes[length++] = tag;
+        bytes[length++] = value & 0xFF;
+        bytes[length++] = value >> 8;
+    }
+
+    /** A signed item in as few bytes as hold value; tag is e.g. LOGICAL_MAXIMUM(0) */
+    constexpr void itemSigned(uint8_t tag, int32_t value) {
+        if (value >= -128 && value <= 127) {
+            item(tag | 1, value & 0xFF);
+        } else if (value >= -32768 && value <= 32767) {
+            item16(tag | 2, value & 0xFFFF);
+        } else {
+            bytes[length++] = tag | 3;
+            for (unsigned i = 0; i < 4; i++) {
+                bytes[length++] = (uint32_t)value >> (8 * i);
+            }
+        }
+    }
+
+    constexpr void usagePage(uint16_t usagePage) {
+        if (page != usagePage) {
+            if (usagePage > 0xFF) {
+                item16(USAGE_PAGE(2), usagePage);
+            } else {
+                item(USAGE_PAGE(1), usagePage);
+            }
+            page = usagePage;
+        }
+    }
+};
+
+/** Count on/off buttons, numbered from First */
+template <unsigned Count, unsigned First = 1>
+struct Buttons {
+    static constexpr FieldKind KIND = FIELD_BUTTONS;
+    static constexpr unsigned COUNT = Count;
+    static constexpr unsigned SIZE = 1;
+    static constexpr unsigned BITS = Count;
+    static constexpr unsigned MAX_ITEMS_LENGTH = 16;
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        w.usagePage(PAGE_BUTTON);
+        w.item(USAGE_MINIMUM(1), First);
+        w.item(USAGE_MAXIMUM(1), First + Count - 1);
+        w.item(LOGICAL_MINIMUM(1), 0);
+        w.item(LOGICAL_MAXIMUM(1), 1);
+        w.item(REPORT_COUNT(1), Count);
+        w.item(REPORT_SIZE(1), 1);
+        w.item(INPUT(1), DATA_VAR_ABS);
+    }
+};
+
+/**
+ * Eight-way hat switch in a nibble: 0 is up, counting clockwise in 45 degree steps, and any
+ * value above 7 is the null state (centred). Its unit is cleared again after it.
+ */
+struct HatSwitch {
+    static constexpr FieldKind KIND = FIELD_HAT;
+    static constexpr unsigned COUNT = 1;
+    static constexpr unsigned SIZE = 4;
+    static constexpr unsigned BITS = 4;
+    static constexpr unsigned MAX_ITEMS_LENGTH = 25;
+    static constexpr uint8_t NULL_STATE = 0xF;
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        w.usagePage(PAGE_GENERIC_DESKTOP);
+        w.item(USAGE(1), USAGE_HAT_SWITCH);
+        w.item(UNIT(1), 0x14);                  // English rotation: degrees
+        w.item(LOGICAL_MINIMUM(1), 0);
+        w.item(LOGICAL_MAXIMUM(1), 7);
+        w.item(PHYSICAL_MINIMUM(1), 0);
+        w.item16(PHYSICAL_MAXIMUM(2), 315);
+        w.item(REPORT_SIZE(1), 4);
+        w.item(REPORT_COUNT(1), 1);
+        w.item(INPUT(1), DATA_VAR_ABS_NULL);
+        w.item(UNIT(1), 0x00);
+    }
+};
+
+/** Unsigned values of Bits bits, 0 to 2^Bits - 1, one per usage of Page */
+template <FieldKind Kind, uint8_t Page, unsigned Bits, uint8_t... Usages>
+struct Values {
+    static_assert(Bits >= 1 && Bits <= 16, "values are at most 16 bits");
+
+    static constexpr FieldKind KIND = Kind;
+    static constexpr unsigned COUNT = sizeof...(Usages);
+    static constexpr unsigned SIZE = Bits;
+    static constexpr unsigned BITS = Bits * sizeof...(Usages);
+    static constexpr unsigned MAX_ITEMS_LENGTH = 15 + 2 * sizeof...(Usages);
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        const uint8_t usages[] = {Usages...};
+        w.usagePage(Page);
+        for (unsigned i = 0; i < COUNT; i++) {
+            w.item(USAGE(1), usages[i]);
+        }
+        w.item(LOGICAL_MINIMUM(1), 0);
+        w.itemSigned(LOGICAL_MAXIMUM(0), (1L << Bits) - 1);
+        w.item(REPORT_SIZE(1), Bits);
+        w.item(REPORT_COUNT(1), COUNT);
+        w.item(INPUT(1), DATA_VAR_ABS);
+    }
+};
+
+/** 8-bit Generic Desktop axes, one per usage */
+template <uint8_t... Usages>
+struct Axes : Values<FIELD_AXES, PAGE_GENERIC_DESKTOP, 8, Usages...> {
+};
+
+/** Generic Desktop axes of up to 16 bits */
+template <unsigned Bits, uint8_t... Usages>
+struct WideAxes : Values<FIELD_AXES, PAGE_GENERIC_DESKTOP, Bits, Usages...> {
+};
+
+/** Left and right analog triggers, released at 0 */
+template <unsigned Bits>
+struct Triggers : Values<FIELD_TRIGGERS, PAGE_SIMULATION, Bits, USAGE_BRAKE, USAGE_ACCELERATOR> {
+};
+
+/** Constant bits, e.g. to byte-align the next field */
+template <unsigned Bits>
+struct Padding {
+    static constexpr FieldKind KIND = FIELD_PADDING;
+    static constexpr unsigned COUNT = 1;
+    static constexpr unsigned SIZE = Bits;
+    static constexpr unsigned BITS = Bits;
+    static constexpr unsigned MAX_ITEMS_LENGTH = 6;
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        w.item(REPORT_SIZE(1), Bits);
+        w.item(REPORT_COUNT(1), 1);
+        w.item(INPUT(1), CONST_VAR_ABS);
+    }
+};
+
+/** Starts the report with ID Id, 1 to 255; it takes no space in the report itself */
+template <uint8_t Id>
+struct ReportId {
+    static_assert(Id != 0, "report ID 0 is reserved");
+
+    static constexpr FieldKind KIND = FIELD_REPORT_ID;
+    static constexpr unsigned COUNT = 0;
+    static constexpr unsigned SIZE = 0;
+    static constexpr unsigned BITS = 0;
+    static constexpr unsigned MAX_ITEMS_LENGTH = 2;
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        w.item(REPORT_ID(1), Id);
+    }
+};
+
+/**
+ * An output or feature report of Length opaque bytes with ID Id, on the vendor page. It takes
+ * no space in the input reports, and goes after all their fields.
+ */
+template <VendorReportType Type, uint8_t Id, uint8_t Usage, unsigned Length>
+struct VendorReport {
+    static_assert(Id != 0, "report ID 0 is reserved");
+
+    static constexpr FieldKind KIND = FIELD_VENDOR;
+    static constexpr unsigned COUNT = 0;
+    static constexpr unsigned SIZE = 0;
+    static constexpr unsigned BITS = 0;
+    static constexpr unsigned MAX_ITEMS_LENGTH = 18;
+    static constexpr uint8_t ID = Id;
+    static constexpr unsigned LENGTH = Length;
+
+    template <class Writer>
+    static constexpr void items(Writer &w) {
+        w.item(REPORT_ID(1), Id);
+        w.usagePage(PAGE_VENDOR);
+        w.item(USAGE(1), Usage);
+        w.item(LOGICAL_MINIMUM(1), 0);
+        w.item16(LOGICAL_MAXIMUM(2), 0xFF);
+        w.item(REPORT_SIZE(1), 8);
+        w.item(REPORT_COUNT(1), Length);
+        w.item(Type == VENDOR_OUTPUT ? OUTPUT(1) : FEATURE(1), DATA_VAR_ABS);
+    }
+};
+
+template <class Field>
+constexpr uint8_t fieldReportId(const Field *) {
+    return 0;
+}
+
+template <uint8_t Id>
+constexpr uint8_t fieldReportId(const ReportId<Id> *) {
+    return Id;
+}
+
+template <unsigned Length>
+struct Descriptor {
+    uint8_t bytes[Length];
+};
+
+template <class... Fields>
+constexpr unsigned reportBits() {
+    const unsigned bits[] = {0, Fields::BITS...};
+    unsigned total = 0;
+    for (unsigned i = 0; i < sizeof(bits) / sizeof(bits[0]); i++) {
+        total += bits[i];
+    }
+    return total;
+}
+
+/** Room for the collections around the fields, and for every field's items */
+template <class... Fields>
+constexpr unsigned descriptorCapacity() {
+    const unsigned lengths[] = {10, Fields::MAX_ITEMS_LENGTH...};
+    unsigned total = 0;
+    for (unsigned i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        total += lengths[i];
+    }
+    return total;
+}
+
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr DescriptorWriter<descriptorCapacity<Fields...>()> writeDescriptor() {
+    DescriptorWriter<descriptorCapacity<Fields...>()> w;
+    w.usagePage(Page);
+    w.item(USAGE(1), Usage);
+    w.item(COLLECTION(1), COLLECTION_PHYSICAL);
+    w.item(COLLECTION(1), COLLECTION_APPLICATION);
+    int expand[] = {0, (Fields::items(w), 0)...};
+    (void)expand;
+    w.item(END_COLLECTION(0));
+    w.item(END_COLLECTION(0));
+    return w;
+}
+
+template <unsigned Length, class Writer>
+constexpr Descriptor<Length> trimDescriptor(const Writer &w) {
+    Descriptor<Length> descriptor = {};
+    for (unsigned i = 0; i < Length; i++) {
+        descriptor.bytes[i] = w.bytes[i];
+    }
+    return descriptor;
+}
+
+/**
+ * An input report of Fields, inside a Physical and an Application collection of the given
+ * usage
+ */
+template <uint8_t Page, uint8_t Usage, class... Fields>
+class Report {
+    public:
+        static constexpr unsigned FIELDS = sizeof...(Fields);
+        static constexpr FieldKind KINDS[FIELDS] = {Fields::KIND...};
+        static constexpr unsigned COUNTS[FIELDS] = {Fields::COUNT...};
+        static constexpr unsigned SIZES[FIELDS] = {Fields::SIZE...};
+        static constexpr unsigned FIELD_BITS[FIELDS] = {Fields::BITS...};
+        static constexpr uint8_t FIELD_IDS[FIELDS] = {fieldReportId((const Fields *)0)...};
+
+        /** Report size in bytes */
+        static constexpr unsigned LENGTH = (reportBits<Fields...>() + 7) / 8;
+
+        /** Index of the first field of a kind, or FIELDS if there is none */
+        static constexpr unsigned find(FieldKind kind) {
+            unsigned i = 0;
+            while (i < FIELDS && KINDS[i] != kind) {
+                i++;
+            }
+            return i;
+        }
+
+        /** Bit offset of the first field of a kind */
+        static constexpr unsigned offset(FieldKind kind) {
+            unsigned bit = 0;
+            for (unsigned i = 0; i < find(kind); i++) {
+                bit += FIELD_BITS[i];
+            }
+            return bit;
+        }
+
+        static constexpr unsigned count(FieldKind kind) {
+            return find(kind) < FIELDS ? COUNTS[find(kind)] : 0;
+        }
+
+        static constexpr unsigned size(FieldKind kind) {
+            return find(kind) < FIELDS ? SIZES[find(kind)] : 0;
+        }
+
+        /** Number of reports: one per ReportId, or a single report with ID 0 */
+        static constexpr unsigned reports() {
+            unsigned count = 0;
+            for (unsigned i = 0; i < FIELDS; i++) {
+                count += KINDS[i] == FIELD_REPORT_ID;
+            }
+            return count ? count : 1;
+        }
+
+        /** Field index of the ReportId starting a report, or FIELDS without any */
+        static constexpr unsigned reportField(unsigned report) {
+            unsigned i = 0;
+            for (unsigned seen = 0; i < FIELDS; i++) {
+                if (KINDS[i] == FIELD_REPORT_ID && seen++ == report) {
+                    break;
+                }
+            }
+            return i;
+        }
+
+        static constexpr uint8_t reportId(unsigned report) {
+            return reportField(report) < FIELDS ? FIELD_IDS[reportField(report)] : 0;
+        }
+
+        /** Bit offset of a field by index */
+        static constexpr unsigned fieldOffset(unsigned field) {
+            unsigned bit = 0;
+            for (unsigned i = 0; i < field && i < FIELDS; i++) {
+                bit += FIELD_BITS[i];
+            }
+            return bit;
+        }
+
+        /** Bit offset at which a report starts in the layout */
+        static constexpr unsigned reportBit(unsigned report) {
+            return reportField(report) < FIELDS ? fieldOffset(reportField(report)) : 0;
+        }
+
+        static constexpr unsigned reportOffset(unsigned report) {
+            return reportBit(report) / 8;
+        }
+
+        static constexpr unsigned reportLength(unsigned report) {
+            return ((report + 1 < reports() ? reportBit(report + 1) : fieldOffset(FIELDS)) -
+                    reportBit(report) + 7) / 8;
+        }
+
+        /** Report holding the first field of a kind */
+        static constexpr unsigned reportOf(FieldKind kind) {
+            unsigned report = 0;
+            for (unsigned i = 1; i < find(kind) && i < FIELDS; i++) {
+                report += KINDS[i] == FIELD_REPORT_ID;
+            }
+            return report;
+        }
+
+        static constexpr unsigned DESCRIPTOR_LENGTH = writeDescriptor<Page, Usage, Fields...>().length;
+
+        /** The report map, kept in flash */
+        static constexpr Descriptor<DESCRIPTOR_LENGTH> DESCRIPTOR =
+            trimDescriptor<DESCRIPTOR_LENGTH>(writeDescriptor<Page, Usage, Fields...>());
+};
+
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr FieldKind Report<Page, Usage, Fields...>::KINDS[];
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr unsigned Report<Page, Usage, Fields...>::COUNTS[];
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr unsigned Report<Page, Usage, Fields...>::SIZES[];
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr unsigned Report<Page, Usage, Fields...>::FIELD_BITS[];
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr uint8_t Report<Page, Usage, Fields...>::FIELD_IDS[];
+template <uint8_t Page, uint8_t Usage, class... Fields>
+constexpr Descriptor<Report<Page, Usage, Fields...>::DESCRIPTOR_LENGTH> Report<Page, Usage, Fields...>::DESCRIPTOR;
+
+/** Byte-for-byte comparison, for static_asserts */
+template <unsigned Length>
+constexpr bool equal(const Descriptor<Length> &descriptor, const uint8_t *bytes, unsigned length) {
+    if (length != Length) {
+        return false;
+    }
+    for (unsigned i = 0; i < Length; i++) {
+        if (descriptor.bytes[i] != bytes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Fills in the fields of a Layout report through a Target with
+ * setBits(byte, mask, value) and write(byte, data, length), such as a ReportSnapshot.
+ *
+ * Every offset and mask is a compile-time constant. Buttons and the hat are set with one
+ * setBits() each, so they must not straddle two bytes. Axes and triggers are packed into a
+ * byte-aligned run and written with one write(), so readers see a field's values change together
+ * whatever their width.
+ */
+template <class Layout, class Target>
+class ReportPacker {
+    public:
+        static constexpr unsigned BUTTONS = Layout::count(FIELD_BUTTONS);
+        static constexpr unsigned BUTTON_OFFSET = Layout::offset(FIELD_BUTTONS);
+        static constexpr unsigned HAT_OFFSET = Layout::offset(FIELD_HAT);
+        static constexpr unsigned AXES = Layout::count(FIELD_AXES);
+        static constexpr unsigned AXIS_BITS = Layout::size(FIELD_AXES);
+        static constexpr unsigned AXIS_OFFSET = Layout::offset(FIELD_AXES);
+        static constexpr unsigned TRIGGERS = Layout::count(FIELD_TRIGGERS);
+        static constexpr unsigned TRIGGER_BITS = Layout::size(FIELD_TRIGGERS);
+        static constexpr unsigned TRIGGER_OFFSET = Layout::offset(FIELD_TRIGGERS);
+
+        static_assert(!Layout::count(FIELD_HAT) ||
+                      (Layout::size(FIELD_HAT) == 4 && HAT_OFFSET % 8 + 4 <= 8),
+                      "hat switch fits in one byte");
+        static_assert(AXIS_OFFSET % 8 == 0 && AXES * AXIS_BITS % 8 == 0,
+                      "axes are a whole number of bytes");
+        static_assert(TRIGGER_OFFSET % 8 == 0 && TRIGGERS * TRIGGER_BITS % 8 == 0,
+                      "triggers are a whole number of bytes");
+
+        explicit ReportPacker(Target &target) : _target(target) {
+        }
+
+        /** Button from 0 */
+        void setButton(unsigned button, bool pressed) {
+            unsigned bit = BUTTON_OFFSET + button;
+            uint8_t mask = 1 << (bit % 8);
+            _target.setBits(bit / 8, mask, pressed ? mask : 0);
+        }
+
+        /** Direction 0-7, or HatSwitch::NULL_STATE */
+        void setHat(uint8_t direction) {
+            constexpr uint8_t mask = 0xF << (HAT_OFFSET % 8);
+            _target.setBits(HAT_OFFSET / 8, mask, (direction & 0xF) << (HAT_OFFSET % 8));
+        }
+
+        /** One 8-bit axis; wider axes are only set all together */
+        void setAxis(unsigned axis, uint8_t value) {
+            static_assert(AXIS_BITS == 8, "setAxis() needs 8-bit axes");
+            _target.setBits(AXIS_OFFSET / 8 + axis, 0xFF, value);
+        }
+
+        /** All axes at once, each 0 to 2^AXIS_BITS - 1 */
+        template <class Value>
+        void setAxes(const Value *values) {
+            uint8_t bytes[AXES * AXIS_BITS / 8];
+            pack(bytes, values, AXES, AXIS_BITS);
+            _target.write(AXIS_OFFSET / 8, bytes, sizeof(bytes));
+        }
+
+        /** Both triggers at once, each 0 to 2^TRIGGER_BITS - 1 */
+        void setTriggers(const uint16_t *values) {
+            uint8_t bytes[TRIGGERS * TRIGGER_BITS / 8];
+            pack(bytes, values, TRIGGERS, TRIGGER_BITS);
+            _target.write(TRIGGER_OFFSET / 8, bytes, sizeof(bytes));
+        }
+
+        /** Value at index of a count x bits run of a report, as packed by ReportPacker */
+        static uint16_t unpack(const uint8_t *bytes, unsigned index, unsigned bits) {
+            unsigned first = index * bits / 8;
+            unsigned last = ((index + 1) * bits - 1) / 8;
+            uint32_t window = 0;
+            for (unsigned i = first; i <= last; i++) {
+                window |= (uint32_t)bytes[i] << (8 * (i - first));
+            }
+            return (window >> (index * bits % 8)) & ((1UL << bits) - 1);
+        }
+
+    private:
+        /* Little endian, LSB first, as HID hosts read values that straddle bytes */
+        template <class Value>
+        static void pack(uint8_t *bytes, const Value *values, unsigned count, unsigned bits) {
+            if (bits == 8) {
+                for (unsigned i = 0; i < count; i++) {
+                    bytes[i] = values[i];
+                }
+                return;
+            }
+            uint32_t accumulator = 0;
+            unsigned pending = 0;
+            for (unsigned i = 0; i < count; i++) {
+                accumulator |= (uint32_t)values[i] << pending;
+                pending += bits;
+                while (pending >= 8) {
+                    *bytes++ = accumulator;
+                    accumulator >>= 8;
+                    pending -= 8;
+                }
+            }
+        }
+
+        Target &_target;
+};
+
+} // namespace hid
+
+#endif // HID_DESCRIPTOR_H
@@ -16,33 +16,149 @@
 
 #include "mbed.h"
 #include "HIDServiceBase.h"
+#include "LatencyTrace.h"
+#include "QueueStats.h"
+
+/*
+ * Stack events handed off to the event queue. The stack's parameters only live for the
+ * callback, so each event carries a copy of what its handler reads.
+ */
+struct HIDServiceBase::ConnectionEvent {
+    HIDServiceBase *service;
+    Gap::ConnectionCallbackParams_t params;
+    Gap::ConnectionParams_t connectionParams;
+
+    void operator()() {
+        params.connectionParams = &connectionParams;
+        service->onConnection(&params);
+    }
+};
+
+struct HIDServiceBase::DisconnectionEvent {
+    HIDServiceBase *service;
+    Gap::DisconnectionCallbackParams_t params;
+
+    void operator()() {
+        service->onDisconnection(&params);
+    }
+};
+
+struct HIDServiceBase::SentEvent {
+    HIDServiceBase *service;
+    unsigned count;
+
+    void operator()() {
+        service->onDataSent(count);
+    }
+};
+
+/* Without a larger ATT MTU, writes carry at most 20 bytes */
+#ifndef HID_HANDOFF_WRITE_MAX
+#define HID_HANDOFF_WRITE_MAX 20
+#endif
+
+struct HIDServiceBase::WrittenEvent {
+    HIDServiceBase *service;
+    GattWriteCallbackParams params;
+    uint8_t data[HID_HANDOFF_WRITE_MAX];
+
+    void operator()() {
+        params.data = data;
+        service->onDataWritten(&params);
+    }
+};
+
+struct HIDServiceBase::UpdatesEvent {
+    HIDServiceBase *service;
+    GattAttribute::Handle_t handle;
+    bool enabled;
+
+    void operator()() {
+        if (enabled)
+            service->onUpdatesEnabled(handle);
+        else
+            service->onUpdatesDisabled(handle);
+    }
+};
+
+/*
+ * Stack events the queue had no room for. They must not run on the stack's thread, so they are
+ * latched here, merged with later ones of the same kind, and run by a single drain event
+ * posted behind whatever was handed off before them. Only the latest state of each kind
+ * matters once a connection is gone, so a disconnection drops everything latched before it.
+ */
+struct HIDServiceBase::Latch {
+    enum {
+        DISCONNECTION = 1 << 0,
+        CONNECTION    = 1 << 1,
+        UPDATES       = 1 << 2,
+        OUTPUT_WRITE  = 1 << 3,
+        FEATURE_WRITE = 1 << 4,
+        SENT          = 1 << 5
+    };
+
+    /* Bits above, in the order drainLatched() runs them */
+    volatile uint32_t events;
+    Gap::DisconnectionCallbackParams_t disconnection;
+    ConnectionEvent connection;
+    /* Input reports whose subscription changed, and whether they are subscribed now */
+    uint32_t updated;
+    uint32_t subscribed;
+    WrittenEvent output;
+    WrittenEvent feature;
+    unsigned sentCount;
+};
+
+/* Handed off unless events are latched already: then the new one is latched behind them */
+template <typename F>
+static bool handOffEvent(events::EventQueue *queue, volatile uint32_t &latched, F event)
+{
+    return !latched && QueueStats::call(queue, QueueStats::EVENT_HANDOFF, event);
+}
 
 HIDServiceBase::HIDServiceBase(BLE          &_ble,
                                report_map_t reportMap,
                                uint8_t      reportMapSize,
-                               report_t     inputReport,
+                               const input_report_t *inputReports,
+                               uint8_t      inputReportCount,
                                report_t     outputReport,
                                report_t     featureReport,
-                               uint8_t      inputReportLength,
                                uint8_t      outputReportLength,
                                uint8_t      featureReportLength,
-                               uint8_t      inputReportTickerDelay) :
+                               uint8_t      inputReportTickerDelay,
+                               uint8_t      outputReportID,
+                               uint8_t      featureReportID) :
     ble(_ble),
     connected (false),
     reportMapLength(reportMapSize),
 
-    inputReport(inputReport),
+    inputReportsCount(inputReportCount),
     outputReport(outputReport),
     featureReport(featureReport),
 
-    inputReportLength(inputReportLength),
     outputReportLength(outputReportLength),
     featureReportLength(featureReportLength),
 
     protocolMode(REPORT_PROTOCOL),
 
-    inputReportReferenceDescriptor(BLE_UUID_DESCRIPTOR_REPORT_REFERENCE,
-            (uint8_t *)&inputReportReferenceData, 2, 2),
+    connParams(NULL),
+
+    sendMode(SEND_IMMEDIATE),
+    dirtyReports(0),
+    subscribedReports(0),
+    reportInFlight(false),
+    sendBlocked(false),
+    reportRefused(false),
+    blockedSinceUs(0),
+
+    eventQueue(NULL),
+    handOff(false),
+    latch(new Latch()),
+    drainPosted(false),
+    coalesceWindowMs(0),
+    lastWriteUs(0),
+    windowEvent(0),
+
     outputReportReferenceDescriptor(BLE_UUID_DESCRIPTOR_REPORT_REFERENCE,
             (uint8_t *)&outputReportReferenceData, 2, 2),
     featureReportReferenceDescriptor(BLE_UUID_DESCRIPTOR_REPORT_REFERENCE,
@@ -52,25 +168,18 @@ HIDServiceBase::HIDServiceBase(BLE          &_ble,
               GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ
             | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE),
 
-    inputReportCharacteristic(GattCharacteristic::UUID_REPORT_CHAR,
-            (uint8_t *)inputReport, inputReportLength, inputReportLength,
-              GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ
-            | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY
-            | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
-            inputReportDescriptors(), 1),
-
     outputReportCharacteristic(GattCharacteristic::UUID_REPORT_CHAR,
             (uint8_t *)outputReport, outputReportLength, outputReportLength,
               GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ
             | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE
             | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
-            outputReportDescriptors(), 1),
+            outputReportDescriptors(outputReportID), 1),
 
     featureReportCharacteristic(GattCharacteristic::UUID_REPORT_CHAR,
             (uint8_t *)featureReport, featureReportLength, featureReportLength,
               GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ
             | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
-            featureReportDescriptors(), 1),
+            featureReportDescriptors(featureReportID), 1),
 
     /*
      * We need to set reportMap content as const, in order to let the compiler put it into flash
@@ -87,27 +196,38 @@ HIDServiceBase::HIDServiceBase(BLE          &_ble,
             GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE),
 
     reportTickerDelay(inputReportTickerDelay),
-    reportTickerIsActive(false)
+    reportTickerIsActive(false),
+    reportsCoalesced(0),
+    reportsRetried(0),
+    statesDropped(0),
+    blockedUs(0),
+    maxBlockedUs(0)
 {
-    static GattCharacteristic *characteristics[] = {
-        &HIDInformationCharacteristic,
-        &reportMapCharacteristic,
-        &protocolModeCharacteristic,
-        &HIDControlPointCharacteristic,
-        NULL,
-        NULL,
-        NULL,
-        NULL,
-        NULL
-    };
+    MBED_ASSERT(inputReportCount <= HID_MAX_INPUT_REPORTS);
+
+    characteristics[0] = &HIDInformationCharacteristic;
+    characteristics[1] = &reportMapCharacteristic;
+    characteristics[2] = &protocolModeCharacteristic;
+    characteristics[3] = &HIDControlPointCharacteristic;
 
     unsigned int charIndex = 4;
     /*
      * Report characteristics are optional, and depend on the reportMap descriptor
      * Note: at least one should be present, but we don't check that at the moment.
+     *
+     * Input reports get a characteristic each, told apart by the ID in their Report Reference.
+     * They live as long as the service, which is never destroyed.
      */
-    if (inputReportLength)
-        characteristics[charIndex++] = &inputReportCharacteristic;
+    for (unsigned i = 0; i < inputReportsCount; i++) {
+        this->inputReports[i] = inputReports[i];
+        inputReportCharacteristics[i] = new GattCharacteristic(GattCharacteristic::UUID_REPORT_CHAR,
+                (uint8_t *)inputReports[i].data, inputReports[i].length, inputReports[i].length,
+                  GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ
+                | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY
+                | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
+                inputReportDescriptors(i), 1);
+        characteristics[charIndex++] = inputReportCharacteristics[i];
+    }
     if (outputReportLength)
         characteristics[charIndex++] = &outputReportCharacteristic;
     if (featureReportLength)
@@ -124,10 +244,15 @@ HIDServiceBase::HIDServiceBase(BLE          &_ble,
 
     ble.gattServer().addService(service);
 
-    ble.gap().onConnection(this, &HIDServiceBase::onConnection);
-    ble.gap().onDisconnection(this, &HIDServiceBase::onDisconnection);
+    ble.gap().onConnection(this, &HIDServiceBase::stackConnection);
+    ble.gap().onDisconnection(this, &HIDServiceBase::stackDisconnection);
 
-    ble.gattServer().onDataSent(this, &HIDServiceBase::onDataSent);
+    ble.gattServer().onDataSent(this, &HIDServiceBase::stackDataSent);
+    ble.gattServer().onDataWritten(this, &HIDServiceBase::stackDataWritten);
+    ble.gattServer().onUpdatesEnabled(
+        GattServer::EventCallback_t(this, &HIDServiceBase::stackUpdatesEnabled));
+    ble.gattServer().onUpdatesDisabled(
+        GattServer::EventCallback_t(this, &HIDServiceBase::stackUpdatesDisabled));
 
     /*
      * Change preferred connection params, in order to optimize the notification frequency. Most
@@ -147,7 +272,8 @@ HIDServiceBase::HIDServiceBase(BLE          &_ble,
     SecurityManager::SecurityMode_t securityMode = SecurityManager::SECURITY_MODE_ENCRYPTION_NO_MITM;
     protocolModeCharacteristic.requireSecurity(securityMode);
     reportMapCharacteristic.requireSecurity(securityMode);
-    inputReportCharacteristic.requireSecurity(securityMode);
+    for (unsigned i = 0; i < inputReportsCount; i++)
+        inputReportCharacteristics[i]->requireSecurity(securityMode);
     outputReportCharacteristic.requireSecurity(securityMode);
     featureReportCharacteristic.requireSecurity(securityMode);
 }
@@ -166,20 +292,116 @@ void HIDServiceBase::stopReportTicker(void) {
 
 void HIDServiceBase::onDataSent(unsigned count) {
     //startReportTicker();
+    TRACE_POINT(SENT);
+    reportInFlight = false;
+    /* The stack has room again: a refused report is retried below, with the latest state */
+    sendBlocked = false;
+
+    if (connParams)
+        connParams->reportsSent(count);
+
+    if (dirtyReports && !(sendMode == SEND_COALESCED && holdForWindow()))
+        sendCallback();
 }
 
-GattAttribute** HIDServiceBase::inputReportDescriptors() {
-    inputReportReferenceData.ID = 0;
-    inputReportReferenceData.type = INPUT_REPORT;
+void HIDServiceBase::onDataWritten(const GattWriteCallbackParams *params) {
+    if (outputReportLength && params->handle == outputReportCharacteristic.getValueHandle())
+        onOutputReport(params->data, params->len);
+    else if (featureReportLength && params->handle == featureReportCharacteristic.getValueHandle())
+        onFeatureReport(params->data, params->len);
+}
 
-    static GattAttribute * descs[] = {
-        &inputReportReferenceDescriptor,
-    };
-    return descs;
+int HIDServiceBase::inputReportIndex(GattAttribute::Handle_t handle) const {
+    for (unsigned i = 0; i < inputReportsCount; i++) {
+        if (inputReportCharacteristics[i]->getValueHandle() == handle)
+            return i;
+    }
+    return -1;
+}
+
+void HIDServiceBase::onUpdatesEnabled(GattAttribute::Handle_t handle) {
+    int index = inputReportIndex(handle);
+    if (index < 0)
+        return;
+    subscribedReports |= 1UL << index;
+    requestSend(1UL << index);
+}
+
+void HIDServiceBase::onUpdatesDisabled(GattAttribute::Handle_t handle) {
+    int index = inputReportIndex(handle);
+    if (index < 0)
+        return;
+    subscribedReports &= ~(1UL << index);
+}
+
+void HIDServiceBase::setCoalesceWindow(uint8_t windowMs) {
+    coalesceWindowMs = eventQueue ? windowMs : 0;
+}
+
+bool HIDServiceBase::holdForWindow(void) {
+    if (windowEvent)
+        return true;
+    if (!coalesceWindowMs)
+        return false;
+
+    uint32_t elapsedUs = us_ticker_read() - lastWriteUs;
+    uint32_t windowUs = coalesceWindowMs * 1000;
+    if (elapsedUs >= windowUs)
+        return false;
+
+    windowEvent = QueueStats::call_in(eventQueue, QueueStats::EVENT_REPORT,
+                                      (windowUs - elapsedUs + 999) / 1000,
+                                      this, &HIDServiceBase::closeWindow);
+    return windowEvent != 0;
+}
+
+void HIDServiceBase::closeWindow(void) {
+    windowEvent = 0;
+    if (connected && dirtyReports && !reportInFlight && !sendBlocked)
+        sendCallback();
+}
+
+void HIDServiceBase::requestSend(uint32_t reports) {
+    if (latch->events && !drainPosted)
+        postDrain();
+    if (!connected)
+        return;
+
+    reports &= (1UL << inputReportsCount) - 1;
+    uint32_t alreadyDirty = dirtyReports & reports;
+    dirtyReports |= reports;
+
+    if (sendBlocked) {
+        /* The refused state is superseded; only the latest goes out, from onDataSent() */
+        statesDropped++;
+        return;
+    }
+
+    if (sendMode == SEND_COALESCED && (reportInFlight || holdForWindow())) {
+        if (alreadyDirty)
+            reportsCoalesced++;
+        return;
+    }
+
+    sendCallback();
 }
 
-GattAttribute** HIDServiceBase::outputReportDescriptors() {
-    outputReportReferenceData.ID = 0;
+void HIDServiceBase::setConnParamManager(ConnParamManager *manager) {
+    connParams = manager;
+    ble.gap().setPreferredConnectionParams(&manager->params(ConnParamManager::MODE_ACTIVE));
+}
+
+GattAttribute** HIDServiceBase::inputReportDescriptors(unsigned index) {
+    inputReportReferenceData[index].ID = inputReports[index].ID;
+    inputReportReferenceData[index].type = INPUT_REPORT;
+
+    inputReportReferenceDescriptors[index] = new GattAttribute(BLE_UUID_DESCRIPTOR_REPORT_REFERENCE,
+            (uint8_t *)&inputReportReferenceData[index], 2, 2);
+    return &inputReportReferenceDescriptors[index];
+}
+
+GattAttribute** HIDServiceBase::outputReportDescriptors(uint8_t ID) {
+    outputReportReferenceData.ID = ID;
     outputReportReferenceData.type = OUTPUT_REPORT;
 
     static GattAttribute * descs[] = {
@@ -188,8 +410,8 @@ GattAttribute** HIDServiceBase::outputReportDescriptors() {
     return descs;
 }
 
-GattAttribute** HIDServiceBase::featureReportDescriptors() {
-    featureReportReferenceData.ID = 0;
+GattAttribute** HIDServiceBase::featureReportDescriptors(uint8_t ID) {
+    featureReportReferenceData.ID = ID;
     featureReportReferenceData.type = FEATURE_REPORT;
 
     static GattAttribute * descs[] = {
@@ -206,22 +428,263 @@ HID_information_t* HIDServiceBase::HIDInformation() {
 }
 
 ble_error_t HIDServiceBase::send(const report_t report) {
-    return ble.gattServer().write(inputReportCharacteristic.getValueHandle(),
-                                  report,
-                                  inputReportLength);
+    return send(0, report);
+}
+
+ble_error_t HIDServiceBase::send(unsigned index, const report_t report) {
+    if (sendBlocked) {
+        /* Another report of the same callback was refused already; this one follows it */
+        dirtyReports |= 1UL << index;
+        return BLE_STACK_BUSY;
+    }
+
+    ble_error_t error = ble.gattServer().write(inputReportCharacteristics[index]->getValueHandle(),
+                                               report,
+                                               inputReports[index].length);
+    if (error == BLE_ERROR_NONE) {
+        /* Without a subscription the stack only stores the value; no onDataSent() follows */
+        if (subscribedReports & (1UL << index))
+            reportInFlight = true;
+        lastWriteUs = us_ticker_read();
+        TRACE_POINT(WRITE);
+        if (connParams)
+            connParams->reportWritten();
+        if (reportRefused) {
+            uint32_t elapsedUs = us_ticker_read() - blockedSinceUs;
+            reportRefused = false;
+            reportsRetried++;
+            blockedUs += elapsedUs;
+            if (elapsedUs > maxBlockedUs)
+                maxBlockedUs = elapsedUs;
+        }
+    } else if (error == BLE_STACK_BUSY || error == BLE_ERROR_NO_MEM) {
+        /* Out of notification buffers, which the nRF5x port reports as BLE_STACK_BUSY (other
+         * ports as BLE_ERROR_NO_MEM): onDataSent() sends the latest report. Any other error
+         * leaves nothing to wait for, so the next change simply tries again. */
+        if (!reportRefused) {
+            reportRefused = true;
+            blockedSinceUs = us_ticker_read();
+        }
+        sendBlocked = true;
+        dirtyReports |= 1UL << index;
+    }
+
+    return error;
 }
 
 ble_error_t HIDServiceBase::read(report_t report) {
-    // TODO. For the time being, we'll just have HID input reports...
-    return BLE_ERROR_NOT_IMPLEMENTED;
+    if (!outputReportLength)
+        return BLE_ERROR_NOT_IMPLEMENTED;
+
+    uint16_t length = outputReportLength;
+    return ble.gattServer().read(outputReportCharacteristic.getValueHandle(),
+                                 const_cast<uint8_t *>(report), &length);
+}
+
+ble_error_t HIDServiceBase::setFeatureReport(const report_t report) {
+    if (!featureReportLength)
+        return BLE_ERROR_NOT_IMPLEMENTED;
+
+    return ble.gattServer().write(featureReportCharacteristic.getValueHandle(),
+                                  report, featureReportLength);
 }
 
 void HIDServiceBase::onConnection(const Gap::ConnectionCallbackParams_t *params)
 {
     this->connected = true;
+    if (connParams)
+        connParams->connected(params->handle, params->connectionParams);
 }
 
 void HIDServiceBase::onDisconnection(const Gap::DisconnectionCallbackParams_t *params)
 {
     this->connected = false;
+    this->dirtyReports = 0;
+    this->subscribedReports = 0;
+    this->reportInFlight = false;
+    this->sendBlocked = false;
+    this->reportRefused = false;
+    if (windowEvent) {
+        eventQueue->cancel(windowEvent);
+        windowEvent = 0;
+    }
+    if (connParams)
+        connParams->disconnected();
+}
+
+void HIDServiceBase::latchEvent(void)
+{
+    QueueStats::deferred(eventQueue, QueueStats::EVENT_HANDOFF);
+    if (!drainPosted)
+        postDrain();
+}
+
+void HIDServiceBase::postDrain(void)
+{
+    /* Only one drain is ever outstanding; if the post fails the next stack event or report
+     * change retries */
+    drainPosted = true;
+    if (!QueueStats::call(eventQueue, QueueStats::EVENT_HANDOFF,
+                          this, &HIDServiceBase::drainLatched))
+        drainPosted = false;
+}
+
+void HIDServiceBase::drainLatched(void)
+{
+    /* Clear first: an event latched meanwhile is either taken below or posts a new drain */
+    drainPosted = false;
+
+    core_util_critical_section_enter();
+    Latch events = *latch;
+    latch->events = 0;
+    latch->updated = 0;
+    latch->sentCount = 0;
+    core_util_critical_section_exit();
+
+    if (events.events & Latch::DISCONNECTION)
+        onDisconnection(&events.disconnection);
+    if (events.events & Latch::CONNECTION)
+        events.connection();
+    for (unsigned i = 0; i < inputReportsCount; i++) {
+        uint32_t bit = 1UL << i;
+        if (!(events.updated & bit))
+            continue;
+        if (events.subscribed & bit)
+            onUpdatesEnabled(inputReportHandle(i));
+        else
+            onUpdatesDisabled(inputReportHandle(i));
+    }
+    if (events.events & Latch::OUTPUT_WRITE)
+        events.output();
+    if (events.events & Latch::FEATURE_WRITE)
+        events.feature();
+    if (events.events & Latch::SENT)
+        onDataSent(events.sentCount);
+}
+
+void HIDServiceBase::stackConnection(const Gap::ConnectionCallbackParams_t *params)
+{
+    if (!handOff) {
+        onConnection(params);
+        return;
+    }
+    ConnectionEvent event = {this, *params, *params->connectionParams};
+    if (handOffEvent(eventQueue, latch->events, event))
+        return;
+
+    core_util_critical_section_enter();
+    latch->events |= Latch::CONNECTION;
+    latch->connection = event;
+    core_util_critical_section_exit();
+    latchEvent();
+}
+
+void HIDServiceBase::stackDisconnection(const Gap::DisconnectionCallbackParams_t *params)
+{
+    if (!handOff) {
+        onDisconnection(params);
+        return;
+    }
+    DisconnectionEvent event = {this, *params};
+    if (handOffEvent(eventQueue, latch->events, event))
+        return;
+
+    core_util_critical_section_enter();
+    latch->events = Latch::DISCONNECTION;
+    latch->disconnection = *params;
+    latch->updated = 0;
+    latch->sentCount = 0;
+    core_util_critical_section_exit();
+    latchEvent();
+}
+
+void HIDServiceBase::stackDataSent(unsigned count)
+{
+    if (!handOff) {
+        onDataSent(count);
+        return;
+    }
+    SentEvent event = {this, count};
+    if (handOffEvent(eventQueue, latch->events, event))
+        return;
+
+    core_util_critical_section_enter();
+    latch->events |= Latch::SENT;
+    latch->sentCount += count;
+    core_util_critical_section_exit();
+    latchEvent();
+}
+
+void HIDServiceBase::stackDataWritten(const GattWriteCallbackParams *params)
+{
+    if (!handOff) {
+        onDataWritten(params);
+        return;
+    }
+    /* Longer than any of our reports: a write to another service, nothing to hand off */
+    if (params->len > HID_HANDOFF_WRITE_MAX)
+        return;
+    WrittenEvent event;
+    event.service = this;
+    event.params = *params;
+    memcpy(event.data, params->data, params->len);
+    if (handOffEvent(eventQueue, latch->events, event))
+        return;
+
+    /* Output and feature reports are state: the latest write of each is all that counts */
+    uint32_t kind;
+    if (outputReportLength && params->handle == outputReportCharacteristic.getValueHandle())
+        kind = Latch::OUTPUT_WRITE;
+    else if (featureReportLength && params->handle == featureReportCharacteristic.getValueHandle())
+        kind = Latch::FEATURE_WRITE;
+    else
+        return;
+
+    core_util_critical_section_enter();
+    latch->events |= kind;
+    if (kind == Latch::OUTPUT_WRITE)
+        latch->output = event;
+    else
+        latch->feature = event;
+    core_util_critical_section_exit();
+    latchEvent();
+}
+
+void HIDServiceBase::stackUpdates(GattAttribute::Handle_t handle, bool enabled)
+{
+    if (!handOff) {
+        if (enabled)
+            onUpdatesEnabled(handle);
+        else
+            onUpdatesDisabled(handle);
+        return;
+    }
+    UpdatesEvent event = {this, handle, enabled};
+    if (handOffEvent(eventQueue, latch->events, event))
+        return;
+
+    int index = inputReportIndex(handle);
+    if (index < 0)
+        return;
+    uint32_t bit = 1UL << index;
+
+    core_util_critical_section_enter();
+    latch->events |= Latch::UPDATES;
+    latch->updated |= bit;
+    if (enabled)
+        latch->subscribed |= bit;
+    else
+        latch->subscribed &= ~bit;
+    core_util_critical_section_exit();
+    latchEvent();
+}
+
+void HIDServiceBase::stackUpdatesEnabled(GattAttribute::Handle_t handle)
+{
+    stackUpdates(handle, true);
+}
+
+void HIDServiceBase::stackUpdatesDisabled(GattAttribute::Handle_t handle)
+{
+    stackUpdates(handle, false);
 }
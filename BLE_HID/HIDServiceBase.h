@@ -21,9 +21,18 @@
 
 #include "ble/BLE.h"
 #include "USBHID_Types.h"
+#include "ConnParamManager.h"
 
 #define BLE_UUID_DESCRIPTOR_REPORT_REFERENCE 0x2908
 
+/* Longest input report that fits in one notification at the default ATT_MTU of 23 */
+#define HID_MAX_NOTIFICATION_LENGTH 20
+
+/* Input report characteristics a service can have, each with its own report ID */
+#ifndef HID_MAX_INPUT_REPORTS
+#define HID_MAX_INPUT_REPORTS 4
+#endif
+
 typedef const uint8_t report_map_t[];
 typedef const uint8_t * report_t;
 
@@ -49,6 +58,24 @@ typedef struct {
     uint8_t type;
 } report_reference_t;
 
+/** An input report: its ID in the report map (0 if the map has none), value and length */
+typedef struct {
+    uint8_t ID;
+    report_t data;
+    uint8_t length;
+} input_report_t;
+
+enum SendMode {
+    /** Every report change is written to the stack straight away */
+    SEND_IMMEDIATE,
+    /**
+     * Report changes are merged while a notification is in flight, and the latest report is
+     * written once the stack has sent it. At most one notification goes out per connection
+     * event.
+     */
+    SEND_COALESCED,
+};
+
 
 class HIDServiceBase {
 public:
@@ -62,32 +89,43 @@ public:
      *         is called "HID report descriptor".
      *  @param reportMapLength
      *         Size of the reportMap array
+     *  @param inputReports
+     *         The input reports, one characteristic each (up to HID_MAX_INPUT_REPORTS). With
+     *         several, each needs the non-zero report ID it has in the reportMap.
+     *  @param inputReportCount
+     *         Number of inputReports
      *  @param outputReportLength
-     *         Maximum length of a sent report (up to 64 bytes) (default: 64 bytes)
-     *  @param inputReportLength
      *         Maximum length of a received report (up to 64 bytes) (default: 64 bytes)
+     *  @param featureReportLength
+     *         Maximum length of a feature report (up to 64 bytes) (default: 64 bytes)
      *  @param inputReportTickerDelay
      *         Delay between input report notifications, in ms. Acceptable values depend directly on
      *         GAP's connInterval parameter, so it shouldn't be less than 12ms
      *         Preferred GAP connection interval is set after this value, in order to send
      *         notifications as quick as possible: minimum connection interval will be set to
      *         (inputReportTickerDelay / 2)
+     *  @param outputReportID
+     *         ID of the output report in the reportMap, if it uses IDs
+     *  @param featureReportID
+     *         ID of the feature report in the reportMap, if it uses IDs
      */
     HIDServiceBase(BLE &_ble,
                    report_map_t reportMap,
                    uint8_t reportMapLength,
-                   report_t inputReport,
+                   const input_report_t *inputReports,
+                   uint8_t inputReportCount,
                    report_t outputReport,
                    report_t featureReport,
-                   uint8_t inputReportLength = 0,
                    uint8_t outputReportLength = 0,
                    uint8_t featureReportLength = 0,
-                   uint8_t inputReportTickerDelay = 50);
+                   uint8_t inputReportTickerDelay = 50,
+                   uint8_t outputReportID = 0,
+                   uint8_t featureReportID = 0);
 
     /**
      *  Send Report
      *
-     *  @param report   Report to send. Must be of size @ref inputReportLength
+     *  @param report   Report to send as the first input report. Must be of its length
      *  @return         The write status
      *
      *  @note Don't call send() directly for multiple reports! Use reportTicker for that, in order
@@ -95,14 +133,32 @@ public:
      */
     virtual ble_error_t send(const report_t report);
 
+    /**
+     *  Send one of the input reports
+     *
+     *  @param index    Input report, in the order given to the constructor
+     *  @param report   Report to send. Must be of that report's length
+     *  @return         The write status
+     */
+    virtual ble_error_t send(unsigned index, const report_t report);
+
     /**
      *  Read Report
      *
-     *  @param report   Report to fill. Must be of size @ref outputReportLength
+     *  @param report   Report to fill with the last output report written by the host. Must be
+     *                  of size @ref outputReportLength
      *  @return         The read status
      */
     virtual ble_error_t read(report_t report);
 
+    /**
+     *  Set the feature report the host reads
+     *
+     *  @param report   Report of size @ref featureReportLength
+     *  @return         The write status
+     */
+    ble_error_t setFeatureReport(const report_t report);
+
     virtual void onConnection(const Gap::ConnectionCallbackParams_t *params);
     virtual void onDisconnection(const Gap::DisconnectionCallbackParams_t *params);
 
@@ -111,6 +167,94 @@ public:
         return connected;
     }
 
+    /**
+     *  Select how report changes signalled with requestSend() turn into notifications
+     */
+    void setSendMode(SendMode mode)
+    {
+        sendMode = mode;
+    }
+
+    SendMode getSendMode(void) const
+    {
+        return sendMode;
+    }
+
+    /**
+     *  Event queue to run deferred sends on; needed by setCoalesceWindow()
+     *
+     *  With handOff, connection, disconnection, subscription, data sent and data written events
+     *  are copied out of the BLE stack and run on this queue, so that all the report state is
+     *  only ever touched by the thread dispatching it. Use it when that is not the thread
+     *  processing BLE events. Events the queue has no room for are kept, merged by kind, and run
+     *  on the queue as soon as a post succeeds again; they never run on the stack's thread.
+     */
+    void setEventQueue(events::EventQueue *queue, bool handOff = false)
+    {
+        eventQueue = queue;
+        this->handOff = handOff && queue;
+    }
+
+    /**
+     *  In SEND_COALESCED mode, also merge report changes for windowMs after each write, so
+     *  that at most one notification goes out per window. 0 only waits for the stack.
+     */
+    void setCoalesceWindow(uint8_t windowMs);
+
+    uint8_t coalesceWindow(void) const
+    {
+        return coalesceWindowMs;
+    }
+
+    /**
+     *  Signal that input reports changed and should be sent
+     *
+     *  The reports, one bit per index, are marked dirty; sendCallback() takes them with
+     *  takeDirtyReports(). In SEND_IMMEDIATE mode this calls sendCallback() right away. In
+     *  SEND_COALESCED mode they stay dirty while a previous notification is in flight;
+     *  onDataSent() then sends the latest reports.
+     *
+     *  In either mode, once the stack has refused a report for lack of buffers nothing more is
+     *  written until onDataSent() frees one; the latest reports are sent then, and the states in
+     *  between are dropped.
+     *
+     *  @param reports  Bit mask of the changed reports, all of them by default
+     */
+    virtual void requestSend(uint32_t reports = ALL_REPORTS);
+
+    /**
+     *  Value handle of an input report characteristic
+     */
+    GattAttribute::Handle_t inputReportHandle(unsigned index) const
+    {
+        return inputReportCharacteristics[index]->getValueHandle();
+    }
+
+    GattAttribute::Handle_t outputReportHandle(void) const
+    {
+        return outputReportCharacteristic.getValueHandle();
+    }
+
+    GattAttribute::Handle_t featureReportHandle(void) const
+    {
+        return featureReportCharacteristic.getValueHandle();
+    }
+
+    uint8_t inputReportCount(void) const
+    {
+        return inputReportsCount;
+    }
+
+    static const uint32_t ALL_REPORTS = 0xFFFFFFFF;
+
+    /**
+     *  Hand connection parameters over to a manager that follows report activity
+     *
+     *  Its active parameters replace the preferred ones set by the constructor, and it is kept
+     *  informed of connections and of every report written and sent.
+     */
+    void setConnParamManager(ConnParamManager *manager);
+
 protected:
     /**
      * Called by BLE API when data has been successfully sent.
@@ -122,6 +266,45 @@ protected:
      */
     virtual void onDataSent(unsigned count);
 
+    /**
+     * Called by BLE API when the host wrote a characteristic; dispatches output and feature
+     * reports to onOutputReport() and onFeatureReport()
+     */
+    virtual void onDataWritten(const GattWriteCallbackParams *params);
+
+    /**
+     * Called by BLE API when the host enabled notifications of an input report. Until then a
+     * write only updates the value the host reads, and no onDataSent() follows it, so the
+     * report is not in flight; the latest state is sent now.
+     *
+     * @param handle    Value handle of the characteristic
+     */
+    virtual void onUpdatesEnabled(GattAttribute::Handle_t handle);
+
+    /**
+     * Called by BLE API when the host disabled notifications of an input report
+     */
+    virtual void onUpdatesDisabled(GattAttribute::Handle_t handle);
+
+    /**
+     * Index of the input report with that value handle, or -1
+     */
+    int inputReportIndex(GattAttribute::Handle_t handle) const;
+
+    /**
+     * Called when the host wrote the output report. The write takes effect right away, over
+     * the current connection.
+     */
+    virtual void onOutputReport(const uint8_t *report, uint16_t length) {
+    }
+
+    /**
+     * Called when the host wrote the feature report. Implementations apply it and report
+     * back what they applied with setFeatureReport().
+     */
+    virtual void onFeatureReport(const uint8_t *report, uint16_t length) {
+    }
+
     /**
      * Start the ticker that sends input reports at regular interval
      *
@@ -141,48 +324,110 @@ protected:
      */
     virtual void sendCallback(void) = 0;
 
+    /**
+     * Input reports marked dirty since the last call, as a bit mask by index; they are clean
+     * afterwards. A report the stack refuses is marked dirty again.
+     */
+    uint32_t takeDirtyReports(void)
+    {
+        uint32_t reports = dirtyReports;
+        dirtyReports = 0;
+        return reports;
+    }
+
     /**
      * Create the Gatt descriptor for a report characteristic
      */
-    GattAttribute** inputReportDescriptors();
-    GattAttribute** outputReportDescriptors();
-    GattAttribute** featureReportDescriptors();
+    GattAttribute** inputReportDescriptors(unsigned index);
+    GattAttribute** outputReportDescriptors(uint8_t ID);
+    GattAttribute** featureReportDescriptors(uint8_t ID);
 
     /**
      * Create the HID information structure
      */
     HID_information_t* HIDInformation();
 
+private:
+    /** True if a write now would fall in the coalescing window; closeWindow() ends it */
+    bool holdForWindow(void);
+    void closeWindow(void);
+
+    /* Registered with the stack; they call the handlers above, or post them with handOff */
+    struct ConnectionEvent;
+    struct DisconnectionEvent;
+    struct SentEvent;
+    struct WrittenEvent;
+    struct UpdatesEvent;
+    struct Latch;
+
+    void stackConnection(const Gap::ConnectionCallbackParams_t *params);
+    void stackDisconnection(const Gap::DisconnectionCallbackParams_t *params);
+    void stackDataSent(unsigned count);
+    void stackDataWritten(const GattWriteCallbackParams *params);
+    void stackUpdatesEnabled(GattAttribute::Handle_t handle);
+    void stackUpdatesDisabled(GattAttribute::Handle_t handle);
+    void stackUpdates(GattAttribute::Handle_t handle, bool enabled);
+
+    /** With handOff and the queue full, stack events wait in latch for drainLatched() */
+    void latchEvent(void);
+    void postDrain(void);
+    void drainLatched(void);
+
 protected:
     BLE &ble;
     bool connected;
 
     int reportMapLength;
 
-    report_t inputReport;
+    input_report_t inputReports[HID_MAX_INPUT_REPORTS];
+    uint8_t inputReportsCount;
     report_t outputReport;
     report_t featureReport;
 
-    uint8_t inputReportLength;
     uint8_t outputReportLength;
     uint8_t featureReportLength;
 
     uint8_t controlPointCommand;
     uint8_t protocolMode;
 
-    report_reference_t inputReportReferenceData;
+    ConnParamManager *connParams;
+
+    SendMode sendMode;
+    /** Input reports waiting to be sent, one bit per index */
+    uint32_t dirtyReports;
+    /** Input reports the host enabled notifications of, one bit per index */
+    uint32_t subscribedReports;
+    /** A notification was queued and onDataSent() has not reported it yet */
+    bool reportInFlight;
+    /** The stack refused the last report; wait for onDataSent() before writing again */
+    bool sendBlocked;
+    /** A refused report has not been replaced by a successful write yet, since blockedSinceUs */
+    bool reportRefused;
+    uint32_t blockedSinceUs;
+
+    events::EventQueue *eventQueue;
+    bool handOff;
+    Latch *latch;
+    /** A drainLatched() event is queued */
+    volatile bool drainPosted;
+    uint8_t coalesceWindowMs;
+    uint32_t lastWriteUs;
+    /** Event ending the coalescing window, 0 if none */
+    int windowEvent;
+
+    report_reference_t inputReportReferenceData[HID_MAX_INPUT_REPORTS];
     report_reference_t outputReportReferenceData;
     report_reference_t featureReportReferenceData;
 
-    GattAttribute inputReportReferenceDescriptor;
+    GattAttribute *inputReportReferenceDescriptors[HID_MAX_INPUT_REPORTS];
     GattAttribute outputReportReferenceDescriptor;
     GattAttribute featureReportReferenceDescriptor;
 
     // Optional gatt characteristics:
     GattCharacteristic protocolModeCharacteristic;
 
-    // Report characteristics (each sort of optional)
-    GattCharacteristic inputReportCharacteristic;
+    // Report characteristics (each sort of optional), created for as many input reports as given
+    GattCharacteristic *inputReportCharacteristics[HID_MAX_INPUT_REPORTS];
     GattCharacteristic outputReportCharacteristic;
     GattCharacteristic featureReportCharacteristic;
 
@@ -191,9 +436,23 @@ protected:
     ReadOnlyGattCharacteristic<HID_information_t> HIDInformationCharacteristic;
     GattCharacteristic HIDControlPointCharacteristic;
 
+    GattCharacteristic *characteristics[4 + HID_MAX_INPUT_REPORTS + 2];
+
     Ticker reportTicker;
     uint32_t reportTickerDelay;
     bool reportTickerIsActive;
+
+public:
+    /** Report changes merged into an already pending report, i.e. writes saved */
+    uint32_t reportsCoalesced;
+
+    /** Reports refused by the stack and sent again once it had room */
+    uint32_t reportsRetried;
+    /** Report states never sent because a newer one replaced them while the stack was full */
+    uint32_t statesDropped;
+    /** Time from a refused report to the write of its replacement, in total and at most */
+    uint64_t blockedUs;
+    uint32_t maxBlockedUs;
 };
 
 #endif /* !HID_SERVICE_BASE_H_ */
@@ -20,6 +20,38 @@
 #include "mbed.h"
 
 #include "HIDServiceBase.h"
+#include "ReportSnapshot.h"
+#include "HIDDescriptor.h"
+#include "LatencyTrace.h"
+
+/*
+ * Send the extended report: STICK_REPORT_BITS axes (12 by default) and two TRIGGER_REPORT_BITS
+ * analog triggers instead of 8-bit axes. Hosts read the layout from the report map.
+ */
+#ifndef JOYSTICK_EXTENDED_REPORT
+#define JOYSTICK_EXTENDED_REPORT 0
+#endif
+
+/*
+ * Send the buttons and hat, and the axes, as two input reports with their own IDs, so that a
+ * button press only puts the few bytes of its report on air. Off, all goes in one report.
+ */
+#ifndef JOYSTICK_SPLIT_REPORTS
+#define JOYSTICK_SPLIT_REPORTS 1
+#endif
+
+/*
+ * Resend an input report unchanged once it is this old, in ms, like a USB idle rate; 0 never
+ * does. Otherwise a report equal to the last one sent is never written again.
+ */
+#ifndef JOYSTICK_KEEP_ALIVE_MS
+#define JOYSTICK_KEEP_ALIVE_MS 0
+#endif
+
+#if JOYSTICK_EXTENDED_REPORT
+#include "StickSampler.h"
+#include "TriggerSampler.h"
+#endif
 
 // TODO integrate this into Gamepad
 
@@ -35,7 +67,27 @@ enum JoystickButton
     JOYSTICK_BUTTON_2       = 0x2,
 };
 
-report_map_t JOYSTICK_REPORT_MAP = {
+#if JOYSTICK_EXTENDED_REPORT
+/* Four wide axes, then two triggers */
+#define JOYSTICK_ANALOG_FIELDS \
+    hid::WideAxes<STICK_REPORT_BITS, hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ>, \
+    hid::Triggers<TRIGGER_REPORT_BITS>
+#else
+/* Four 8-bit axes */
+#define JOYSTICK_ANALOG_FIELDS \
+    hid::Axes<hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ>
+#endif
+
+/** 12 buttons, a hat switch in the upper nibble of byte 1, then the analog fields */
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    JOYSTICK_ANALOG_FIELDS> JoystickLayout;
+
+#if !JOYSTICK_EXTENDED_REPORT
+
+/* The report map as it was written by hand; the generated one must not drift from it */
+static constexpr uint8_t JOYSTICK_REPORT_MAP_REFERENCE[] = {
   0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
   0x09, 0x05,                    // USAGE (Game Pad)
   0xa1, 0x00,                    //   COLLECTION (Physical)
@@ -72,41 +124,374 @@ report_map_t JOYSTICK_REPORT_MAP = {
   0xc0                           //     END_COLLECTION
 };
 
-static uint8_t report[] = { 0, 0, 0, 0, 0, 0};
+static_assert(hid::equal(JoystickLayout::DESCRIPTOR, JOYSTICK_REPORT_MAP_REFERENCE,
+                         sizeof(JOYSTICK_REPORT_MAP_REFERENCE)),
+              "generated report map matches the reference");
+static_assert(JoystickLayout::LENGTH == 6, "report is 6 bytes");
+
+#endif
+
+static_assert(JoystickLayout::LENGTH <= HID_MAX_NOTIFICATION_LENGTH,
+              "report fits in one notification at the default ATT MTU");
+
+/* Vendor output report: rumble motor strengths, rumble duration and LEDs */
+static const unsigned JOYSTICK_OUTPUT_LENGTH = 4;
+/* Vendor feature report: the tuning of JoystickTuning */
+static const unsigned JOYSTICK_FEATURE_LENGTH = 8;
+
+typedef hid::VendorReport<hid::VENDOR_OUTPUT, 3, 0x01, JOYSTICK_OUTPUT_LENGTH> JoystickOutputReport;
+typedef hid::VendorReport<hid::VENDOR_FEATURE, 4, 0x02, JOYSTICK_FEATURE_LENGTH> JoystickFeatureReport;
+
+/*
+ * The report map sent to hosts. With output and feature reports every report needs an ID, so
+ * even a single input report has one. Report IDs take no room in the layout: the input reports
+ * are slices of JoystickLayout, and the same packer fills them.
+ */
+#if JOYSTICK_SPLIT_REPORTS
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::ReportId<1>,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    hid::ReportId<2>,
+                    JOYSTICK_ANALOG_FIELDS,
+                    JoystickOutputReport,
+                    JoystickFeatureReport> JoystickReportMap;
+
+static_assert(JoystickReportMap::reports() == 2 &&
+              JoystickReportMap::reportOf(hid::FIELD_HAT) == 0 &&
+              JoystickReportMap::reportOf(hid::FIELD_AXES) == 1 &&
+              JoystickReportMap::reportOf(hid::FIELD_TRIGGERS) == 1,
+              "buttons and hat in the first report, axes and triggers in the second");
+static_assert(JoystickReportMap::reportBit(1) % 8 == 0, "axes report starts on a byte");
+#else
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::ReportId<1>,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    JOYSTICK_ANALOG_FIELDS,
+                    JoystickOutputReport,
+                    JoystickFeatureReport> JoystickReportMap;
+#endif
+
+static_assert(JoystickReportMap::LENGTH == JoystickLayout::LENGTH &&
+              JoystickReportMap::offset(hid::FIELD_HAT) == JoystickLayout::offset(hid::FIELD_HAT) &&
+              JoystickReportMap::offset(hid::FIELD_AXES) == JoystickLayout::offset(hid::FIELD_AXES) &&
+              JoystickReportMap::offset(hid::FIELD_TRIGGERS) == JoystickLayout::offset(hid::FIELD_TRIGGERS),
+              "report map keeps the fields of the layout in place");
+
+static const unsigned JOYSTICK_REPORT_LENGTH = JoystickLayout::LENGTH;
+
+/* Backing store of the input report characteristics; only written by the sender */
+static uint8_t report[JOYSTICK_REPORT_LENGTH] = {0};
+
+/* Each input report is the slice of report[] its ID covers in the report map */
+static const input_report_t joystickInputReports[] = {
+#if JOYSTICK_SPLIT_REPORTS
+    {JoystickReportMap::reportId(0), report + JoystickReportMap::reportOffset(0),
+     JoystickReportMap::reportLength(0)},
+    {JoystickReportMap::reportId(1), report + JoystickReportMap::reportOffset(1),
+     JoystickReportMap::reportLength(1)},
+#else
+    {JoystickReportMap::reportId(0), report, JOYSTICK_REPORT_LENGTH},
+#endif
+};
+
+/* Backing store of the output and feature report characteristics */
+static uint8_t joystickOutput[JOYSTICK_OUTPUT_LENGTH] = {0};
+static uint8_t joystickFeature[JOYSTICK_FEATURE_LENGTH] = {0};
+
+/**
+ * Tuning the host reads and writes at runtime through the vendor feature report. The report
+ * is a format byte, then the fields below in order, little endian.
+ */
+struct JoystickTuning {
+    static const uint8_t FORMAT = 1;
+
+    /** StickPoller fastest and idle periods */
+    uint8_t pollMinMs;
+    uint8_t pollIdleMs;
+    /** Debounce time of every button and hat input */
+    uint8_t debounceMs;
+    /** Coalescing window of SEND_COALESCED, see HIDServiceBase::setCoalesceWindow() */
+    uint8_t coalesceMs;
+    /** A SendMode */
+    uint8_t sendMode;
+    /** Keep-alive period, see JoystickService::setKeepAlive() */
+    uint16_t keepAliveMs;
+
+    void encode(uint8_t *report) const {
+        report[0] = FORMAT;
+        report[1] = pollMinMs;
+        report[2] = pollIdleMs;
+        report[3] = debounceMs;
+        report[4] = coalesceMs;
+        report[5] = sendMode;
+        report[6] = keepAliveMs & 0xFF;
+        report[7] = keepAliveMs >> 8;
+    }
+
+    /** @return false, leaving the tuning as it was, if report is not in this format */
+    bool decode(const uint8_t *report, uint16_t length) {
+        if (length != JOYSTICK_FEATURE_LENGTH || report[0] != FORMAT)
+            return false;
+        pollMinMs = report[1];
+        pollIdleMs = report[2];
+        debounceMs = report[3];
+        coalesceMs = report[4];
+        sendMode = report[5];
+        keepAliveMs = report[6] | (report[7] << 8);
+        return true;
+    }
+};
+
+/**
+ * Commands the host writes through the vendor output report: two rumble motors, for a time
+ * in 10 ms units or until the next command if 0, and one bit per LED.
+ */
+struct JoystickOutput {
+    uint8_t rumbleLeft;
+    uint8_t rumbleRight;
+    uint8_t rumbleTicks;
+    uint8_t leds;
+
+    bool decode(const uint8_t *report, uint16_t length) {
+        if (length != JOYSTICK_OUTPUT_LENGTH)
+            return false;
+        rumbleLeft = report[0];
+        rumbleRight = report[1];
+        rumbleTicks = report[2];
+        leds = report[3];
+        return true;
+    }
+};
+
+typedef ReportSnapshot<JOYSTICK_REPORT_LENGTH> JoystickReport;
+typedef hid::ReportPacker<JoystickLayout, JoystickReport> JoystickPacker;
 
 class JoystickService: public HIDServiceBase
 {
 public:
     JoystickService(BLE &_ble) :
         HIDServiceBase(_ble,
-                       JOYSTICK_REPORT_MAP, sizeof(JOYSTICK_REPORT_MAP),
-                       inputReport          = report,
-                       outputReport         = NULL,
-                       featureReport        = NULL,
-                       inputReportLength    = 6,
-                       outputReportLength   = 0,
-                       featureReportLength  = 0,
-                       reportTickerDelay    = 20),
-        failedReports (0)
+                       JoystickReportMap::DESCRIPTOR.bytes, JoystickReportMap::DESCRIPTOR_LENGTH,
+                       joystickInputReports,
+                       sizeof(joystickInputReports) / sizeof(joystickInputReports[0]),
+                       joystickOutput,
+                       joystickFeature,
+                       JOYSTICK_OUTPUT_LENGTH,
+                       JOYSTICK_FEATURE_LENGTH,
+                       20,
+                       JoystickOutputReport::ID,
+                       JoystickFeatureReport::ID),
+        lastSentValid (0),
+        keepAliveDue (0),
+        keepAliveUs (JOYSTICK_KEEP_ALIVE_MS * 1000),
+        failedReports (0),
+        snapshotRetries (0),
+        reportsSuppressed (0),
+        keepAlivesSent (0),
+        tuningWrites (0),
+        tuningRejected (0),
+        outputWrites (0)
     {
+        setSendMode(SEND_COALESCED);
+
+        memset(&currentTuning, 0, sizeof(currentTuning));
+        currentTuning.sendMode = SEND_COALESCED;
+        currentTuning.keepAliveMs = JOYSTICK_KEEP_ALIVE_MS;
+    }
+
+    /**
+     * Called with a tuning written by the host, before the service applies its own part of it.
+     * The handler applies the rest and corrects the fields to the values it could apply.
+     */
+    void onTuning(mbed::Callback<void(JoystickTuning *)> handler) {
+        tuningHandler = handler;
+    }
+
+    /** Called with every rumble and LED command the host writes */
+    void onOutput(mbed::Callback<void(const JoystickOutput &)> handler) {
+        outputHandler = handler;
+    }
+
+    /**
+     * Apply the service's part of a tuning, i.e. send mode, coalescing window and keep-alive,
+     * and let the host read all of it
+     */
+    void setTuning(const JoystickTuning &value) {
+        currentTuning = value;
+        if (currentTuning.sendMode > SEND_COALESCED)
+            currentTuning.sendMode = getSendMode();
+        setSendMode((SendMode)currentTuning.sendMode);
+        setCoalesceWindow(currentTuning.coalesceMs);
+        currentTuning.coalesceMs = coalesceWindow();
+        setKeepAlive(currentTuning.keepAliveMs);
+
+        currentTuning.encode(joystickFeature);
+        setFeatureReport(joystickFeature);
+    }
+
+    const JoystickTuning &tuning(void) const {
+        return currentTuning;
     }
 
-    void copyReport(uint8_t *newReport) {
-        for (int i = 0; i < 6; i++) {
-            report[i] = newReport[i];
+    /**
+     * Current state of the gamepad. Input handlers write to it from any context, also before
+     * the service is created; sendCallback() sends a consistent snapshot of it.
+     */
+    static JoystickReport &reportState() {
+        static JoystickReport state;
+        return state;
+    }
+
+    /** Sets the fields of reportState() by button number, hat direction, axis and trigger */
+    static JoystickPacker &packer() {
+        static JoystickPacker packer(reportState());
+        return packer;
+    }
+
+    /** Signal a change of buttons or hat, sending only their report */
+    void buttonsChanged(void) {
+        requestSend(1UL << JoystickReportMap::reportOf(hid::FIELD_BUTTONS));
+    }
+
+    /** Signal a change of axes or triggers, sending only their report */
+    void axesChanged(void) {
+        requestSend(1UL << JoystickReportMap::reportOf(hid::FIELD_AXES));
+    }
+
+    /** Resend unchanged reports every ms milliseconds; 0 stops it */
+    void setKeepAlive(uint32_t ms) {
+        keepAliveUs = ms * 1000;
+    }
+
+    /**
+     * Send the reports nothing was written to for a keep-alive period. Call it periodically;
+     * the resend is late by up to that call period.
+     */
+    void keepAlive(void) {
+        if (!connected || !keepAliveUs)
+            return;
+
+        uint32_t now = us_ticker_read();
+        uint32_t due = 0;
+        for (unsigned i = 0; i < inputReportsCount; i++) {
+            if (now - lastSentUs[i] >= keepAliveUs)
+                due |= 1UL << i;
+        }
+        if (due) {
+            keepAliveDue |= due;
+            requestSend(due);
         }
     }
 
+    virtual void onConnection(const Gap::ConnectionCallbackParams_t *params) {
+        /* a new host has only read the characteristics, nothing is known to be sent */
+        lastSentValid = 0;
+        keepAliveDue = 0;
+        for (unsigned i = 0; i < inputReportsCount; i++)
+            lastSentUs[i] = us_ticker_read();
+        HIDServiceBase::onConnection(params);
+    }
+
+    virtual void onUpdatesEnabled(GattAttribute::Handle_t handle) {
+        /* writes before the subscription were never notified; the host gets the current state */
+        int index = inputReportIndex(handle);
+        if (index >= 0)
+            lastSentValid &= ~(1UL << index);
+        HIDServiceBase::onUpdatesEnabled(handle);
+    }
+
+    virtual void onFeatureReport(const uint8_t *data, uint16_t length) {
+        JoystickTuning value = currentTuning;
+        if (!value.decode(data, length)) {
+            tuningRejected++;
+            /* the host reads back what is in effect */
+            setFeatureReport(joystickFeature);
+            return;
+        }
+        tuningWrites++;
+        if (tuningHandler)
+            tuningHandler(&value);
+        setTuning(value);
+    }
+
+    virtual void onOutputReport(const uint8_t *data, uint16_t length) {
+        JoystickOutput output;
+        if (!output.decode(data, length))
+            return;
+        outputWrites++;
+        if (outputHandler)
+            outputHandler(output);
+    }
+
+    /** Where input report index starts in the whole report, in bytes */
+    static unsigned reportOffset(unsigned index) {
+        return joystickInputReports[index].data - report;
+    }
+
     virtual void sendCallback(void) {
         if (!connected)
             return;
 
-        if (send(report))
-            failedReports++;
+        uint32_t reports = takeDirtyReports();
+        snapshotRetries += reportState().read(report);
+        TRACE_POINT(COPY);
+
+        for (unsigned i = 0; i < inputReportsCount; i++) {
+            uint32_t bit = 1UL << i;
+            if (!(reports & bit))
+                continue;
+
+            const input_report_t &input = joystickInputReports[i];
+            uint8_t *last = lastSent + (input.data - report);
+            if ((lastSentValid & bit) && !(keepAliveDue & bit) &&
+                !memcmp(input.data, last, input.length)) {
+                reportsSuppressed++;
+                continue;
+            }
+
+            if (send(i, input.data)) {
+                failedReports++;
+                continue;
+            }
+            memcpy(last, input.data, input.length);
+            lastSentValid |= bit;
+            lastSentUs[i] = us_ticker_read();
+            if (keepAliveDue & bit) {
+                keepAliveDue &= ~bit;
+                keepAlivesSent++;
+            }
+        }
     }
 
+protected:
+    /* Reports as last accepted by the stack on this connection, laid out like report[] */
+    uint8_t lastSent[JOYSTICK_REPORT_LENGTH];
+    uint32_t lastSentValid;
+    uint32_t lastSentUs[HID_MAX_INPUT_REPORTS];
+    /** Reports to write even if unchanged */
+    uint32_t keepAliveDue;
+    uint32_t keepAliveUs;
+
+    JoystickTuning currentTuning;
+    mbed::Callback<void(JoystickTuning *)> tuningHandler;
+    mbed::Callback<void(const JoystickOutput &)> outputHandler;
+
 public:
+    /** Writes refused by the stack; when it was out of buffers the latest report follows later */
     uint32_t failedReports;
+    /** Snapshot reads that had to be retried because an input handler was writing */
+    uint32_t snapshotRetries;
+    /** Writes skipped because the report was the same as the last one sent */
+    uint32_t reportsSuppressed;
+    /** Unchanged reports sent because their keep-alive period ran out */
+    uint32_t keepAlivesSent;
+    /** Feature reports written by the host and applied, or ignored as malformed */
+    uint32_t tuningWrites;
+    uint32_t tuningRejected;
+    /** Output reports written by the host */
+    uint32_t outputWrites;
 };
 
 #endif
@@ -0,0 +1,117 @@
+#ifndef REPORT_SNAPSHOT_H
+#define REPORT_SNAPSHOT_H
+
+#include "mbed.h"
+
+/**
+ * Input report shared between interrupt handlers, event queue callbacks and the sender.
+ *
+ * Writers update their fields with atomic read-modify-write operations on 32-bit words, so
+ * concurrent writers never lose each other's bits, and bracket every update with a writer count
+ * and a version bump. Readers copy the whole report and retry if a writer was active or finished
+ * meanwhile. No side masks interrupts.
+ *
+ * Writers may run in any context. A reader may be preempted by writers (e.g. an ISR) but must not
+ * itself preempt a writer running in thread context, or it would spin until that writer resumes.
+ */
+template <unsigned Length>
+class ReportSnapshot {
+public:
+    /**
+     * Replace the bits selected by mask in byte index
+     */
+    void setBits(unsigned index, uint8_t mask, uint8_t value) {
+        beginWrite();
+        update(index, mask, value);
+        endWrite();
+    }
+
+    void setByte(unsigned index, uint8_t value) {
+        setBits(index, 0xFF, value);
+    }
+
+    /**
+     * Replace length bytes starting at index; readers see all of them change at once
+     */
+    void write(unsigned index, const uint8_t *data, unsigned length) {
+        beginWrite();
+        for (unsigned i = 0; i < length; i++) {
+            update(index + i, 0xFF, data[i]);
+        }
+        endWrite();
+    }
+
+    /**
+     * Copy a consistent report into buffer, which must hold Length bytes
+     *
+     * @return false if a writer was active or completed during the copy
+     */
+    bool tryRead(uint8_t *buffer) const {
+        uint32_t version = _version;
+        __DMB();
+        if (_writers)
+            return false;
+
+        uint32_t words[WORDS];
+        for (unsigned i = 0; i < WORDS; i++) {
+            words[i] = _words[i];
+        }
+
+        __DMB();
+        if (_writers || _version != version)
+            return false;
+
+        memcpy(buffer, words, Length);
+        return true;
+    }
+
+    /**
+     * Copy a consistent report into buffer, retrying until no writer interferes
+     *
+     * @return Number of retries needed
+     */
+    unsigned read(uint8_t *buffer) const {
+        unsigned retries = 0;
+        while (!tryRead(buffer)) {
+            retries++;
+        }
+        return retries;
+    }
+
+    /**
+     * Incremented by every completed update
+     */
+    uint32_t version() const {
+        return _version;
+    }
+
+private:
+    static const unsigned WORDS = (Length + 3) / 4;
+
+    void beginWrite() {
+        core_util_atomic_incr_u32(&_writers, 1);
+    }
+
+    void endWrite() {
+        core_util_atomic_incr_u32(&_version, 1);
+        core_util_atomic_decr_u32(&_writers, 1);
+    }
+
+    void update(unsigned index, uint8_t mask, uint8_t value) {
+        volatile uint32_t *word = &_words[index / 4];
+        unsigned shift = (index % 4) * 8;
+        uint32_t wordMask = (uint32_t)mask << shift;
+        uint32_t bits = ((uint32_t)value << shift) & wordMask;
+
+        uint32_t current = *word;
+        while (!core_util_atomic_cas_u32(word, &current, (current & ~wordMask) | bits)) {
+        }
+    }
+
+    /* Little-endian byte order, matching the report layout on target and host */
+    volatile uint32_t _words[WORDS];
+    volatile uint32_t _writers;
+    volatile uint32_t _version;
+};
+
+#endif // REPORT_SNAPSHOT_H
@@ -0,0 +1,159 @@
+#include "ConfigStore.h"
+#include "QueueStats.h"
+
+static_assert(sizeof(GamepadSettings) == 38, "GamepadSettings has no padding; fields are only appended");
+static_assert(ConfigStore::RECORD_SIZE <= ConfigStore::MAX_RECORD_SIZE, "record fits the read buffer");
+
+/* CRC-32 (reflected 0xEDB88320) a nibble at a time */
+static const uint32_t CRC_NIBBLES[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+ConfigStore::ConfigStore(events::EventQueue *queue, mbed::FileSystem *fs, const char *path)
+: loads(0), saves(0), unchanged(0), _queue(queue), _fs(fs), _path(path), _handle(0),
+  _haveStored(false), _lastSaveMs(0), _saved(false) {
+}
+
+bool ConfigStore::load(GamepadSettings *settings) {
+    uint8_t record[MAX_RECORD_SIZE];
+    File file;
+    if (file.open(_fs, _path, O_RDONLY)) {
+        return false;
+    }
+    ssize_t size = file.read(record, sizeof(record));
+    file.close();
+
+    if (size <= 0 || !decode(record, size, settings)) {
+        return false;
+    }
+    loads++;
+    _stored = *settings;
+    _haveStored = true;
+    return true;
+}
+
+void ConfigStore::requestSave(const GamepadSettings &settings) {
+    _pending = settings;
+    if (_haveStored && !memcmp(&_stored, &settings, sizeof(settings))) {
+        // Changed back before the write happened
+        if (_handle) {
+            _queue->cancel(_handle);
+            _handle = 0;
+        }
+        unchanged++;
+        return;
+    }
+
+    // A newer request restarts the quiet period, up to the rate limit
+    if (_handle) {
+        _queue->cancel(_handle);
+    }
+    uint32_t delayMs = CONFIG_SAVE_DELAY_MS;
+    if (_saved) {
+        uint32_t sinceMs = us_ticker_read() / 1000 - _lastSaveMs;
+        if (sinceMs + delayMs < CONFIG_MIN_SAVE_INTERVAL_MS) {
+            delayMs = CONFIG_MIN_SAVE_INTERVAL_MS - sinceMs;
+        }
+    }
+    _handle = QueueStats::call_in(_queue, QueueStats::EVENT_SETTINGS, delayMs, this, &ConfigStore::save);
+}
+
+void ConfigStore::flush() {
+    if (!_handle) {
+        return;
+    }
+    _queue->cancel(_handle);
+    save();
+}
+
+void ConfigStore::save() {
+    _handle = 0;
+    if (_haveStored && !memcmp(&_stored, &_pending, sizeof(_pending))) {
+        unchanged++;
+        return;
+    }
+    write(_pending);
+}
+
+bool ConfigStore::write(const GamepadSettings &settings) {
+    uint8_t record[RECORD_SIZE];
+    size_t size = encode(settings, record);
+
+    File file;
+    if (file.open(_fs, _path, O_WRONLY | O_CREAT | O_TRUNC)) {
+        return false;
+    }
+    bool ok = file.write(record, size) == (ssize_t)size;
+    ok = !file.close() && ok;
+    if (!ok) {
+        return false;
+    }
+
+    saves++;
+    _stored = settings;
+    _haveStored = true;
+    _lastSaveMs = us_ticker_read() / 1000;
+    _saved = true;
+    return true;
+}
+
+size_t ConfigStore::encode(const GamepadSettings &settings, uint8_t *record) {
+    return encodeRecord(MAGIC, VERSION, &settings, sizeof(settings), record);
+}
+
+bool ConfigStore::decode(const uint8_t *record, size_t size, GamepadSettings *settings) {
+    const uint8_t *payload;
+    uint16_t length;
+    if (!decodeRecord(MAGIC, record, size, &payload, &length)) {
+        return false;
+    }
+
+    // Older records are a prefix of the current layout; newer ones extend it
+    memcpy(settings, payload, length < sizeof(*settings) ? length : sizeof(*settings));
+    return true;
+}
+
+size_t ConfigStore::encodeRecord(uint32_t magic, uint16_t version, const void *payload,
+                                 uint16_t length, uint8_t *record) {
+    memcpy(record, &magic, 4);
+    memcpy(record + 4, &version, 2);
+    memcpy(record + 6, &length, 2);
+    memcpy(record + HEADER_SIZE, payload, length);
+
+    uint32_t crc = crc32(record, HEADER_SIZE + length);
+    memcpy(record + HEADER_SIZE + length, &crc, 4);
+    return FRAME_SIZE + length;
+}
+
+bool ConfigStore::decodeRecord(uint32_t magic, const uint8_t *record, size_t size,
+                               const uint8_t **payload, uint16_t *length) {
+    uint32_t recordMagic;
+    uint16_t version;
+    uint32_t crc;
+    if (size < FRAME_SIZE) {
+        return false;
+    }
+    memcpy(&recordMagic, record, 4);
+    memcpy(&version, record + 4, 2);
+    memcpy(length, record + 6, 2);
+    if (recordMagic != magic || !version || size < FRAME_SIZE + *length) {
+        return false;
+    }
+    memcpy(&crc, record + HEADER_SIZE + *length, 4);
+    if (crc != crc32(record, HEADER_SIZE + *length)) {
+        return false;
+    }
+    *payload = record + HEADER_SIZE;
+    return true;
+}
+
+uint32_t ConfigStore::crc32(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ CRC_NIBBLES[crc & 0xF];
+        crc = (crc >> 4) ^ CRC_NIBBLES[crc & 0xF];
+    }
+    return ~crc;
+}
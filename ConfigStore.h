@@ -0,0 +1,146 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+#include "FileSystem.h"
+
+/* Quiet time after the last change before it is written, so that a burst of changes costs one write */
+#ifndef CONFIG_SAVE_DELAY_MS
+#define CONFIG_SAVE_DELAY_MS 2000
+#endif
+
+/* Shortest time between two writes of the record, to bound flash wear */
+#ifndef CONFIG_MIN_SAVE_INTERVAL_MS
+#define CONFIG_MIN_SAVE_INTERVAL_MS 30000
+#endif
+
+/**
+ * Calibration and tuning kept across power cycles.
+ *
+ * New fields are only ever appended, so that a record written by older firmware still loads,
+ * with the fields it lacks left at their defaults. Multi-byte fields are stored in the native
+ * (little endian) byte order.
+ */
+struct GamepadSettings {
+    static const unsigned AXES = 4;
+    static const unsigned INPUTS = 16;
+
+    uint16_t axisMin[AXES];
+    uint16_t axisCentre[AXES];
+    uint16_t axisMax[AXES];
+    /** AxisProcessor deadzone and curve */
+    uint16_t deadzone;
+    uint8_t curve;
+    /** StickPoller fastest and idle periods */
+    uint8_t pollMinMs;
+    uint8_t pollIdleMs;
+    /** Input map profile, loaded from profile<n>.map (see InputMap) */
+    uint8_t profile;
+    /** Debounce samples of each input, four bits each, even inputs in the low nibble */
+    uint8_t debounceTicks[INPUTS / 2];
+
+    unsigned ticks(unsigned input) const {
+        return (debounceTicks[input / 2] >> (4 * (input % 2))) & 0xF;
+    }
+
+    void setTicks(unsigned input, unsigned ticks) {
+        unsigned shift = 4 * (input % 2);
+        debounceTicks[input / 2] = (debounceTicks[input / 2] & ~(0xF << shift)) | ((ticks & 0xF) << shift);
+    }
+};
+
+/**
+ * Versioned binary record of GamepadSettings in one small file.
+ *
+ * The record is a header (magic, version, payload length), the settings and a CRC-32 of both,
+ * loaded with a single read at boot. encodeRecord() and decodeRecord() frame other payloads the
+ * same way, under a magic of their own. Saving is lazy: requestSave() only schedules a write on the
+ * event queue, after CONFIG_SAVE_DELAY_MS of quiet and no sooner than
+ * CONFIG_MIN_SAVE_INTERVAL_MS after the previous write, and a record identical to the one on
+ * flash is never rewritten. littlefs commits the new file on close, so losing power mid-write
+ * leaves the previous record in place.
+ */
+class ConfigStore {
+    public:
+        static const uint32_t MAGIC = 0x47504346; // "GPCF"
+        static const uint16_t VERSION = 1;
+        static const size_t HEADER_SIZE = 8;
+        /** Header and CRC around a payload */
+        static const size_t FRAME_SIZE = HEADER_SIZE + 4;
+        static const size_t RECORD_SIZE = FRAME_SIZE + sizeof(GamepadSettings);
+        /** Largest record accepted, leaving room for fields appended by later versions */
+        static const size_t MAX_RECORD_SIZE = 128;
+
+        /**
+         * @param path File name on fs, which must be mounted before load() or a save
+         */
+        ConfigStore(events::EventQueue *queue, mbed::FileSystem *fs, const char *path);
+
+        /**
+         * Read the record into settings, which should hold the defaults
+         *
+         * @return true if a valid record was found; settings is left untouched otherwise
+         */
+        bool load(GamepadSettings *settings);
+
+        /** Write settings later, if they differ from the stored record */
+        void requestSave(const GamepadSettings &settings);
+
+        /** Write a pending save now, e.g. before shutting down */
+        void flush();
+
+        /** True while a save is scheduled */
+        bool pending() const {
+            return _handle != 0;
+        }
+
+        /** @return Bytes written to record, RECORD_SIZE */
+        static size_t encode(const GamepadSettings &settings, uint8_t *record);
+
+        /** @return true if record holds a valid record of any version */
+        static bool decode(const uint8_t *record, size_t size, GamepadSettings *settings);
+
+        /**
+         * Frame a payload: header (magic, version, length), payload and CRC-32 of both
+         *
+         * @return Bytes written to record, FRAME_SIZE + length
+         */
+        static size_t encodeRecord(uint32_t magic, uint16_t version, const void *payload,
+                                   uint16_t length, uint8_t *record);
+
+        /**
+         * Check the framing of a record of any version
+         *
+         * @param payload   Set to the payload within record
+         * @param length    Set to the payload length, which may differ from the current layout's
+         * @return true if record holds a whole record with that magic and a matching CRC
+         */
+        static bool decodeRecord(uint32_t magic, const uint8_t *record, size_t size,
+                                 const uint8_t **payload, uint16_t *length);
+
+        static uint32_t crc32(const uint8_t *data, size_t size);
+
+        /** Records read and written, and saves skipped because nothing changed */
+        uint32_t loads;
+        uint32_t saves;
+        uint32_t unchanged;
+
+    private:
+        void save();
+        bool write(const GamepadSettings &settings);
+
+        events::EventQueue *_queue;
+        mbed::FileSystem *_fs;
+        const char *_path;
+        int _handle;
+
+        /* Contents of the file, valid once loaded or written */
+        GamepadSettings _stored;
+        bool _haveStored;
+        GamepadSettings _pending;
+        uint32_t _lastSaveMs;
+        bool _saved;
+};
+
+#endif // CONFIG_STORE_H
@@ -0,0 +1,274 @@
+#include "ConnParamManager.h"
+#include "QueueStats.h"
+
+ConnParamManager::ConnParamManager(events::EventQueue *queue)
+: requests(0), accepted(0), rejected(0), unsettled(0), _queue(queue), _onInterval(NULL),
+  _connected(false), _handle(0), _liveMode(MODES), _liveSinceUs(0), _idleMs(0), _mode(MODE_ACTIVE),
+  _lastActivityUs(0), _lastRequestUs(0), _idleHandle(0), _updateHandle(0), _pending(false),
+  _requested(MODE_ACTIVE), _requestUs(0), _samples(0), _maxDelayUs(0), _inFlight(0),
+  _timing(false), _timingCounts(false), _writtenUs(0) {
+    memset(&_live, 0, sizeof(_live));
+    memset(_rejectedUs, 0, sizeof(_rejectedUs));
+    memset(_haveRejected, 0, sizeof(_haveRejected));
+
+    Gap::ConnectionParams_t active = {CONN_ACTIVE_MIN_INTERVAL, CONN_ACTIVE_MAX_INTERVAL, 0,
+                                      CONN_SUPERVISION_TIMEOUT};
+    Gap::ConnectionParams_t idle = {CONN_IDLE_MIN_INTERVAL, CONN_IDLE_MAX_INTERVAL,
+                                    CONN_IDLE_LATENCY, CONN_SUPERVISION_TIMEOUT};
+    _params[MODE_ACTIVE] = active;
+    _params[MODE_IDLE] = idle;
+}
+
+void ConnParamManager::setParams(Mode mode, const Gap::ConnectionParams_t &params) {
+    if (mode >= MODES) {
+        return;
+    }
+    _params[mode] = params;
+    _haveRejected[mode] = false;
+    if (_connected) {
+        _liveMode = classify(_live);
+        update();
+    }
+}
+
+void ConnParamManager::onIntervalChange(void (*callback)(uint16_t interval)) {
+    _onInterval = callback;
+}
+
+void ConnParamManager::connected(Gap::Handle_t handle, const Gap::ConnectionParams_t *params) {
+    uint32_t now = us_ticker_read();
+    _connected = true;
+    _handle = handle;
+    _pending = false;
+    _inFlight = 0;
+    _timing = false;
+    memset(_haveRejected, 0, sizeof(_haveRejected));
+    _lastRequestUs = now - CONN_UPDATE_HOLDOFF_MS * 1000;
+
+    // The connection event gives the parameters the central chose
+    _live = *params;
+    _live.minConnectionInterval = _live.maxConnectionInterval;
+    _liveMode = classify(_live);
+    _liveSinceUs = now;
+    if (_onInterval) {
+        _onInterval(_live.minConnectionInterval);
+    }
+
+    // A host connecting is usually about to be used
+    _mode = MODE_ACTIVE;
+    _lastActivityUs = now;
+    if (!_idleHandle) {
+        _idleHandle = QueueStats::call_in(_queue, QueueStats::EVENT_CONN_PARAMS, CONN_IDLE_AFTER_MS,
+                                          this, &ConnParamManager::checkIdle);
+    }
+    update();
+}
+
+void ConnParamManager::disconnected() {
+    if (_liveMode == MODE_IDLE) {
+        _idleMs += (us_ticker_read() - _liveSinceUs) / 1000;
+    }
+    if (_pending) {
+        unsettled++;
+    }
+    _connected = false;
+    _pending = false;
+    _liveMode = MODES;
+    if (_idleHandle) {
+        _queue->cancel(_idleHandle);
+        _idleHandle = 0;
+    }
+    if (_updateHandle) {
+        _queue->cancel(_updateHandle);
+        _updateHandle = 0;
+    }
+}
+
+void ConnParamManager::reportWritten() {
+    uint32_t now = us_ticker_read();
+
+    // Only a notification with none ahead of it is sure to leave at the next connection event
+    if (!_inFlight) {
+        _timing = true;
+        _timingCounts = _pending && now - _requestUs >= SETTLE_MS * 1000;
+        _writtenUs = now;
+    }
+    _inFlight++;
+
+    _lastActivityUs = now;
+    if (_mode != MODE_ACTIVE) {
+        _mode = MODE_ACTIVE;
+        update();
+    }
+    if (!_idleHandle && _connected) {
+        _idleHandle = QueueStats::call_in(_queue, QueueStats::EVENT_CONN_PARAMS, CONN_IDLE_AFTER_MS,
+                                          this, &ConnParamManager::checkIdle);
+    }
+}
+
+void ConnParamManager::reportsSent(unsigned count) {
+    if (_timing) {
+        _timing = false;
+        if (_timingCounts && _pending) {
+            sample(us_ticker_read() - _writtenUs);
+        }
+    }
+    _inFlight = count < _inFlight ? _inFlight - count : 0;
+
+    // A request may have been waiting for this delay to settle the previous one
+    update();
+}
+
+uint32_t ConnParamManager::idleTimeMs() const {
+    uint32_t ms = _idleMs;
+    if (_connected && _liveMode == MODE_IDLE) {
+        ms += (us_ticker_read() - _liveSinceUs) / 1000;
+    }
+    return ms;
+}
+
+void ConnParamManager::update() {
+    if (!_connected || _updateHandle) {
+        return;
+    }
+    Mode want = _mode;
+    if (_pending ? want == _requested : want == _liveMode) {
+        return;
+    }
+    // The delay of the report now in flight tells whether the outstanding request was applied;
+    // asking again before it arrives would lose that
+    if (_pending && _timing && _timingCounts) {
+        return;
+    }
+
+    uint32_t now = us_ticker_read();
+    uint32_t waitMs = 0;
+    uint32_t sinceRequestMs = (now - _lastRequestUs) / 1000;
+    if (want != MODE_ACTIVE && sinceRequestMs < CONN_UPDATE_HOLDOFF_MS) {
+        waitMs = CONN_UPDATE_HOLDOFF_MS - sinceRequestMs;
+    }
+    uint32_t sinceRejectedMs = (now - _rejectedUs[want]) / 1000;
+    if (_haveRejected[want] && sinceRejectedMs < CONN_RETRY_MS &&
+            CONN_RETRY_MS - sinceRejectedMs > waitMs) {
+        waitMs = CONN_RETRY_MS - sinceRejectedMs;
+    }
+    if (waitMs) {
+        _updateHandle = QueueStats::call_in(_queue, QueueStats::EVENT_CONN_PARAMS, waitMs,
+                                            this, &ConnParamManager::retry);
+        return;
+    }
+
+    if (_pending) {
+        unsettled++;
+    }
+    requests++;
+    _lastRequestUs = now;
+    ble_error_t error = BLE::Instance().gap().updateConnectionParams(_handle, &_params[want]);
+    if (error) {
+        printf("Error during Gap::updateConnectionParams %d\r\n", error);
+        _pending = false;
+        _requested = want;
+        settle(false);
+        return;
+    }
+    _pending = true;
+    _requested = want;
+    _requestUs = now;
+    _samples = 0;
+    _maxDelayUs = 0;
+    // A report already in flight was written under the previous parameters
+    _timingCounts = false;
+}
+
+void ConnParamManager::retry() {
+    _updateHandle = 0;
+    update();
+}
+
+void ConnParamManager::checkIdle() {
+    _idleHandle = 0;
+    uint32_t quietMs = (us_ticker_read() - _lastActivityUs) / 1000;
+    if (quietMs < CONN_IDLE_AFTER_MS) {
+        _idleHandle = QueueStats::call_in(_queue, QueueStats::EVENT_CONN_PARAMS,
+                                          CONN_IDLE_AFTER_MS - quietMs,
+                                          this, &ConnParamManager::checkIdle);
+        return;
+    }
+    _mode = MODE_IDLE;
+    update();
+}
+
+void ConnParamManager::sample(uint32_t delayUs) {
+    // The report left at the first connection event after it was written, so the live
+    // interval is at least the delay; rule out whichever outcome is shorter than that
+    _samples++;
+    if (delayUs > _maxDelayUs) {
+        _maxDelayUs = delayUs;
+    }
+    const Gap::ConnectionParams_t &want = _params[_requested];
+    uint32_t oldUs = _live.maxConnectionInterval * 1250;
+    uint32_t newMinUs = want.minConnectionInterval * 1250;
+    uint32_t newMaxUs = want.maxConnectionInterval * 1250;
+
+    if (delayUs > newMaxUs + SLACK_US) {
+        settle(false);
+    } else if (delayUs > oldUs + SLACK_US) {
+        settle(true);
+    } else if (_samples >= CONFIRM_SAMPLES) {
+        // Neither ruled out: a longer interval would very likely have shown by now
+        settle(oldUs >= newMinUs);
+    }
+}
+
+void ConnParamManager::settle(bool accept) {
+    _pending = false;
+    if (!accept) {
+        rejected++;
+        _haveRejected[_requested] = true;
+        _rejectedUs[_requested] = us_ticker_read();
+        return;
+    }
+
+    accepted++;
+    _haveRejected[_requested] = false;
+    Gap::ConnectionParams_t params = _params[_requested];
+    // The central picks an interval in the requested range; estimate it from the longest delay
+    uint16_t interval = _maxDelayUs / 1250;
+    if (interval < params.minConnectionInterval) {
+        interval = params.minConnectionInterval;
+    } else if (interval > params.maxConnectionInterval) {
+        interval = params.maxConnectionInterval;
+    }
+    params.minConnectionInterval = interval;
+    params.maxConnectionInterval = interval;
+    // Counted from the request: the central applies it within a few connection events
+    setLive(params, _requestUs);
+}
+
+void ConnParamManager::setLive(const Gap::ConnectionParams_t &params, uint32_t sinceUs) {
+    bool changed = params.minConnectionInterval != _live.minConnectionInterval;
+    if (_liveMode == MODE_IDLE) {
+        _idleMs += (sinceUs - _liveSinceUs) / 1000;
+    }
+    _live = params;
+    _liveMode = classify(params);
+    _liveSinceUs = sinceUs;
+
+    printf("Connection interval %u.%02u ms, latency %u\r\n", _live.minConnectionInterval * 5 / 4,
+           _live.minConnectionInterval * 125 % 100, _live.slaveLatency);
+    if (changed && _onInterval) {
+        _onInterval(_live.minConnectionInterval);
+    }
+}
+
+ConnParamManager::Mode ConnParamManager::classify(const Gap::ConnectionParams_t &params) const {
+    for (unsigned mode = 0; mode < MODES; mode++) {
+        const Gap::ConnectionParams_t &want = _params[mode];
+        if (params.minConnectionInterval >= want.minConnectionInterval &&
+                params.minConnectionInterval <= want.maxConnectionInterval &&
+                params.slaveLatency == want.slaveLatency) {
+            return (Mode)mode;
+        }
+    }
+    return MODES;
+}
@@ -0,0 +1,168 @@
+#ifndef CONN_PARAM_MANAGER_H
+#define CONN_PARAM_MANAGER_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+#include "ble/BLE.h"
+
+/*
+ * Connection parameters while playing and while the gamepad is left alone, in 1.25 ms units.
+ * With min == max the live interval is known exactly once the central accepts a request.
+ */
+#ifndef CONN_ACTIVE_MIN_INTERVAL
+#define CONN_ACTIVE_MIN_INTERVAL 6
+#endif
+#ifndef CONN_ACTIVE_MAX_INTERVAL
+#define CONN_ACTIVE_MAX_INTERVAL 6
+#endif
+#ifndef CONN_IDLE_MIN_INTERVAL
+#define CONN_IDLE_MIN_INTERVAL 24
+#endif
+#ifndef CONN_IDLE_MAX_INTERVAL
+#define CONN_IDLE_MAX_INTERVAL 24
+#endif
+#ifndef CONN_IDLE_LATENCY
+#define CONN_IDLE_LATENCY 4
+#endif
+/* Supervision timeout in 10 ms units; long, as some hosts handle reconnection badly */
+#ifndef CONN_SUPERVISION_TIMEOUT
+#define CONN_SUPERVISION_TIMEOUT 3200
+#endif
+
+/* Quiet time before relaxing the link; any report brings it back at once */
+#ifndef CONN_IDLE_AFTER_MS
+#define CONN_IDLE_AFTER_MS 5000
+#endif
+
+/* Shortest time from any update request to asking for the idle parameters, and the time before
+ * repeating a rejected request */
+#ifndef CONN_UPDATE_HOLDOFF_MS
+#define CONN_UPDATE_HOLDOFF_MS 1000
+#endif
+#ifndef CONN_RETRY_MS
+#define CONN_RETRY_MS 30000
+#endif
+
+/**
+ * Negotiates short connection intervals while reports flow and a relaxed interval with slave
+ * latency once they stop.
+ *
+ * The first report after a quiet spell asks for the active parameters straight away; the idle
+ * ones are only requested after CONN_IDLE_AFTER_MS without reports, and never sooner than
+ * CONN_UPDATE_HOLDOFF_MS after the previous request, so bursts of input do not make the link
+ * flap between the two.
+ *
+ * The central is free to reject or ignore a request, and the stack does not report the outcome,
+ * so the manager works it out from its own notifications: one written while none is in flight
+ * leaves at the next connection event, so the time until the stack reports it sent is a lower
+ * bound on the live interval. A request is settled when a delay rules out either the previous
+ * interval or the requested one, or after CONFIRM_SAMPLES delays in favour of the shorter one.
+ */
+class ConnParamManager {
+    public:
+        enum Mode {
+            MODE_ACTIVE = 0,
+            MODE_IDLE,
+            MODES
+        };
+
+        /** Delays needed to settle a request when none rules out either outcome */
+        static const unsigned CONFIRM_SAMPLES = 8;
+        /** Allowance for the sent event to reach the application */
+        static const uint32_t SLACK_US = 2000;
+        /** Time for the central to apply an update, after which delays count */
+        static const uint32_t SETTLE_MS = 500;
+
+        ConnParamManager(events::EventQueue *queue);
+
+        const Gap::ConnectionParams_t &params(Mode mode) const {
+            return _params[mode];
+        }
+
+        void setParams(Mode mode, const Gap::ConnectionParams_t &params);
+
+        /** Called with the interval, in 1.25 ms units, on connection and whenever it changes */
+        void onIntervalChange(void (*callback)(uint16_t interval));
+
+        void connected(Gap::Handle_t handle, const Gap::ConnectionParams_t *params);
+        void disconnected();
+
+        /** A report was handed to the stack */
+        void reportWritten();
+
+        /** The stack sent count reports */
+        void reportsSent(unsigned count);
+
+        Mode mode() const {
+            return _mode;
+        }
+
+        /** Last interval known to be in use, in 1.25 ms units; 0 when not connected */
+        uint16_t liveInterval() const {
+            return _connected ? _live.minConnectionInterval : 0;
+        }
+
+        uint16_t liveLatency() const {
+            return _connected ? _live.slaveLatency : 0;
+        }
+
+        /** False while a request is waiting to be settled */
+        bool settled() const {
+            return !_pending;
+        }
+
+        /** Update requests made, and how they were settled */
+        uint32_t requests;
+        uint32_t accepted;
+        uint32_t rejected;
+        /** Requests overtaken by the next one before a delay settled them */
+        uint32_t unsettled;
+
+        /** Time spent with the idle parameters in force, in ms */
+        uint32_t idleTimeMs() const;
+
+    private:
+        void update();
+        void retry();
+        void checkIdle();
+        void sample(uint32_t delayUs);
+        void settle(bool accept);
+        void setLive(const Gap::ConnectionParams_t &params, uint32_t sinceUs);
+        Mode classify(const Gap::ConnectionParams_t &params) const;
+
+        events::EventQueue *_queue;
+        void (*_onInterval)(uint16_t interval);
+        Gap::ConnectionParams_t _params[MODES];
+
+        bool _connected;
+        Gap::Handle_t _handle;
+        Gap::ConnectionParams_t _live;
+        /* Mode whose parameters are live, MODES for neither */
+        Mode _liveMode;
+        uint32_t _liveSinceUs;
+        uint32_t _idleMs;
+
+        Mode _mode;
+        uint32_t _lastActivityUs;
+        uint32_t _lastRequestUs;
+        uint32_t _rejectedUs[MODES];
+        bool _haveRejected[MODES];
+        int _idleHandle;
+        int _updateHandle;
+
+        /* Outstanding request: the mode asked for, when, and the delays seen since it took effect */
+        bool _pending;
+        Mode _requested;
+        uint32_t _requestUs;
+        unsigned _samples;
+        uint32_t _maxDelayUs;
+
+        /* Notifications in the stack, and the one being timed: when it was written and whether
+         * its delay counts towards the outstanding request */
+        unsigned _inFlight;
+        bool _timing;
+        bool _timingCounts;
+        uint32_t _writtenUs;
+};
+
+#endif // CONN_PARAM_MANAGER_H
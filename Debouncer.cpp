@@ -0,0 +1,49 @@
+#include "Debouncer.h"
+
+Debouncer::Debouncer() {
+    for (unsigned plane = 0; plane < 4; plane++) {
+        _threshold[plane] = 0;
+    }
+    reset(0);
+    setAllTicks(1);
+}
+
+void Debouncer::setTicks(unsigned input, unsigned ticks) {
+    if (ticks < 1) {
+        ticks = 1;
+    } else if (ticks > MAX_TICKS) {
+        ticks = MAX_TICKS;
+    }
+
+    uint16_t bit = 1 << input;
+    for (unsigned plane = 0; plane < 4; plane++) {
+        if (ticks & (1 << plane)) {
+            _threshold[plane] |= bit;
+        } else {
+            _threshold[plane] &= ~bit;
+        }
+    }
+}
+
+void Debouncer::setAllTicks(unsigned ticks) {
+    for (unsigned input = 0; input < 16; input++) {
+        setTicks(input, ticks);
+    }
+}
+
+unsigned Debouncer::ticks(unsigned input) const {
+    unsigned ticks = 0;
+    for (unsigned plane = 0; plane < 4; plane++) {
+        if (_threshold[plane] & (1 << input)) {
+            ticks |= 1 << plane;
+        }
+    }
+    return ticks;
+}
+
+void Debouncer::reset(uint16_t state) {
+    _state = state;
+    for (unsigned plane = 0; plane < 4; plane++) {
+        _count[plane] = 0;
+    }
+}
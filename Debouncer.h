@@ -0,0 +1,78 @@
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+
+#include "mbed.h"
+
+/**
+ * Debounces up to 16 digital inputs in parallel.
+ *
+ * Each input has a 4-bit counter stored bit-sliced across four 16-bit planes (a "vertical
+ * counter"), so all inputs are updated with the same handful of logic operations per tick. A
+ * counter runs while its raw sample differs from the debounced state and is cleared as soon as
+ * they agree; when it reaches the input's threshold the debounced state flips. Thresholds are
+ * per input, also stored bit-sliced, and compared in parallel.
+ *
+ * An input therefore changes state after exactly `ticks` consecutive samples at the new level,
+ * and any bounce shorter than that is rejected.
+ */
+class Debouncer {
+    public:
+        static const unsigned MAX_TICKS = 15;
+
+        Debouncer();
+
+        /** Set the number of stable ticks input needs to change state (1-15) */
+        void setTicks(unsigned input, unsigned ticks);
+        void setAllTicks(unsigned ticks);
+        unsigned ticks(unsigned input) const;
+
+        /** Force the debounced state and clear all counters */
+        void reset(uint16_t state);
+
+        /**
+         * Feed one sample of all inputs
+         *
+         * @return Mask of inputs whose debounced state changed
+         */
+        uint16_t tick(uint16_t raw) {
+            uint16_t differs = raw ^ _state;
+
+            // Increment the counters of differing inputs, clear the others
+            uint16_t carry = differs;
+            uint16_t c0 = _count[0] ^ carry; carry &= _count[0];
+            uint16_t c1 = _count[1] ^ carry; carry &= _count[1];
+            uint16_t c2 = _count[2] ^ carry; carry &= _count[2];
+            uint16_t c3 = _count[3] ^ carry;
+
+            // Inputs whose counter equals their threshold
+            uint16_t changed = differs
+                & ~(c0 ^ _threshold[0]) & ~(c1 ^ _threshold[1])
+                & ~(c2 ^ _threshold[2]) & ~(c3 ^ _threshold[3]);
+
+            uint16_t keep = differs & ~changed;
+            _count[0] = c0 & keep;
+            _count[1] = c1 & keep;
+            _count[2] = c2 & keep;
+            _count[3] = c3 & keep;
+
+            _state ^= changed;
+            return changed;
+        }
+
+        /** Debounced state of all inputs */
+        uint16_t state() const {
+            return _state;
+        }
+
+        /** True when no counter is running, i.e. ticking can stop until the next edge */
+        bool settled() const {
+            return !(_count[0] | _count[1] | _count[2] | _count[3]);
+        }
+
+    private:
+        uint16_t _state;
+        uint16_t _count[4];
+        uint16_t _threshold[4];
+};
+
+#endif // DEBOUNCER_H
@@ -2,9 +2,7 @@
 #include "mbed.h"
 
 HatButton::HatButton(PinName pin, Direction dir, void (*updateCb)(Direction, bool))
-: InterruptIn(pin, PullUp), _dir(dir), _updateCb(updateCb) {
-    this->rise(callback(this, &HatButton::onRise));
-    this->fall(callback(this, &HatButton::onFall));
+: InputPin(pin, INPUT_BASE + dir), _dir(dir), _updateCb(updateCb) {
 }
 
 void HatButton::onRise() {
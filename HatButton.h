@@ -2,8 +2,9 @@
 #define HAT_BUTTON_H
 
 #include "mbed.h"
+#include "InputPin.h"
 
-class HatButton : public InterruptIn {
+class HatButton : public InputPin {
     public:
         enum Direction {
             UP = 0,
@@ -12,6 +13,9 @@ class HatButton : public InterruptIn {
             LEFT
         };
 
+        /** Input index of the first hat direction, after the 12 buttons */
+        static const unsigned INPUT_BASE = 12;
+
         HatButton(PinName pin, Direction dir, void (*updateCb)(Direction, bool));
         virtual void onRise();
         virtual void onFall();
@@ -0,0 +1,103 @@
+#include "HatResolver.h"
+#include "HatButton.h"
+#include "HIDDescriptor.h"
+
+namespace {
+
+struct HatTable {
+    uint8_t values[16];
+};
+
+/* Hat values by vertical (down, centre, up) then horizontal (left, centre, right) direction */
+constexpr uint8_t COMPASS[3][3] = {
+    {5, 4, 3},
+    {6, hid::HatSwitch::NULL_STATE, 2},
+    {7, 0, 1},
+};
+
+constexpr HatTable makeHatTable() {
+    HatTable table = {};
+    for (unsigned mask = 0; mask < 16; mask++) {
+        int up = (mask >> HatButton::UP) & 1;
+        int right = (mask >> HatButton::RIGHT) & 1;
+        int down = (mask >> HatButton::DOWN) & 1;
+        int left = (mask >> HatButton::LEFT) & 1;
+        table.values[mask] = COMPASS[up - down + 1][right - left + 1];
+    }
+    return table;
+}
+
+constexpr HatTable HAT_TABLE = makeHatTable();
+
+/* Up beats down; a vertical takes right over left, while left alone beats right */
+constexpr HatTable makeFixedPriorityTable() {
+    HatTable table = {};
+    for (unsigned mask = 0; mask < 16; mask++) {
+        int up = (mask >> HatButton::UP) & 1;
+        int right = (mask >> HatButton::RIGHT) & 1;
+        int down = (mask >> HatButton::DOWN) & 1;
+        int left = (mask >> HatButton::LEFT) & 1;
+        int vertical = up ? 1 : (down ? -1 : 0);
+        int horizontal = vertical ? (right ? 1 : (left ? -1 : 0)) : (left ? -1 : (right ? 1 : 0));
+        table.values[mask] = COMPASS[vertical + 1][horizontal + 1];
+    }
+    return table;
+}
+
+constexpr HatTable FIXED_PRIORITY_TABLE = makeFixedPriorityTable();
+
+static_assert(HAT_TABLE.values[0x0] == hid::HatSwitch::NULL_STATE, "centred");
+static_assert(HAT_TABLE.values[0x1] == 0 && HAT_TABLE.values[0x3] == 1, "up, up-right");
+static_assert(HAT_TABLE.values[0x9] == 7, "up-left");
+static_assert(HAT_TABLE.values[0x5] == hid::HatSwitch::NULL_STATE, "up and down cancel");
+static_assert(HAT_TABLE.values[0xB] == 0, "left and right cancel");
+static_assert(HAT_TABLE.values[0xF] == hid::HatSwitch::NULL_STATE, "all four cancel");
+static_assert(FIXED_PRIORITY_TABLE.values[0x5] == 0, "up over down");
+static_assert(FIXED_PRIORITY_TABLE.values[0xA] == 6, "left over right");
+static_assert(FIXED_PRIORITY_TABLE.values[0xB] == 1, "right over left going up");
+
+/* The direction across the hat from each single direction bit */
+inline uint8_t opposite(uint8_t bit) {
+    return ((bit << 2) | (bit >> 2)) & 0xF;
+}
+
+} // namespace
+
+HatResolver::HatResolver()
+: _policy(SOCD_NEUTRAL), _table(HAT_TABLE.values), _held(0), _suppressed(0) {
+    setPolicy((Policy)(HAT_SOCD_POLICY));
+}
+
+void HatResolver::setPolicy(Policy policy) {
+    _policy = policy < SOCD_POLICIES ? policy : SOCD_NEUTRAL;
+    _table = _policy == SOCD_FIXED_PRIORITY ? FIXED_PRIORITY_TABLE.values : HAT_TABLE.values;
+    _suppressed = 0;
+}
+
+uint8_t HatResolver::update(unsigned direction, bool pressed) {
+    uint8_t bit = 1 << direction;
+    uint8_t other = opposite(bit);
+    if (pressed) {
+        _held |= bit;
+        if (_held & other) {
+            if (_policy == SOCD_LAST_WINS) {
+                _suppressed |= other;
+            } else if (_policy == SOCD_FIRST_WINS) {
+                _suppressed |= bit;
+            }
+        }
+    } else {
+        /* Whichever of the two is left held has the axis to itself */
+        _held &= ~bit;
+        _suppressed &= ~(bit | other);
+    }
+    return _table[_held & ~_suppressed];
+}
+
+uint8_t HatResolver::value() const {
+    return _table[_held & ~_suppressed];
+}
+
+uint8_t HatResolver::lookup(uint8_t mask) {
+    return HAT_TABLE.values[mask & 0xF];
+}
@@ -0,0 +1,80 @@
+#ifndef HAT_RESOLVER_H
+#define HAT_RESOLVER_H
+
+#include "mbed.h"
+
+/*
+ * How opposing hat directions held together resolve, one of HatResolver::Policy. The default
+ * keeps the fixed priorities the hat always had; SOCD_NEUTRAL is the usual choice for fighting
+ * games.
+ */
+#ifndef HAT_SOCD_POLICY
+#define HAT_SOCD_POLICY HatResolver::SOCD_FIXED_PRIORITY
+#endif
+
+/**
+ * Turns the four hat buttons into the report's hat switch value.
+ *
+ * The buttons held form a 4-bit mask, bit n for HatButton direction n (up, right, down, left),
+ * looked up in a 16-entry table computed at compile time. Simultaneous opposing cardinal
+ * directions (SOCD: up with down, left with right) resolve per axis by the policy:
+ *
+ *  - SOCD_NEUTRAL: the two cancel out, leaving the other axis;
+ *  - SOCD_LAST_WINS: the one pressed last, until it is released and the other takes over again;
+ *  - SOCD_FIRST_WINS: the one held first; the other only takes over once it is released;
+ *  - SOCD_FIXED_PRIORITY: up over down; left over right, but right over left on a diagonal. This
+ *    is how the hat resolved before there were policies, through its own 16-entry table.
+ *
+ * Last and first wins keep a mask of the losing buttons, updated on each edge, so resolving is
+ * one table load under every policy.
+ */
+class HatResolver {
+    public:
+        enum Policy {
+            SOCD_NEUTRAL = 0,
+            SOCD_LAST_WINS,
+            SOCD_FIRST_WINS,
+            SOCD_FIXED_PRIORITY,
+            SOCD_POLICIES
+        };
+
+        HatResolver();
+
+        /**
+         * Takes effect from the next edge; under the first and last wins policies, opposing
+         * buttons held now cancel until one is released
+         */
+        void setPolicy(Policy policy);
+        Policy policy() const {
+            return _policy;
+        }
+
+        /**
+         * Record a press or release of one direction
+         *
+         * @return The hat switch value now, hid::HatSwitch::NULL_STATE when centred
+         */
+        uint8_t update(unsigned direction, bool pressed);
+
+        /** The hat switch value for the buttons held */
+        uint8_t value() const;
+
+        /** Buttons held, and those of them losing to an opposing direction */
+        uint8_t held() const {
+            return _held;
+        }
+        uint8_t suppressed() const {
+            return _suppressed;
+        }
+
+        /** The value of a mask of directions under SOCD_NEUTRAL */
+        static uint8_t lookup(uint8_t mask);
+
+    private:
+        Policy _policy;
+        const uint8_t *_table;
+        uint8_t _held;
+        uint8_t _suppressed;
+};
+
+#endif // HAT_RESOLVER_H
@@ -0,0 +1,89 @@
+#ifndef INPUT_EVENT_RING_H
+#define INPUT_EVENT_RING_H
+
+#include "mbed.h"
+
+struct InputEvent {
+    uint8_t input;
+    uint8_t level;
+    uint32_t timestamp;
+};
+
+/**
+ * Fixed-size single-producer/single-consumer ring of input edges.
+ *
+ * push() runs in interrupt context and never allocates or blocks; when the ring is full the
+ * edge is counted and dropped, and the consumer must recover the lost levels some other way.
+ * pop() runs on the consumer thread. The indices are free-running and only written by their
+ * owner, so no locking is needed on a single core.
+ *
+ * @tparam Size Number of entries, must be a power of two
+ */
+template <unsigned Size>
+class InputEventRing {
+public:
+    InputEventRing() : _head(0), _tail(0), _drops(0), _highWater(0) {
+    }
+
+    bool push(uint8_t input, uint8_t level, uint32_t timestamp) {
+        uint32_t head = _head;
+        uint32_t used = head - _tail;
+        if (used >= Size) {
+            _drops++;
+            return false;
+        }
+
+        InputEvent &event = _events[head & (Size - 1)];
+        event.input = input;
+        event.level = level;
+        event.timestamp = timestamp;
+        __DMB();
+        _head = head + 1;
+
+        if (used + 1 > _highWater)
+            _highWater = used + 1;
+        return true;
+    }
+
+    bool pop(InputEvent *event) {
+        uint32_t tail = _tail;
+        if (tail == _head)
+            return false;
+
+        __DMB();
+        *event = _events[tail & (Size - 1)];
+        __DMB();
+        _tail = tail + 1;
+        return true;
+    }
+
+    bool empty() const {
+        return _tail == _head;
+    }
+
+    /** Edges lost because the ring was full */
+    uint32_t drops() const {
+        return _drops;
+    }
+
+    /** Largest number of entries ever waiting in the ring */
+    uint32_t highWater() const {
+        return _highWater;
+    }
+
+    void resetCounters() {
+        _drops = 0;
+        _highWater = 0;
+    }
+
+private:
+    static_assert((Size & (Size - 1)) == 0, "InputEventRing size must be a power of two");
+
+    InputEvent _events[Size];
+    volatile uint32_t _head;
+    volatile uint32_t _tail;
+    volatile uint32_t _drops;
+    volatile uint32_t _highWater;
+};
+
+#endif // INPUT_EVENT_RING_H
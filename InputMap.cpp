@@ -0,0 +1,210 @@
+#include "InputMap.h"
+#include "QueueStats.h"
+
+static_assert(sizeof(InputProfile) == 160, "InputProfile has no padding");
+static_assert(InputMap::OUTPUTS <= 16, "outputs fit a 16-bit mask");
+static_assert(InputProfile::MACROS < InputProfile::MACRO, "macro numbers fit below the flag");
+
+namespace {
+
+/* An output, a macro or nothing */
+bool validTarget(uint8_t target) {
+    if (target == InputProfile::NONE) {
+        return true;
+    }
+    if (target & InputProfile::MACRO) {
+        return (unsigned)(target & ~InputProfile::MACRO) < InputProfile::MACROS;
+    }
+    return target < InputMap::OUTPUTS;
+}
+
+} // namespace
+
+void InputProfile::setIdentity() {
+    memset(this, 0, sizeof(*this));
+    for (unsigned input = 0; input < INPUTS; input++) {
+        map[input] = input;
+    }
+}
+
+struct InputMap::MacroEvent {
+    InputMap *map;
+    unsigned macro;
+
+    void operator()() {
+        map->_macroHandle[macro] = 0;
+        map->macroStep(macro);
+    }
+};
+
+InputMap::InputMap(events::EventQueue *queue, Handler handler)
+: _queue(queue), _handler(handler), _held(0), _outputs(0) {
+    memset(_holds, 0, sizeof(_holds));
+    memset(_macroHandle, 0, sizeof(_macroHandle));
+    memset(_macroStep, 0, sizeof(_macroStep));
+
+    InputProfile identity;
+    identity.setIdentity();
+    compile(identity);
+}
+
+bool InputMap::compile(const InputProfile &profile) {
+    /* Check everything before touching the active layout */
+    uint16_t chorded = 0;
+    for (unsigned chord = 0; chord < InputProfile::CHORDS; chord++) {
+        uint16_t inputs = profile.chords[chord].inputs;
+        if (!inputs) {
+            continue;
+        }
+        if ((inputs & chorded) || !validTarget(profile.chords[chord].output)) {
+            return false;
+        }
+        chorded |= inputs;
+    }
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        if (!validTarget(profile.map[input])) {
+            return false;
+        }
+    }
+
+    /* Release everything held under the old layout */
+    uint16_t held = _held;
+    for (unsigned macro = 0; macro < InputProfile::MACROS; macro++) {
+        stopMacro(macro);
+    }
+    for (unsigned output = 0; output < OUTPUTS; output++) {
+        if (_holds[output]) {
+            _holds[output] = 1;
+            hold(output, false);
+        }
+    }
+    _held = 0;
+
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        _bindings[input].output = profile.map[input];
+        _bindings[input].chord = NO_CHORD;
+    }
+    for (unsigned chord = 0; chord < InputProfile::CHORDS; chord++) {
+        const InputProfile::Chord &source = profile.chords[chord];
+        _chords[chord].inputs = source.inputs;
+        _chords[chord].output = source.output;
+        _chords[chord].active = false;
+        for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+            if (source.inputs & (1 << input)) {
+                _bindings[input].chord = chord;
+            }
+        }
+    }
+    memcpy(_macros, profile.macros, sizeof(_macros));
+
+    /* Inputs still held take effect under the new layout */
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        if (held & (1 << input)) {
+            this->input(input, true);
+        }
+    }
+    return true;
+}
+
+void InputMap::hold(unsigned output, bool pressed) {
+    if (pressed) {
+        if (_holds[output]++) {
+            return;
+        }
+    } else {
+        /* Nothing to release if the layout changed since the press */
+        if (!_holds[output] || --_holds[output]) {
+            return;
+        }
+    }
+    _outputs ^= 1 << output;
+    _handler(output, pressed);
+}
+
+void InputMap::holdAll(uint16_t outputs, bool pressed) {
+    for (unsigned output = 0; outputs; output++, outputs >>= 1) {
+        if (outputs & 1) {
+            hold(output, pressed);
+        }
+    }
+}
+
+void InputMap::updateChord(unsigned chord) {
+    Chord &c = _chords[chord];
+    bool complete = (_held & c.inputs) == c.inputs;
+    if (complete != c.active) {
+        c.active = complete;
+        if (c.output != InputProfile::NONE) {
+            drive(c.output, complete);
+        }
+    }
+}
+
+void InputMap::startMacro(unsigned macro) {
+    if (_macroHandle[macro] || !_macros[macro][0].ticks) {
+        return;
+    }
+    _macroStep[macro] = 0;
+    holdAll(_macros[macro][0].outputs, true);
+    MacroEvent event = {this, macro};
+    _macroHandle[macro] = QueueStats::call_in(_queue, QueueStats::EVENT_MACRO,
+                                              _macros[macro][0].ticks * INPUT_MACRO_TICK_MS, event);
+    if (!_macroHandle[macro]) {
+        /* No room on the queue: end the step now rather than hold it forever */
+        holdAll(_macros[macro][0].outputs, false);
+    }
+}
+
+void InputMap::macroStep(unsigned macro) {
+    unsigned step = _macroStep[macro];
+    holdAll(_macros[macro][step].outputs, false);
+    if (++step >= InputProfile::MACRO_STEPS || !_macros[macro][step].ticks) {
+        return;
+    }
+    _macroStep[macro] = step;
+    holdAll(_macros[macro][step].outputs, true);
+    MacroEvent event = {this, macro};
+    _macroHandle[macro] = QueueStats::call_in(_queue, QueueStats::EVENT_MACRO,
+                                              _macros[macro][step].ticks * INPUT_MACRO_TICK_MS, event);
+    if (!_macroHandle[macro]) {
+        holdAll(_macros[macro][step].outputs, false);
+    }
+}
+
+void InputMap::stopMacro(unsigned macro) {
+    if (!_macroHandle[macro]) {
+        return;
+    }
+    _queue->cancel(_macroHandle[macro]);
+    _macroHandle[macro] = 0;
+    holdAll(_macros[macro][_macroStep[macro]].outputs, false);
+}
+
+bool InputMap::load(mbed::FileSystem *fs, const char *path, InputProfile *profile) {
+    uint8_t record[MAX_RECORD_SIZE];
+    File file;
+    if (file.open(fs, path, O_RDONLY)) {
+        return false;
+    }
+    ssize_t size = file.read(record, sizeof(record));
+    file.close();
+
+    return size > 0 && decode(record, size, profile);
+}
+
+size_t InputMap::encode(const InputProfile &profile, uint8_t *record) {
+    return ConfigStore::encodeRecord(MAGIC, VERSION, &profile, sizeof(profile), record);
+}
+
+bool InputMap::decode(const uint8_t *record, size_t size, InputProfile *profile) {
+    const uint8_t *payload;
+    uint16_t length;
+    if (!ConfigStore::decodeRecord(MAGIC, record, size, &payload, &length)) {
+        return false;
+    }
+
+    /* Older records are a prefix of the current layout; what they lack maps to itself */
+    profile->setIdentity();
+    memcpy(profile, payload, length < sizeof(*profile) ? length : sizeof(*profile));
+    return true;
+}
@@ -0,0 +1,188 @@
+#ifndef INPUT_MAP_H
+#define INPUT_MAP_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+#include "FileSystem.h"
+#include "ConfigStore.h"
+
+/* Length of a macro step, as the output report's rumble time */
+#ifndef INPUT_MACRO_TICK_MS
+#define INPUT_MACRO_TICK_MS 10
+#endif
+
+/**
+ * A layout of the gamepad's inputs, as stored in a profile file.
+ *
+ * Inputs and outputs are numbered alike: buttons 0-11, then the hat's up, right, down and left
+ * at 12-15. Each input drives one output, nothing, or a macro, so any permutation of the
+ * buttons and hat is a layout. A chord drives one more output (or macro) while all of its
+ * inputs are held, on top of what they drive themselves; an input is in one chord at most. A
+ * macro holds a set of outputs for each of its steps in turn, for ticks of
+ * INPUT_MACRO_TICK_MS each; a step of 0 ticks ends it.
+ *
+ * Multi-byte fields are stored in the native (little endian) byte order.
+ */
+struct InputProfile {
+    static const unsigned INPUTS = 16;
+    static const unsigned CHORDS = 4;
+    static const unsigned MACROS = 4;
+    static const unsigned MACRO_STEPS = 8;
+
+    /** Values of map[] and Chord::output besides outputs 0-15 */
+    static const uint8_t NONE = 0xFF;
+    static const uint8_t MACRO = 0x80;
+
+    struct Chord {
+        /** Inputs to hold together, one bit each; 0 if the chord is unused */
+        uint16_t inputs;
+        uint8_t output;
+        uint8_t reserved;
+    };
+
+    struct MacroStep {
+        /** Outputs held during the step, one bit each */
+        uint16_t outputs;
+        uint8_t ticks;
+        uint8_t reserved;
+    };
+
+    uint8_t map[INPUTS];
+    Chord chords[CHORDS];
+    MacroStep macros[MACROS][MACRO_STEPS];
+
+    /** Every input to the output of the same number, no chords or macros */
+    void setIdentity();
+};
+
+/**
+ * Remaps input edges to outputs through the active profile.
+ *
+ * A profile is compiled into a flat binding per input, so an edge costs one indexed load
+ * whatever the layout, plus a chord check if the input is in one. Outputs count the inputs,
+ * chords and macro steps holding them: an output is pressed while any of them holds it, and the
+ * handler is only called when that changes. Macros play on the event queue, once per press of
+ * their input; a press while the macro plays is ignored.
+ *
+ * Profiles are versioned binary records framed like the settings, by
+ * ConfigStore::encodeRecord(): a header (magic, version, payload length), the profile and a
+ * CRC-32 of both.
+ */
+class InputMap {
+    public:
+        static const unsigned OUTPUTS = InputProfile::INPUTS;
+        static const uint32_t MAGIC = 0x504D5047; // "GPMP"
+        static const uint16_t VERSION = 1;
+        static const size_t RECORD_SIZE = ConfigStore::FRAME_SIZE + sizeof(InputProfile);
+        /** Largest record accepted, leaving room for fields appended by later versions */
+        static const size_t MAX_RECORD_SIZE = 256;
+
+        /** Called with each output whose state changed */
+        typedef void (*Handler)(unsigned output, bool pressed);
+
+        /** Starts with the identity layout */
+        InputMap(events::EventQueue *queue, Handler handler);
+
+        /**
+         * Make profile the active layout. Outputs held under the old one are released and the
+         * inputs held now pressed again under the new one.
+         *
+         * @return false, leaving the active layout alone, if profile refers to outputs, chords
+         *         or macros that do not exist or puts an input in two chords
+         */
+        bool compile(const InputProfile &profile);
+
+        /** Handle a press or release of input; repeating the last one does nothing */
+        void input(unsigned input, bool pressed) {
+            Binding binding = _bindings[input];
+            uint16_t bit = 1 << input;
+            if (((_held & bit) != 0) == pressed) {
+                return;
+            }
+            _held ^= bit;
+            if (binding.output != InputProfile::NONE) {
+                drive(binding.output, pressed);
+            }
+            if (binding.chord != NO_CHORD) {
+                updateChord(binding.chord);
+            }
+        }
+
+        /** Outputs and inputs pressed now, one bit each */
+        uint16_t outputs() const {
+            return _outputs;
+        }
+        uint16_t held() const {
+            return _held;
+        }
+
+        /** True while macro plays */
+        bool playing(unsigned macro) const {
+            return _macroHandle[macro] != 0;
+        }
+
+        /**
+         * Read the profile record at path into profile
+         *
+         * @return true if a valid record was found; profile is left untouched otherwise
+         */
+        static bool load(mbed::FileSystem *fs, const char *path, InputProfile *profile);
+
+        /** @return Bytes written to record, RECORD_SIZE */
+        static size_t encode(const InputProfile &profile, uint8_t *record);
+
+        /** @return true if record holds a valid record of any version */
+        static bool decode(const uint8_t *record, size_t size, InputProfile *profile);
+
+    private:
+        static const uint8_t NO_CHORD = 0xFF;
+
+        struct Binding {
+            uint8_t output;
+            uint8_t chord;
+        };
+
+        struct Chord {
+            uint16_t inputs;
+            uint8_t output;
+            bool active;
+        };
+
+        /** Press or release an output or, on press, start a macro */
+        void drive(uint8_t output, bool pressed) {
+            if (output & InputProfile::MACRO) {
+                if (pressed) {
+                    startMacro(output & ~InputProfile::MACRO);
+                }
+            } else {
+                hold(output, pressed);
+            }
+        }
+
+        void hold(unsigned output, bool pressed);
+        void holdAll(uint16_t outputs, bool pressed);
+        void updateChord(unsigned chord);
+        void startMacro(unsigned macro);
+        void macroStep(unsigned macro);
+        void stopMacro(unsigned macro);
+
+        /* Queue event running the next step of a macro */
+        struct MacroEvent;
+
+        events::EventQueue *_queue;
+        Handler _handler;
+
+        Binding _bindings[InputProfile::INPUTS];
+        Chord _chords[InputProfile::CHORDS];
+        InputProfile::MacroStep _macros[InputProfile::MACROS][InputProfile::MACRO_STEPS];
+
+        uint16_t _held;
+        uint16_t _outputs;
+        /** Inputs, chords and macro steps holding each output */
+        uint8_t _holds[OUTPUTS];
+
+        int _macroHandle[InputProfile::MACROS];
+        uint8_t _macroStep[InputProfile::MACROS];
+};
+
+#endif // INPUT_MAP_H
@@ -0,0 +1,219 @@
+#include "InputPin.h"
+#include "LatencyTrace.h"
+#include "QueueStats.h"
+#include "mbed.h"
+
+InputEventRing<INPUT_EVENT_RING_SIZE> InputPin::events;
+uint32_t InputPin::maxDrainLagUs = 0;
+Debouncer InputPin::debouncer;
+
+InputPin *InputPin::_inputs[InputPin::MAX_INPUTS];
+events::EventQueue *InputPin::_queue = NULL;
+volatile bool InputPin::_drainPosted = false;
+uint16_t InputPin::_raw = 0xFFFF;
+int InputPin::_debounceHandle = 0;
+#if !INPUT_SCAN_MODE
+uint32_t InputPin::_drops = 0;
+#endif
+
+#if INPUT_SCAN_MODE
+PortIn *InputPin::_port = NULL;
+Ticker InputPin::_scanTicker;
+uint8_t InputPin::_portInput[32];
+uint32_t InputPin::_lastPort = 0;
+volatile uint16_t InputPin::_scanRaw = 0xFFFF;
+volatile uint32_t InputPin::_scanTimestamp = 0;
+
+static const uint8_t NO_INPUT = 0xFF;
+
+InputPin::InputPin(PinName pin, unsigned index)
+: _pin(pin), _index(index) {
+    MBED_ASSERT(index < MAX_INPUTS);
+    _inputs[index] = this;
+}
+#else
+InputPin::InputPin(PinName pin, unsigned index)
+: InterruptIn(pin, PullUp), _index(index) {
+    MBED_ASSERT(index < MAX_INPUTS);
+    _inputs[index] = this;
+
+    this->rise(callback(this, &InputPin::isrRise));
+    this->fall(callback(this, &InputPin::isrFall));
+}
+#endif
+
+void InputPin::start(events::EventQueue *queue) {
+    // Inputs are pulled up, so absent ones read as released
+    _raw = 0xFFFF;
+#if INPUT_SCAN_MODE
+    uint32_t portMask = 0;
+    memset(_portInput, NO_INPUT, sizeof(_portInput));
+    for (unsigned i = 0; i < MAX_INPUTS; i++) {
+        if (_inputs[i]) {
+            unsigned bit = _inputs[i]->_pin & 0x1F;
+            portMask |= 1u << bit;
+            _portInput[bit] = i;
+        }
+    }
+
+    _port = new PortIn(Port0, portMask);
+    _port->mode(PullUp);
+    _lastPort = _port->read();
+    for (unsigned bit = 0; bit < 32; bit++) {
+        if (_portInput[bit] != NO_INPUT && !(_lastPort & (1u << bit))) {
+            _raw &= ~(1 << _portInput[bit]);
+        }
+    }
+    _scanRaw = _raw;
+#else
+    _raw = readPins();
+#endif
+    debouncer.setAllTicks(INPUT_DEBOUNCE_TICKS);
+    debouncer.reset(_raw);
+
+    _queue = queue;
+#if INPUT_SCAN_MODE
+    _scanTicker.attach_us(&InputPin::isrScan, INPUT_SCAN_PERIOD_US);
+#else
+    if (!events.empty()) {
+        postDrain();
+    }
+#endif
+}
+
+void InputPin::setDebounceTicks(unsigned index, unsigned ticks) {
+    debouncer.setTicks(index, ticks);
+}
+
+#if INPUT_SCAN_MODE
+void InputPin::isrScan() {
+    uint32_t port = _port->read();
+    uint32_t changed = port ^ _lastPort;
+    if (!changed) {
+        return;
+    }
+    _lastPort = port;
+    TRACE_POINT(EDGE_ISR);
+
+    uint16_t raw = _scanRaw;
+    while (changed) {
+        unsigned bit = __builtin_ctz(changed);
+        changed &= changed - 1;
+        raw ^= 1 << _portInput[bit];
+    }
+    _scanRaw = raw;
+
+    if (!_drainPosted) {
+        _scanTimestamp = us_ticker_read();
+        postDrain();
+    }
+}
+#else
+uint16_t InputPin::readPins() {
+    uint16_t raw = 0xFFFF;
+    for (unsigned i = 0; i < MAX_INPUTS; i++) {
+        if (_inputs[i] && !_inputs[i]->read()) {
+            raw &= ~(1 << i);
+        }
+    }
+    return raw;
+}
+
+void InputPin::isrRise() {
+    isrEdge(1);
+}
+
+void InputPin::isrFall() {
+    isrEdge(0);
+}
+
+void InputPin::isrEdge(uint8_t level) {
+    TRACE_POINT(EDGE_ISR);
+    events.push(_index, level, us_ticker_read());
+    if (!_drainPosted) {
+        postDrain();
+    }
+}
+#endif
+
+void InputPin::postDrain() {
+    if (!_queue) {
+        return;
+    }
+    // Only one drain is ever outstanding; if the post fails the next edge retries
+    _drainPosted = true;
+    if (!QueueStats::call(_queue, QueueStats::EVENT_INPUT, &InputPin::drain)) {
+        _drainPosted = false;
+    }
+}
+
+void InputPin::drain() {
+    // Clear first: an edge arriving while draining either gets popped below or posts a new drain
+    _drainPosted = false;
+
+#if INPUT_SCAN_MODE
+    uint32_t lag = us_ticker_read() - _scanTimestamp;
+    if (lag > maxDrainLagUs) {
+        maxDrainLagUs = lag;
+    }
+    bool edges = _raw != _scanRaw;
+    _raw = _scanRaw;
+#else
+    uint32_t drops = events.drops();
+    InputEvent event;
+    bool edges = false;
+    while (events.pop(&event)) {
+        uint32_t lag = us_ticker_read() - event.timestamp;
+        if (lag > maxDrainLagUs) {
+            maxDrainLagUs = lag;
+        }
+
+        if (event.level) {
+            _raw |= 1 << event.input;
+        } else {
+            _raw &= ~(1 << event.input);
+        }
+        edges = true;
+    }
+    // Edges were lost to a full ring, maybe a release: read the pins back rather than leave an
+    // input at a level it has left. A drop after this posts another drain, which comes back here.
+    if (drops != _drops) {
+        _drops = drops;
+        _raw = readPins();
+        edges = true;
+    }
+#endif
+
+    if (edges)
+        TRACE_POINT(DRAIN);
+    if (edges && !_debounceHandle) {
+        _debounceHandle = QueueStats::call_every(_queue, QueueStats::EVENT_DEBOUNCE, INPUT_DEBOUNCE_TICK_MS,
+                                                  &InputPin::debounceTick);
+    }
+}
+
+void InputPin::debounceTick() {
+    uint16_t changed = debouncer.tick(_raw);
+    uint16_t state = debouncer.state();
+
+    while (changed) {
+        unsigned i = __builtin_ctz(changed);
+        changed &= changed - 1;
+
+        InputPin *input = _inputs[i];
+        if (!input) {
+            continue;
+        }
+        TRACE_POINT(HANDLER);
+        if (state & (1 << i)) {
+            input->onRise();
+        } else {
+            input->onFall();
+        }
+    }
+
+    if (debouncer.settled()) {
+        _queue->cancel(_debounceHandle);
+        _debounceHandle = 0;
+    }
+}
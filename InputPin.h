@@ -0,0 +1,131 @@
+#ifndef INPUT_PIN_H
+#define INPUT_PIN_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+
+#include "InputEventRing.h"
+#include "Debouncer.h"
+
+#ifndef INPUT_EVENT_RING_SIZE
+#define INPUT_EVENT_RING_SIZE 32
+#endif
+
+/* Debounce sampling period and default number of stable samples per input */
+#ifndef INPUT_DEBOUNCE_TICK_MS
+#define INPUT_DEBOUNCE_TICK_MS 1
+#endif
+#ifndef INPUT_DEBOUNCE_TICKS
+#define INPUT_DEBOUNCE_TICKS 4
+#endif
+
+/*
+ * Build with INPUT_SCAN_MODE=1 to sample all inputs with one GPIO port read every
+ * INPUT_SCAN_PERIOD_US instead of taking an interrupt per pin edge
+ */
+#ifndef INPUT_SCAN_MODE
+#define INPUT_SCAN_MODE 0
+#endif
+#ifndef INPUT_SCAN_PERIOD_US
+#define INPUT_SCAN_PERIOD_US 500
+#endif
+
+/**
+ * Digital input whose edges are handled on the event queue.
+ *
+ * The interrupt handlers only push (input, level, timestamp) into a shared ring. A single drain
+ * event on the queue then consumes every buffered edge in order, so a burst of edges costs at
+ * most one queue allocation instead of one per edge.
+ *
+ * All GPIO interrupts share one priority and do not preempt each other, which makes them a
+ * single producer as far as the ring is concerned.
+ *
+ * Edges only update a raw bitmask of all inputs. While any input is unsettled, a periodic
+ * queue event feeds that mask to a shared Debouncer and calls the handlers of the inputs whose
+ * debounced state changed; bounces shorter than the input's debounce time never reach them.
+ * If the ring was full and edges were dropped, the next drain reads every pin back instead, so
+ * a lost release cannot leave a button held.
+ *
+ * In scan mode there are no pin interrupts: a Ticker reads the whole port, XORs it with the
+ * previous read and, only if some input changed, publishes the new raw mask and posts a drain.
+ * Inputs must then all be on Port0, and the same onRise/onFall handlers are called.
+ */
+#if INPUT_SCAN_MODE
+class InputPin {
+#else
+class InputPin : public InterruptIn {
+#endif
+    public:
+        /** Number of inputs; buttons use 0-11 and the hat 12-15 */
+        static const unsigned MAX_INPUTS = 16;
+
+        InputPin(PinName pin, unsigned index);
+
+        virtual void onRise() = 0;
+        virtual void onFall() = 0;
+
+        /**
+         * Sample the initial input levels and start handling edges on queue. Edges are
+         * buffered until this is called.
+         */
+        static void start(events::EventQueue *queue);
+
+        /** Dispatch all buffered edges to the debouncer */
+        static void drain();
+
+        /** The input registered at index, or NULL */
+        static InputPin *input(unsigned index) {
+            return _inputs[index];
+        }
+
+        /** Set how long input must be stable before its handlers run, in debounce ticks */
+        static void setDebounceTicks(unsigned index, unsigned ticks);
+
+        static Debouncer debouncer;
+
+        static InputEventRing<INPUT_EVENT_RING_SIZE> events;
+
+        /** Largest delay between an edge and its handler, in microseconds */
+        static uint32_t maxDrainLagUs;
+
+    protected:
+#if INPUT_SCAN_MODE
+        static void isrScan();
+
+        PinName _pin;
+#else
+        void isrRise();
+        void isrFall();
+        void isrEdge(uint8_t level);
+
+        /** Current levels of all inputs, absent ones released */
+        static uint16_t readPins();
+#endif
+
+        unsigned _index;
+
+    private:
+        static void postDrain();
+        static void debounceTick();
+
+#if INPUT_SCAN_MODE
+        static PortIn *_port;
+        static Ticker _scanTicker;
+        static uint8_t _portInput[32];
+        static uint32_t _lastPort;
+        static volatile uint16_t _scanRaw;
+        static volatile uint32_t _scanTimestamp;
+#endif
+
+        static InputPin *_inputs[MAX_INPUTS];
+        static events::EventQueue *_queue;
+        static volatile bool _drainPosted;
+        static uint16_t _raw;
+        static int _debounceHandle;
+#if !INPUT_SCAN_MODE
+        /* Ring drops as of the last read back of the pins */
+        static uint32_t _drops;
+#endif
+};
+
+#endif // INPUT_PIN_H
@@ -0,0 +1,109 @@
+#include "LatencyTrace.h"
+
+#if LATENCY_TRACE
+
+static const int IDLE = -1;
+
+uint32_t LatencyTrace::traces;
+uint32_t LatencyTrace::abandoned;
+uint32_t LatencyTrace::_histogram[LatencyTrace::STAGES][LatencyTrace::BUCKETS];
+volatile int LatencyTrace::_stage = IDLE;
+volatile uint32_t LatencyTrace::_startUs;
+volatile uint32_t LatencyTrace::_lastUs;
+
+void LatencyTrace::point(Stage stage) {
+    uint32_t now = us_ticker_read();
+
+    if (stage == EDGE_ISR) {
+        if (_stage != IDLE) {
+            if (now - _lastUs < LATENCY_TRACE_STALE_US)
+                return;
+            abandoned++;
+        }
+        _startUs = now;
+        _lastUs = now;
+        _stage = EDGE_ISR;
+        return;
+    }
+
+    if (_stage != stage - 1)
+        return;
+
+    _histogram[stage][bucket(now - _lastUs)]++;
+    _lastUs = now;
+    _stage = stage;
+
+    if (stage == SENT) {
+        _histogram[EDGE_ISR][bucket(now - _startUs)]++;
+        traces++;
+        _stage = IDLE;
+    }
+}
+
+void LatencyTrace::reset() {
+    _stage = IDLE;
+    traces = 0;
+    abandoned = 0;
+    memset(_histogram, 0, sizeof(_histogram));
+}
+
+uint32_t LatencyTrace::count(Stage stage) {
+    uint32_t total = 0;
+    for (unsigned i = 0; i < BUCKETS; i++)
+        total += _histogram[stage][i];
+    return total;
+}
+
+uint32_t LatencyTrace::percentile(Stage stage, unsigned percent) {
+    uint32_t total = count(stage);
+    if (!total)
+        return 0;
+
+    /* Smallest bucket holding at least percent of the samples at or below it */
+    uint64_t wanted = ((uint64_t)total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        seen += _histogram[stage][i];
+        if (seen >= wanted)
+            return 1UL << i;
+    }
+    return 1UL << (BUCKETS - 1);
+}
+
+const char *LatencyTrace::stageName(Stage stage) {
+    static const char *const names[STAGES] = {
+        "isr", "drain", "handler", "update", "copy", "write", "sent"
+    };
+    return names[stage];
+}
+
+void LatencyTrace::dump() {
+    /* Columns up to the highest bucket in use, headed by their upper bounds */
+    unsigned used = 1;
+    for (unsigned s = 0; s < STAGES; s++)
+        for (unsigned i = 0; i < BUCKETS; i++)
+            if (_histogram[s][i] && i + 1 > used)
+                used = i + 1;
+
+    printf("latency trace: %lu traces, %lu abandoned\r\n",
+           (unsigned long)traces, (unsigned long)abandoned);
+    printf("%-8s %8s %8s", "stage", "p50 us", "p99 us");
+    for (unsigned i = 0; i < used; i++) {
+        char label[24];
+        snprintf(label, sizeof(label), "<%lu", 1UL << i);
+        printf(" %7s", label);
+    }
+    printf("\r\n");
+
+    /* Stages in path order, then the whole path */
+    for (unsigned n = 1; n <= STAGES; n++) {
+        Stage s = (Stage)(n % STAGES);
+        printf("%-8s %8lu %8lu", s == EDGE_ISR ? "total" : stageName(s),
+               (unsigned long)percentile(s, 50), (unsigned long)percentile(s, 99));
+        for (unsigned i = 0; i < used; i++)
+            printf(" %7lu", (unsigned long)_histogram[s][i]);
+        printf("\r\n");
+    }
+}
+
+#endif
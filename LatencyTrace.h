@@ -0,0 +1,87 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include "mbed.h"
+
+/*
+ * Per-stage latency tracing of the input-to-air path. Off by default: with LATENCY_TRACE 0 the
+ * trace points compile to nothing and no tables are linked in.
+ */
+#ifndef LATENCY_TRACE
+#define LATENCY_TRACE 0
+#endif
+
+/* A trace that has not moved on for this long was dropped along the way (a bounce the debouncer
+ * rejected, a state already sent) and the next edge starts a new one */
+#ifndef LATENCY_TRACE_STALE_US
+#define LATENCY_TRACE_STALE_US 100000
+#endif
+
+#if LATENCY_TRACE
+#define TRACE_POINT(stage) LatencyTrace::point(LatencyTrace::stage)
+#else
+#define TRACE_POINT(stage) do {} while (0)
+#endif
+
+/**
+ * Follows one input edge at a time from the pin interrupt to the radio and keeps a log2
+ * histogram of the time spent between each pair of stages.
+ *
+ * An edge starts a trace when none is in flight; each later stage is taken only from the stage
+ * before it, so events belonging to other inputs or reports are ignored until the traced one
+ * arrives. The EDGE_ISR histogram holds the whole path, from the edge to the stack reporting the
+ * notification sent.
+ *
+ * Bucket 0 counts zero-length intervals and bucket n those of [2^(n-1), 2^n) microseconds; the
+ * last one also takes anything longer.
+ */
+class LatencyTrace {
+    public:
+        enum Stage {
+            EDGE_ISR,   /* InputPin interrupt */
+            DRAIN,      /* edge moved out of the ring buffer by the queue */
+            HANDLER,    /* debounced onRise()/onFall() dispatched */
+            UPDATE,     /* report updated and send requested */
+            COPY,       /* snapshot copied for sending */
+            WRITE,      /* GattServer::write() accepted the notification */
+            SENT,       /* stack reported it sent */
+            STAGES
+        };
+
+        static const unsigned BUCKETS = 21;
+
+        /** Record that the traced edge reached stage; callable from interrupt context */
+        static void point(Stage stage);
+
+        static void reset();
+
+        static const uint32_t *histogram(Stage stage) {
+            return _histogram[stage];
+        }
+        static uint32_t count(Stage stage);
+
+        /** Exclusive upper bound in microseconds of the bucket holding a percentile, 0 if empty */
+        static uint32_t percentile(Stage stage, unsigned percent);
+
+        static const char *stageName(Stage stage);
+
+        /** Print the histograms to the console */
+        static void dump();
+
+        static unsigned bucket(uint32_t us) {
+            unsigned n = us ? 32 - __builtin_clz(us) : 0;
+            return n < BUCKETS ? n : BUCKETS - 1;
+        }
+
+        /** Traces that reached the radio, and those dropped along the way */
+        static uint32_t traces;
+        static uint32_t abandoned;
+
+    private:
+        static uint32_t _histogram[STAGES][BUCKETS];
+        static volatile int _stage;
+        static volatile uint32_t _startUs;
+        static volatile uint32_t _lastUs;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "QueueStats.h"
+
+#if QUEUE_STATS
+
+QueueStats::QueueCounters QueueStats::_queues[QUEUE_STATS_QUEUES];
+
+QueueStats::QueueCounters *QueueStats::counters(events::EventQueue *queue) {
+    for (unsigned i = 0; i < QUEUE_STATS_QUEUES; i++) {
+        QueueCounters &queueCounters = _queues[i];
+        if (queueCounters.queue == queue)
+            return &queueCounters;
+        if (queueCounters.queue)
+            continue;
+        /* Free: take it, unless a post from another thread just took it for some queue */
+        void *expected = NULL;
+        if (core_util_atomic_cas_ptr((void *volatile *)&queueCounters.queue, &expected, queue) ||
+            expected == queue)
+            return &queueCounters;
+    }
+    return NULL;
+}
+
+int QueueStats::posted(QueueCounters *queueCounters, EventType type, int id) {
+    if (!queueCounters)
+        return id;
+    TypeStats &stats = queueCounters->types[type];
+    if (!id) {
+        core_util_atomic_incr_u32(&stats.failed, 1);
+        return 0;
+    }
+    core_util_atomic_incr_u32(&stats.posted, 1);
+    uint32_t live = queueCounters->live;
+    uint32_t highWater = queueCounters->highWater;
+    while (live > highWater &&
+           !core_util_atomic_cas_u32(&queueCounters->highWater, &highWater, live)) {
+    }
+    return id;
+}
+
+void QueueStats::ran(TypeStats &stats, uint32_t dueUs, uint32_t periodUs, uint32_t startUs) {
+    uint32_t runUs = us_ticker_read() - startUs;
+    int32_t late = startUs - dueUs;
+    uint32_t lagUs = late > 0 ? late : 0;
+    if (periodUs)
+        lagUs %= periodUs;
+
+    stats.runs++;
+    stats.totalLagUs += lagUs;
+    stats.totalRunUs += runUs;
+    if (lagUs > stats.maxLagUs)
+        stats.maxLagUs = lagUs;
+    if (runUs > stats.maxRunUs)
+        stats.maxRunUs = runUs;
+}
+
+void QueueStats::track(events::EventQueue *queue, const char *name) {
+    QueueCounters *queueCounters = counters(queue);
+    if (queueCounters)
+        queueCounters->name = name;
+}
+
+const QueueStats::TypeStats &QueueStats::stats(events::EventQueue *queue, EventType type) {
+    static const TypeStats none = {};
+    QueueCounters *queueCounters = counters(queue);
+    return queueCounters ? queueCounters->types[type] : none;
+}
+
+uint32_t QueueStats::depth(events::EventQueue *queue) {
+    QueueCounters *queueCounters = counters(queue);
+    return queueCounters ? queueCounters->live : 0;
+}
+
+uint32_t QueueStats::highWater(events::EventQueue *queue) {
+    QueueCounters *queueCounters = counters(queue);
+    return queueCounters ? queueCounters->highWater : 0;
+}
+
+uint32_t QueueStats::failedPosts(events::EventQueue *queue) {
+    uint32_t failed = 0;
+    for (unsigned i = 0; i < EVENT_TYPES; i++)
+        failed += stats(queue, (EventType)i).failed;
+    return failed;
+}
+
+const char *QueueStats::typeName(EventType type) {
+    static const char *const names[EVENT_TYPES] = {
+        "ble", "input", "debounce", "stick poll", "report", "conn params", "advertising",
+        "settings", "blink", "handoff", "macro", "other"
+    };
+    return names[type];
+}
+
+void QueueStats::reset() {
+    for (unsigned i = 0; i < QUEUE_STATS_QUEUES; i++) {
+        if (_queues[i].queue)
+            reset(_queues[i].queue);
+    }
+}
+
+void QueueStats::reset(events::EventQueue *queue) {
+    QueueCounters *queueCounters = counters(queue);
+    if (!queueCounters)
+        return;
+    memset(queueCounters->types, 0, sizeof(queueCounters->types));
+    queueCounters->highWater = queueCounters->live;
+}
+
+void QueueStats::dump() {
+    for (unsigned q = 0; q < QUEUE_STATS_QUEUES; q++) {
+        const QueueCounters &queueCounters = _queues[q];
+        if (!queueCounters.queue)
+            continue;
+        printf("event queue %s: depth %lu, high water %lu, %lu failed posts; times in us\r\n",
+               queueCounters.name ? queueCounters.name : "?",
+               (unsigned long)queueCounters.live, (unsigned long)queueCounters.highWater,
+               (unsigned long)failedPosts(queueCounters.queue));
+        printf("%-12s %8s %6s %8s %8s %9s %9s %9s %9s\r\n", "type", "posted", "failed",
+               "deferred", "runs", "lag mean", "lag max", "run mean", "run max");
+        for (unsigned i = 0; i < EVENT_TYPES; i++) {
+            const TypeStats &stats = queueCounters.types[i];
+            if (!stats.posted && !stats.failed && !stats.deferred && !stats.runs)
+                continue;
+            printf("%-12s %8lu %6lu %8lu %8lu %9lu %9lu %9lu %9lu\r\n", typeName((EventType)i),
+                   (unsigned long)stats.posted, (unsigned long)stats.failed,
+                   (unsigned long)stats.deferred, (unsigned long)stats.runs,
+                   (unsigned long)(stats.runs ? stats.totalLagUs / stats.runs : 0),
+                   (unsigned long)stats.maxLagUs,
+                   (unsigned long)(stats.runs ? stats.totalRunUs / stats.runs : 0),
+                   (unsigned long)stats.maxRunUs);
+        }
+    }
+}
+
+#endif
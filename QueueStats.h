@@ -0,0 +1,198 @@
+#ifndef QUEUE_STATS_H
+#define QUEUE_STATS_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+
+/*
+ * Event queue instrumentation. Off by default: with QUEUE_STATS 0 the posting helpers below
+ * forward straight to the queue and nothing is recorded.
+ */
+#ifndef QUEUE_STATS
+#define QUEUE_STATS 0
+#endif
+
+/* Event queues counted separately; posts to any further queue go through uncounted */
+#ifndef QUEUE_STATS_QUEUES
+#define QUEUE_STATS_QUEUES 2
+#endif
+
+/**
+ * Posts events to an EventQueue tagged with what they are for, and keeps for each queue and
+ * type the number of posts, failed posts and deferred events, the dispatch lag (due time to
+ * start of run) and the run time, plus the high-water mark of events held by each queue.
+ *
+ * Every firmware post goes through call(), call_in() or call_every() here, so a queue's depth
+ * is the number of tagged events alive on it: posted and not yet run or cancelled, periodic ones
+ * and the one running included. That is what occupies the queue's allocation, and a failed post
+ * means it ran out. Periodic events are due every period after they are posted; their lag is
+ * taken within the period.
+ *
+ * A queue gets its counters at its first post, or when named with track(). Post counts, depth
+ * and high water are updated atomically, so any thread or interrupt can post; lag and run time
+ * are only written by the thread dispatching the queue.
+ */
+class QueueStats {
+    public:
+        enum EventType {
+            EVENT_BLE,          /* BLE::processEvents */
+            EVENT_INPUT,        /* input edges out of the ring */
+            EVENT_DEBOUNCE,     /* debounce ticks, running the button and hat handlers */
+            EVENT_STICK_POLL,
+            EVENT_REPORT,       /* end of a report coalescing window */
+            EVENT_CONN_PARAMS,
+            EVENT_ADVERTISING,
+            EVENT_SETTINGS,
+            EVENT_BLINK,
+            EVENT_HANDOFF,      /* BLE stack events handed over to the input thread */
+            EVENT_MACRO,        /* input map macro steps */
+            EVENT_OTHER,
+            EVENT_TYPES
+        };
+
+        struct TypeStats {
+            uint32_t posted;
+            uint32_t failed;
+            /** Events that could not be posted and were kept for a later post, see deferred() */
+            uint32_t deferred;
+            uint32_t runs;
+            uint32_t maxLagUs;
+            uint32_t maxRunUs;
+            uint64_t totalLagUs;
+            uint64_t totalRunUs;
+        };
+
+        /* The posting statement ends before posted() so the depth it samples only counts the
+         * queued copy of the event */
+        template <typename F>
+        static int call(events::EventQueue *queue, EventType type, F f) {
+#if QUEUE_STATS
+            QueueCounters *queueCounters = counters(queue);
+            int id = queue->call(Tracked<F>(queueCounters, type, 0, 0, f));
+            return posted(queueCounters, type, id);
+#else
+            return queue->call(f);
+#endif
+        }
+
+        template <typename F>
+        static int call_in(events::EventQueue *queue, EventType type, int ms, F f) {
+#if QUEUE_STATS
+            QueueCounters *queueCounters = counters(queue);
+            int id = queue->call_in(ms, Tracked<F>(queueCounters, type, ms, 0, f));
+            return posted(queueCounters, type, id);
+#else
+            return queue->call_in(ms, f);
+#endif
+        }
+
+        template <typename F>
+        static int call_every(events::EventQueue *queue, EventType type, int ms, F f) {
+#if QUEUE_STATS
+            QueueCounters *queueCounters = counters(queue);
+            int id = queue->call_every(ms, Tracked<F>(queueCounters, type, ms, ms, f));
+            return posted(queueCounters, type, id);
+#else
+            return queue->call_every(ms, f);
+#endif
+        }
+
+        template <typename T, typename R>
+        static int call(events::EventQueue *queue, EventType type, T *obj, R (T::*method)()) {
+            return call(queue, type, mbed::callback(obj, method));
+        }
+
+        template <typename T, typename R>
+        static int call_in(events::EventQueue *queue, EventType type, int ms, T *obj,
+                           R (T::*method)()) {
+            return call_in(queue, type, ms, mbed::callback(obj, method));
+        }
+
+        /** An event of that type could not be posted and was kept to run later, not lost */
+        static void deferred(events::EventQueue *queue, EventType type) {
+#if QUEUE_STATS
+            QueueCounters *queueCounters = counters(queue);
+            if (queueCounters)
+                core_util_atomic_incr_u32(&queueCounters->types[type].deferred, 1);
+#endif
+        }
+
+        /** Name a queue in dump() */
+        static void track(events::EventQueue *queue, const char *name);
+
+        static const TypeStats &stats(events::EventQueue *queue, EventType type);
+
+        /** Events held by the queue now, and at most since the last reset */
+        static uint32_t depth(events::EventQueue *queue);
+        static uint32_t highWater(events::EventQueue *queue);
+        static uint32_t failedPosts(events::EventQueue *queue);
+
+        static const char *typeName(EventType type);
+
+        /** Clear the counters of every queue; depths are kept, as those events are still queued */
+        static void reset();
+        /** Clear the counters of one queue, from the thread dispatching it */
+        static void reset(events::EventQueue *queue);
+
+        /** Print the counters of every queue to the console */
+        static void dump();
+
+    private:
+        struct QueueCounters {
+            events::EventQueue *volatile queue;
+            const char *name;
+            TypeStats types[EVENT_TYPES];
+            volatile uint32_t live;
+            volatile uint32_t highWater;
+        };
+
+        /* Counters of an uncounted queue have nowhere to go: everything is skipped */
+        template <typename F>
+        class Tracked {
+            public:
+                Tracked(QueueCounters *queueCounters, EventType type, int delayMs, int periodMs,
+                        F f)
+                : _f(f), _counters(queueCounters), _type(type),
+                  _dueUs(us_ticker_read() + delayMs * 1000), _periodUs(periodMs * 1000) {
+                    if (_counters)
+                        core_util_atomic_incr_u32(&_counters->live, 1);
+                }
+
+                Tracked(const Tracked &other)
+                : _f(other._f), _counters(other._counters), _type(other._type),
+                  _dueUs(other._dueUs), _periodUs(other._periodUs) {
+                    if (_counters)
+                        core_util_atomic_incr_u32(&_counters->live, 1);
+                }
+
+                ~Tracked() {
+                    if (_counters)
+                        core_util_atomic_decr_u32(&_counters->live, 1);
+                }
+
+                void operator()() {
+                    uint32_t startUs = us_ticker_read();
+                    _f();
+                    if (_counters)
+                        ran(_counters->types[_type], _dueUs, _periodUs, startUs);
+                }
+
+            private:
+                Tracked &operator=(const Tracked &);
+
+                F _f;
+                QueueCounters *_counters;
+                EventType _type;
+                uint32_t _dueUs;
+                uint32_t _periodUs;
+        };
+
+        /** The queue's counters, taking free ones at its first post; NULL once all are taken */
+        static QueueCounters *counters(events::EventQueue *queue);
+        static int posted(QueueCounters *queueCounters, EventType type, int id);
+        static void ran(TypeStats &stats, uint32_t dueUs, uint32_t periodUs, uint32_t startUs);
+
+        static QueueCounters _queues[QUEUE_STATS_QUEUES];
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "StickPoller.h"
+#include "QueueStats.h"
+
+/* Until a connection tells us otherwise, assume the central's usual 7.5 ms interval */
+static const uint16_t DEFAULT_INTERVAL = 6;
+
+StickPoller::StickPoller(events::EventQueue *queue, bool (*poll)())
+: wakeups(0), scheduleFailures(0), startFailures(0), _queue(queue), _poll(poll), _handle(0),
+  _running(false), _startRequested(false), _interval(DEFAULT_INTERVAL),
+  _minMs(STICK_POLL_MIN_MS), _idleMs(STICK_POLL_IDLE_MS), _fastMs(0), _periodMs(0), _stillPolls(0),
+  _secondStart(0), _secondWakeups(0), _lastSecondWakeups(0) {
+    setConnectionInterval(DEFAULT_INTERVAL);
+    _periodMs = _fastMs;
+}
+
+void StickPoller::start() {
+    stop();
+    _periodMs = _fastMs;
+    _stillPolls = 0;
+    _secondStart = us_ticker_read();
+    _secondWakeups = 0;
+    _running = true;
+    schedule();
+}
+
+void StickPoller::stop() {
+    _running = false;
+    _startRequested = false;
+    if (_handle) {
+        _queue->cancel(_handle);
+        _handle = 0;
+    }
+    _lastSecondWakeups = 0;
+}
+
+void StickPoller::requestStart() {
+    _startRequested = true;
+    if (!QueueStats::call(_queue, QueueStats::EVENT_HANDOFF, this, &StickPoller::start)) {
+        startFailures++;
+    }
+}
+
+void StickPoller::resume() {
+    if (_startRequested) {
+        start();
+    } else if (_running && !_handle) {
+        schedule();
+    }
+}
+
+void StickPoller::schedule() {
+    _handle = QueueStats::call_in(_queue, QueueStats::EVENT_STICK_POLL, _periodMs,
+                                  this, &StickPoller::run);
+    if (!_handle) {
+        scheduleFailures++;
+    }
+}
+
+void StickPoller::setConnectionInterval(uint16_t interval) {
+    // Half the interval, in ms: interval * 1.25 / 2
+    _interval = interval;
+    unsigned fastMs = (interval * 5) / 8;
+    if (fastMs < _minMs) {
+        fastMs = _minMs;
+    } else if (fastMs > _idleMs) {
+        fastMs = _idleMs;
+    }
+    _fastMs = fastMs;
+    if (_periodMs < _fastMs) {
+        _periodMs = _fastMs;
+    } else if (_periodMs > _idleMs) {
+        _periodMs = _idleMs;
+    }
+    resume();
+}
+
+void StickPoller::setRates(unsigned minMs, unsigned idleMs) {
+    _minMs = minMs ? minMs : 1;
+    _idleMs = idleMs > _minMs ? idleMs : _minMs;
+    setConnectionInterval(_interval);
+}
+
+void StickPoller::run() {
+    _handle = 0;
+
+    wakeups++;
+    _secondWakeups++;
+    uint32_t now = us_ticker_read();
+    if (now - _secondStart >= 1000000) {
+        _lastSecondWakeups = _secondWakeups;
+        _secondWakeups = 0;
+        _secondStart = now;
+    }
+
+    if (_poll()) {
+        _stillPolls = 0;
+        _periodMs = _fastMs;
+    } else if (++_stillPolls > STICK_POLL_HOLD) {
+        _periodMs *= 2;
+        if (_periodMs > _idleMs) {
+            _periodMs = _idleMs;
+        }
+    }
+
+    schedule();
+}
@@ -0,0 +1,108 @@
+#ifndef STICK_POLLER_H
+#define STICK_POLLER_H
+
+#include "mbed.h"
+#include <events/mbed_events.h>
+
+/* Fastest poll period, and the slowest one the poller backs off to while the sticks are still */
+#ifndef STICK_POLL_MIN_MS
+#define STICK_POLL_MIN_MS 2
+#endif
+#ifndef STICK_POLL_IDLE_MS
+#define STICK_POLL_IDLE_MS 40
+#endif
+
+/* Polls at the fast rate after the last motion before backing off */
+#ifndef STICK_POLL_HOLD
+#define STICK_POLL_HOLD 8
+#endif
+
+/**
+ * Runs a poll function on the event queue at a rate that follows stick motion.
+ *
+ * While the poll function reports motion the poller runs every half connection interval (but
+ * no faster than the minimum period, STICK_POLL_MIN_MS by default), so a fresh sample is ready
+ * for every connection event. Once the sticks have been still for STICK_POLL_HOLD polls the
+ * period doubles on every poll, up to the idle period (STICK_POLL_IDLE_MS).
+ *
+ * Each poll posts the next one. If the queue is out of room for it, polling pauses until
+ * resume() or a rate change gets the post through. The same goes for requestStart() from another
+ * thread: a start it cannot post is made by the next resume() instead.
+ */
+class StickPoller {
+    public:
+        /**
+         * @param poll Samples the sticks; returns true while they are moving
+         */
+        StickPoller(events::EventQueue *queue, bool (*poll)());
+
+        void start();
+        void stop();
+
+        /** Post start() from another thread, e.g. the one handling BLE events */
+        void requestStart();
+
+        /** Start, or post the next poll, if that could not be posted before; cheap when it was */
+        void resume();
+
+        /** Derive the fast period from a connection interval, in 1.25 ms units */
+        void setConnectionInterval(uint16_t interval);
+
+        /** Bound the fast period from below and the idle backoff from above */
+        void setRates(unsigned minMs, unsigned idleMs);
+
+        unsigned minMs() const {
+            return _minMs;
+        }
+
+        unsigned idleMs() const {
+            return _idleMs;
+        }
+
+        /** Current poll period */
+        unsigned periodMs() const {
+            return _periodMs;
+        }
+
+        unsigned fastPeriodMs() const {
+            return _fastMs;
+        }
+
+        /** Polls completed in the last whole second */
+        unsigned wakeupsPerSecond() const {
+            return _lastSecondWakeups;
+        }
+
+        /** Polls since boot */
+        uint32_t wakeups;
+
+        /** Polls that could not be posted, each pausing polling until the next resume() */
+        uint32_t scheduleFailures;
+
+        /** Starts requestStart() could not post, left to the next resume() */
+        volatile uint32_t startFailures;
+
+    private:
+        void run();
+        void schedule();
+
+        events::EventQueue *_queue;
+        bool (*_poll)();
+        int _handle;
+        bool _running;
+        /* Set by requestStart(), cleared by start() and stop() */
+        volatile bool _startRequested;
+
+        uint16_t _interval;
+        unsigned _minMs;
+        unsigned _idleMs;
+        unsigned _fastMs;
+        unsigned _periodMs;
+        unsigned _stillPolls;
+
+        uint32_t _secondStart;
+        unsigned _secondWakeups;
+        unsigned _lastSecondWakeups;
+};
+
+#endif // STICK_POLLER_H
@@ -0,0 +1,144 @@
+#include "StickSampler.h"
+
+/* Fractional bits of report counts, leaving room for full scale in 24 bits */
+static const unsigned FRACTION = 24 - StickSampler::BITS;
+
+/* Quantiser hysteresis, in 1/2^FRACTION report counts */
+static const int32_t HYSTERESIS = 1 << (FRACTION - 2);
+static const int32_t HALF_COUNT = 1 << (FRACTION - 1);
+
+/* Report counts per processed position unit, in fixed point */
+static const int32_t CENTRE_POSITION = StickSampler::CENTRE << FRACTION;
+static const int32_t SCALE_BELOW = (StickSampler::CENTRE << FRACTION) / AxisProcessor::FULL_SCALE;
+static const int32_t SCALE_ABOVE = ((StickSampler::CENTRE - 1) << FRACTION) / AxisProcessor::FULL_SCALE;
+
+static const unsigned CALIBRATION_BURSTS = 16;
+
+StickSampler::StickSampler(AnalogIn *const inputs[AXES])
+: conversions(0), bursts(0), _reported(0), _moving(false) {
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        _inputs[axis] = inputs[axis];
+        _filtered[axis] = 0;
+        _values[axis] = 0;
+    }
+    setOversampling(STICK_OVERSAMPLE_LOG2);
+    setFilter(STICK_FILTER_MIN_SHIFT, STICK_FILTER_MAX_SHIFT, STICK_FILTER_FAST_DELTA);
+    setChangeThreshold(STICK_CHANGE_THRESHOLD);
+}
+
+void StickSampler::setOversampling(unsigned log2) {
+    // Keeps the sum of a burst within 32 bits
+    _oversampleLog2 = log2 > 8 ? 8 : log2;
+}
+
+void StickSampler::setFilter(unsigned minShift, unsigned maxShift, uint16_t fastDelta) {
+    _maxShift = maxShift > 8 ? 8 : maxShift;
+    _minShift = minShift > _maxShift ? _maxShift : minShift;
+    _fastDelta = fastDelta ? fastDelta : 1;
+}
+
+void StickSampler::setChangeThreshold(uint8_t counts) {
+    _threshold = counts ? counts : 1;
+}
+
+void StickSampler::calibrate() {
+    uint32_t sum[AXES] = {0};
+    uint16_t raw[AXES];
+    for (unsigned i = 0; i < CALIBRATION_BURSTS; i++) {
+        burst(raw);
+        for (unsigned axis = 0; axis < AXES; axis++) {
+            sum[axis] += raw[axis];
+        }
+    }
+
+    _reported = 0;
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        _filtered[axis] = (sum[axis] / CALIBRATION_BURSTS) << 8;
+        _processor.setCentre(axis, sum[axis] / CALIBRATION_BURSTS);
+        _values[axis] = CENTRE;
+        _reported |= (uint64_t)lane(CENTRE) << (16 * axis);
+    }
+}
+
+void StickSampler::prime() {
+    uint16_t raw[AXES];
+    burst(raw);
+
+    _reported = 0;
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        _filtered[axis] = raw[axis] << 8;
+        _values[axis] = CENTRE;
+        _reported |= (uint64_t)lane(CENTRE) << (16 * axis);
+    }
+    // A stick held away from its centre at power-up is reported where it is
+    update(raw);
+}
+
+bool StickSampler::sample() {
+    uint16_t raw[AXES];
+    burst(raw);
+    return update(raw);
+}
+
+bool StickSampler::update(const uint16_t raw[AXES]) {
+    uint16_t filtered[AXES];
+    bool fast = false;
+
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        int32_t delta = ((int32_t)raw[axis] << 8) - _filtered[axis];
+        uint32_t speed = (delta < 0 ? -delta : delta) >> 8;
+
+        // Halve the smoothing time constant for every doubling of speed past the fast delta
+        unsigned shift = _maxShift;
+        while (shift > _minShift && speed >= _fastDelta) {
+            shift--;
+            speed >>= 1;
+        }
+        _filtered[axis] += delta >> shift;
+        if (shift < _maxShift) {
+            fast = true;
+        }
+
+        filtered[axis] = _filtered[axis] >> 8;
+    }
+
+    int32_t positions[AXES];
+    _processor.process(filtered, positions);
+
+    uint64_t current = 0;
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        // Report counts in fixed point: 0 at full deflection below, CENTRE centred, 2^BITS - 1 above
+        int32_t position = CENTRE_POSITION + positions[axis] * (positions[axis] < 0 ? SCALE_BELOW : SCALE_ABOVE);
+        int32_t offset = position - ((int32_t)_values[axis] << FRACTION);
+        if (offset > HALF_COUNT + HYSTERESIS || offset < -(HALF_COUNT + HYSTERESIS)) {
+            _values[axis] = (position + HALF_COUNT) >> FRACTION;
+        }
+        current |= (uint64_t)lane(_values[axis]) << (16 * axis);
+    }
+
+    if (!changedLanes(current, _reported, lane(_threshold) ? lane(_threshold) : 1)) {
+        _moving = fast;
+        return false;
+    }
+    _reported = current;
+    _moving = true;
+    return true;
+}
+
+void StickSampler::burst(uint16_t raw[AXES]) {
+    uint32_t sum[AXES] = {0};
+    unsigned count = 1 << _oversampleLog2;
+
+    // Interleave the axes so that each average spans the whole burst
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned axis = 0; axis < AXES; axis++) {
+            sum[axis] += _inputs[axis]->read_u16();
+        }
+    }
+    for (unsigned axis = 0; axis < AXES; axis++) {
+        raw[axis] = sum[axis] >> _oversampleLog2;
+    }
+
+    conversions += count * AXES;
+    bursts++;
+}
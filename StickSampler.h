@@ -0,0 +1,168 @@
+#ifndef STICK_SAMPLER_H
+#define STICK_SAMPLER_H
+
+#include "mbed.h"
+#include "AxisProcessor.h"
+
+/* Conversions averaged per axis per burst, as a power of two */
+#ifndef STICK_OVERSAMPLE_LOG2
+#define STICK_OVERSAMPLE_LOG2 2
+#endif
+
+/*
+ * Filter smoothing as IIR shifts: MAX_SHIFT while the stick is still, easing towards MIN_SHIFT
+ * as it moves faster than FAST_DELTA (16-bit ADC units per burst)
+ */
+#ifndef STICK_FILTER_MIN_SHIFT
+#define STICK_FILTER_MIN_SHIFT 0
+#endif
+#ifndef STICK_FILTER_MAX_SHIFT
+#define STICK_FILTER_MAX_SHIFT 2
+#endif
+#ifndef STICK_FILTER_FAST_DELTA
+#define STICK_FILTER_FAST_DELTA 512
+#endif
+
+/*
+ * Resolution of the reported axes in bits, 8 to 16. The standard report carries 8; the extended
+ * report (JOYSTICK_EXTENDED_REPORT) defaults to 12, about what the ADC resolves after averaging
+ */
+#ifndef STICK_REPORT_BITS
+#if JOYSTICK_EXTENDED_REPORT
+#define STICK_REPORT_BITS 12
+#else
+#define STICK_REPORT_BITS 8
+#endif
+#endif
+
+/*
+ * Smallest change of any axis, in report counts, that makes a new report. Wide axes default to a
+ * quarter of an 8-bit count, as their single counts are mostly ADC noise
+ */
+#ifndef STICK_CHANGE_THRESHOLD
+#if STICK_REPORT_BITS > 10
+#define STICK_CHANGE_THRESHOLD (1 << (STICK_REPORT_BITS - 10))
+#else
+#define STICK_CHANGE_THRESHOLD 1
+#endif
+#endif
+
+/**
+ * Acquisition pipeline for the four stick axes.
+ *
+ * Each sample() takes a burst of 16-bit conversions of every axis, interleaved, and averages
+ * them. The result goes through a fixed-point IIR filter whose smoothing adapts to speed in
+ * the manner of a one-euro filter: heavy while the stick is still, to remove ADC noise, and
+ * lighter as it moves, to limit lag. An AxisProcessor then applies calibration, deadzone and
+ * response curve. Outputs are quantised to STICK_REPORT_BITS report counts with a quarter count
+ * of hysteresis so a value near a boundary does not flicker, then compared with the last
+ * reported values for all four axes at once.
+ */
+class StickSampler {
+    public:
+        static const unsigned AXES = 4;
+        static const unsigned BITS = STICK_REPORT_BITS;
+        /** Output at rest; 0 and 2^BITS - 1 at full deflection */
+        static const uint16_t CENTRE = 1 << (BITS - 1);
+
+        static_assert(BITS >= 8 && BITS <= 16, "stick report resolution is 8 to 16 bits");
+
+        StickSampler(AnalogIn *const inputs[AXES]);
+
+        void setOversampling(unsigned log2);
+        void setFilter(unsigned minShift, unsigned maxShift, uint16_t fastDelta);
+        void setChangeThreshold(uint8_t counts);
+
+        /**
+         * Average several bursts, take them as the centre position (reported as CENTRE) and
+         * reset the filter
+         */
+        void calibrate();
+
+        /**
+         * Start the filter from one burst, keeping the calibration; used when the centres were
+         * restored rather than sampled
+         */
+        void prime();
+
+        /** Calibration, deadzone and response curve */
+        AxisProcessor &processor() {
+            return _processor;
+        }
+
+        /**
+         * Sample and filter all axes
+         *
+         * @return true if an axis moved by at least the change threshold since the values
+         *         last reported true
+         */
+        bool sample();
+
+        /** Filter one set of averaged 16-bit readings; the second half of sample() */
+        bool update(const uint16_t raw[AXES]);
+
+        /**
+         * True if the last update changed an output or had to follow faster than the fast
+         * delta, i.e. the stick is in motion rather than resting under noise
+         */
+        bool moving() const {
+            return _moving;
+        }
+
+        /** Current outputs, 0 to 2^BITS - 1 per axis in report order */
+        const uint16_t *values() const {
+            return _values;
+        }
+
+        /**
+         * Compare four 16-bit lanes holding values 0-32767 in one pass
+         *
+         * @return Lanes (bit 15 of each) where current and previous differ by at least threshold
+         */
+        static uint64_t changedLanes(uint64_t current, uint64_t previous, uint8_t threshold) {
+            const uint64_t high = 0x8000800080008000ULL;
+            uint64_t limit = threshold * 0x0001000100010001ULL;
+
+            // Each lane becomes 0x8000 + difference, 1 to 0xFFFF for 15-bit values: no borrow
+            uint64_t up = (current | high) - previous;
+            uint64_t down = (previous | high) - current;
+            // Subtracting the threshold could borrow from the next lane after a near full-scale
+            // swing the other way; redone with bit 15 set it cannot, and the lanes that had it
+            // clear went the other way and are masked out
+            up = ((up | high) - limit) & up;
+            down = ((down | high) - limit) & down;
+            return (up | down) & high;
+        }
+
+        /**
+         * Value of an axis in changedLanes() lanes, which hold 15 bits: at 16-bit resolution
+         * changes are compared to within two counts
+         */
+        static uint16_t lane(uint16_t value) {
+            return value >> (BITS > 15 ? BITS - 15 : 0);
+        }
+
+        /** ADC conversions and bursts taken */
+        uint32_t conversions;
+        uint32_t bursts;
+
+    private:
+        void burst(uint16_t raw[AXES]);
+
+        AnalogIn *_inputs[AXES];
+        unsigned _oversampleLog2;
+        unsigned _minShift;
+        unsigned _maxShift;
+        uint16_t _fastDelta;
+        uint8_t _threshold;
+
+        /* Filter state, 16-bit readings with 8 fractional bits */
+        int32_t _filtered[AXES];
+        AxisProcessor _processor;
+
+        uint16_t _values[AXES];
+        uint64_t _reported;
+        bool _moving;
+};
+
+#endif // STICK_SAMPLER_H
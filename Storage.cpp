@@ -0,0 +1,36 @@
+#include "Storage.h"
+
+#if STORAGE_BACKEND == STORAGE_FLASHIAP
+#include "FlashIAP.h"
+#include "FlashIAPBlockDevice.h"
+
+#if defined(MBED_ROM_START) && defined(MBED_ROM_SIZE)
+static_assert(STORAGE_FLASH_ADDRESS >= MBED_ROM_START &&
+              STORAGE_FLASH_ADDRESS + STORAGE_FLASH_SIZE <= MBED_ROM_START + MBED_ROM_SIZE,
+              "STORAGE_FLASH region outside flash");
+#endif
+#if defined(MBED_APP_START) && defined(MBED_APP_SIZE)
+static_assert(STORAGE_FLASH_ADDRESS >= MBED_APP_START + MBED_APP_SIZE ||
+              STORAGE_FLASH_ADDRESS + STORAGE_FLASH_SIZE <= MBED_APP_START,
+              "STORAGE_FLASH region overlaps the application region");
+#endif
+
+static FlashIAPBlockDevice device(STORAGE_FLASH_ADDRESS, STORAGE_FLASH_SIZE);
+#elif STORAGE_BACKEND == STORAGE_HOST_FILE
+#include "FileBlockDevice.h"
+static FileBlockDevice device(STORAGE_HOST_PATH, STORAGE_SIZE);
+#else
+#include "HeapBlockDevice.h"
+static HeapBlockDevice device(STORAGE_SIZE, 512);
+#endif
+
+BlockDevice *storage_device() {
+#if STORAGE_BACKEND == STORAGE_FLASHIAP
+    /* Only the linker knows where the image ends; formatting over it would erase the code */
+    if (STORAGE_FLASH_ADDRESS < FLASHIAP_APP_ROM_END_ADDR) {
+        error("error: storage at 0x%lx overlaps the image, which ends at 0x%lx\n",
+              (unsigned long)STORAGE_FLASH_ADDRESS, (unsigned long)FLASHIAP_APP_ROM_END_ADDR);
+    }
+#endif
+    return &device;
+}
@@ -0,0 +1,45 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "mbed.h"
+#include "BlockDevice.h"
+
+/* Block devices that can hold the file system */
+#define STORAGE_HEAP        0
+#define STORAGE_FLASHIAP    1
+#define STORAGE_HOST_FILE   2
+
+/*
+ * Where /fs lives: internal flash on target, so bonds and settings survive a reset. The heap
+ * device loses everything at reset; the host file device exists in the simulator only.
+ */
+#ifndef STORAGE_BACKEND
+#define STORAGE_BACKEND STORAGE_FLASHIAP
+#endif
+
+/*
+ * Flash region for STORAGE_FLASHIAP, from flashiap-block-device.base-address and .size in
+ * mbed_app.json: the top 32 KB (eight 4 KB pages) of the nRF52832. Storage.cpp checks at build
+ * time that it lies within flash and past any configured application region, and at startup
+ * that it starts after the end of the image.
+ */
+#ifndef STORAGE_FLASH_ADDRESS
+#define STORAGE_FLASH_ADDRESS MBED_CONF_FLASHIAP_BLOCK_DEVICE_BASE_ADDRESS
+#endif
+#ifndef STORAGE_FLASH_SIZE
+#define STORAGE_FLASH_SIZE MBED_CONF_FLASHIAP_BLOCK_DEVICE_SIZE
+#endif
+
+/* Size of the STORAGE_HEAP and STORAGE_HOST_FILE devices */
+#ifndef STORAGE_SIZE
+#define STORAGE_SIZE 8192
+#endif
+
+#ifndef STORAGE_HOST_PATH
+#define STORAGE_HOST_PATH "gamepad-flash.bin"
+#endif
+
+/** The block device selected by STORAGE_BACKEND; halts if its flash region overlaps the image */
+BlockDevice *storage_device();
+
+#endif // STORAGE_H
@@ -0,0 +1,99 @@
+#include "TriggerSampler.h"
+
+/* Quantiser hysteresis and rounding, in 1/65536 report counts */
+static const uint32_t HYSTERESIS = 1 << 14;
+static const uint32_t HALF_COUNT = 1 << 15;
+
+static const unsigned CALIBRATION_BURSTS = 16;
+
+TriggerSampler::TriggerSampler(AnalogIn *const inputs[TRIGGERS]) : conversions(0), _moving(false) {
+    for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+        _inputs[trigger] = inputs[trigger];
+        _start[trigger] = TRIGGER_DEADZONE;
+        _scale[trigger] = ((uint32_t)MAX << 16) / (TRIGGER_FULL_READING - TRIGGER_DEADZONE);
+        _values[trigger] = 0;
+        _filtered[trigger] = 0;
+    }
+    setChangeThreshold(TRIGGER_CHANGE_THRESHOLD);
+}
+
+void TriggerSampler::setChangeThreshold(uint16_t counts) {
+    _step = ((uint32_t)(counts ? counts - 1 : 0) << 16) + HALF_COUNT + HYSTERESIS;
+}
+
+void TriggerSampler::calibrate() {
+    uint32_t sum[TRIGGERS] = {0};
+    unsigned count = CALIBRATION_BURSTS << TRIGGER_OVERSAMPLE_LOG2;
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+            sum[trigger] += _inputs[trigger]->read_u16();
+        }
+    }
+    conversions += count * TRIGGERS;
+
+    for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+        uint32_t start = sum[trigger] / count + TRIGGER_DEADZONE;
+        // A trigger resting near the top still gets some travel
+        if (start > TRIGGER_FULL_READING - 256) {
+            start = TRIGGER_FULL_READING - 256;
+        }
+        _start[trigger] = start;
+        _scale[trigger] = ((uint32_t)MAX << 16) / (TRIGGER_FULL_READING - start);
+        _filtered[trigger] = (sum[trigger] / count) << 8;
+        _values[trigger] = 0;
+    }
+}
+
+bool TriggerSampler::sample() {
+    uint32_t sum[TRIGGERS] = {0};
+    unsigned count = 1 << TRIGGER_OVERSAMPLE_LOG2;
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+            sum[trigger] += _inputs[trigger]->read_u16();
+        }
+    }
+    conversions += count * TRIGGERS;
+
+    uint16_t raw[TRIGGERS];
+    for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+        raw[trigger] = sum[trigger] >> TRIGGER_OVERSAMPLE_LOG2;
+    }
+    return update(raw);
+}
+
+bool TriggerSampler::update(const uint16_t raw[TRIGGERS]) {
+    bool changed = false;
+    bool fast = false;
+    for (unsigned trigger = 0; trigger < TRIGGERS; trigger++) {
+        // Same smoothing as the sticks: heavy at rest, lighter the faster the trigger moves
+        int32_t delta = ((int32_t)raw[trigger] << 8) - _filtered[trigger];
+        uint32_t speed = (delta < 0 ? -delta : delta) >> 8;
+        unsigned shift = STICK_FILTER_MAX_SHIFT;
+        while (shift > STICK_FILTER_MIN_SHIFT && speed >= STICK_FILTER_FAST_DELTA) {
+            shift--;
+            speed >>= 1;
+        }
+        _filtered[trigger] += delta >> shift;
+        if (shift < STICK_FILTER_MAX_SHIFT) {
+            fast = true;
+        }
+
+        uint16_t reading = _filtered[trigger] >> 8;
+        uint32_t travel = reading > _start[trigger] ? reading - _start[trigger] : 0;
+        // Report counts in 16.16 fixed point
+        uint64_t position = (uint64_t)travel * _scale[trigger];
+        if (position > (uint64_t)MAX << 16) {
+            position = (uint64_t)MAX << 16;
+        }
+        int64_t offset = (int64_t)position - ((int64_t)_values[trigger] << 16);
+        // The ends are always reached, so released reads exactly 0
+        bool end = (position == 0 || position == (uint64_t)MAX << 16) &&
+                   position != (uint64_t)_values[trigger] << 16;
+        if (end || offset > _step || offset < -(int64_t)_step) {
+            _values[trigger] = (position + HALF_COUNT) >> 16;
+            changed = true;
+        }
+    }
+    _moving = changed || fast;
+    return changed;
+}
@@ -0,0 +1,97 @@
+#ifndef TRIGGER_SAMPLER_H
+#define TRIGGER_SAMPLER_H
+
+#include "mbed.h"
+#include "StickSampler.h"
+
+/* Resolution of the reported triggers in bits, 8 to 16 */
+#ifndef TRIGGER_REPORT_BITS
+#define TRIGGER_REPORT_BITS 12
+#endif
+
+/* Smallest change of a trigger, in report counts, that makes a new report; as for the sticks */
+#ifndef TRIGGER_CHANGE_THRESHOLD
+#if TRIGGER_REPORT_BITS > 10
+#define TRIGGER_CHANGE_THRESHOLD (1 << (TRIGGER_REPORT_BITS - 10))
+#else
+#define TRIGGER_CHANGE_THRESHOLD 1
+#endif
+#endif
+
+/* Conversions averaged per trigger per burst, as a power of two */
+#ifndef TRIGGER_OVERSAMPLE_LOG2
+#define TRIGGER_OVERSAMPLE_LOG2 2
+#endif
+
+/*
+ * Travel past the rest position that still reads as released, and the reading when fully
+ * pulled, in 16-bit ADC units
+ */
+#ifndef TRIGGER_DEADZONE
+#define TRIGGER_DEADZONE 1024
+#endif
+#ifndef TRIGGER_FULL_READING
+#define TRIGGER_FULL_READING 0xFF00
+#endif
+
+/**
+ * Acquisition of the two analog triggers of the extended report.
+ *
+ * Triggers are sprung, so the rest position is taken afresh by calibrate() at every boot
+ * instead of being stored. Each sample() averages a burst of conversions per trigger, smooths it
+ * with the sticks' adaptive IIR filter (STICK_FILTER_*) and maps the travel from rest + TRIGGER_DEADZONE to TRIGGER_FULL_READING onto 0 to 2^BITS - 1. An output
+ * follows once it is off by the change threshold plus a quarter count of hysteresis, except that
+ * the ends are always reached.
+ */
+class TriggerSampler {
+    public:
+        static const unsigned TRIGGERS = 2;
+        static const unsigned BITS = TRIGGER_REPORT_BITS;
+        static const uint16_t MAX = (1UL << BITS) - 1;
+
+        static_assert(BITS >= 8 && BITS <= 16, "trigger report resolution is 8 to 16 bits");
+
+        TriggerSampler(AnalogIn *const inputs[TRIGGERS]);
+
+        void setChangeThreshold(uint16_t counts);
+
+        /** Take the current readings as released */
+        void calibrate();
+
+        /**
+         * Sample both triggers
+         *
+         * @return true if either output changed
+         */
+        bool sample();
+
+        /** Map one averaged 16-bit reading of each trigger; the second half of sample() */
+        bool update(const uint16_t raw[TRIGGERS]);
+
+        /** True if the last update changed an output or the filter had to follow fast */
+        bool moving() const {
+            return _moving;
+        }
+
+        /** Current outputs, 0 released to MAX fully pulled, in report order */
+        const uint16_t *values() const {
+            return _values;
+        }
+
+        /** ADC conversions taken */
+        uint32_t conversions;
+
+    private:
+        AnalogIn *_inputs[TRIGGERS];
+        /* Reading where travel starts, and MAX / travel in 16.16 fixed point */
+        uint16_t _start[TRIGGERS];
+        uint32_t _scale[TRIGGERS];
+        /* Filter state, 16-bit readings with 8 fractional bits */
+        int32_t _filtered[TRIGGERS];
+        bool _moving;
+        uint16_t _values[TRIGGERS];
+        /* Offset from an output that moves it, in 16.16 fixed point */
+        uint32_t _step;
+};
+
+#endif // TRIGGER_SAMPLER_H
@@ -19,113 +19,121 @@
 #include "ble/BLE.h"
 #include "SecurityManager.h"
 #include "LittleFileSystem.h"
+#include "Storage.h"
 
 #include "JoystickService.h"
 #include "HatButton.h"
+#include "HatResolver.h"
+#include "InputMap.h"
+#include "StickSampler.h"
+#include "TriggerSampler.h"
+#include "StickPoller.h"
+#include "ConfigStore.h"
+#include "Advertiser.h"
+#include "ConnParamManager.h"
+#include "LatencyTrace.h"
+#include "QueueStats.h"
 
 JoystickService *hidServicePtr;
-uint8_t _hidReport[6] = {0};
+JoystickPacker &_hidReport = JoystickService::packer();
+
+/*
+ * Input handling and reports run on their own queue and thread, above the one processing BLE
+ * events, so a burst of stack events cannot hold up a button. BLE, advertising, storage and the
+ * console stay on queue; the handoff points into the gamepad service are the stack events it
+ * copies onto the input queue (see HIDServiceBase::setEventQueue()) and the posts below.
+ * INPUT_THREAD 0 keeps everything on queue, dispatched by main().
+ */
+#ifndef INPUT_THREAD
+#define INPUT_THREAD 1
+#endif
+
+#ifndef INPUT_THREAD_STACK_SIZE
+#define INPUT_THREAD_STACK_SIZE 2048
+#endif
 
 events::EventQueue queue;
+#if INPUT_THREAD
+events::EventQueue inputEvents;
+Thread inputThread(osPriorityHigh, INPUT_THREAD_STACK_SIZE, NULL, "input");
+events::EventQueue &inputQueue = inputEvents;
+#else
+events::EventQueue &inputQueue = queue;
+#endif
 
 static const uint8_t DEVICE_NAME[] = "Gamepad";
-static const uint8_t MIN_AXES_DELTA = 5;
 
-HeapBlockDevice hbd(8192, 512);
 LittleFileSystem fs("fs");
 DigitalOut led(LED1);
+/* player indicator and rumble motors, driven by the host through the output report */
+DigitalOut player_led(LED2);
+PwmOut rumble_left(P0_9);
+PwmOut rumble_right(P0_10);
 
 AnalogIn a_x0(A5);
 AnalogIn a_y0(A4);
 AnalogIn a_x1(A3);
 AnalogIn a_y1(A2);
+#if JOYSTICK_EXTENDED_REPORT
+AnalogIn a_lt(A0);
+AnalogIn a_rt(A1);
+#endif
 
-bool hatButtonState[4] = {false};
-
-enum HatDirection {
-    DIR_IDLE = -1,
-    DIR_UP,
-    DIR_UP_RIGHT,
-    DIR_RIGHT,
-    DIR_DOWN_RIGHT,
-    DIR_DOWN,
-    DIR_DOWN_LEFT,
-    DIR_LEFT,
-    DIR_UP_LEFT,
-};
+/* up, right, down and left buttons to the hat switch, opposing directions per HAT_SOCD_POLICY */
+HatResolver hatResolver;
+
+/* the sticks, sampled by read_analog_sticks() at a rate following their motion */
+bool read_analog_sticks();
+StickPoller stickPoller(&inputQueue, &read_analog_sticks);
 
 void update_button() {
+    TRACE_POINT(UPDATE);
     if (hidServicePtr) {
-        hidServicePtr->copyReport(_hidReport);
-        hidServicePtr->sendCallback();
+        hidServicePtr->buttonsChanged();
+    }
+}
+
+void update_axes() {
+    if (hidServicePtr) {
+        hidServicePtr->axesChanged();
+    }
+}
+
+/** Buttons 0-11 and the hat directions after them, as remapped by the input map */
+void update_output(unsigned output, bool pressed) {
+    if (output < HatButton::INPUT_BASE) {
+        _hidReport.setButton(output, pressed);
+    } else {
+        _hidReport.setHat(hatResolver.update(output - HatButton::INPUT_BASE, pressed));
     }
+    update_button();
+    /* a poll the input queue had no room for is posted again on the next edge */
+    stickPoller.resume();
 }
 
-int8_t hatDirection = DIR_IDLE;
+/* physical inputs to report buttons and hat, per the profile loaded at boot */
+InputMap inputMap(&inputQueue, &update_output);
 
-class Button : public InterruptIn {
+class Button : public InputPin {
     public:
         Button(PinName pin, unsigned int btnNumber)
-        : InterruptIn(pin, PullUp), _btnNumber(btnNumber), _btnOffset(_btnNumber % 8) {
-            if (_btnNumber <= 7) {
-                _reportIndex = 0;
-            } else {
-                _reportIndex = 1;
-            }
-
-            this->rise(queue.event(this, &Button::onRise));
-            this->fall(queue.event(this, &Button::onFall));
+        : InputPin(pin, btnNumber), _btnNumber(btnNumber) {
         }
 
         virtual void onRise() {
-            // TODO deibounce
-            _hidReport[_reportIndex] &= ~(1 << _btnOffset);
-            update_button();
+            inputMap.input(_btnNumber, false);
         }
 
         virtual void onFall() {
-            // TODO debounce
-            _hidReport[_reportIndex] |= 1 << _btnOffset;
-            update_button();
+            inputMap.input(_btnNumber, true);
         }
 
     protected:
         unsigned int _btnNumber;
-        unsigned int _btnOffset;
-        unsigned int _reportIndex;
 };
 
 void update_hat_direction(HatButton::Direction dir, bool pressed) {
-
-    hatButtonState[dir] = pressed;
-
-    if (hatButtonState[HatButton::UP]) {
-        if (hatButtonState[HatButton::RIGHT]) {
-            hatDirection = DIR_UP_RIGHT;
-        } else if (hatButtonState[HatButton::LEFT]) {
-            hatDirection = DIR_UP_LEFT;
-        } else {
-            hatDirection = DIR_UP;
-        }
-    } else if (hatButtonState[HatButton::DOWN]) {
-        if (hatButtonState[HatButton::RIGHT]) {
-            hatDirection = DIR_DOWN_RIGHT;
-        } else if (hatButtonState[HatButton::LEFT]) {
-            hatDirection = DIR_DOWN_LEFT;
-        } else {
-            hatDirection = DIR_DOWN;
-        }
-    } else if (hatButtonState[HatButton::LEFT]) {
-        hatDirection = DIR_LEFT;
-    } else if (hatButtonState[HatButton::RIGHT]) {
-        hatDirection = DIR_RIGHT;
-    } else {
-        hatDirection = DIR_IDLE;
-    }
-
-    // TODO debounce
-    _hidReport[1] = (hatDirection & 0xF) << 4;
-    queue.call(update_button);
+    inputMap.input(HatButton::INPUT_BASE + dir, pressed);
 }
 
 Button btn0(P0_11, 0);
@@ -143,45 +151,207 @@ HatButton hat3(P0_25, HatButton::LEFT, &update_hat_direction);
 
 
 AnalogIn *axes[] = { &a_x0, &a_y0, &a_x1, &a_y1 };
-uint8_t axes_initial[4];
-uint8_t axes_previous[4];
-
+StickSampler sticks(axes);
+static_assert(JoystickPacker::AXES == StickSampler::AXES, "one report axis per stick axis");
+static_assert(JoystickPacker::AXIS_BITS == StickSampler::BITS, "sticks sampled at report resolution");
+
+#if JOYSTICK_EXTENDED_REPORT
+AnalogIn *triggerInputs[] = { &a_lt, &a_rt };
+TriggerSampler triggers(triggerInputs);
+static_assert(JoystickPacker::TRIGGERS == TriggerSampler::TRIGGERS, "one report trigger per input");
+static_assert(JoystickPacker::TRIGGER_BITS == TriggerSampler::BITS, "triggers sampled at report resolution");
+#endif
+
+bool read_analog_sticks() {
+    bool changed = sticks.sample();
+    bool moving = sticks.moving();
+    if (changed) {
+        _hidReport.setAxes(sticks.values());
+    }
+#if JOYSTICK_EXTENDED_REPORT
+    /* triggers share the stick poll, and keep it fast while they move */
+    if (triggers.sample()) {
+        _hidReport.setTriggers(triggers.values());
+        changed = true;
+    }
+    moving = moving || triggers.moving();
+#endif
+    if (changed) {
+        update_axes();
+    }
+    /* the poll runs at least every idle period, often enough to time keep-alives */
+    if (hidServicePtr) {
+        hidServicePtr->keepAlive();
+    }
+    return moving;
+}
 
-const uint8_t AXIS_MAX = 255;
+/* 7.5 ms connection interval while playing, relaxed with slave latency when left alone */
+ConnParamManager connParams(&inputQueue);
 
-unsigned int map(unsigned int x, unsigned int in_min, unsigned int in_max, unsigned int out_min, unsigned int out_max) {
-    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+/** Poll the sticks in step with the connection events */
+void set_poll_interval(uint16_t interval) {
+    stickPoller.setConnectionInterval(interval);
 }
 
-uint8_t read_initial_axis(unsigned int axis) {
-    return axes[axis]->read() * AXIS_MAX;
+/* input map profile in use; without a valid profile<n>.map the layout is the identity */
+uint8_t inputProfile = 0;
+
+void load_input_profile(uint8_t profile) {
+    char path[20];
+    snprintf(path, sizeof(path), "profile%u.map", profile);
+    inputProfile = profile;
+    InputProfile layout;
+    if (InputMap::load(&fs, path, &layout) && !inputMap.compile(layout)) {
+        printf("Invalid input profile %s\r\n", path);
+    }
 }
 
-uint8_t read_axis(unsigned int axis) {
-    uint8_t val = axes[axis]->read() * AXIS_MAX;
-    return 128 + (val - axes_initial[axis]);
-    //return map(val, 50, 220, 0, AXIS_MAX);
+/* calibration and tuning, restored at boot so the sticks need not be centred at power up */
+ConfigStore settingsStore(&queue, &fs, "gamepad.cfg");
+
+void capture_settings(GamepadSettings *settings) {
+    AxisProcessor &processor = sticks.processor();
+    for (unsigned axis = 0; axis < GamepadSettings::AXES; axis++) {
+        processor.calibration(axis, &settings->axisMin[axis], &settings->axisCentre[axis],
+                              &settings->axisMax[axis]);
+    }
+    settings->deadzone = processor.deadzone();
+    settings->curve = processor.curve();
+    settings->pollMinMs = stickPoller.minMs();
+    settings->pollIdleMs = stickPoller.idleMs();
+    settings->profile = inputProfile;
+    for (unsigned input = 0; input < GamepadSettings::INPUTS; input++) {
+        settings->setTicks(input, InputPin::debouncer.ticks(input));
+    }
 }
 
-int update_handle;
-
-void read_analog_sticks() {
-    int val;
-    bool update = false;
-    for (unsigned int i = 0; i < 4; i++) {
-        val = read_axis(i);
-        if (abs((int)axes_previous[i] - val) >= MIN_AXES_DELTA) {
-            _hidReport[2 + i] = val;
-            axes_previous[i] = val;
-            update = true;
+void apply_settings(const GamepadSettings &settings) {
+    AxisProcessor &processor = sticks.processor();
+    for (unsigned axis = 0; axis < GamepadSettings::AXES; axis++) {
+        if (!processor.setCalibration(axis, settings.axisMin[axis], settings.axisCentre[axis],
+                                      settings.axisMax[axis])) {
+            printf("Axis %u calibration too narrow, widened\r\n", axis);
         }
     }
+    processor.setDeadzone(settings.deadzone);
+    processor.setCurve((AxisProcessor::Curve)settings.curve);
+    stickPoller.setRates(settings.pollMinMs, settings.pollIdleMs);
+    for (unsigned input = 0; input < GamepadSettings::INPUTS; input++) {
+        if (settings.ticks(input)) {
+            InputPin::setDebounceTicks(input, settings.ticks(input));
+        }
+    }
+}
 
-    if (update) {
-        queue.call(update_button);
+/**
+ * Call after changing any tuning, from the thread owning the input state; the record is rewritten
+ * lazily, and only if it differs
+ */
+void settings_changed() {
+    GamepadSettings settings;
+    capture_settings(&settings);
+    /* the store belongs to the main queue; with that full, capture again a little later */
+    int id = QueueStats::call(&queue, QueueStats::EVENT_SETTINGS, [settings]() {
+        settingsStore.requestSave(settings);
+    });
+    if (!id) {
+        QueueStats::call_in(&inputQueue, QueueStats::EVENT_SETTINGS, CONFIG_SAVE_DELAY_MS,
+                            &settings_changed);
     }
 }
 
+/** Fill in the parts of a tuning that live outside the gamepad service */
+void capture_tuning(JoystickTuning *tuning) {
+    tuning->pollMinMs = stickPoller.minMs();
+    tuning->pollIdleMs = stickPoller.idleMs();
+    tuning->debounceMs = InputPin::debouncer.ticks(0) * INPUT_DEBOUNCE_TICK_MS;
+}
+
+/** A tuning written by the host: takes effect now, and is stored like any other setting */
+void apply_tuning(JoystickTuning *tuning) {
+    stickPoller.setRates(tuning->pollMinMs, tuning->pollIdleMs);
+    unsigned ticks = tuning->debounceMs / INPUT_DEBOUNCE_TICK_MS;
+    ticks = ticks < 1 ? 1 : (ticks > 15 ? 15 : ticks);
+    for (unsigned input = 0; input < GamepadSettings::INPUTS; input++) {
+        InputPin::setDebounceTicks(input, ticks);
+    }
+    capture_tuning(tuning);
+    settings_changed();
+}
+
+int rumble_stop_handle = 0;
+
+void stop_rumble() {
+    if (rumble_stop_handle) {
+        inputQueue.cancel(rumble_stop_handle);
+        rumble_stop_handle = 0;
+    }
+    rumble_left = 0.0f;
+    rumble_right = 0.0f;
+}
+
+void apply_output(const JoystickOutput &output) {
+    stop_rumble();
+    rumble_left = output.rumbleLeft / 255.0f;
+    rumble_right = output.rumbleRight / 255.0f;
+    if (output.rumbleTicks && (output.rumbleLeft || output.rumbleRight)) {
+        rumble_stop_handle = QueueStats::call_in(&inputQueue, QueueStats::EVENT_OTHER,
+                                                 output.rumbleTicks * 10, []() {
+            rumble_stop_handle = 0;
+            stop_rumble();
+        });
+    }
+    player_led = output.leds & 1;
+}
+
+#if LATENCY_TRACE || QUEUE_STATS
+/* 'd' on the console prints the latency histograms, 'q' the event queue counters, 'r' clears
+ * them all */
+RawSerial console(USBTX, USBRX, 115200);
+
+#if QUEUE_STATS && INPUT_THREAD
+/* Each queue's counters are cleared by the thread dispatching it */
+void reset_input_queue_stats() {
+    QueueStats::reset(&inputQueue);
+}
+#endif
+
+void reset_stats() {
+#if LATENCY_TRACE
+    LatencyTrace::reset();
+#endif
+#if QUEUE_STATS
+    QueueStats::reset(&queue);
+#if INPUT_THREAD
+    QueueStats::call(&inputQueue, QueueStats::EVENT_OTHER, &reset_input_queue_stats);
+#endif
+#endif
+}
+
+void on_console_rx() {
+    while (console.readable()) {
+        int c = console.getc();
+#if LATENCY_TRACE
+        if (c == 'd') {
+            QueueStats::call(&queue, QueueStats::EVENT_OTHER, &LatencyTrace::dump);
+        }
+#endif
+#if QUEUE_STATS
+        if (c == 'q') {
+            QueueStats::call(&queue, QueueStats::EVENT_OTHER, &QueueStats::dump);
+        }
+#endif
+        if (c == 'r') {
+            QueueStats::call(&queue, QueueStats::EVENT_OTHER, &reset_stats);
+        }
+    }
+}
+#endif
+
+/* fast, then slow advertising until a host connects */
+Advertiser advertiser(&queue);
+
 void blink(void) {
     led = !led;
 }
@@ -210,8 +380,6 @@ public:
         } else {
             printf("Pairing failed\r\n");
         }
-
-        update_handle = queue.call_every(40, &read_analog_sticks);
     }
 
     /** Inform the application of change in encryption status. This will be
@@ -227,6 +395,14 @@ public:
         } else if (result == ble::link_encryption_t::NOT_ENCRYPTED) {
             printf("Link NOT_ENCRYPTED\r\n");
         }
+
+        /* the host subscribes once the link is secure, whether freshly paired or re-encrypted
+         * with a stored bond */
+        if (result == ble::link_encryption_t::ENCRYPTED ||
+                result == ble::link_encryption_t::ENCRYPTED_WITH_MITM) {
+            /* with the input queue full, the next input edge or interval change starts it */
+            stickPoller.requestStart();
+        }
     }
 };
 
@@ -234,7 +410,8 @@ SMDevice securityManagerEventHandler;
 
 /** Schedule processing of events from the BLE in the event queue. */
 void schedule_ble_events(BLE::OnEventsToProcessCallbackContext *context) {
-    queue.call(mbed::callback(&context->ble, &BLE::processEvents));
+    QueueStats::call(&queue, QueueStats::EVENT_BLE,
+                     mbed::callback(&context->ble, &BLE::processEvents));
 }
 
 /** End demonstration unexpectedly. Called if timeout is reached during advertising,
@@ -250,6 +427,8 @@ void on_connect(const Gap::ConnectionCallbackParams_t *connection_event) {
     BLE& ble = BLE::Instance();
     ble_error_t error;
 
+    advertiser.connected();
+
     /* Request a change in link security. This will be done
      * indirectly by asking the master of the connection to
      * change it. Depending on circumstances different actions
@@ -266,19 +445,19 @@ void on_connect(const Gap::ConnectionCallbackParams_t *connection_event) {
     }
 };
 
+/* Runs on the input thread, which owns the stick poller and the rumble timer */
+void stop_input() {
+    stickPoller.stop();
+    /* the host is not there to stop it */
+    stop_rumble();
+}
+
 /** This is called by Gap to notify the application we disconnected,
  *  in our case it ends the demonstration. */
 void on_disconnect(const Gap::DisconnectionCallbackParams_t *event) {
-    BLE& ble = BLE::Instance();
-    ble_error_t error;
-    printf("Disconnected - demonstration ended \r\n");
-    queue.cancel(update_handle);
-    error = ble.gap().startAdvertising();
-    if (error) {
-        printf("Error during Gap::startAdvertising.\r\n");
-    } else {
-        printf("Started advertising\r\n");
-    }
+    printf("Disconnected\r\n");
+    QueueStats::call(&inputQueue, QueueStats::EVENT_HANDOFF, &stop_input);
+    advertiser.start();
 };
 
 void start() {
@@ -313,19 +492,8 @@ void start() {
 
     error = ble.gap().setAppearance(GapAdvertisingData::JOYSTICK);
 
-    /* advertise to everyone */
-    ble.gap().setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
-    /* how many milliseconds between advertisements, lower interval
-     * increases the chances of being seen at the cost of more power */
-    ble.gap().setAdvertisingInterval(20);
-    ble.gap().setAdvertisingTimeout(0);
-
-    error = ble.gap().startAdvertising();
-
-    if (error) {
-        printf("Error during Gap::startAdvertising.\r\n");
-        return;
-    }
+    /* fast, then slowly to save power */
+    advertiser.start();
 
     /** This tells the stack to generate a pairingRequest event
      * which will require this application to respond before pairing
@@ -354,6 +522,13 @@ void on_init_complete(BLE::InitializationCompleteCallbackContext *event) {
         return;
     }
 
+    /* Keep bonds in /fs/bt.db across resets, so a known host only re-encrypts */
+    error = ble.securityManager().preserveBondingStateOnReset(true);
+
+    if (error) {
+        printf("Error during preserveBondingStateOnReset %d\r\n", error);
+    }
+
     /* Tell the security manager to use methods in this class to inform us
      * of any events. Class needs to implement SecurityManagerEventHandler. */
     ble.securityManager().setSecurityManagerEventHandler(&securityManagerEventHandler);
@@ -371,37 +546,78 @@ void on_init_complete(BLE::InitializationCompleteCallbackContext *event) {
     ble.gap().onDisconnection(&on_disconnect);
 
     hidServicePtr = new JoystickService(ble);
-
-    /* start test in 500 ms */
-    queue.call_in(500, &start);
+    connParams.onIntervalChange(&set_poll_interval);
+    hidServicePtr->setConnParamManager(&connParams);
+    hidServicePtr->setEventQueue(&inputQueue, INPUT_THREAD);
+
+    /* the host tunes the gamepad through the feature report and drives rumble and LEDs */
+    JoystickTuning tuning = hidServicePtr->tuning();
+    capture_tuning(&tuning);
+    hidServicePtr->setTuning(tuning);
+    hidServicePtr->onTuning(&apply_tuning);
+    hidServicePtr->onOutput(&apply_output);
+
+    start();
 };
 
 int main() {
+#if QUEUE_STATS
+    QueueStats::track(&queue, "main");
+#if INPUT_THREAD
+    QueueStats::track(&inputQueue, "input");
+#endif
+#endif
+
+    /* button and hat edges are buffered by their ISRs and handled on the input queue */
+    InputPin::start(&inputQueue);
+
     /* to show we're running we'll blink every 500ms */
-    queue.call_every(500, &blink);
+    QueueStats::call_every(&queue, QueueStats::EVENT_BLINK, 500, &blink);
 
-    for (unsigned int i = 0; i < 4; i++) {
-        axes_initial[i] = read_initial_axis(i);
-        _hidReport[2 + i] = axes_initial[i];
-    }
+#if LATENCY_TRACE || QUEUE_STATS
+    console.attach(&on_console_rx);
+#endif
 
     BLE& ble = BLE::Instance();
 
-    // Mount and/or format the filesystem for storing persistent pairing info
-    int err = fs.mount(&hbd);
+    // Mount and/or format the filesystem for storing persistent pairing info and settings
+    int err = fs.mount(storage_device());
     printf("%s\n", (err ? "Fail :(" : "OK"));
     if (err) {
         // Reformat if we can't mount the filesystem
         // this should only happen on the first boot
         printf("No filesystem found, formatting... ");
         fflush(stdout);
-        err = fs.reformat(&hbd);
+        err = fs.reformat(storage_device());
         printf("%s\n", (err ? "Fail :(" : "OK"));
         if (err) {
             error("error: %s (%d)\n", strerror(-err), err);
         }
     }
 
+    GamepadSettings settings;
+    capture_settings(&settings);
+    if (settingsStore.load(&settings)) {
+        apply_settings(settings);
+        sticks.prime();
+    } else {
+        /* without a stored calibration the sticks are assumed to be centred at power up */
+        printf("No stored settings, calibrating\r\n");
+        sticks.calibrate();
+        settings_changed();
+    }
+    load_input_profile(settings.profile);
+    _hidReport.setAxes(sticks.values());
+#if JOYSTICK_EXTENDED_REPORT
+    /* sprung triggers are released at power up */
+    triggers.calibrate();
+#endif
+
+#if INPUT_THREAD
+    /* calibrated: from here on the sticks and buttons belong to the input thread */
+    inputThread.start(callback(&inputEvents, &events::EventQueue::dispatch_forever));
+#endif
+
     // Start bluetooth and the gamepad service
     printf("\r\n PERIPHERAL \r\n\r\n");
 
@@ -0,0 +1,272 @@
+/* Minimal host microbenchmark harness */
+
+#include "MicroBench.h"
+#include "SimKernel.h"
+
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+uint64_t g_allocations;
+
+} // namespace
+
+/* Every heap allocation of the process goes through here, so benchmarks can count them */
+void *operator new(size_t size)
+{
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t size) noexcept
+{
+    free(p);
+}
+
+namespace bench {
+
+namespace {
+
+struct Benchmark {
+    const char *name;
+    BenchmarkFn fn;
+};
+
+struct Result {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+std::vector<Benchmark> &registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+const uint64_t MIN_RUN_NS = 100000000;
+
+/* Baseline entry holding the calibration loop's timing on the machine that wrote it */
+const char CALIBRATION[] = "calibration";
+
+/*
+ * A dependent chain of integer multiply-adds: how fast this host runs plain code. Timings are
+ * compared against a baseline in units of this loop, so a baseline written on another machine
+ * still applies.
+ */
+void calibrate(uint32_t iterations)
+{
+    uint32_t x = 1;
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (unsigned step = 0; step < 8; step++) {
+            x = x * 1664525u + 1013904223u;
+        }
+        doNotOptimize(x);
+    }
+}
+
+/* Grow the iteration count until a run takes long enough to time reliably */
+Result measure(BenchmarkFn fn, uint32_t *iterationsOut)
+{
+    uint32_t iterations = 1;
+    uint64_t elapsed = 0;
+    uint64_t allocs = 0;
+    while (true) {
+        uint64_t allocsBefore = g_allocations;
+        uint64_t start = sim::hostNs();
+        fn(iterations);
+        elapsed = sim::hostNs() - start;
+        allocs = g_allocations - allocsBefore;
+        if (elapsed >= MIN_RUN_NS || iterations >= (1u << 30)) {
+            break;
+        }
+        iterations *= elapsed < MIN_RUN_NS / 16 ? 8 : 2;
+    }
+    *iterationsOut = iterations;
+    Result result = {(double)elapsed / iterations, (double)allocs / iterations};
+    return result;
+}
+
+/* Baseline files hold the --tsv output; lines starting with '#' are comments */
+bool loadBaseline(const char *path, std::map<std::string, Result> *baseline)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char name[128];
+        Result result;
+        if (line[0] != '#' &&
+            sscanf(line, "%127s %lf %lf", name, &result.nsPerOp, &result.allocsPerOp) == 3) {
+            (*baseline)[name] = result;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+} // namespace
+
+Registration::Registration(const char *name, BenchmarkFn fn)
+{
+    Benchmark benchmark = {name, fn};
+    registry().push_back(benchmark);
+}
+
+uint64_t allocations()
+{
+    return g_allocations;
+}
+
+int run(int argc, char **argv)
+{
+    const char *filter = NULL;
+    const char *baselinePath = NULL;
+    const char *savePath = NULL;
+    bool tsv = false;
+    double tolerance = 15.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--tsv")) {
+            tsv = true;
+        } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL);
+        } else if (argv[i][0] != '-' && !filter) {
+            filter = argv[i];
+        } else {
+            printf("usage: %s [--tsv] [--baseline file] [--save file] [--tolerance percent] [filter]\n",
+                   argv[0]);
+            return 2;
+        }
+    }
+
+    std::map<std::string, Result> baseline;
+    if (baselinePath && !loadBaseline(baselinePath, &baseline)) {
+        printf("cannot read baseline %s\n", baselinePath);
+        return 2;
+    }
+    FILE *save = NULL;
+    if (savePath) {
+        save = fopen(savePath, "w");
+        if (!save) {
+            printf("cannot write %s\n", savePath);
+            return 2;
+        }
+        fprintf(save, "# name\tns/op\tallocs/op\titerations\n");
+    }
+    if (tsv) {
+        printf("# name\tns/op\tallocs/op\titerations%s\n", baselinePath ? "\tbaseline ns/op\tchange %" : "");
+    }
+
+    /* Baseline timings are scaled by how much faster or slower this host runs the calibration */
+    uint32_t calibrationIterations;
+    Result calibration = measure(&calibrate, &calibrationIterations);
+    double hostScale = 1.0;
+    std::map<std::string, Result>::const_iterator baseCalibration = baseline.find(CALIBRATION);
+    if (baseCalibration != baseline.end()) {
+        hostScale = calibration.nsPerOp / baseCalibration->second.nsPerOp;
+        baseline.erase(baseCalibration);
+    }
+    if (save) {
+        fprintf(save, "%s\t%.2f\t%.4f\t%u\n", CALIBRATION, calibration.nsPerOp, 0.0,
+                calibrationIterations);
+    }
+    if (baselinePath && !tsv) {
+        printf("calibration loop %.2f ns/op; baseline timings scaled by %.2f for this host\n",
+               calibration.nsPerOp, hostScale);
+    }
+
+    unsigned slower = 0;
+    unsigned allocating = 0;
+    for (size_t i = 0; i < registry().size(); i++) {
+        const Benchmark &benchmark = registry()[i];
+        if (filter && !strstr(benchmark.name, filter)) {
+            continue;
+        }
+
+        uint32_t iterations;
+        Result result = measure(benchmark.fn, &iterations);
+        if (save) {
+            fprintf(save, "%s\t%.2f\t%.4f\t%u\n", benchmark.name, result.nsPerOp,
+                    result.allocsPerOp, iterations);
+        }
+
+        /* Change against the baseline, and whether it is a regression */
+        const char *verdict = "";
+        double change = 0.0;
+        std::map<std::string, Result>::const_iterator base = baseline.find(benchmark.name);
+        bool compared = base != baseline.end();
+        double baseNs = compared ? base->second.nsPerOp * hostScale : 0.0;
+        if (compared) {
+            change = (result.nsPerOp / baseNs - 1.0) * 100.0;
+            /* Setup allocations amortise over the iterations; only whole ones per op count */
+            if (result.allocsPerOp > base->second.allocsPerOp + 0.5) {
+                verdict = "  ALLOCATES";
+                allocating++;
+            } else if (change > tolerance) {
+                verdict = "  SLOWER";
+                slower++;
+            }
+        } else if (baselinePath) {
+            verdict = "  (new)";
+        }
+
+        if (tsv) {
+            printf("%s\t%.2f\t%.4f\t%u", benchmark.name, result.nsPerOp, result.allocsPerOp,
+                   iterations);
+            if (compared) {
+                printf("\t%.2f\t%+.1f", baseNs, change);
+            }
+            printf("\n");
+        } else if (compared) {
+            printf("%-40s %10.2f ns/op %8.2f allocs/op  baseline %10.2f ns/op %+7.1f %%%s\n",
+                   benchmark.name, result.nsPerOp, result.allocsPerOp, baseNs, change, verdict);
+        } else {
+            printf("%-40s %10.2f ns/op %8.2f allocs/op  (%u iterations)%s\n", benchmark.name,
+                   result.nsPerOp, result.allocsPerOp, iterations, verdict);
+        }
+    }
+
+    if (save) {
+        fclose(save);
+    }
+    if (baselinePath && !tsv) {
+        printf("%u slower than %s by more than %.0f %%, %u allocating more\n", slower,
+               baselinePath, tolerance, allocating);
+    }
+    return allocating ? 1 : 0;
+}
+
+} // namespace bench
@@ -0,0 +1,55 @@
+/* Minimal host microbenchmark harness
+ *
+ * Benchmarks register themselves with BENCHMARK(name) and receive an iteration count; the
+ * harness grows the count until a run takes long enough to time reliably and reports
+ * nanoseconds and heap allocations per iteration.
+ *
+ * Results can be written as tab-separated values and saved as a baseline; a later run against
+ * the baseline shows the change of every benchmark and flags regressions. Allocation counts are
+ * exact and any increase fails the run; timings only warn. A baseline also records a fixed
+ * integer calibration loop, timed again by every run, and its timings are scaled by how the two
+ * compare, so a baseline written on one machine can be checked on another. That corrects for
+ * the host's speed, not for its caches or branch predictors, nor for load during the run.
+ */
+
+#ifndef SIM_MICRO_BENCH_H
+#define SIM_MICRO_BENCH_H
+
+#include <stdint.h>
+
+namespace bench {
+
+typedef void (*BenchmarkFn)(uint32_t iterations);
+
+struct Registration {
+    Registration(const char *name, BenchmarkFn fn);
+};
+
+/** Keep the compiler from optimising away a value */
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** Heap allocations made so far through operator new */
+uint64_t allocations();
+
+/**
+ * Run the registered benchmarks as the command line asks:
+ *
+ *   [--tsv] [--baseline file] [--save file] [--tolerance percent] [filter]
+ *
+ * Only benchmarks whose name contains filter are run. Returns the exit status: non-zero if a
+ * benchmark allocates more than its baseline or the arguments are wrong.
+ */
+int run(int argc, char **argv);
+
+} // namespace bench
+
+#define BENCHMARK(name) \
+    static void name(uint32_t iterations); \
+    static bench::Registration name##_registration(#name, &name); \
+    static void name(uint32_t iterations)
+
+#endif // SIM_MICRO_BENCH_H
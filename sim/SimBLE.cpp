@@ -0,0 +1,726 @@
+/* Simulated BLE stack: BLE, Gap, GattServer and SecurityManager stand-ins */
+
+#include "SimBLE.h"
+#include "SimKernel.h"
+#include "FileSystem.h"
+
+#include <deque>
+#include <set>
+#include <vector>
+
+namespace sim {
+
+void startAdvertisingEvents();
+void stopAdvertisingEvents();
+
+namespace {
+
+struct Packet {
+    GattAttribute::Handle_t handle;
+    uint16_t len;
+    uint8_t data[64];
+};
+
+struct Link {
+    bool connected;
+    bool encrypted;
+    bool subscribed;
+    Gap::Handle_t handle;
+    Gap::ConnectionParams_t params;
+    int connectionEventId;
+    unsigned eventsSkipped;
+    std::deque<Packet> tx;
+    /** Writes from the central, waiting for a connection event */
+    std::deque<Packet> rx;
+};
+
+BleHooks g_hooks;
+Link g_link;
+int g_connectId = 0;
+us_timestamp_t g_scanFrom = 0;
+us_timestamp_t g_advStart;
+uint32_t g_advMeanUs;
+uint32_t g_rand = 1;
+bool g_eventsSignalled = false;
+std::deque<mbed::Callback<void()> > g_stackEvents;
+std::set<GattAttribute::Handle_t> g_notifyHandles;
+
+const Gap::Handle_t CONNECTION_HANDLE = 1;
+
+/* The simulated central's address, which the peripheral learns when bonding */
+const BLEProtocol::Address_t CENTRAL_ADDRESS = {
+    BLEProtocol::AddressType::RANDOM_STATIC, {0x11, 0x22, 0x33, 0x44, 0x55, 0xc6}
+};
+
+uint32_t random32()
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 17;
+    g_rand ^= g_rand << 5;
+    return g_rand;
+}
+
+void connectionEvent()
+{
+    /* With nothing to send the peripheral may sleep through slaveLatency events */
+    if (g_link.tx.empty() && g_link.eventsSkipped < g_link.params.slaveLatency) {
+        g_link.eventsSkipped++;
+        return;
+    }
+    g_link.eventsSkipped = 0;
+    stats().connectionEvents++;
+
+    while (!g_link.rx.empty()) {
+        Packet p = g_link.rx.front();
+        g_link.rx.pop_front();
+        blePostStackEvent(0, [p]() {
+            GattServer &server = BLE::Instance().gattServer();
+            GattAttribute *attribute = server.sim_findAttribute(p.handle);
+            if (!attribute || p.len > attribute->getMaxLength()) {
+                return;
+            }
+            if (attribute->getValuePtr()) {
+                memcpy(attribute->getValuePtr(), p.data, p.len);
+            }
+            attribute->sim_setLength(p.len);
+            GattWriteCallbackParams params = {
+                g_link.handle, p.handle, GattWriteCallbackParams::OP_WRITE_REQ, 0, p.len, p.data
+            };
+            server.sim_dataWritten(&params);
+        });
+    }
+
+    unsigned count = 0;
+    while (count < config().txPerEvent && !g_link.tx.empty()) {
+        Packet &p = g_link.tx.front();
+        stats().packetsOnAir++;
+        stats().bytesOnAir += p.len + PACKET_OVERHEAD_BYTES;
+        if (g_hooks.onAir) {
+            g_hooks.onAir(p.handle, p.data, p.len);
+        }
+        g_link.tx.pop_front();
+        count++;
+    }
+
+    if (count) {
+        blePostStackEvent(0, [count]() { BLE::Instance().gattServer().sim_dataSent(count); });
+    }
+}
+
+void startConnectionEvents()
+{
+    if (g_link.connectionEventId) {
+        cancel(g_link.connectionEventId);
+    }
+    uint32_t intervalUs = g_link.params.minConnectionInterval * Gap::UNIT_1_25_MS;
+    g_link.eventsSkipped = 0;
+    g_link.connectionEventId = schedule(now() + intervalUs, &connectionEvent, intervalUs, false);
+}
+
+uint16_t acceptedInterval(const Gap::ConnectionParams_t &requested)
+{
+    uint16_t interval = requested.minConnectionInterval;
+    if (interval < config().centralMinInterval) {
+        interval = config().centralMinInterval;
+    }
+    if (requested.maxConnectionInterval && interval > requested.maxConnectionInterval) {
+        interval = requested.maxConnectionInterval;
+    }
+    return interval;
+}
+
+void connect()
+{
+    Gap &gap = BLE::Instance().gap();
+    g_connectId = 0;
+    if (!gap.advertising) {
+        return;
+    }
+    stopAdvertisingEvents();
+    gap.advertising = false;
+
+    g_link.connected = true;
+    g_link.encrypted = false;
+    g_link.subscribed = false;
+    g_link.handle = CONNECTION_HANDLE;
+    g_link.params = gap.preferredParams;
+    g_link.params.minConnectionInterval = acceptedInterval(gap.preferredParams);
+    g_link.params.maxConnectionInterval = g_link.params.minConnectionInterval;
+    g_link.tx.clear();
+    g_link.rx.clear();
+    startConnectionEvents();
+
+    if (g_hooks.onConnected) {
+        g_hooks.onConnected();
+    }
+
+    blePostStackEvent(0, []() {
+        Gap::ConnectionCallbackParams_t params;
+        memset(&params, 0, sizeof(params));
+        params.handle = g_link.handle;
+        params.role = Gap::PERIPHERAL;
+        params.connectionParams = &g_link.params;
+        BLE::Instance().gap().sim_connected(&params);
+    });
+}
+
+void encrypted()
+{
+    if (!g_link.connected) {
+        return;
+    }
+    g_link.encrypted = true;
+    BLE::Instance().securityManager().sim_handler()->linkEncryptionResult(
+        g_link.handle, ble::link_encryption_t::ENCRYPTED);
+
+    /* The host subscribes to input reports once the link is secure */
+    g_link.subscribed = true;
+    for (std::set<GattAttribute::Handle_t>::iterator it = g_notifyHandles.begin();
+         it != g_notifyHandles.end(); ++it) {
+        GattAttribute::Handle_t handle = *it;
+        blePostStackEvent(0, [handle]() {
+            BLE::Instance().gattServer().sim_updatesEnabled(handle);
+        });
+    }
+    if (g_hooks.onEncrypted) {
+        g_hooks.onEncrypted();
+    }
+}
+
+void disconnected(Gap::DisconnectionReason_t reason)
+{
+    if (!g_link.connected) {
+        return;
+    }
+    g_link.connected = false;
+    g_link.encrypted = false;
+    g_link.subscribed = false;
+    g_link.tx.clear();
+    cancel(g_link.connectionEventId);
+    g_link.connectionEventId = 0;
+
+    if (g_hooks.onDisconnected) {
+        g_hooks.onDisconnected();
+    }
+
+    Gap::Handle_t handle = g_link.handle;
+    blePostStackEvent(0, [handle, reason]() {
+        Gap::DisconnectionCallbackParams_t params = {handle, reason};
+        BLE::Instance().gap().sim_disconnected(&params);
+    });
+}
+
+} // namespace
+
+BleHooks &bleHooks()
+{
+    return g_hooks;
+}
+
+uint16_t bleConnectionInterval()
+{
+    return g_link.connected ? g_link.params.minConnectionInterval : 0;
+}
+
+void bleDisconnect()
+{
+    disconnected(Gap::REMOTE_USER_TERMINATED_CONNECTION);
+}
+
+void bleHostWrite(GattAttribute::Handle_t handle, const uint8_t *data, uint16_t len)
+{
+    if (!g_link.connected || len > sizeof(((Packet *)0)->data)) {
+        return;
+    }
+    Packet p;
+    p.handle = handle;
+    p.len = len;
+    memcpy(p.data, data, len);
+    g_link.rx.push_back(p);
+}
+
+void bleHostAway(uint32_t awayUs)
+{
+    g_scanFrom = now() + awayUs;
+}
+
+/* Find the first advertising packet the central hears and schedule the connection then */
+void startAdvertisingEvents()
+{
+    Gap &gap = BLE::Instance().gap();
+    g_advStart = now();
+    g_advMeanUs = gap.advInterval * 1000 + 5000;
+    us_timestamp_t limit = g_advStart + 3600000000ULL;
+    us_timestamp_t t = g_advStart;
+    while (t < limit) {
+        if (t >= g_scanFrom && t % config().scanIntervalUs < config().scanWindowUs) {
+            g_connectId = schedule(t + config().connectSetupUs, &connect, 0, false);
+            break;
+        }
+        t += gap.advInterval * 1000 + random32() % 10000;
+    }
+}
+
+void stopAdvertisingEvents()
+{
+    stats().advertisingEvents += (now() - g_advStart) / g_advMeanUs + 1;
+    if (g_connectId) {
+        cancel(g_connectId);
+        g_connectId = 0;
+    }
+}
+
+void blePostStackEvent(uint32_t delayUs, mbed::Callback<void()> fn)
+{
+    schedule(now() + delayUs, [fn]() {
+        g_stackEvents.push_back(fn);
+        BLE::Instance().sim_signalEvents();
+    }, 0, false);
+}
+
+} // namespace sim
+
+/* BLE */
+
+BLE::BLE() : sim_initCallback(NULL), _initialized(false)
+{
+}
+
+BLE &BLE::Instance()
+{
+    static BLE instance;
+    return instance;
+}
+
+ble_error_t BLE::init(InitializationCompleteCallback_t completion_cb)
+{
+    if (_initialized) {
+        return BLE_ERROR_ALREADY_INITIALIZED;
+    }
+    sim_initCallback = completion_cb;
+    if (sim::g_hooks.onInit) {
+        sim::g_hooks.onInit();
+    }
+    sim::blePostStackEvent(1000, [this]() {
+        _initialized = true;
+        if (sim_initCallback) {
+            InitializationCompleteCallbackContext context = {*this, BLE_ERROR_NONE};
+            sim_initCallback(&context);
+        }
+    });
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t BLE::shutdown()
+{
+    _initialized = false;
+    return BLE_ERROR_NONE;
+}
+
+void BLE::sim_signalEvents()
+{
+    if (sim::g_eventsSignalled) {
+        return;
+    }
+    sim::g_eventsSignalled = true;
+    if (_onEventsToProcess) {
+        OnEventsToProcessCallbackContext context = {*this};
+        _onEventsToProcess(&context);
+    }
+}
+
+void BLE::processEvents()
+{
+    sim::g_eventsSignalled = false;
+    sim::consume(sim::config().processEventsCostUs);
+    while (!sim::g_stackEvents.empty()) {
+        mbed::Callback<void()> fn = sim::g_stackEvents.front();
+        sim::g_stackEvents.pop_front();
+        fn();
+    }
+}
+
+/* Gap */
+
+Gap::Gap() :
+    advType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED),
+    advInterval(100),
+    advTimeout(0),
+    advertising(false)
+{
+    /* Stack default when the application does not set preferred parameters */
+    ConnectionParams_t defaults = {24, 40, 0, 400};
+    preferredParams = defaults;
+}
+
+ble_error_t Gap::getAddress(AddressType_t *typeP, Address_t address)
+{
+    static const Address_t simAddress = {0x01, 0x02, 0x03, 0x04, 0x05, 0xc6};
+    *typeP = ADDR_TYPE_RANDOM_STATIC;
+    memcpy(address, simAddress, sizeof(Address_t));
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::setAdvertisingPayload(const GapAdvertisingData &payload)
+{
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::setAppearance(GapAdvertisingData::Appearance appearance)
+{
+    return BLE_ERROR_NONE;
+}
+
+void Gap::setAdvertisingType(GapAdvertisingParams::AdvertisingType_t type)
+{
+    advType = type;
+}
+
+void Gap::setAdvertisingInterval(uint16_t interval)
+{
+    advInterval = interval;
+}
+
+void Gap::setAdvertisingTimeout(uint16_t timeout)
+{
+    advTimeout = timeout;
+}
+
+ble_error_t Gap::startAdvertising()
+{
+    if (advertising || sim::g_link.connected) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+    /* The legacy API has no peer address for directed advertising; nRF5x refuses it */
+    if (advType == GapAdvertisingParams::ADV_CONNECTABLE_DIRECTED) {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+    advertising = true;
+    sim::startAdvertisingEvents();
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::stopAdvertising()
+{
+    if (advertising) {
+        sim::stopAdvertisingEvents();
+    }
+    advertising = false;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::setWhitelist(const Whitelist_t &list)
+{
+    if (list.size > getMaxWhitelistSize()) {
+        return BLE_ERROR_PARAM_OUT_OF_RANGE;
+    }
+    whitelist.assign(list.addresses, list.addresses + list.size);
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::setPreferredConnectionParams(const ConnectionParams_t *params)
+{
+    preferredParams = *params;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::getPreferredConnectionParams(ConnectionParams_t *params)
+{
+    *params = preferredParams;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::updateConnectionParams(Handle_t handle, const ConnectionParams_t *params)
+{
+    if (!sim::g_link.connected || handle != sim::g_link.handle) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    /* The central applies the update a few connection events later */
+    ConnectionParams_t requested = *params;
+    uint32_t delayUs = 6 * sim::g_link.params.minConnectionInterval * UNIT_1_25_MS;
+    sim::schedule(sim::now() + delayUs, [requested]() {
+        if (!sim::g_link.connected || !sim::config().centralAcceptsUpdates) {
+            return;
+        }
+        sim::g_link.params = requested;
+        sim::g_link.params.minConnectionInterval = sim::acceptedInterval(requested);
+        sim::g_link.params.maxConnectionInterval = sim::g_link.params.minConnectionInterval;
+        sim::startConnectionEvents();
+    }, 0, false);
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Gap::disconnect(Handle_t connectionHandle, DisconnectionReason_t reason)
+{
+    sim::disconnected(LOCAL_HOST_TERMINATED_CONNECTION);
+    return BLE_ERROR_NONE;
+}
+
+void Gap::sim_connected(const ConnectionCallbackParams_t *params)
+{
+    for (size_t i = 0; i < _connectionCallbacks.size(); i++) {
+        _connectionCallbacks[i](params);
+    }
+}
+
+void Gap::sim_disconnected(const DisconnectionCallbackParams_t *params)
+{
+    for (size_t i = 0; i < _disconnectionCallbacks.size(); i++) {
+        _disconnectionCallbacks[i](params);
+    }
+}
+
+void Gap::sim_timeout(TimeoutSource_t source)
+{
+    if (_timeoutCallback) {
+        _timeoutCallback(source);
+    }
+}
+
+/* GattServer */
+
+GattServer::GattServer()
+{
+}
+
+ble_error_t GattServer::addService(GattService &service)
+{
+    /* Handle layout: service declaration, then per characteristic its declaration, value and
+     * descriptors, with an implicit CCCD after notifying characteristics */
+    GattAttribute::Handle_t handle = _attributes.size() + 1;
+    _attributes.push_back(NULL);
+
+    for (unsigned i = 0; i < service.getCharacteristicCount(); i++) {
+        GattCharacteristic *characteristic = service.getCharacteristic(i);
+
+        _attributes.push_back(NULL);
+        handle++;
+
+        handle++;
+        characteristic->getValueAttribute().sim_setHandle(handle);
+        _attributes.push_back(&characteristic->getValueAttribute());
+
+        if (characteristic->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) {
+            sim::g_notifyHandles.insert(handle);
+            _attributes.push_back(NULL);
+            handle++;
+        }
+
+        for (unsigned d = 0; d < characteristic->getDescriptorCount(); d++) {
+            handle++;
+            characteristic->getDescriptor(d)->sim_setHandle(handle);
+            _attributes.push_back(characteristic->getDescriptor(d));
+        }
+    }
+    return BLE_ERROR_NONE;
+}
+
+GattAttribute *GattServer::sim_findAttribute(GattAttribute::Handle_t handle)
+{
+    if (handle == 0 || handle > _attributes.size()) {
+        return NULL;
+    }
+    return _attributes[handle - 1];
+}
+
+ble_error_t GattServer::write(GattAttribute::Handle_t attributeHandle, const uint8_t *value,
+                              uint16_t size, bool localOnly)
+{
+    sim::consume(sim::config().gattWriteCostUs);
+
+    GattAttribute *attribute = sim_findAttribute(attributeHandle);
+    if (!attribute || size > attribute->getMaxLength()) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    if (attribute->getValuePtr() && attribute->getValuePtr() != value) {
+        memcpy(attribute->getValuePtr(), value, size);
+    }
+    attribute->sim_setLength(size);
+
+    if (localOnly || !sim::g_link.subscribed || !sim::g_notifyHandles.count(attributeHandle)) {
+        return BLE_ERROR_NONE;
+    }
+
+    ble_error_t result = BLE_ERROR_NONE;
+    if (sim::g_link.tx.size() >= sim::config().txBuffers) {
+        sim::stats().gattWriteFailures++;
+        result = BLE_STACK_BUSY;
+    } else {
+        sim::Packet p;
+        p.handle = attributeHandle;
+        p.len = size;
+        memcpy(p.data, value, size);
+        sim::g_link.tx.push_back(p);
+        sim::stats().gattWrites++;
+    }
+
+    if (sim::g_hooks.onNotify) {
+        sim::g_hooks.onNotify(attributeHandle, value, size, result);
+    }
+    return result;
+}
+
+ble_error_t GattServer::read(GattAttribute::Handle_t attributeHandle, uint8_t *buffer,
+                             uint16_t *lengthP)
+{
+    GattAttribute *attribute = sim_findAttribute(attributeHandle);
+    if (!attribute) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    if (*lengthP > attribute->getLength()) {
+        *lengthP = attribute->getLength();
+    }
+    memcpy(buffer, attribute->getValuePtr(), *lengthP);
+    return BLE_ERROR_NONE;
+}
+
+void GattServer::sim_dataSent(unsigned count)
+{
+    for (size_t i = 0; i < _dataSentCallbacks.size(); i++) {
+        _dataSentCallbacks[i](count);
+    }
+}
+
+void GattServer::sim_dataWritten(const GattWriteCallbackParams *params)
+{
+    for (size_t i = 0; i < _dataWrittenCallbacks.size(); i++) {
+        _dataWrittenCallbacks[i](params);
+    }
+}
+
+void GattServer::sim_updatesEnabled(GattAttribute::Handle_t handle)
+{
+    _updatesEnabledCallback(handle);
+}
+
+void GattServer::sim_updatesDisabled(GattAttribute::Handle_t handle)
+{
+    _updatesDisabledCallback(handle);
+}
+
+/* SecurityManager */
+
+SecurityManager::SecurityManager() :
+    pairingAuthorisationRequired(false),
+    bonded(false),
+    _handler(&_defaultHandler),
+    _bonding(false),
+    _preserveBonds(true),
+    _dbFilepath(NULL)
+{
+}
+
+/*
+ * The bond database is a file like FileSecurityDb's: a header and one fixed-size entry per
+ * peer holding its identity address and the keys distributed while pairing. The simulated
+ * central keeps its side of the bond for as long as the peripheral does.
+ */
+static const char BOND_DB_MAGIC[4] = {'S', 'M', 'D', 'B'};
+static const size_t BOND_ENTRY_SIZE = 96;
+
+ble_error_t SecurityManager::init(bool enableBonding, bool requireMITM,
+                                  SecurityIOCapabilities_t iocaps, const uint8_t *passkey,
+                                  bool signing, const char *dbFilepath)
+{
+    _bonding = enableBonding;
+    _dbFilepath = dbFilepath;
+    bonded = false;
+
+    const char *path;
+    mbed::FileSystem *fs = dbFilepath ? mbed::FileSystem::sim_lookup(dbFilepath, &path) : NULL;
+    if (!fs || !_preserveBonds) {
+        /* Without a file the database lives in RAM and starts empty */
+        return BLE_ERROR_NONE;
+    }
+    uint8_t db[sizeof(BOND_DB_MAGIC) + BOND_ENTRY_SIZE];
+    mbed::File file;
+    if (!file.open(fs, path, O_RDONLY)) {
+        bonded = file.read(db, sizeof(db)) == (ssize_t)sizeof(db) &&
+                 !memcmp(db, BOND_DB_MAGIC, sizeof(BOND_DB_MAGIC));
+        file.close();
+    }
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t SecurityManager::generateWhitelistFromBondTable(Gap::Whitelist_t *whitelist) const
+{
+    if (!whitelist) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    bool bond = bonded;
+    EventHandler *handler = _handler;
+    sim::blePostStackEvent(0, [whitelist, bond, handler]() {
+        whitelist->size = 0;
+        if (bond && whitelist->capacity) {
+            whitelist->addresses[whitelist->size++] = sim::CENTRAL_ADDRESS;
+        }
+        handler->whitelistFromBondTable(whitelist);
+    });
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t SecurityManager::preserveBondingStateOnReset(bool enable)
+{
+    _preserveBonds = enable;
+    return BLE_ERROR_NONE;
+}
+
+void SecurityManager::storeBond()
+{
+    const char *path;
+    mbed::FileSystem *fs = _dbFilepath ? mbed::FileSystem::sim_lookup(_dbFilepath, &path) : NULL;
+    if (!fs) {
+        return;
+    }
+    uint8_t db[sizeof(BOND_DB_MAGIC) + BOND_ENTRY_SIZE] = {0};
+    memcpy(db, BOND_DB_MAGIC, sizeof(BOND_DB_MAGIC));
+    mbed::File file;
+    if (!file.open(fs, path, O_WRONLY | O_CREAT | O_TRUNC)) {
+        file.write(db, sizeof(db));
+        file.close();
+    }
+}
+
+ble_error_t SecurityManager::setPairingRequestAuthorisation(bool required)
+{
+    pairingAuthorisationRequired = required;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t SecurityManager::acceptPairingRequest(ble::connection_handle_t connectionHandle)
+{
+    sim::blePostStackEvent(sim::config().pairingDelayUs, [this, connectionHandle]() {
+        if (_bonding) {
+            bonded = true;
+            storeBond();
+        }
+        sim::encrypted();
+        _handler->pairingResult(connectionHandle, SEC_STATUS_SUCCESS);
+    });
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t SecurityManager::cancelPairingRequest(ble::connection_handle_t connectionHandle)
+{
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t SecurityManager::setLinkSecurity(ble::connection_handle_t connectionHandle,
+                                             SecurityMode_t securityMode)
+{
+    if (!sim::g_link.connected || connectionHandle != sim::g_link.handle) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    if (bonded) {
+        sim::blePostStackEvent(sim::config().reencryptDelayUs, &sim::encrypted);
+    } else if (pairingAuthorisationRequired) {
+        sim::blePostStackEvent(sim::config().pairingRequestDelayUs, [this, connectionHandle]() {
+            _handler->pairingRequest(connectionHandle);
+        });
+    } else {
+        acceptPairingRequest(connectionHandle);
+    }
+    return BLE_ERROR_NONE;
+}
@@ -0,0 +1,61 @@
+/* Simulated BLE central and link layer
+ *
+ * The central scans with a duty cycle and connects on the first advertising packet that falls
+ * in a scan window, sent every advertising interval plus a random 0-10 ms advDelay. Like the
+ * nRF5x port, Gap::startAdvertising() refuses directed advertising. The central accepts the
+ * peripheral's preferred connection interval (bounded by Config::centralMinInterval), pairs or
+ * re-encrypts, then subscribes to notifications, which the peripheral learns through
+ * GattServer::onUpdatesEnabled(); writes before that only update the value. Parameter updates
+ * take effect six connection events after the request, unless Config::centralAcceptsUpdates is
+ * cleared; the peripheral skips up to slaveLatency events while it has nothing to send.
+ * Notifications written while the stack has free buffers are transmitted at the next
+ * connection events, Config::txPerEvent at a time; GattServer::write() fails with
+ * BLE_STACK_BUSY while all Config::txBuffers are in use, as the nRF5x port does. Writes from the
+ * central arrive at connection events too.
+ */
+
+#ifndef SIM_BLE_CENTRAL_H
+#define SIM_BLE_CENTRAL_H
+
+#include "ble/BLE.h"
+
+namespace sim {
+
+/** Link layer bytes added to every notification: LL header, L2CAP, ATT header and MIC */
+static const unsigned PACKET_OVERHEAD_BYTES = 2 + 4 + 3 + 4;
+
+struct BleHooks {
+    /** BLE::init() called by the application, i.e. the end of its boot */
+    mbed::Callback<void()> onInit;
+    /** Every GattServer::write() to a subscribed notify characteristic, with its result */
+    mbed::Callback<void(GattAttribute::Handle_t, const uint8_t *, uint16_t, ble_error_t)> onNotify;
+    /** A notification leaving the radio */
+    mbed::Callback<void(GattAttribute::Handle_t, const uint8_t *, uint16_t)> onAir;
+    mbed::Callback<void()> onConnected;
+    mbed::Callback<void()> onEncrypted;
+    mbed::Callback<void()> onDisconnected;
+};
+
+BleHooks &bleHooks();
+
+/** Connection interval in 1.25 ms units, 0 when not connected */
+uint16_t bleConnectionInterval();
+
+/** The central drops the link */
+void bleDisconnect();
+
+/**
+ * The central writes a characteristic, e.g. an output or feature report. The write reaches the
+ * peripheral at the next connection event it listens to, through GattServer::onDataWritten().
+ */
+void bleHostWrite(GattAttribute::Handle_t handle, const uint8_t *data, uint16_t len);
+
+/** The central stops scanning for the next awayUs, e.g. while out of range */
+void bleHostAway(uint32_t awayUs);
+
+/** Deliver a stack event to the application through BLE::processEvents() */
+void blePostStackEvent(uint32_t delayUs, mbed::Callback<void()> fn);
+
+} // namespace sim
+
+#endif // SIM_BLE_CENTRAL_H
@@ -0,0 +1,1142 @@
+/* Host simulator kernel and mbed driver stand-ins */
+
+#include "SimKernel.h"
+#include "events/mbed_events.h"
+#include "LittleFileSystem.h"
+#include "FileSystem.h"
+#include "FileBlockDevice.h"
+
+#include <chrono>
+#include <climits>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+namespace sim {
+
+Config::Config() :
+    isrCostUs(2),
+    dispatchCostUs(3),
+    adcSampleCostUs(12),
+    gattWriteCostUs(20),
+    processEventsCostUs(40),
+    fileReadCostUs(300),
+    fileWriteCostUs(3000),
+    scanIntervalUs(60000),
+    scanWindowUs(30000),
+    connectSetupUs(2500),
+    pairingRequestDelayUs(30000),
+    pairingDelayUs(400000),
+    reencryptDelayUs(60000),
+    centralMinInterval(6),
+    centralAcceptsUpdates(true),
+    txBuffers(3),
+    txPerEvent(2),
+    adcNoiseLsb(4)
+{
+}
+
+namespace {
+
+struct HardwareEvent {
+    int id;
+    uint32_t periodUs;
+    bool interrupt;
+    mbed::Callback<void()> fn;
+};
+
+typedef std::pair<us_timestamp_t, uint32_t> TimelineKey;
+
+Config g_config;
+Stats g_stats;
+
+us_timestamp_t g_now = 0;
+bool g_inIsr = false;
+bool g_running = false;
+bool g_stop = false;
+/* Priority of the thread whose body runs, and of the queue callback running; nothing running
+ * outside a callback is preempted */
+int g_threadPriority = osPriorityNormal;
+bool g_startingThread = false;
+int g_dispatchPriority = INT_MAX;
+
+/*
+ * Containers touched by constructors and destructors of firmware globals are created on first
+ * use and never destroyed, so static initialisation and destruction order does not matter
+ */
+std::map<TimelineKey, HardwareEvent> &timeline()
+{
+    static std::map<TimelineKey, HardwareEvent> *t = new std::map<TimelineKey, HardwareEvent>;
+    return *t;
+}
+
+std::map<int, TimelineKey> &timelineIds()
+{
+    static std::map<int, TimelineKey> *ids = new std::map<int, TimelineKey>;
+    return *ids;
+}
+
+uint32_t g_timelineSeq = 0;
+int g_nextTimelineId = 1;
+
+std::vector<events::EventQueue *> &queues()
+{
+    static std::vector<events::EventQueue *> *q = new std::vector<events::EventQueue *>;
+    return *q;
+}
+
+struct PinState {
+    int level;
+    float analog;
+    float duty;
+    mbed::InterruptIn *irq;
+};
+
+std::map<int, PinState> &pins()
+{
+    static std::map<int, PinState> *p = new std::map<int, PinState>;
+    return *p;
+}
+
+PinState &pin(PinName name)
+{
+    std::map<int, PinState>::iterator it = pins().find(name);
+    if (it == pins().end()) {
+        PinState s = {0, 0.5f, 0.0f, NULL};
+        it = pins().insert(std::make_pair((int)name, s)).first;
+    }
+    return it->second;
+}
+
+uint32_t g_noiseState = 0x12345678;
+
+int noise(unsigned peak)
+{
+    if (!peak) {
+        return 0;
+    }
+    g_noiseState ^= g_noiseState << 13;
+    g_noiseState ^= g_noiseState >> 17;
+    g_noiseState ^= g_noiseState << 5;
+    return (int)(g_noiseState % (2 * peak + 1)) - (int)peak;
+}
+
+template <typename F>
+void runIsr(F f)
+{
+    bool nested = g_inIsr;
+    g_stats.interrupts++;
+    g_inIsr = true;
+    consume(g_config.isrCostUs);
+    uint64_t start = hostNs();
+    f();
+    g_stats.isrHostNs += hostNs() - start;
+    g_inIsr = nested;
+}
+
+void advanceTo(us_timestamp_t target)
+{
+    while (!timeline().empty() && timeline().begin()->first.first <= target) {
+        std::map<TimelineKey, HardwareEvent>::iterator it = timeline().begin();
+        us_timestamp_t at = it->first.first;
+        HardwareEvent ev = it->second;
+        timelineIds().erase(ev.id);
+        timeline().erase(it);
+
+        if (ev.periodUs) {
+            TimelineKey key(at + ev.periodUs, g_timelineSeq++);
+            timeline()[key] = ev;
+            timelineIds()[ev.id] = key;
+        }
+
+        if (at > g_now) {
+            g_now = at;
+        }
+        if (ev.interrupt) {
+            runIsr(ev.fn);
+        } else {
+            ev.fn();
+        }
+    }
+    if (target > g_now) {
+        g_now = target;
+    }
+}
+
+/* Due queue with a priority above the callback running, highest priority first */
+events::EventQueue *readyAbove(int priority, us_timestamp_t *nextDue)
+{
+    events::EventQueue *ready = NULL;
+    us_timestamp_t readyDue = 0;
+    *nextDue = UINT64_MAX;
+    for (size_t i = 0; i < queues().size(); i++) {
+        events::EventQueue *queue = queues()[i];
+        us_timestamp_t due;
+        if (queue->sim_priority <= priority || !queue->sim_next_due(&due)) {
+            continue;
+        }
+        if (due > g_now) {
+            if (due < *nextDue) {
+                *nextDue = due;
+            }
+        } else if (!ready || queue->sim_priority > ready->sim_priority ||
+                   (queue->sim_priority == ready->sim_priority && due < readyDue)) {
+            ready = queue;
+            readyDue = due;
+        }
+    }
+    return ready;
+}
+
+void dispatchFrom(events::EventQueue *queue)
+{
+    int preempted = g_dispatchPriority;
+    g_dispatchPriority = queue->sim_priority;
+    queue->sim_dispatch_one();
+    g_dispatchPriority = preempted;
+}
+
+} // namespace
+
+Config &config()
+{
+    return g_config;
+}
+
+Stats &stats()
+{
+    return g_stats;
+}
+
+void resetStats()
+{
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+us_timestamp_t now()
+{
+    return g_now;
+}
+
+void consume(uint32_t us)
+{
+    g_stats.busyUs += us;
+    if (g_inIsr) {
+        /* Interrupts do not nest; anything falling due is taken on return */
+        g_now += us;
+        return;
+    }
+    if (!g_running || g_dispatchPriority == INT_MAX) {
+        advanceTo(g_now + us);
+        return;
+    }
+
+    /* Time spent in interrupts overlaps the work; time spent in preempting callbacks does not */
+    uint64_t remaining = us;
+    while (true) {
+        us_timestamp_t nextDue;
+        events::EventQueue *preempt = readyAbove(g_dispatchPriority, &nextDue);
+        if (preempt) {
+            dispatchFrom(preempt);
+            continue;
+        }
+        if (!remaining) {
+            break;
+        }
+        /* Stop at the next interrupt, which may post to a higher priority queue */
+        us_timestamp_t step = remaining;
+        if (nextDue - g_now < step) {
+            step = nextDue - g_now;
+        }
+        if (!timeline().empty()) {
+            us_timestamp_t at = timeline().begin()->first.first;
+            step = at <= g_now ? 0 : (at - g_now < step ? at - g_now : step);
+        }
+        us_timestamp_t before = g_now;
+        advanceTo(g_now + step);
+        uint64_t advanced = g_now - before;
+        remaining = advanced >= remaining ? 0 : remaining - advanced;
+    }
+}
+
+bool inIsr()
+{
+    return g_inIsr;
+}
+
+int schedule(us_timestamp_t at, mbed::Callback<void()> fn, uint32_t periodUs, bool interrupt)
+{
+    HardwareEvent ev = {g_nextTimelineId++, periodUs, interrupt, fn};
+    TimelineKey key(at < g_now ? g_now : at, g_timelineSeq++);
+    timeline()[key] = ev;
+    timelineIds()[ev.id] = key;
+    return ev.id;
+}
+
+void cancel(int id)
+{
+    std::map<int, TimelineKey>::iterator it = timelineIds().find(id);
+    if (it != timelineIds().end()) {
+        timeline().erase(it->second);
+        timelineIds().erase(it);
+    }
+}
+
+void run()
+{
+    g_running = true;
+    g_stop = false;
+
+    while (!g_stop) {
+        events::EventQueue *ready = NULL;
+        us_timestamp_t readyDue = 0;
+        us_timestamp_t next = UINT64_MAX;
+
+        for (size_t i = 0; i < queues().size(); i++) {
+            us_timestamp_t due;
+            if (!queues()[i]->sim_next_due(&due)) {
+                continue;
+            }
+            if (due <= g_now) {
+                if (!ready || queues()[i]->sim_priority > ready->sim_priority ||
+                        (queues()[i]->sim_priority == ready->sim_priority && due < readyDue)) {
+                    ready = queues()[i];
+                    readyDue = due;
+                }
+            } else if (due < next) {
+                next = due;
+            }
+        }
+
+        if (ready) {
+            dispatchFrom(ready);
+            continue;
+        }
+
+        if (!timeline().empty() && timeline().begin()->first.first < next) {
+            next = timeline().begin()->first.first;
+        }
+        if (next == UINT64_MAX) {
+            break;
+        }
+        advanceTo(next);
+    }
+
+    g_running = false;
+}
+
+void stop()
+{
+    g_stop = true;
+}
+
+bool running()
+{
+    return g_running;
+}
+
+void registerQueue(events::EventQueue *queue)
+{
+    if (std::find(queues().begin(), queues().end(), queue) == queues().end()) {
+        queues().push_back(queue);
+    }
+}
+
+void unregisterQueue(events::EventQueue *queue)
+{
+    queues().erase(std::remove(queues().begin(), queues().end(), queue), queues().end());
+}
+
+int threadPriority()
+{
+    return g_threadPriority;
+}
+
+bool startingThread()
+{
+    return g_startingThread;
+}
+
+void startThread(int priority, mbed::Callback<void()> task)
+{
+    int caller = g_threadPriority;
+    g_threadPriority = priority;
+    g_startingThread = true;
+    task();
+    g_startingThread = false;
+    g_threadPriority = caller;
+}
+
+void setPin(PinName name, int level)
+{
+    PinState &p = pin(name);
+    level = level ? 1 : 0;
+    if (p.level == level) {
+        return;
+    }
+    p.level = level;
+    if (p.irq) {
+        mbed::InterruptIn *irq = p.irq;
+        runIsr([irq, level]() { irq->sim_edge(level); });
+    }
+}
+
+static mbed::RawSerial *&console()
+{
+    static mbed::RawSerial *serial;
+    return serial;
+}
+
+void serialInput(const char *text)
+{
+    mbed::RawSerial *serial = console();
+    for (; serial && *text; text++) {
+        char c = *text;
+        runIsr([serial, c]() { serial->sim_receive(c); });
+    }
+}
+
+int getPin(PinName name)
+{
+    return pin(name).level;
+}
+
+void setAnalog(PinName name, float value)
+{
+    pin(name).analog = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+float getPwm(PinName name)
+{
+    return pin(name).duty;
+}
+
+void addIsrHostNs(uint64_t ns)
+{
+    g_stats.isrHostNs += ns;
+}
+
+uint64_t hostNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Used by the driver stand-ins below */
+static uint16_t sampleAdc12(PinName name)
+{
+    consume(g_config.adcSampleCostUs);
+    g_stats.adcConversions++;
+    int value = (int)(pin(name).analog * 4095.0f + 0.5f) + noise(g_config.adcNoiseLsb);
+    if (value < 0) {
+        value = 0;
+    } else if (value > 4095) {
+        value = 4095;
+    }
+    return value;
+}
+
+static void attachIrq(PinName name, mbed::InterruptIn *irq, PinMode mode)
+{
+    PinState &p = pin(name);
+    p.irq = irq;
+    if (mode == PullUp) {
+        p.level = 1;
+    }
+}
+
+static void detachIrq(PinName name, mbed::InterruptIn *irq)
+{
+    PinState &p = pin(name);
+    if (p.irq == irq) {
+        p.irq = NULL;
+    }
+}
+
+} // namespace sim
+
+/* mbed platform functions */
+
+void error(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(1);
+}
+
+void wait_ms(int ms)
+{
+    sim::consume(ms * 1000);
+}
+
+void wait_us(int us)
+{
+    sim::consume(us);
+}
+
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)sim::now();
+}
+
+namespace mbed {
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin)
+{
+    write(value);
+}
+
+void DigitalOut::write(int value)
+{
+    sim::pin(_pin).level = value ? 1 : 0;
+}
+
+int DigitalOut::read()
+{
+    return sim::pin(_pin).level;
+}
+
+PwmOut::PwmOut(PinName pin) : _pin(pin)
+{
+    write(0.0f);
+}
+
+void PwmOut::write(float value)
+{
+    sim::pin(_pin).duty = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+float PwmOut::read()
+{
+    return sim::pin(_pin).duty;
+}
+
+DigitalIn::DigitalIn(PinName pin, PinMode mode) : _pin(pin)
+{
+    if (mode == PullUp) {
+        sim::pin(_pin).level = 1;
+    }
+}
+
+int DigitalIn::read()
+{
+    return sim::pin(_pin).level;
+}
+
+PortIn::PortIn(PortName port, int mask) : _mask(mask)
+{
+}
+
+int PortIn::read()
+{
+    uint32_t value = 0;
+    for (unsigned i = 0; i < 32; i++) {
+        if ((_mask & (1u << i)) && sim::pin((PinName)i).level) {
+            value |= 1u << i;
+        }
+    }
+    return value;
+}
+
+void PortIn::mode(PinMode pull)
+{
+    if (pull != PullUp) {
+        return;
+    }
+    for (unsigned i = 0; i < 32; i++) {
+        if (_mask & (1u << i)) {
+            sim::pin((PinName)i).level = 1;
+        }
+    }
+}
+
+AnalogIn::AnalogIn(PinName pin) : _pin(pin)
+{
+}
+
+float AnalogIn::read()
+{
+    return sim::sampleAdc12(_pin) * (1.0f / 4095.0f);
+}
+
+unsigned short AnalogIn::read_u16()
+{
+    /* Same 12 to 16 bit scaling as the nRF52 HAL */
+    uint16_t value = sim::sampleAdc12(_pin);
+    return (value << 4) | (value >> 8);
+}
+
+RawSerial::RawSerial(PinName tx, PinName rx, int baud) : _rxHead(0), _rxTail(0)
+{
+    sim::console() = this;
+}
+
+RawSerial::~RawSerial()
+{
+    if (sim::console() == this) {
+        sim::console() = NULL;
+    }
+}
+
+void RawSerial::attach(Callback<void()> func, IrqType type)
+{
+    if (type == RxIrq) {
+        _rxIrq = func;
+    }
+}
+
+int RawSerial::readable()
+{
+    return _rxHead != _rxTail;
+}
+
+int RawSerial::getc()
+{
+    while (!readable()) {
+        sim::consume(100);
+    }
+    return _rxBuffer[_rxTail++ % sizeof(_rxBuffer)];
+}
+
+int RawSerial::putc(int c)
+{
+    return putchar(c);
+}
+
+void RawSerial::sim_receive(char c)
+{
+    /* A full FIFO drops the character, as the UART would */
+    if (_rxHead - _rxTail < sizeof(_rxBuffer)) {
+        _rxBuffer[_rxHead++ % sizeof(_rxBuffer)] = c;
+    }
+    if (_rxIrq) {
+        _rxIrq();
+    }
+}
+
+InterruptIn::InterruptIn(PinName pin, PinMode mode) : _pin(pin), _irqEnabled(true)
+{
+    sim::attachIrq(pin, this, mode);
+}
+
+InterruptIn::~InterruptIn()
+{
+    sim::detachIrq(_pin, this);
+}
+
+int InterruptIn::read()
+{
+    return sim::pin(_pin).level;
+}
+
+void InterruptIn::rise(Callback<void()> func)
+{
+    _rise = func;
+}
+
+void InterruptIn::fall(Callback<void()> func)
+{
+    _fall = func;
+}
+
+void InterruptIn::enable_irq()
+{
+    _irqEnabled = true;
+}
+
+void InterruptIn::disable_irq()
+{
+    _irqEnabled = false;
+}
+
+void InterruptIn::sim_edge(int level)
+{
+    if (!_irqEnabled) {
+        return;
+    }
+    if (level && _rise) {
+        _rise();
+    } else if (!level && _fall) {
+        _fall();
+    }
+}
+
+Ticker::Ticker() : _id(0)
+{
+}
+
+Ticker::~Ticker()
+{
+    detach();
+}
+
+void Ticker::attach_us(Callback<void()> func, us_timestamp_t t)
+{
+    detach();
+    _id = sim::schedule(sim::now() + t, func, t);
+}
+
+void Ticker::detach()
+{
+    if (_id) {
+        sim::cancel(_id);
+        _id = 0;
+    }
+}
+
+Timer::Timer() : _start(0), _elapsed(0), _running(false)
+{
+}
+
+void Timer::start()
+{
+    if (!_running) {
+        _start = sim::now();
+        _running = true;
+    }
+}
+
+void Timer::stop()
+{
+    if (_running) {
+        _elapsed += sim::now() - _start;
+        _running = false;
+    }
+}
+
+void Timer::reset()
+{
+    _start = sim::now();
+    _elapsed = 0;
+}
+
+int Timer::read_us()
+{
+    return (int)(_elapsed + (_running ? sim::now() - _start : 0));
+}
+
+int Timer::read_ms()
+{
+    return read_us() / 1000;
+}
+
+float Timer::read()
+{
+    return read_us() / 1000000.0f;
+}
+
+} // namespace mbed
+
+namespace rtos {
+
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    sim::startThread(_priority, task);
+    return osOK;
+}
+
+} // namespace rtos
+
+/* events::EventQueue */
+
+namespace events {
+
+EventQueue::EventQueue(unsigned size, unsigned char *buffer) :
+    sim_priority(0),
+    _capacity(size / EVENTS_EVENT_SIZE),
+    _nextId(1),
+    _seq(0),
+    _chained(NULL)
+{
+}
+
+EventQueue::~EventQueue()
+{
+    sim::unregisterQueue(this);
+}
+
+void EventQueue::dispatch(int ms)
+{
+    sim_priority = sim::threadPriority();
+    sim::registerQueue(this);
+    if (sim::running() || sim::startingThread()) {
+        /* Already dispatched by the kernel loop */
+        return;
+    }
+    if (ms >= 0) {
+        sim::schedule(sim::now() + ms * 1000, &sim::stop, 0, false);
+    }
+    sim::run();
+}
+
+void EventQueue::break_dispatch()
+{
+    sim::stop();
+}
+
+void EventQueue::chain(EventQueue *target)
+{
+    _chained = target;
+    if (target) {
+        sim_priority = target->sim_priority;
+        sim::registerQueue(this);
+    } else {
+        sim::unregisterQueue(this);
+    }
+}
+
+int EventQueue::post(mbed::Callback<void()> cb, int delay_ms, int period_ms)
+{
+    if (_events.size() >= _capacity) {
+        sim::stats().postFailures++;
+        return 0;
+    }
+
+    PendingEvent ev;
+    ev.id = _nextId++;
+    ev.due = sim::now() + (us_timestamp_t)delay_ms * 1000;
+    ev.period_us = period_ms < 0 ? -1 : period_ms * 1000;
+    ev.seq = _seq++;
+    ev.cb = cb;
+    _events.push_back(ev);
+    return ev.id;
+}
+
+void EventQueue::cancel(int id)
+{
+    for (size_t i = 0; i < _events.size(); i++) {
+        if (_events[i].id == id) {
+            _events.erase(_events.begin() + i);
+            return;
+        }
+    }
+}
+
+int EventQueue::time_left(int id)
+{
+    for (size_t i = 0; i < _events.size(); i++) {
+        if (_events[i].id == id) {
+            us_timestamp_t now = sim::now();
+            return _events[i].due > now ? (int)((_events[i].due - now) / 1000) : 0;
+        }
+    }
+    return -1;
+}
+
+bool EventQueue::sim_next_due(us_timestamp_t *when) const
+{
+    if (_events.empty()) {
+        return false;
+    }
+    size_t best = 0;
+    for (size_t i = 1; i < _events.size(); i++) {
+        if (_events[i].due < _events[best].due ||
+                (_events[i].due == _events[best].due && _events[i].seq < _events[best].seq)) {
+            best = i;
+        }
+    }
+    *when = _events[best].due;
+    return true;
+}
+
+void EventQueue::sim_dispatch_one()
+{
+    size_t best = 0;
+    for (size_t i = 1; i < _events.size(); i++) {
+        if (_events[i].due < _events[best].due ||
+                (_events[i].due == _events[best].due && _events[i].seq < _events[best].seq)) {
+            best = i;
+        }
+    }
+
+    mbed::Callback<void()> cb = _events[best].cb;
+    if (_events[best].period_us >= 0) {
+        _events[best].due += _events[best].period_us;
+        if (_events[best].due < sim::now()) {
+            _events[best].due = sim::now();
+        }
+        _events[best].seq = _seq++;
+    } else {
+        _events.erase(_events.begin() + best);
+    }
+
+    sim::stats().dispatches++;
+    sim::consume(sim::config().dispatchCostUs);
+    uint64_t start = sim::hostNs();
+    cb();
+    sim::stats().dispatchHostNs += sim::hostNs() - start;
+}
+
+} // namespace events
+
+/* LittleFileSystem */
+
+int LittleFileSystem::mount(BlockDevice *bd)
+{
+    int err = bd->init();
+    if (err) {
+        return err;
+    }
+    if (!bd->sim_formatted) {
+        return -EINVAL;
+    }
+    _bd = bd;
+    return 0;
+}
+
+int LittleFileSystem::unmount()
+{
+    _bd = NULL;
+    return 0;
+}
+
+int LittleFileSystem::reformat(BlockDevice *bd)
+{
+    if (bd) {
+        _bd = bd;
+    }
+    if (!_bd) {
+        return -EINVAL;
+    }
+    int err = _bd->init();
+    if (err) {
+        return err;
+    }
+    _bd->sim_formatted = true;
+    _bd->sim_files.clear();
+    _bd->sim_sync();
+    return 0;
+}
+
+/* FileSystem and File */
+
+namespace {
+
+std::string filePath(const char *path)
+{
+    while (*path == '/') {
+        path++;
+    }
+    return path;
+}
+
+std::map<std::string, mbed::FileSystem *> &fileSystems()
+{
+    static std::map<std::string, mbed::FileSystem *> *systems =
+        new std::map<std::string, mbed::FileSystem *>();
+    return *systems;
+}
+
+} // namespace
+
+namespace mbed {
+
+FileSystem::FileSystem(const char *name) : _bd(NULL), _name(name ? name : "")
+{
+    if (name) {
+        fileSystems()[_name] = this;
+    }
+}
+
+FileSystem::~FileSystem()
+{
+    if (!_name.empty()) {
+        fileSystems().erase(_name);
+    }
+}
+
+FileSystem *FileSystem::sim_lookup(const char *path, const char **rest)
+{
+    if (*path != '/') {
+        return NULL;
+    }
+    const char *end = strchr(path + 1, '/');
+    if (!end) {
+        return NULL;
+    }
+    std::map<std::string, FileSystem *>::iterator fs =
+        fileSystems().find(std::string(path + 1, end - path - 1));
+    if (fs == fileSystems().end()) {
+        return NULL;
+    }
+    *rest = end + 1;
+    return fs->second;
+}
+
+int FileSystem::remove(const char *path)
+{
+    if (!_bd) {
+        return -EINVAL;
+    }
+    if (!_bd->sim_files.erase(filePath(path))) {
+        return -ENOENT;
+    }
+    _bd->sim_sync();
+    return 0;
+}
+
+int File::open(FileSystem *fs, const char *path, int flags)
+{
+    close();
+    BlockDevice *bd = fs ? fs->sim_device() : NULL;
+    if (!bd) {
+        return -EINVAL;
+    }
+    std::string name = filePath(path);
+    std::map<std::string, std::vector<uint8_t> >::iterator file = bd->sim_files.find(name);
+    if (file == bd->sim_files.end()) {
+        if (!(flags & O_CREAT)) {
+            return -ENOENT;
+        }
+        bd->sim_files[name];
+    } else if (flags & O_TRUNC) {
+        file->second.clear();
+    }
+    _fs = fs;
+    _path = name;
+    _flags = flags;
+    _pos = 0;
+    _dirty = false;
+    return 0;
+}
+
+int File::close()
+{
+    if (!_fs) {
+        return -EINVAL;
+    }
+    /* littlefs commits a file's new contents atomically when it is closed */
+    if (_dirty) {
+        sim::consume(sim::g_config.fileWriteCostUs);
+        sim::g_stats.fileWrites++;
+        _fs->sim_device()->sim_sync();
+    }
+    _fs = NULL;
+    return 0;
+}
+
+ssize_t File::read(void *buffer, size_t size)
+{
+    if (!_fs || (_flags & O_ACCMODE) == O_WRONLY) {
+        return -EBADF;
+    }
+    const std::vector<uint8_t> &data = _fs->sim_device()->sim_files[_path];
+    size_t count = _pos < data.size() ? std::min(size, data.size() - _pos) : 0;
+    memcpy(buffer, data.data() + _pos, count);
+    _pos += count;
+    sim::consume(sim::g_config.fileReadCostUs);
+    sim::g_stats.fileReads++;
+    return count;
+}
+
+ssize_t File::write(const void *buffer, size_t size)
+{
+    if (!_fs || (_flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    std::vector<uint8_t> &data = _fs->sim_device()->sim_files[_path];
+    if (data.size() < _pos + size) {
+        data.resize(_pos + size);
+    }
+    memcpy(data.data() + _pos, buffer, size);
+    _pos += size;
+    _dirty = true;
+    sim::g_stats.fileBytesWritten += size;
+    return size;
+}
+
+off_t File::size()
+{
+    if (!_fs) {
+        return -EINVAL;
+    }
+    return _fs->sim_device()->sim_files[_path].size();
+}
+
+} // namespace mbed
+
+/* FileBlockDevice
+ *
+ * Image layout: "GPBD", a formatted flag, then for each file its name and contents, each
+ * preceded by a 32-bit length.
+ */
+
+namespace {
+
+const char FILE_DEVICE_MAGIC[4] = {'G', 'P', 'B', 'D'};
+
+bool readU32(FILE *file, uint32_t *value)
+{
+    return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+void writeU32(FILE *file, uint32_t value)
+{
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+} // namespace
+
+int FileBlockDevice::init()
+{
+    if (_loaded || sim_path.empty()) {
+        _loaded = true;
+        return 0;
+    }
+    _loaded = true;
+
+    FILE *file = fopen(sim_path.c_str(), "rb");
+    if (!file) {
+        /* Erased flash */
+        return 0;
+    }
+    char magic[4];
+    uint32_t formatted;
+    uint32_t count;
+    if (fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, FILE_DEVICE_MAGIC, 4) &&
+            readU32(file, &formatted) && readU32(file, &count)) {
+        sim_formatted = formatted;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t length;
+            if (!readU32(file, &length)) {
+                break;
+            }
+            std::string name(length, '\0');
+            std::vector<uint8_t> data;
+            if (fread(&name[0], 1, length, file) != length || !readU32(file, &length)) {
+                break;
+            }
+            data.resize(length);
+            if (length && fread(data.data(), 1, length, file) != length) {
+                break;
+            }
+            sim_files[name] = data;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+void FileBlockDevice::sim_sync()
+{
+    if (sim_path.empty()) {
+        return;
+    }
+    FILE *file = fopen(sim_path.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    fwrite(FILE_DEVICE_MAGIC, sizeof(FILE_DEVICE_MAGIC), 1, file);
+    writeU32(file, sim_formatted);
+    writeU32(file, sim_files.size());
+    for (std::map<std::string, std::vector<uint8_t> >::iterator it = sim_files.begin();
+            it != sim_files.end(); ++it) {
+        writeU32(file, it->first.size());
+        fwrite(it->first.data(), 1, it->first.size(), file);
+        writeU32(file, it->second.size());
+        fwrite(it->second.data(), 1, it->second.size(), file);
+    }
+    fclose(file);
+}
@@ -0,0 +1,153 @@
+/* Host simulator kernel
+ *
+ * Everything runs on a single host thread against a virtual microsecond clock:
+ *
+ *  - "hardware" events (pin edges, Ticker expiries, radio connection events) sit on a timeline
+ *    and run in simulated interrupt context as soon as the clock reaches them, including while
+ *    the CPU is busy inside an event queue callback;
+ *  - EventQueue callbacks run when they are due, highest priority queue first. A queue takes the
+ *    priority of the thread dispatching it, and one of higher priority preempts the callback
+ *    running whenever that burns CPU time (consume());
+ *  - CPU time is modelled: every dispatch, ISR and stack call consumes a configurable number of
+ *    virtual microseconds (see Config), so queueing delays show up in measured latencies.
+ *
+ * Host wall-clock time spent inside firmware code is tracked separately (Stats::*HostNs).
+ */
+
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include "mbed.h"
+
+namespace events {
+class EventQueue;
+}
+
+namespace sim {
+
+struct Config {
+    /** Cost of taking an interrupt and running an ISR prologue/epilogue */
+    uint32_t isrCostUs;
+    /** Cost of dequeuing and invoking one EventQueue callback */
+    uint32_t dispatchCostUs;
+    /** Cost of one blocking ADC conversion */
+    uint32_t adcSampleCostUs;
+    /** Cost of one GattServer::write() into the stack */
+    uint32_t gattWriteCostUs;
+    /** Cost of one BLE::processEvents() call */
+    uint32_t processEventsCostUs;
+    /** Cost of opening and reading a small file, metadata lookup included */
+    uint32_t fileReadCostUs;
+    /** Cost of committing a small file on close: programming its blocks and the metadata pair */
+    uint32_t fileWriteCostUs;
+
+    /**
+     * The central scans for scanWindowUs out of every scanIntervalUs and connects on the first
+     * advertising packet it hears, connectSetupUs before the connection callback
+     */
+    uint32_t scanIntervalUs;
+    uint32_t scanWindowUs;
+    uint32_t connectSetupUs;
+    /** Delay between setLinkSecurity() and the pairing request reaching the application */
+    uint32_t pairingRequestDelayUs;
+    /** Delay between acceptPairingRequest() and the link being encrypted */
+    uint32_t pairingDelayUs;
+    /** Delay to re-encrypt a link with an existing bond */
+    uint32_t reencryptDelayUs;
+
+    /** Shortest connection interval the central accepts, in 1.25 ms units */
+    uint16_t centralMinInterval;
+    /** Whether the central applies connection parameter updates or turns them down */
+    bool centralAcceptsUpdates;
+    /** Notification buffers available in the stack */
+    unsigned txBuffers;
+    /** Notifications the link layer transmits per connection event */
+    unsigned txPerEvent;
+
+    /** Peak ADC noise added to every conversion, in 12-bit LSBs */
+    unsigned adcNoiseLsb;
+
+    Config();
+};
+
+struct Stats {
+    uint32_t interrupts;
+    uint32_t dispatches;
+    uint32_t postFailures;
+    uint64_t busyUs;
+    uint64_t isrHostNs;
+    uint64_t dispatchHostNs;
+    uint32_t adcConversions;
+    uint32_t advertisingEvents;
+    uint32_t fileReads;
+    uint32_t fileWrites;
+    uint32_t fileBytesWritten;
+
+    uint32_t gattWrites;
+    uint32_t gattWriteFailures;
+    uint32_t packetsOnAir;
+    uint32_t bytesOnAir;
+    /** Connection events the peripheral woke up for, i.e. not skipped with slave latency */
+    uint32_t connectionEvents;
+};
+
+Config &config();
+Stats &stats();
+void resetStats();
+
+/** Current virtual time in microseconds */
+us_timestamp_t now();
+
+/** Burn CPU time; interrupts that fall due meanwhile are taken */
+void consume(uint32_t us);
+
+/** True while running in simulated interrupt context */
+bool inIsr();
+
+/**
+ * Schedule a hardware event. Events flagged as interrupts run in interrupt context and are
+ * counted in Stats::interrupts; the others model peripherals outside the application CPU
+ * (the radio, the test stimulus). Returns an id for cancel().
+ */
+int schedule(us_timestamp_t at, mbed::Callback<void()> fn, uint32_t periodUs = 0,
+             bool interrupt = true);
+void cancel(int id);
+
+/** Run until stop() is called or nothing is left to do */
+void run();
+void stop();
+bool running();
+
+/** Event queues register themselves so run() can dispatch them */
+void registerQueue(events::EventQueue *queue);
+void unregisterQueue(events::EventQueue *queue);
+
+/** Priority of the thread running now: main's, or the one whose body is being started */
+int threadPriority();
+
+/** True while a Thread body is being started; its queue only registers then */
+bool startingThread();
+void startThread(int priority, mbed::Callback<void()> task);
+
+/** Drive a digital input; edges fire the InterruptIn handlers in interrupt context */
+void setPin(PinName pin, int level);
+int getPin(PinName pin);
+
+/** Drive an analog input with a normalised voltage (0.0 - 1.0) */
+void setAnalog(PinName pin, float value);
+
+/** Type text into the serial console; each character raises a receive interrupt */
+void serialInput(const char *text);
+
+/** Duty cycle a PwmOut drives on a pin */
+float getPwm(PinName pin);
+
+/** Record host time spent in firmware code */
+void addIsrHostNs(uint64_t ns);
+
+/** Monotonic host clock, for measuring real CPU cost */
+uint64_t hostNs();
+
+} // namespace sim
+
+#endif // SIM_KERNEL_H
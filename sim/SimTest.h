@@ -0,0 +1,39 @@
+/* Minimal host unit test harness
+ *
+ * A test program calls its test functions from main() and returns simtest::report(). CHECK()
+ * prints every condition that does not hold and counts it; the run then ends with PASSED or
+ * FAILED, and exits non-zero on failure, which is what `make test` looks for.
+ */
+
+#ifndef SIM_SIM_TEST_H
+#define SIM_SIM_TEST_H
+
+#include <stdio.h>
+
+namespace simtest {
+
+/** Checks that have failed so far */
+inline int &failures()
+{
+    static int count;
+    return count;
+}
+
+/** Print the verdict; @return the exit status for main() */
+inline int report()
+{
+    printf("%s\n", failures() ? "FAILED" : "PASSED");
+    return failures() ? 1 : 0;
+}
+
+} // namespace simtest
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            simtest::failures()++; \
+        } \
+    } while (0)
+
+#endif
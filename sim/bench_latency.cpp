@@ -0,0 +1,867 @@
+/* End-to-end latency benchmark for the gamepad firmware
+ *
+ * Boots the unmodified firmware in the simulator, waits for the simulated host to connect and
+ * encrypt the link, then injects button/hat edges and stick steps and measures, in virtual
+ * time, how long each input change takes to reach GattServer::write() and the radio.
+ *
+ * An edge counts as delivered by the first accepted write that shows its effect. Edges that are
+ * overridden by a newer edge on the same input before being delivered count as superseded.
+ *
+ * Boot is measured too: the time until the firmware hands over to the BLE stack and until the
+ * host can read the first report, with or without a settings record already on the file system
+ * (--config), and optionally with the sticks held away from the centre at power up. With
+ * --flash, /fs is kept in a host file across runs like flash across resets, so a second run
+ * finds the bond and the settings stored by the first.
+ *
+ * --disconnects drops the link at even intervals, with the host out of range for --host-away
+ * each time, and reports how long reconnecting took in each advertising phase.
+ *
+ * --play and --pause alternate stretches of input with quiet ones, over which the connection
+ * parameters should relax and come back; --reject-updates makes the host refuse every update.
+ *
+ * Built with JOYSTICK_EXTENDED_REPORT (bench_latency_extended), the sticks are reported at
+ * STICK_REPORT_BITS and the two analog triggers are stepped like the stick axes. Axis errors are
+ * given in 8-bit counts either way so the two builds compare.
+ *
+ * The firmware is built with LATENCY_TRACE and QUEUE_STATS: the time each traced edge spent
+ * between the stages of the path is summarised from its histograms, and each event queue's
+ * depth and per-type dispatch lag from its counters. --trace-dump also types 'd' and 'q' into
+ * the console at the end of the run for the firmware's own dumps.
+ *
+ * Input runs on its own high priority queue and thread (INPUT_THREAD), above BLE event
+ * processing; bench_latency_shared is built with INPUT_THREAD 0 to put everything back on one
+ * queue. --ble-cost sets the CPU time each BLE::processEvents() call takes, to see how much a
+ * busy stack delays input in either build.
+ */
+
+#include "SimKernel.h"
+#include "SimBLE.h"
+#include "JoystickService.h"
+#include "InputPin.h"
+#include "LatencyTrace.h"
+#include "QueueStats.h"
+#include "StickPoller.h"
+#include "AxisProcessor.h"
+#include "ConfigStore.h"
+#include "Advertiser.h"
+#include "ConnParamManager.h"
+#include "Storage.h"
+#include "FileBlockDevice.h"
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+int firmware_main();
+extern events::EventQueue queue;
+extern events::EventQueue &inputQueue;
+extern JoystickService *hidServicePtr;
+extern StickPoller stickPoller;
+extern ConfigStore settingsStore;
+extern Advertiser advertiser;
+extern ConnParamManager connParams;
+
+namespace {
+
+const unsigned REPORT_LENGTH = JOYSTICK_REPORT_LENGTH;
+
+struct Options {
+    unsigned durationMs;
+    unsigned buttonRate;
+    unsigned stickRate;
+    unsigned stickStep;
+    unsigned seed;
+    int sendMode;
+    unsigned bounce;
+    int debounceTicks;
+    bool storedConfig;
+    const char *flashFile;
+    unsigned disconnects;
+    unsigned hostAwayMs;
+    int advFastMs;
+    float bootDeflection;
+    unsigned playMs;
+    unsigned pauseMs;
+    int keepAliveMs;
+    /* Feature and output reports the host writes as the run starts, if set */
+    const char *tune;
+    const char *rumble;
+    bool traceDump;
+};
+
+enum InputKind {
+    INPUT_BUTTON,
+    INPUT_HAT,
+    INPUT_AXIS,
+    INPUT_TRIGGER,
+    INPUT_KINDS
+};
+
+struct Input {
+    PinName pin;
+    InputKind kind;
+    /* Byte of a button or the hat, index of an axis or a trigger */
+    unsigned byte;
+    uint8_t mask;
+};
+
+const Input INPUTS[] = {
+    {P0_11, INPUT_BUTTON, 0, 0x01},
+    {P0_12, INPUT_BUTTON, 0, 0x02},
+    {P0_13, INPUT_BUTTON, 0, 0x04},
+    {P0_14, INPUT_BUTTON, 0, 0x08},
+    {P0_15, INPUT_BUTTON, 0, 0x10},
+    {P0_16, INPUT_BUTTON, 0, 0x20},
+    {P0_26, INPUT_BUTTON, 0, 0x40},
+    {P0_27, INPUT_BUTTON, 0, 0x80},
+    {P0_22, INPUT_HAT, 1, 0xF0},
+    {P0_23, INPUT_HAT, 1, 0xF0},
+    {P0_24, INPUT_HAT, 1, 0xF0},
+    {P0_25, INPUT_HAT, 1, 0xF0},
+    {A5, INPUT_AXIS, 0, 0},
+    {A4, INPUT_AXIS, 1, 0},
+    {A3, INPUT_AXIS, 2, 0},
+    {A2, INPUT_AXIS, 3, 0},
+#if JOYSTICK_EXTENDED_REPORT
+    {A0, INPUT_TRIGGER, 0, 0},
+    {A1, INPUT_TRIGGER, 1, 0},
+#endif
+};
+const unsigned INPUT_COUNT = sizeof(INPUTS) / sizeof(INPUTS[0]);
+const unsigned DIGITAL_INPUT_COUNT = 12;
+/* Stick axes and triggers */
+const unsigned AXIS_COUNT = INPUT_COUNT - DIGITAL_INPUT_COUNT;
+
+/* Triggers rest released; sticks centred */
+const float TRIGGER_REST = 0.05f;
+
+/* An axis counts as settled this long after its last step */
+const uint32_t AXIS_SETTLE_US = 300000;
+const uint32_t AXIS_ERROR_PERIOD_US = 5000;
+
+struct PendingEdge {
+    unsigned input;
+    us_timestamp_t time;
+    /* Buttons: the bit value the host must see. Hat and axes: the value the host saw before */
+    uint16_t value;
+};
+
+Options g_options;
+uint32_t g_rand;
+
+us_timestamp_t g_start;
+us_timestamp_t g_end;
+uint16_t g_interval;
+bool g_measuring;
+
+us_timestamp_t g_bleInitUs;
+us_timestamp_t g_firstReportUs;
+bool g_rebonded;
+uint32_t g_bootConversions;
+
+uint8_t g_hostReport[REPORT_LENGTH];
+std::vector<PendingEdge> g_pending;
+std::deque<std::vector<us_timestamp_t> > g_inFlight;
+
+std::vector<uint32_t> g_writeLatency;
+std::vector<uint32_t> g_airLatency;
+std::vector<uint32_t> g_axisWriteLatency;
+uint32_t g_pollWakeups;
+uint32_t g_idleMs;
+unsigned g_edges[INPUT_KINDS];
+unsigned g_superseded;
+unsigned g_writesAttempted;
+unsigned g_writesAccepted;
+unsigned g_logicalTransitions;
+unsigned g_hostTransitions;
+
+float g_axisValue[AXIS_COUNT];
+us_timestamp_t g_axisStepTime[AXIS_COUNT];
+unsigned g_axisChanges;
+unsigned g_axisJitter;
+double g_axisErrorSum;
+double g_axisErrorMax;
+unsigned g_axisErrorSamples;
+
+uint32_t random32()
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 17;
+    g_rand ^= g_rand << 5;
+    return g_rand;
+}
+
+/* Exponentially distributed gap for a Poisson process of the given rate */
+uint32_t poissonGapUs(unsigned ratePerSecond)
+{
+    double u = (random32() + 1.0) / 4294967297.0;
+    return (uint32_t)(-log(u) * 1000000.0 / ratePerSecond);
+}
+
+/* An axis or trigger value in a report, at report resolution */
+uint16_t analogValue(const uint8_t *report, const Input &in)
+{
+    if (in.kind == INPUT_TRIGGER) {
+        return JoystickPacker::unpack(report + JoystickPacker::TRIGGER_OFFSET / 8, in.byte,
+                                      JoystickPacker::TRIGGER_BITS);
+    }
+    return JoystickPacker::unpack(report + JoystickPacker::AXIS_OFFSET / 8, in.byte,
+                                  JoystickPacker::AXIS_BITS);
+}
+
+float restValue(const Input &in)
+{
+    return in.kind == INPUT_TRIGGER ? TRIGGER_REST : 0.5f;
+}
+
+void recordEdge(unsigned input, uint16_t value)
+{
+    if (!g_measuring) {
+        return;
+    }
+    /* The four hat inputs share one report field, so a hat edge supersedes any other */
+    for (size_t i = 0; i < g_pending.size(); i++) {
+        if (g_pending[i].input == input ||
+                (INPUTS[input].kind == INPUT_HAT && INPUTS[g_pending[i].input].kind == INPUT_HAT)) {
+            g_pending.erase(g_pending.begin() + i);
+            g_superseded++;
+            break;
+        }
+    }
+    PendingEdge edge = {input, sim::now(), value};
+    g_pending.push_back(edge);
+    g_edges[INPUTS[input].kind]++;
+}
+
+void setDigital(unsigned input, bool pressed)
+{
+    const Input &in = INPUTS[input];
+    if (sim::getPin(in.pin) == !pressed) {
+        return;
+    }
+    uint8_t expected = in.kind == INPUT_BUTTON ? (pressed ? in.mask : 0)
+                                               : (g_hostReport[in.byte] & in.mask);
+    recordEdge(input, expected);
+    if (g_measuring) {
+        g_logicalTransitions++;
+    }
+
+    /* Active low, pulled up. The contact bounces before settling at the new level */
+    int level = !pressed;
+    sim::setPin(in.pin, level);
+    us_timestamp_t t = sim::now();
+    for (unsigned i = 0; i < 2 * g_options.bounce; i++) {
+        t += 100 + random32() % 1500;
+        PinName pin = in.pin;
+        int bounceLevel = (i % 2) ? level : !level;
+        sim::schedule(t, [pin, bounceLevel]() { sim::setPin(pin, bounceLevel); }, 0, false);
+    }
+}
+
+void setAxis(unsigned input, float value)
+{
+    const Input &in = INPUTS[input];
+    recordEdge(input, analogValue(g_hostReport, in));
+    sim::setAnalog(in.pin, value);
+    g_axisValue[input - DIGITAL_INPUT_COUNT] = value;
+    g_axisStepTime[input - DIGITAL_INPUT_COUNT] = sim::now();
+}
+
+bool axisSettled(unsigned axis)
+{
+    return sim::now() - g_axisStepTime[axis] >= AXIS_SETTLE_US;
+}
+
+/*
+ * Compare what the host sees with the stick position: half scale at the centre the firmware
+ * sampled at boot, 0 and full scale at the ends of the ADC range. Errors are in 8-bit counts.
+ */
+void sampleAxisError()
+{
+    if (!g_measuring) {
+        return;
+    }
+    const double centre = 1 << (JoystickPacker::AXIS_BITS - 1);
+    const double perCount = 1 << (JoystickPacker::AXIS_BITS - 8);
+    for (unsigned axis = 0; axis < AXIS_COUNT; axis++) {
+        const Input &in = INPUTS[DIGITAL_INPUT_COUNT + axis];
+        if (in.kind != INPUT_AXIS || !axisSettled(axis)) {
+            continue;
+        }
+        double offset = g_axisValue[axis] - 0.5;
+        double ideal = centre + offset * (offset < 0 ? 2 * centre : 2 * centre - 2);
+        double error = fabs(analogValue(g_hostReport, in) - ideal) / perCount;
+        g_axisErrorSum += error;
+        g_axisErrorSamples++;
+        if (error > g_axisErrorMax) {
+            g_axisErrorMax = error;
+        }
+    }
+}
+
+bool isDelivered(const PendingEdge &edge, const uint8_t *report)
+{
+    const Input &in = INPUTS[edge.input];
+    if (in.kind == INPUT_AXIS || in.kind == INPUT_TRIGGER) {
+        return analogValue(report, in) != edge.value;
+    }
+    uint8_t current = report[in.byte] & in.mask;
+    if (in.kind == INPUT_BUTTON) {
+        return current == edge.value;
+    }
+    return current != (edge.value & in.mask);
+}
+
+/* The host puts each input report in its place in the whole report, by characteristic */
+void mergeReport(uint8_t *merged, GattAttribute::Handle_t handle, const uint8_t *data, uint16_t len)
+{
+    memcpy(merged, g_hostReport, REPORT_LENGTH);
+    for (unsigned i = 0; i < hidServicePtr->inputReportCount(); i++) {
+        if (hidServicePtr->inputReportHandle(i) == handle) {
+            unsigned offset = JoystickService::reportOffset(i);
+            memcpy(merged + offset, data, std::min<unsigned>(len, REPORT_LENGTH - offset));
+            return;
+        }
+    }
+}
+
+void onNotify(GattAttribute::Handle_t handle, const uint8_t *written, uint16_t len, ble_error_t result)
+{
+    if (!g_measuring) {
+        return;
+    }
+    g_writesAttempted++;
+    if (result != BLE_ERROR_NONE) {
+        return;
+    }
+    g_writesAccepted++;
+
+    uint8_t data[REPORT_LENGTH];
+    mergeReport(data, handle, written, len);
+
+    std::vector<us_timestamp_t> delivered;
+    for (size_t i = 0; i < g_pending.size();) {
+        if (isDelivered(g_pending[i], data)) {
+            g_writeLatency.push_back(sim::now() - g_pending[i].time);
+            if (INPUTS[g_pending[i].input].kind >= INPUT_AXIS) {
+                g_axisWriteLatency.push_back(sim::now() - g_pending[i].time);
+            }
+            delivered.push_back(g_pending[i].time);
+            g_pending.erase(g_pending.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    g_inFlight.push_back(delivered);
+
+    for (unsigned axis = 0; axis < AXIS_COUNT; axis++) {
+        const Input &in = INPUTS[DIGITAL_INPUT_COUNT + axis];
+        if (analogValue(g_hostReport, in) != analogValue(data, in)) {
+            g_axisChanges++;
+            if (axisSettled(axis)) {
+                g_axisJitter++;
+            }
+        }
+    }
+
+    g_hostTransitions += __builtin_popcount(g_hostReport[0] ^ data[0]);
+    if ((g_hostReport[1] ^ data[1]) & 0xF0) {
+        g_hostTransitions++;
+    }
+    memcpy(g_hostReport, data, REPORT_LENGTH);
+}
+
+void onAir(GattAttribute::Handle_t handle, const uint8_t *data, uint16_t len)
+{
+    if (g_inFlight.empty()) {
+        return;
+    }
+    const std::vector<us_timestamp_t> &edges = g_inFlight.front();
+    for (size_t i = 0; i < edges.size(); i++) {
+        g_airLatency.push_back(sim::now() - edges[i]);
+    }
+    g_inFlight.pop_front();
+}
+
+/* Inputs only change during the play stretches */
+bool playing(us_timestamp_t t)
+{
+    if (!g_options.pauseMs) {
+        return true;
+    }
+    uint64_t cycleUs = (uint64_t)(g_options.playMs + g_options.pauseMs) * 1000;
+    return (t - g_start) % cycleUs < (uint64_t)g_options.playMs * 1000;
+}
+
+void releaseDigital(unsigned input)
+{
+    setDigital(input, false);
+}
+
+void scheduleButtons()
+{
+    us_timestamp_t t = g_start;
+    while (g_options.buttonRate) {
+        t += poissonGapUs(g_options.buttonRate);
+        if (t >= g_end) {
+            break;
+        }
+        if (!playing(t)) {
+            continue;
+        }
+        unsigned input = random32() % DIGITAL_INPUT_COUNT;
+        uint32_t holdUs = 30000 + random32() % 90000;
+        sim::schedule(t, [input]() { setDigital(input, true); }, 0, false);
+        sim::schedule(t + holdUs, [input]() { releaseDigital(input); }, 0, false);
+    }
+}
+
+/* Random positions, or a random walk of stickStep counts per step */
+void scheduleSticks()
+{
+    for (unsigned input = DIGITAL_INPUT_COUNT; input < INPUT_COUNT && g_options.stickRate; input++) {
+        us_timestamp_t t = g_start;
+        float value = 0.5f;
+        while (true) {
+            t += poissonGapUs(g_options.stickRate);
+            if (t >= g_end) {
+                break;
+            }
+            if (!playing(t)) {
+                continue;
+            }
+            if (g_options.stickStep) {
+                float step = g_options.stickStep / 255.0f;
+                value += (random32() & 1) ? step : -step;
+                if (value < 0.1f || value > 0.9f) {
+                    value = 0.5f;
+                }
+            } else {
+                value = 0.1f + (random32() % 1000) * 0.0008f;
+            }
+            sim::schedule(t, [input, value]() { setAxis(input, value); }, 0, false);
+        }
+    }
+}
+
+void onBleInit()
+{
+    g_bleInitUs = sim::now();
+    g_bootConversions = sim::stats().adcConversions;
+}
+
+/* A settings record as a previous boot with the sticks centred would have saved it */
+void storeSettings()
+{
+    GamepadSettings settings;
+    /* The sticks rest at half scale: 12-bit 2048, widened to 16 bits like the HAL does */
+    uint16_t centre = (2048 << 4) | (2048 >> 8);
+    for (unsigned axis = 0; axis < GamepadSettings::AXES; axis++) {
+        settings.axisMin[axis] = 0;
+        settings.axisCentre[axis] = centre;
+        settings.axisMax[axis] = 65535;
+    }
+    settings.deadzone = STICK_DEADZONE;
+    settings.curve = STICK_CURVE;
+    settings.pollMinMs = STICK_POLL_MIN_MS;
+    settings.pollIdleMs = STICK_POLL_IDLE_MS;
+    settings.profile = 0;
+    for (unsigned input = 0; input < GamepadSettings::INPUTS; input++) {
+        settings.setTicks(input, INPUT_DEBOUNCE_TICKS);
+    }
+
+    BlockDevice *bd = storage_device();
+    bd->init();
+    std::vector<uint8_t> &file = bd->sim_files["gamepad.cfg"];
+    file.resize(ConfigStore::RECORD_SIZE);
+    ConfigStore::encode(settings, file.data());
+    bd->sim_formatted = true;
+    bd->sim_sync();
+}
+
+void onConnected()
+{
+    g_rebonded = BLE::Instance().securityManager().bonded;
+}
+
+/* Parse up to count comma separated numbers into values; returns how many were given */
+unsigned parseList(const char *list, unsigned *values, unsigned count)
+{
+    unsigned n = 0;
+    while (n < count && *list) {
+        char *end;
+        values[n++] = strtoul(list, &end, 0);
+        list = *end == ',' ? end + 1 : end + strlen(end);
+    }
+    return n;
+}
+
+/* The host tunes the gamepad and starts the rumble, over the running connection */
+void hostWrites()
+{
+    if (g_options.tune) {
+        unsigned values[6];
+        if (parseList(g_options.tune, values, 6) == 6) {
+            JoystickTuning tuning;
+            tuning.pollMinMs = values[0];
+            tuning.pollIdleMs = values[1];
+            tuning.debounceMs = values[2];
+            tuning.coalesceMs = values[3];
+            tuning.sendMode = values[4];
+            tuning.keepAliveMs = values[5];
+            uint8_t feature[JOYSTICK_FEATURE_LENGTH];
+            tuning.encode(feature);
+            sim::bleHostWrite(hidServicePtr->featureReportHandle(), feature, sizeof(feature));
+        }
+    }
+    if (g_options.rumble) {
+        unsigned values[3] = {0, 0, 0};
+        parseList(g_options.rumble, values, 3);
+        uint8_t output[JOYSTICK_OUTPUT_LENGTH] = {
+            (uint8_t)values[0], (uint8_t)values[1], (uint8_t)values[2], 0x01
+        };
+        sim::bleHostWrite(hidServicePtr->outputReportHandle(), output, sizeof(output));
+    }
+}
+
+void onEncrypted()
+{
+    if (g_start) {
+        return;
+    }
+    /* HID hosts read the report characteristic as soon as the link is encrypted */
+    g_firstReportUs = sim::now();
+
+    /* The user lets go of the sticks they were holding at power up */
+    for (unsigned i = DIGITAL_INPUT_COUNT; i < INPUT_COUNT; i++) {
+        setAxis(i, restValue(INPUTS[i]));
+    }
+    /* Give the application a moment to settle after pairing */
+    g_start = sim::now() + 200000;
+    g_interval = sim::bleConnectionInterval();
+    g_end = g_start + (us_timestamp_t)g_options.durationMs * 1000;
+
+    sim::schedule(g_start, []() {
+        if (g_options.sendMode >= 0) {
+            hidServicePtr->setSendMode((SendMode)g_options.sendMode);
+        }
+        if (g_options.keepAliveMs >= 0) {
+            hidServicePtr->setKeepAlive(g_options.keepAliveMs);
+        }
+        hostWrites();
+        hidServicePtr->reportsCoalesced = 0;
+        hidServicePtr->reportsSuppressed = 0;
+        hidServicePtr->keepAlivesSent = 0;
+        hidServicePtr->reportsRetried = 0;
+        hidServicePtr->statesDropped = 0;
+        hidServicePtr->blockedUs = 0;
+        hidServicePtr->maxBlockedUs = 0;
+        InputPin::events.resetCounters();
+        if (g_options.debounceTicks >= 0) {
+            InputPin::debouncer.setAllTicks(g_options.debounceTicks);
+        }
+        InputPin::maxDrainLagUs = 0;
+        LatencyTrace::reset();
+        QueueStats::reset();
+        /* HID hosts read the report characteristic when they connect */
+        JoystickService::reportState().read(g_hostReport);
+        sim::resetStats();
+        g_pollWakeups = stickPoller.wakeups;
+        g_idleMs = connParams.idleTimeMs();
+        g_measuring = true;
+    }, 0, false);
+    scheduleButtons();
+    scheduleSticks();
+    for (unsigned i = 0; i < g_options.disconnects; i++) {
+        us_timestamp_t t = g_start + (us_timestamp_t)g_options.durationMs * 1000 * (2 * i + 1) /
+                           (2 * g_options.disconnects);
+        sim::schedule(t, []() {
+            if (sim::bleConnectionInterval()) {
+                sim::bleHostAway(g_options.hostAwayMs * 1000);
+                sim::bleDisconnect();
+            }
+        }, 0, false);
+    }
+    sim::schedule(g_start + AXIS_ERROR_PERIOD_US, &sampleAxisError, AXIS_ERROR_PERIOD_US, false);
+    sim::schedule(g_end, []() {
+        g_measuring = false;
+        g_pollWakeups = stickPoller.wakeups - g_pollWakeups;
+        g_idleMs = connParams.idleTimeMs() - g_idleMs;
+    }, 0, false);
+    if (g_options.traceDump) {
+        sim::schedule(g_end + 100000, []() { sim::serialInput("dq"); }, 0, false);
+    }
+    sim::schedule(g_end + 500000, &sim::stop, 0, false);
+}
+
+void printPercentiles(const char *name, std::vector<uint32_t> &values)
+{
+    if (values.empty()) {
+        printf("%-24s: no samples\n", name);
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    printf("%-24s: p50 %6u us  p99 %6u us  max %6u us  (n=%u)\n", name,
+           values[values.size() / 2],
+           values[(values.size() * 99) / 100],
+           values.back(),
+           (unsigned)values.size());
+}
+
+void printQueueStats(const char *name, events::EventQueue *events)
+{
+    printf("%-24s: high water %u/%u, %u failed posts\n", name, QueueStats::highWater(events),
+           events->sim_capacity(), QueueStats::failedPosts(events));
+    for (unsigned type = 0; type < QueueStats::EVENT_TYPES; type++) {
+        const QueueStats::TypeStats &stats = QueueStats::stats(events, (QueueStats::EventType)type);
+        if (!stats.runs) {
+            continue;
+        }
+        printf("%-24s: %-11s %7u runs, lag mean %5u max %6u us, run mean %4u max %5u us\n", "",
+               QueueStats::typeName((QueueStats::EventType)type), stats.runs,
+               (unsigned)(stats.totalLagUs / stats.runs), stats.maxLagUs,
+               (unsigned)(stats.totalRunUs / stats.runs), stats.maxRunUs);
+    }
+}
+
+void printResults()
+{
+    double seconds = g_options.durationMs / 1000.0;
+    const sim::Stats &stats = sim::stats();
+
+    printf("\n== gamepad sim: %u button edges/s (%u bounces), %u stick steps/s/axis, %.1f s, interval %.2f ms ==\n",
+           g_options.buttonRate, g_options.bounce, g_options.stickRate, seconds,
+           g_interval * 1.25);
+    char reports[32] = "";
+    for (unsigned i = 0; i < hidServicePtr->inputReportCount(); i++) {
+        unsigned end = i + 1 < hidServicePtr->inputReportCount() ? JoystickService::reportOffset(i + 1)
+                                                                 : REPORT_LENGTH;
+        snprintf(reports + strlen(reports), sizeof(reports) - strlen(reports), "%s%u",
+                 i ? "+" : "", end - JoystickService::reportOffset(i));
+    }
+    printf("%-24s: %u bytes in %u input reports (%s), %u-bit axes, %u triggers\n", "report",
+           REPORT_LENGTH, hidServicePtr->inputReportCount(), reports, JoystickPacker::AXIS_BITS,
+           JoystickPacker::TRIGGERS);
+    printf("%-24s: %u buttons, %u hat, %u axes, %u triggers\n", "input changes",
+           g_edges[INPUT_BUTTON], g_edges[INPUT_HAT], g_edges[INPUT_AXIS], g_edges[INPUT_TRIGGER]);
+    printf("%-24s: %u delivered, %u superseded, %u never visible\n", "edges",
+           (unsigned)g_writeLatency.size(), g_superseded, (unsigned)g_pending.size());
+    printf("%-24s: %u seen by host, %u made by user\n", "button/hat transitions",
+           g_hostTransitions, g_logicalTransitions);
+    printf("%-24s: %u seen by host, %u while settled (jitter)\n", "axis changes",
+           g_axisChanges, g_axisJitter);
+    printf("%-24s: mean %.2f max %.2f counts (%u samples)\n", "settled axis error",
+           g_axisErrorSamples ? g_axisErrorSum / g_axisErrorSamples : 0.0, g_axisErrorMax,
+           g_axisErrorSamples);
+    printPercentiles("edge -> write", g_writeLatency);
+    printPercentiles("edge -> air", g_airLatency);
+    printPercentiles("axis edge -> write", g_axisWriteLatency);
+    printf("%-24s: %u attempted, %u accepted, %u rejected\n", "GattServer::write",
+           g_writesAttempted, g_writesAccepted, g_writesAttempted - g_writesAccepted);
+    printf("%-24s: %u coalesced (writes saved)\n", "", hidServicePtr->reportsCoalesced);
+    printf("%-24s: %u suppressed as unchanged, %u keep-alives\n", "",
+           hidServicePtr->reportsSuppressed, hidServicePtr->keepAlivesSent);
+    printf("%-24s: %u retried after backpressure, %u states dropped, blocked mean %u us max %u us\n",
+           "", hidServicePtr->reportsRetried, hidServicePtr->statesDropped,
+           hidServicePtr->reportsRetried ? (unsigned)(hidServicePtr->blockedUs / hidServicePtr->reportsRetried) : 0,
+           hidServicePtr->maxBlockedUs);
+    printf("%-24s: %.1f\n", "reports/s", g_writesAccepted / seconds);
+    printf("%-24s: %.1f packets/s, %.1f bytes/s\n", "on air",
+           stats.packetsOnAir / seconds, stats.bytesOnAir / seconds);
+    printf("%-24s: %u interrupts, %u dispatches, %u failed posts\n", "application CPU",
+           stats.interrupts, stats.dispatches, stats.postFailures);
+    printf("%-24s: %.2f %% busy, %.0f host ns/report\n", "",
+           stats.busyUs * 100.0 / (seconds * 1000000.0),
+           g_writesAccepted ? (double)(stats.isrHostNs + stats.dispatchHostNs) / g_writesAccepted : 0.0);
+    printf("%-24s: %.2f ms, latency %u now; idle %.1f %% of the time, %.1f events/s\n",
+           "connection", connParams.liveInterval() * 1.25, connParams.liveLatency(),
+           g_idleMs * 100.0 / g_options.durationMs,
+           stats.connectionEvents / seconds);
+    printf("%-24s: %u requests, %u accepted, %u rejected, %u unsettled\n", "",
+           connParams.requests, connParams.accepted, connParams.rejected, connParams.unsettled);
+    printf("%-24s: %.1f wakeups/s, period %u ms now, %u ms fast, %lu failed posts\n",
+           "stick poll", g_pollWakeups / seconds, stickPoller.periodMs(),
+           stickPoller.fastPeriodMs(), (unsigned long)stickPoller.scheduleFailures);
+    printf("%-24s: %.0f conversions/s, %.2f %% CPU in conversions\n", "ADC",
+           stats.adcConversions / seconds,
+           stats.adcConversions * sim::config().adcSampleCostUs * 100.0 / (seconds * 1000000.0));
+    for (unsigned stage = LatencyTrace::DRAIN; stage < LatencyTrace::STAGES; stage++) {
+        LatencyTrace::Stage s = (LatencyTrace::Stage)stage;
+        char name[32];
+        snprintf(name, sizeof(name), "trace %s -> %s", LatencyTrace::stageName((LatencyTrace::Stage)(stage - 1)),
+                 LatencyTrace::stageName(s));
+        printf("%-24s: p50 < %6u us  p99 < %6u us  (n=%u)\n", name, LatencyTrace::percentile(s, 50),
+               LatencyTrace::percentile(s, 99), LatencyTrace::count(s));
+    }
+    printf("%-24s: p50 < %6u us  p99 < %6u us  (n=%u), %u abandoned\n", "trace isr -> sent",
+           LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 50),
+           LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 99), LatencyTrace::traces,
+           LatencyTrace::abandoned);
+    printQueueStats("main queue", &queue);
+    if (&inputQueue != &queue) {
+        printQueueStats("input queue", &inputQueue);
+    }
+    printf("%-24s: high water %u/%u, %u dropped, max drain lag %u us\n", "input edge ring",
+           (unsigned)InputPin::events.highWater(), INPUT_EVENT_RING_SIZE,
+           (unsigned)InputPin::events.drops(), (unsigned)InputPin::maxDrainLagUs);
+    printf("%-24s: ble init at %.2f ms (%u conversions), first report at %.1f ms (%s)\n", "boot",
+           g_bleInitUs / 1000.0, g_bootConversions, g_firstReportUs / 1000.0,
+           g_rebonded ? "bond restored, re-encrypted" : "paired");
+    for (unsigned phase = Advertiser::PHASE_FAST; phase < Advertiser::PHASES; phase++) {
+        const Advertiser::PhaseStats &adv = advertiser.stats[phase];
+        char name[32];
+        snprintf(name, sizeof(name), "advertising %s", Advertiser::phaseName((Advertiser::Phase)phase));
+        printf("%-24s: entered %u, %u connections, mean %.1f ms, max %u ms\n", name,
+               adv.entered, adv.connections,
+               adv.connections ? (double)adv.totalMs / adv.connections : 0.0, adv.maxMs);
+    }
+    printf("%-24s: %u advertising events\n", "", stats.advertisingEvents);
+    printf("%-24s: %s, %u loaded, %u saved, %u unchanged; %u file writes, %u bytes\n", "settings",
+           g_options.storedConfig ? "stored" : "none", settingsStore.loads, settingsStore.saves,
+           settingsStore.unchanged, stats.fileWrites, stats.fileBytesWritten);
+
+    /* What the host reads back from the feature report */
+    uint8_t feature[JOYSTICK_FEATURE_LENGTH];
+    uint16_t length = sizeof(feature);
+    JoystickTuning tuning;
+    BLE::Instance().gattServer().read(hidServicePtr->featureReportHandle(), feature, &length);
+    if (tuning.decode(feature, length)) {
+        printf("%-24s: %u written, %u rejected; poll %u-%u ms, debounce %u ms, window %u ms, %s, keep-alive %u ms\n",
+               "host tuning", hidServicePtr->tuningWrites, hidServicePtr->tuningRejected,
+               tuning.pollMinMs, tuning.pollIdleMs, tuning.debounceMs, tuning.coalesceMs,
+               tuning.sendMode == SEND_IMMEDIATE ? "immediate" : "coalesced", tuning.keepAliveMs);
+    }
+    printf("%-24s: %u commands, motors at %.2f/%.2f, player LED %s\n", "host output",
+           hidServicePtr->outputWrites, sim::getPwm(P0_9), sim::getPwm(P0_10),
+           sim::getPin(LED2) ? "on" : "off");
+}
+
+void usage(const char *name)
+{
+    printf("usage: %s [--duration ms] [--buttons edges/s] [--sticks steps/s] [--seed n]\n"
+           "          [--interval units_1.25ms] [--tx-buffers n] [--tx-per-event n]\n"
+           "          [--send-mode immediate|coalesced] [--bounce n] [--debounce-ticks n]\n"
+           "          [--stick-step counts] [--adc-noise lsb] [--config none|stored]\n"
+           "          [--boot-deflection fraction] [--flash file]\n"
+           "          [--disconnects n] [--host-away ms] [--adv-fast-ms ms]\n"
+           "          [--play ms --pause ms] [--reject-updates] [--keep-alive ms]\n"
+           "          [--tune poll_min,poll_idle,debounce,window,mode,keep_alive]\n"
+           "          [--rumble left,right,ticks_10ms] [--ble-cost us] [--trace-dump]\n", name);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    g_options.durationMs = 10000;
+    g_options.buttonRate = 20;
+    g_options.stickRate = 5;
+    g_options.stickStep = 0;
+    g_options.seed = 1;
+    g_options.sendMode = -1;
+    g_options.bounce = 0;
+    g_options.debounceTicks = -1;
+    g_options.storedConfig = false;
+    g_options.flashFile = "";
+    g_options.disconnects = 0;
+    g_options.hostAwayMs = 0;
+    g_options.advFastMs = -1;
+    g_options.bootDeflection = 0.0f;
+    g_options.playMs = 0;
+    g_options.pauseMs = 0;
+    g_options.keepAliveMs = -1;
+    g_options.tune = NULL;
+    g_options.rumble = NULL;
+    g_options.traceDump = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        unsigned value = (i + 1 < argc) ? strtoul(argv[i + 1], NULL, 0) : 0;
+        if (!strcmp(arg, "--send-mode") && i + 1 < argc) {
+            g_options.sendMode = strcmp(argv[i + 1], "immediate") ? SEND_COALESCED : SEND_IMMEDIATE;
+        } else if (!strcmp(arg, "--config") && i + 1 < argc) {
+            g_options.storedConfig = !strcmp(argv[i + 1], "stored");
+        } else if (!strcmp(arg, "--flash") && i + 1 < argc) {
+            g_options.flashFile = argv[i + 1];
+        } else if (!strcmp(arg, "--trace-dump")) {
+            g_options.traceDump = true;
+            continue;
+        } else if (!strcmp(arg, "--reject-updates")) {
+            sim::config().centralAcceptsUpdates = false;
+            continue;
+        } else if (!strcmp(arg, "--boot-deflection") && i + 1 < argc) {
+            g_options.bootDeflection = strtof(argv[i + 1], NULL);
+        } else if (!strcmp(arg, "--duration")) {
+            g_options.durationMs = value;
+        } else if (!strcmp(arg, "--buttons")) {
+            g_options.buttonRate = value;
+        } else if (!strcmp(arg, "--sticks")) {
+            g_options.stickRate = value;
+        } else if (!strcmp(arg, "--stick-step")) {
+            g_options.stickStep = value;
+        } else if (!strcmp(arg, "--disconnects")) {
+            g_options.disconnects = value;
+        } else if (!strcmp(arg, "--host-away")) {
+            g_options.hostAwayMs = value;
+        } else if (!strcmp(arg, "--adv-fast-ms")) {
+            g_options.advFastMs = value;
+        } else if (!strcmp(arg, "--play")) {
+            g_options.playMs = value;
+        } else if (!strcmp(arg, "--pause")) {
+            g_options.pauseMs = value;
+        } else if (!strcmp(arg, "--tune") && i + 1 < argc) {
+            g_options.tune = argv[i + 1];
+        } else if (!strcmp(arg, "--rumble") && i + 1 < argc) {
+            g_options.rumble = argv[i + 1];
+        } else if (!strcmp(arg, "--keep-alive")) {
+            g_options.keepAliveMs = value;
+        } else if (!strcmp(arg, "--bounce")) {
+            g_options.bounce = value;
+        } else if (!strcmp(arg, "--debounce-ticks")) {
+            g_options.debounceTicks = value;
+        } else if (!strcmp(arg, "--seed")) {
+            g_options.seed = value;
+        } else if (!strcmp(arg, "--interval")) {
+            sim::config().centralMinInterval = value;
+        } else if (!strcmp(arg, "--tx-buffers")) {
+            sim::config().txBuffers = value;
+        } else if (!strcmp(arg, "--adc-noise")) {
+            sim::config().adcNoiseLsb = value;
+        } else if (!strcmp(arg, "--tx-per-event")) {
+            sim::config().txPerEvent = value;
+        } else if (!strcmp(arg, "--ble-cost")) {
+            sim::config().processEventsCostUs = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    g_rand = g_options.seed * 2654435761u + 1;
+
+    for (unsigned i = DIGITAL_INPUT_COUNT; i < INPUT_COUNT; i++) {
+        float value = INPUTS[i].kind == INPUT_AXIS ? 0.5f + g_options.bootDeflection : TRIGGER_REST;
+        sim::setAnalog(INPUTS[i].pin, value);
+        g_axisValue[i - DIGITAL_INPUT_COUNT] = value;
+    }
+    /* Without --flash, storage starts erased like a HeapBlockDevice after reset */
+    static_cast<FileBlockDevice *>(storage_device())->sim_path = g_options.flashFile;
+    if (g_options.storedConfig) {
+        storeSettings();
+    }
+    if (g_options.advFastMs >= 0) {
+        advertiser.setPhase(Advertiser::PHASE_FAST, ADV_FAST_INTERVAL_MS, g_options.advFastMs);
+    }
+
+    sim::BleHooks &hooks = sim::bleHooks();
+    hooks.onInit = &onBleInit;
+    hooks.onNotify = &onNotify;
+    hooks.onAir = &onAir;
+    hooks.onConnected = &onConnected;
+    hooks.onEncrypted = &onEncrypted;
+
+    firmware_main();
+
+    printResults();
+    return 0;
+}
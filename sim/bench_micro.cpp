@@ -0,0 +1,360 @@
+/* Microbenchmarks for the firmware hot paths
+ *
+ *   bench_micro [--tsv] [--baseline file] [--save file] [--tolerance percent] [filter]
+ *
+ * The firmware's main.cpp is linked in, with its globals constructed but firmware_main() never
+ * called: the input handlers run against the report with no service attached, and the service
+ * benchmarks use one of their own on a link nobody subscribed to, so GattServer::write() only
+ * stores the value. bench_micro.baseline holds the results the tree was last checked in with,
+ * and the calibration loop's time on the machine that wrote it; `make bench-baseline` rewrites
+ * it.
+ */
+
+#include "MicroBench.h"
+#include "SimKernel.h"
+#include "Debouncer.h"
+#include "StickSampler.h"
+#include "AxisProcessor.h"
+#include "HatButton.h"
+#include "HatResolver.h"
+#include "InputMap.h"
+#include "InputPin.h"
+#include "JoystickService.h"
+
+#include <stdlib.h>
+
+void update_hat_direction(HatButton::Direction dir, bool pressed);
+bool read_analog_sticks();
+
+BENCHMARK(debouncer_tick_idle)
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(4);
+    debouncer.reset(0xFFFF);
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench::doNotOptimize(debouncer.tick(0xFFFF));
+    }
+}
+
+BENCHMARK(debouncer_tick_all_bouncing)
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(15);
+    debouncer.reset(0xFFFF);
+    uint16_t raw = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        /* Every input toggles every few samples, so all counters keep running */
+        raw ^= (i & 7) ? 0 : 0xFFFF;
+        bench::doNotOptimize(debouncer.tick(raw));
+    }
+}
+
+namespace {
+
+AnalogIn stickX0(A5);
+AnalogIn stickY0(A4);
+AnalogIn stickX1(A3);
+AnalogIn stickY1(A2);
+AnalogIn *const sticks[StickSampler::AXES] = {&stickX0, &stickY0, &stickX1, &stickY1};
+
+/* Averaged readings around the centre with a few LSBs of noise */
+void noisyReadings(uint16_t raw[][StickSampler::AXES], unsigned count)
+{
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            seed = seed * 1664525 + 1013904223;
+            raw[i][axis] = 32768 + (seed >> 24) - 128;
+        }
+    }
+}
+
+/* Readings spread over the whole range, as with the sticks in use */
+void sweepReadings(uint16_t raw[][StickSampler::AXES], unsigned count)
+{
+    uint32_t seed = 3;
+    for (unsigned i = 0; i < count; i++) {
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            seed = seed * 1664525 + 1013904223;
+            raw[i][axis] = seed >> 16;
+        }
+    }
+}
+
+} // namespace
+
+BENCHMARK(stick_sampler_update)
+{
+    static uint16_t raw[256][StickSampler::AXES];
+    noisyReadings(raw, 256);
+
+    StickSampler sampler(sticks);
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench::doNotOptimize(sampler.update(raw[i & 255]));
+    }
+}
+
+BENCHMARK(stick_change_packed)
+{
+    uint64_t previous = 0x0080008000800080ULL;
+    uint64_t current = previous;
+    for (uint32_t i = 0; i < iterations; i++) {
+        current ^= (uint64_t)(i & 3) << (16 * (i & 3));
+        bench::doNotOptimize(StickSampler::changedLanes(current, previous, 5));
+    }
+}
+
+/* The per-axis loop the packed detector replaced */
+BENCHMARK(stick_change_scalar)
+{
+    uint8_t previous[StickSampler::AXES] = {128, 128, 128, 128};
+    uint8_t current[StickSampler::AXES] = {128, 128, 128, 128};
+    for (uint32_t i = 0; i < iterations; i++) {
+        current[i & 3] ^= i & 3;
+        bench::doNotOptimize(current);
+        bool changed = false;
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            if (abs((int)previous[axis] - current[axis]) >= 5) {
+                changed = true;
+            }
+        }
+        bench::doNotOptimize(changed);
+    }
+}
+
+/* The float read_axis() this replaced: reading * 255, centred by the boot sample in uint8 */
+BENCHMARK(axis_float_legacy)
+{
+    static uint16_t raw[256][StickSampler::AXES];
+    sweepReadings(raw, 256);
+    uint8_t initial[StickSampler::AXES] = {127, 127, 127, 127};
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint8_t out[StickSampler::AXES];
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            float reading = raw[i & 255][axis] * (1.0f / 65535.0f);
+            uint8_t val = reading * 255;
+            out[axis] = 128 + (val - initial[axis]);
+        }
+        bench::doNotOptimize(out);
+    }
+}
+
+/* What calibration, radial deadzone and curve would cost written in float */
+BENCHMARK(axis_float_equivalent)
+{
+    static uint16_t raw[256][StickSampler::AXES];
+    sweepReadings(raw, 256);
+    volatile float exponent = 2.0f;
+    const float centre = 32768.0f;
+    const float deadzone = 0.1f;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        float out[StickSampler::AXES];
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            float offset = raw[i & 255][axis] - centre;
+            float value = offset / (offset < 0 ? centre : 65535.0f - centre);
+            out[axis] = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        }
+        for (unsigned stick = 0; stick < StickSampler::AXES; stick += 2) {
+            float radius = sqrtf(out[stick] * out[stick] + out[stick + 1] * out[stick + 1]);
+            float shaped = 0.0f;
+            if (radius > deadzone) {
+                shaped = powf((radius - deadzone) / (1.0f - deadzone), exponent) / radius;
+            }
+            out[stick] *= shaped;
+            out[stick + 1] *= shaped;
+        }
+        bench::doNotOptimize(out);
+    }
+}
+
+BENCHMARK(axis_processor_integer)
+{
+    static uint16_t raw[256][StickSampler::AXES];
+    sweepReadings(raw, 256);
+    AxisProcessor processor;
+    processor.setDeadzone(3277);
+    processor.setCurve(AxisProcessor::CURVE_SQUARE);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        int32_t out[StickSampler::AXES];
+        processor.process(raw[i & 255], out);
+        bench::doNotOptimize(out);
+    }
+}
+
+/* Edges taking the four hat buttons through every combination, one button changing per edge
+ * (Gray code order) */
+struct HatEdges {
+    HatButton::Direction dirs[16];
+    bool pressed[16];
+
+    HatEdges() {
+        for (unsigned step = 0; step < 16; step++) {
+            unsigned from = step ^ (step >> 1);
+            unsigned next = (step + 1) & 15;
+            unsigned to = next ^ (next >> 1);
+            unsigned bit = __builtin_ctz(from ^ to);
+            dirs[step] = (HatButton::Direction)bit;
+            pressed[step] = (to >> bit) & 1;
+        }
+    }
+};
+
+/* The whole hat edge handler, through the report update */
+BENCHMARK(hat_direction_all_combinations)
+{
+    HatEdges edges;
+    for (uint32_t i = 0; i < iterations; i++) {
+        update_hat_direction(edges.dirs[i & 15], edges.pressed[i & 15]);
+    }
+}
+
+/* The hat resolver alone, per edge, under each SOCD policy */
+void resolveHat(HatResolver::Policy policy, uint32_t iterations)
+{
+    HatEdges edges;
+    HatResolver resolver;
+    resolver.setPolicy(policy);
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench::doNotOptimize(resolver.update(edges.dirs[i & 15], edges.pressed[i & 15]));
+    }
+}
+
+BENCHMARK(hat_resolve_neutral)
+{
+    resolveHat(HatResolver::SOCD_NEUTRAL, iterations);
+}
+
+BENCHMARK(hat_resolve_last_wins)
+{
+    resolveHat(HatResolver::SOCD_LAST_WINS, iterations);
+}
+
+BENCHMARK(hat_resolve_first_wins)
+{
+    resolveHat(HatResolver::SOCD_FIRST_WINS, iterations);
+}
+
+/* The input map alone, per edge, with the identity layout and with a remapped one */
+void countOutput(unsigned output, bool pressed)
+{
+    static unsigned changes;
+    changes++;
+    bench::doNotOptimize(changes);
+}
+
+void mapInputs(const InputProfile &profile, uint32_t iterations)
+{
+    events::EventQueue queue;
+    InputMap map(&queue, &countOutput);
+    map.compile(profile);
+    for (uint32_t i = 0; i < iterations; i++) {
+        map.input(i & 15, i & 16);
+    }
+}
+
+BENCHMARK(input_map_identity)
+{
+    InputProfile profile;
+    profile.setIdentity();
+    mapInputs(profile, iterations);
+}
+
+/* Buttons reversed, every input shared with another, and all four chords in use */
+BENCHMARK(input_map_remapped_chords)
+{
+    InputProfile profile;
+    profile.setIdentity();
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        profile.map[input] = (15 - input) / 2;
+    }
+    for (unsigned chord = 0; chord < InputProfile::CHORDS; chord++) {
+        profile.chords[chord].inputs = 0x11 << chord;
+        profile.chords[chord].output = 12 + chord;
+    }
+    mapInputs(profile, iterations);
+}
+
+/* One press or release of each of the eight buttons in turn */
+BENCHMARK(button_rise_fall)
+{
+    for (uint32_t i = 0; i < iterations; i++) {
+        InputPin *button = InputPin::input(i & 7);
+        if (i & 8) {
+            button->onRise();
+        } else {
+            button->onFall();
+        }
+    }
+}
+
+/* A stick poll with every axis moving, so each call updates the report */
+BENCHMARK(read_analog_sticks_moving)
+{
+    static const PinName pins[StickSampler::AXES] = {A5, A4, A3, A2};
+    static float values[64][StickSampler::AXES];
+    uint32_t seed = 5;
+    for (unsigned i = 0; i < 64; i++) {
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            seed = seed * 1664525 + 1013904223;
+            values[i][axis] = (seed >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+            sim::setAnalog(pins[axis], values[i & 63][axis]);
+        }
+        bench::doNotOptimize(read_analog_sticks());
+    }
+}
+
+/* A stick poll with the sticks at rest */
+BENCHMARK(read_analog_sticks_idle)
+{
+    static const PinName pins[StickSampler::AXES] = {A5, A4, A3, A2};
+    for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+        sim::setAnalog(pins[axis], 0.5f);
+    }
+    for (uint32_t i = 0; i < iterations; i++) {
+        bench::doNotOptimize(read_analog_sticks());
+    }
+}
+
+namespace {
+
+JoystickService &service()
+{
+    static JoystickService *joystick = new JoystickService(BLE::Instance());
+    return *joystick;
+}
+
+} // namespace
+
+/* The snapshot sendCallback() copies out before sending, with the inputs updating it */
+BENCHMARK(joystick_copy_report)
+{
+    uint8_t report[JOYSTICK_REPORT_LENGTH];
+    for (uint32_t i = 0; i < iterations; i++) {
+        JoystickService::packer().setButton(i & 7, i & 8);
+        bench::doNotOptimize(JoystickService::reportState().read(report));
+        bench::doNotOptimize(report);
+    }
+}
+
+BENCHMARK(hid_send)
+{
+    JoystickService &joystick = service();
+    for (uint32_t i = 0; i < iterations; i++) {
+        JoystickService::packer().setButton(i & 7, i & 8);
+        unsigned index = i % joystick.inputReportCount();
+        bench::doNotOptimize(joystick.send(index, joystickInputReports[index].data));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    return bench::run(argc, argv);
+}
@@ -0,0 +1,46 @@
+/* Host simulator stand-in for BlockDevice.h
+ *
+ * Block devices are modelled at the level of the files on them rather than their blocks: whether
+ * they hold a formatted file system, and the contents of each file.
+ */
+
+#ifndef SIM_BLOCK_DEVICE_H
+#define SIM_BLOCK_DEVICE_H
+
+#include "mbed.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+typedef uint64_t bd_size_t;
+
+class BlockDevice {
+public:
+    BlockDevice() : sim_formatted(false)
+    {
+    }
+    virtual ~BlockDevice()
+    {
+    }
+
+    virtual int init()
+    {
+        return 0;
+    }
+
+    virtual int deinit()
+    {
+        return 0;
+    }
+
+    /* Simulator: called after every change to the file system on this device */
+    virtual void sim_sync()
+    {
+    }
+
+    bool sim_formatted;
+    std::map<std::string, std::vector<uint8_t> > sim_files;
+};
+
+#endif // SIM_BLOCK_DEVICE_H
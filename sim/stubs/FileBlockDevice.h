@@ -0,0 +1,31 @@
+/* Block device kept in a file on the host, standing in for the target's flash
+ *
+ * The file is read on the first init() and rewritten after every change, so what the firmware
+ * stores survives the process exiting, like flash survives a reset. An empty path keeps the
+ * contents in memory only, which behaves like a HeapBlockDevice.
+ */
+
+#ifndef SIM_FILE_BLOCK_DEVICE_H
+#define SIM_FILE_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+
+class FileBlockDevice : public BlockDevice {
+public:
+    FileBlockDevice(const char *path, bd_size_t size) : sim_path(path ? path : ""), _size(size),
+        _loaded(false)
+    {
+    }
+
+    virtual int init();
+    virtual void sim_sync();
+
+    /* Host file; may be changed before the first init() */
+    std::string sim_path;
+
+private:
+    bd_size_t _size;
+    bool _loaded;
+};
+
+#endif // SIM_FILE_BLOCK_DEVICE_H
@@ -0,0 +1,74 @@
+/* Host simulator stand-in for FileSystem.h and File.h
+ *
+ * Files live on the BlockDevice they were written to, so they survive unmount and remount as on
+ * target. File systems register under their name, so paths like "/fs/bt.db" resolve as they do
+ * through the mbed retarget layer. Opening, reading and writing consume modelled CPU time (see
+ * sim::Config).
+ */
+
+#ifndef SIM_FILE_SYSTEM_H
+#define SIM_FILE_SYSTEM_H
+
+#include "mbed.h"
+#include "BlockDevice.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+
+namespace mbed {
+
+class FileSystem {
+public:
+    FileSystem(const char *name = NULL);
+    virtual ~FileSystem();
+
+    int remove(const char *path);
+
+    /* Simulator: the block device currently mounted, if any */
+    BlockDevice *sim_device()
+    {
+        return _bd;
+    }
+
+    /* Simulator: the file system named by the first component of an absolute path, and the
+       rest of the path */
+    static FileSystem *sim_lookup(const char *path, const char **rest);
+
+protected:
+    BlockDevice *_bd;
+
+private:
+    std::string _name;
+};
+
+class File {
+public:
+    File() : _fs(NULL), _flags(0), _pos(0), _dirty(false)
+    {
+    }
+    File(FileSystem *fs, const char *path, int flags = O_RDONLY) : _fs(NULL), _flags(0), _pos(0), _dirty(false)
+    {
+        open(fs, path, flags);
+    }
+    virtual ~File()
+    {
+        close();
+    }
+
+    int open(FileSystem *fs, const char *path, int flags = O_RDONLY);
+    int close();
+    ssize_t read(void *buffer, size_t size);
+    ssize_t write(const void *buffer, size_t size);
+    off_t size();
+
+private:
+    FileSystem *_fs;
+    std::string _path;
+    int _flags;
+    size_t _pos;
+    bool _dirty;
+};
+
+} // namespace mbed
+
+#endif // SIM_FILE_SYSTEM_H
@@ -0,0 +1,22 @@
+/* Host simulator stand-in for HeapBlockDevice.h
+ *
+ * Volatile like on target: a fresh process always starts unformatted.
+ */
+
+#ifndef SIM_HEAP_BLOCK_DEVICE_H
+#define SIM_HEAP_BLOCK_DEVICE_H
+
+#include "BlockDevice.h"
+
+class HeapBlockDevice : public BlockDevice {
+public:
+    HeapBlockDevice(bd_size_t size, bd_size_t block = 512) : _size(size), _block(block)
+    {
+    }
+
+private:
+    bd_size_t _size;
+    bd_size_t _block;
+};
+
+#endif // SIM_HEAP_BLOCK_DEVICE_H
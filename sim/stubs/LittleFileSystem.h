@@ -0,0 +1,26 @@
+/* Host simulator stand-in for LittleFileSystem.h
+ *
+ * Mounting initialises the block device and fails unless it holds a formatted file system.
+ */
+
+#ifndef SIM_LITTLE_FILE_SYSTEM_H
+#define SIM_LITTLE_FILE_SYSTEM_H
+
+#include "mbed.h"
+#include "FileSystem.h"
+
+class LittleFileSystem : public mbed::FileSystem {
+public:
+    LittleFileSystem(const char *name = NULL, BlockDevice *bd = NULL) : FileSystem(name)
+    {
+        if (bd) {
+            mount(bd);
+        }
+    }
+
+    int mount(BlockDevice *bd);
+    int unmount();
+    int reformat(BlockDevice *bd = NULL);
+};
+
+#endif // SIM_LITTLE_FILE_SYSTEM_H
@@ -0,0 +1,9 @@
+/* Host simulator stand-in for SecurityManager.h; the class lives with the rest of the stack in
+ * ble/BLE.h. */
+
+#ifndef SIM_SECURITY_MANAGER_H
+#define SIM_SECURITY_MANAGER_H
+
+#include "ble/BLE.h"
+
+#endif // SIM_SECURITY_MANAGER_H
@@ -0,0 +1,747 @@
+/* Host simulator stand-in for ble/BLE.h
+ *
+ * Implements the subset of the legacy mbed BLE API used by the gamepad: BLE, Gap, GattServer
+ * and SecurityManager. The stack is backed by a simulated central (see SimBLE.cpp) that
+ * connects, pairs and drains notifications once per connection event.
+ */
+
+#ifndef SIM_BLE_H
+#define SIM_BLE_H
+
+#include "mbed.h"
+
+#include <vector>
+
+enum ble_error_t {
+    BLE_ERROR_NONE                      = 0,
+    BLE_ERROR_BUFFER_OVERFLOW           = 1,
+    BLE_ERROR_NOT_IMPLEMENTED           = 2,
+    BLE_ERROR_PARAM_OUT_OF_RANGE        = 3,
+    BLE_ERROR_INVALID_PARAM             = 4,
+    BLE_STACK_BUSY                      = 5,
+    BLE_ERROR_INVALID_STATE             = 6,
+    BLE_ERROR_NO_MEM                    = 7,
+    BLE_ERROR_OPERATION_NOT_PERMITTED   = 8,
+    BLE_ERROR_INITIALIZATION_INCOMPLETE = 9,
+    BLE_ERROR_ALREADY_INITIALIZED       = 10,
+    BLE_ERROR_UNSPECIFIED               = 11,
+    BLE_ERROR_INTERNAL_STACK_FAILURE    = 12,
+};
+
+template <typename ContextType>
+class FunctionPointerWithContext {
+public:
+    typedef void (*pvoidfcontext_t)(ContextType context);
+
+    FunctionPointerWithContext(pvoidfcontext_t function = NULL)
+    {
+        if (function) {
+            _func = function;
+        }
+    }
+
+    template <typename T>
+    FunctionPointerWithContext(T *object, void (T::*member)(ContextType context))
+        : _func([object, member](ContextType context) { (object->*member)(context); })
+    {
+    }
+
+    void call(ContextType context) const
+    {
+        if (_func) {
+            _func(context);
+        }
+    }
+
+    void operator()(ContextType context) const
+    {
+        call(context);
+    }
+
+    operator bool() const
+    {
+        return (bool)_func;
+    }
+
+private:
+    std::function<void(ContextType)> _func;
+};
+
+namespace ble {
+
+typedef uintptr_t connection_handle_t;
+typedef uint16_t attribute_handle_t;
+
+struct link_encryption_t {
+    enum type {
+        NOT_ENCRYPTED,
+        ENCRYPTION_IN_PROGRESS,
+        ENCRYPTED,
+        ENCRYPTED_WITH_MITM,
+        ENCRYPTED_WITH_SC_AND_MITM
+    };
+
+    link_encryption_t(type value) : _value(value)
+    {
+    }
+
+    type value() const
+    {
+        return _value;
+    }
+
+    friend bool operator==(link_encryption_t lhs, type rhs)
+    {
+        return lhs._value == rhs;
+    }
+
+    friend bool operator!=(link_encryption_t lhs, type rhs)
+    {
+        return lhs._value != rhs;
+    }
+
+private:
+    type _value;
+};
+
+} // namespace ble
+
+namespace BLEProtocol {
+
+typedef uint8_t AddressBytes_t[6];
+
+struct AddressType {
+    enum Type {
+        PUBLIC = 0,
+        RANDOM_STATIC,
+        RANDOM_PRIVATE_RESOLVABLE,
+        RANDOM_PRIVATE_NON_RESOLVABLE
+    };
+};
+typedef AddressType::Type AddressType_t;
+
+struct Address_t {
+    AddressType_t type;
+    AddressBytes_t address;
+};
+
+} // namespace BLEProtocol
+
+class UUID {
+public:
+    typedef uint16_t ShortUUIDBytes_t;
+
+    UUID(ShortUUIDBytes_t shortUUID = 0) : _short(shortUUID)
+    {
+    }
+
+    ShortUUIDBytes_t getShortUUID() const
+    {
+        return _short;
+    }
+
+private:
+    ShortUUIDBytes_t _short;
+};
+
+class GapAdvertisingData {
+public:
+    enum Flags_t {
+        LE_LIMITED_DISCOVERABLE = 0x01,
+        LE_GENERAL_DISCOVERABLE = 0x02,
+        BREDR_NOT_SUPPORTED     = 0x04,
+    };
+
+    enum DataType_t {
+        FLAGS                           = 0x01,
+        INCOMPLETE_LIST_16BIT_SERVICE_IDS = 0x02,
+        COMPLETE_LIST_16BIT_SERVICE_IDS = 0x03,
+        SHORTENED_LOCAL_NAME            = 0x08,
+        COMPLETE_LOCAL_NAME             = 0x09,
+        APPEARANCE                      = 0x19,
+    };
+
+    enum Appearance_t {
+        UNKNOWN                 = 0,
+        GENERIC_HID             = 960,
+        KEYBOARD                = 961,
+        MOUSE                   = 962,
+        JOYSTICK                = 963,
+        GAMEPAD                 = 964,
+    };
+    typedef Appearance_t Appearance;
+
+    GapAdvertisingData() : _length(0)
+    {
+    }
+
+    ble_error_t addFlags(uint8_t flags)
+    {
+        return addData(FLAGS, &flags, 1);
+    }
+
+    ble_error_t addData(DataType_t type, const uint8_t *payload, uint8_t len)
+    {
+        if ((size_t)_length + len + 2 > sizeof(_payload)) {
+            return BLE_ERROR_BUFFER_OVERFLOW;
+        }
+        _payload[_length++] = len + 1;
+        _payload[_length++] = type;
+        memcpy(&_payload[_length], payload, len);
+        _length += len;
+        return BLE_ERROR_NONE;
+    }
+
+    uint8_t getPayloadLen() const
+    {
+        return _length;
+    }
+
+private:
+    uint8_t _payload[31];
+    uint8_t _length;
+};
+
+class GapAdvertisingParams {
+public:
+    enum AdvertisingType_t {
+        ADV_CONNECTABLE_UNDIRECTED,
+        ADV_CONNECTABLE_DIRECTED,
+        ADV_SCANNABLE_UNDIRECTED,
+        ADV_NON_CONNECTABLE_UNDIRECTED
+    };
+    typedef AdvertisingType_t AdvertisingType;
+};
+
+class Gap {
+public:
+    typedef ble::connection_handle_t Handle_t;
+
+    enum AddressType_t {
+        ADDR_TYPE_PUBLIC = 0,
+        ADDR_TYPE_RANDOM_STATIC,
+        ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE,
+        ADDR_TYPE_RANDOM_PRIVATE_NON_RESOLVABLE
+    };
+    typedef uint8_t Address_t[6];
+
+    enum Role_t {
+        PERIPHERAL = 0x1,
+        CENTRAL    = 0x2,
+    };
+
+    enum TimeoutSource_t {
+        TIMEOUT_SRC_ADVERTISING      = 0x00,
+        TIMEOUT_SRC_SECURITY_REQUEST = 0x01,
+        TIMEOUT_SRC_SCAN             = 0x02,
+        TIMEOUT_SRC_CONN             = 0x03,
+    };
+
+    enum DisconnectionReason_t {
+        CONNECTION_TIMEOUT                        = 0x08,
+        REMOTE_USER_TERMINATED_CONNECTION         = 0x13,
+        LOCAL_HOST_TERMINATED_CONNECTION          = 0x16,
+    };
+
+    struct ConnectionParams_t {
+        uint16_t minConnectionInterval;
+        uint16_t maxConnectionInterval;
+        uint16_t slaveLatency;
+        uint16_t connectionSupervisionTimeout;
+    };
+
+    struct ConnectionCallbackParams_t {
+        Handle_t handle;
+        Role_t role;
+        AddressType_t peerAddrType;
+        Address_t peerAddr;
+        AddressType_t ownAddrType;
+        Address_t ownAddr;
+        const ConnectionParams_t *connectionParams;
+    };
+
+    struct DisconnectionCallbackParams_t {
+        Handle_t handle;
+        DisconnectionReason_t reason;
+    };
+
+    struct Whitelist_t {
+        BLEProtocol::Address_t *addresses;
+        uint8_t size;
+        uint8_t capacity;
+    };
+
+    typedef FunctionPointerWithContext<const ConnectionCallbackParams_t *> ConnectionEventCallback_t;
+    typedef FunctionPointerWithContext<const DisconnectionCallbackParams_t *> DisconnectionEventCallback_t;
+    typedef FunctionPointerWithContext<TimeoutSource_t> TimeoutEventCallback_t;
+
+    static const unsigned UNIT_1_25_MS = 1250;
+
+    static uint16_t MSEC_TO_GAP_DURATION_UNITS(uint32_t durationInMillis)
+    {
+        return (durationInMillis * 1000) / UNIT_1_25_MS;
+    }
+
+    Gap();
+
+    void onConnection(ConnectionEventCallback_t callback)
+    {
+        _connectionCallbacks.push_back(callback);
+    }
+
+    template <typename T>
+    void onConnection(T *tptr, void (T::*mptr)(const ConnectionCallbackParams_t *))
+    {
+        _connectionCallbacks.push_back(ConnectionEventCallback_t(tptr, mptr));
+    }
+
+    void onDisconnection(DisconnectionEventCallback_t callback)
+    {
+        _disconnectionCallbacks.push_back(callback);
+    }
+
+    template <typename T>
+    void onDisconnection(T *tptr, void (T::*mptr)(const DisconnectionCallbackParams_t *))
+    {
+        _disconnectionCallbacks.push_back(DisconnectionEventCallback_t(tptr, mptr));
+    }
+
+    void onTimeout(TimeoutEventCallback_t callback)
+    {
+        _timeoutCallback = callback;
+    }
+
+    ble_error_t getAddress(AddressType_t *typeP, Address_t address);
+
+    ble_error_t setAdvertisingPayload(const GapAdvertisingData &payload);
+    ble_error_t setAppearance(GapAdvertisingData::Appearance appearance);
+    void setAdvertisingType(GapAdvertisingParams::AdvertisingType_t advType);
+    void setAdvertisingInterval(uint16_t interval);
+    void setAdvertisingTimeout(uint16_t timeout);
+    ble_error_t startAdvertising();
+    ble_error_t stopAdvertising();
+
+    uint8_t getMaxWhitelistSize() const
+    {
+        return 8;
+    }
+    ble_error_t setWhitelist(const Whitelist_t &whitelist);
+
+    ble_error_t setPreferredConnectionParams(const ConnectionParams_t *params);
+    ble_error_t getPreferredConnectionParams(ConnectionParams_t *params);
+    ble_error_t updateConnectionParams(Handle_t handle, const ConnectionParams_t *params);
+
+    ble_error_t disconnect(Handle_t connectionHandle, DisconnectionReason_t reason);
+
+    /* Simulator interface */
+    void sim_connected(const ConnectionCallbackParams_t *params);
+    void sim_disconnected(const DisconnectionCallbackParams_t *params);
+    void sim_timeout(TimeoutSource_t source);
+
+    GapAdvertisingParams::AdvertisingType_t advType;
+    uint16_t advInterval;
+    uint16_t advTimeout;
+    bool advertising;
+    ConnectionParams_t preferredParams;
+    std::vector<BLEProtocol::Address_t> whitelist;
+
+private:
+    std::vector<ConnectionEventCallback_t> _connectionCallbacks;
+    std::vector<DisconnectionEventCallback_t> _disconnectionCallbacks;
+    TimeoutEventCallback_t _timeoutCallback;
+};
+
+class SecurityManager;
+
+class GattAttribute {
+public:
+    typedef ble::attribute_handle_t Handle_t;
+
+    GattAttribute(const UUID &uuid, uint8_t *valuePtr = NULL, uint16_t len = 0,
+                  uint16_t maxLen = 0, bool hasVariableLen = true)
+        : _uuid(uuid), _valuePtr(valuePtr), _len(len), _maxLen(maxLen), _handle(0)
+    {
+    }
+
+    Handle_t getHandle() const
+    {
+        return _handle;
+    }
+
+    const UUID &getUUID() const
+    {
+        return _uuid;
+    }
+
+    uint8_t *getValuePtr()
+    {
+        return _valuePtr;
+    }
+
+    uint16_t getLength() const
+    {
+        return _len;
+    }
+
+    uint16_t getMaxLength() const
+    {
+        return _maxLen;
+    }
+
+    /* Simulator interface */
+    void sim_setHandle(Handle_t handle)
+    {
+        _handle = handle;
+    }
+    void sim_setLength(uint16_t len)
+    {
+        _len = len;
+    }
+
+private:
+    UUID _uuid;
+    uint8_t *_valuePtr;
+    uint16_t _len;
+    uint16_t _maxLen;
+    Handle_t _handle;
+};
+
+class GattCharacteristic {
+public:
+    enum {
+        UUID_HID_INFORMATION_CHAR   = 0x2A4A,
+        UUID_REPORT_MAP_CHAR        = 0x2A4B,
+        UUID_HID_CONTROL_POINT_CHAR = 0x2A4C,
+        UUID_REPORT_CHAR            = 0x2A4D,
+        UUID_PROTOCOL_MODE_CHAR     = 0x2A4E,
+    };
+
+    enum Properties_t {
+        BLE_GATT_CHAR_PROPERTIES_NONE                   = 0x00,
+        BLE_GATT_CHAR_PROPERTIES_BROADCAST              = 0x01,
+        BLE_GATT_CHAR_PROPERTIES_READ                   = 0x02,
+        BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE = 0x04,
+        BLE_GATT_CHAR_PROPERTIES_WRITE                  = 0x08,
+        BLE_GATT_CHAR_PROPERTIES_NOTIFY                 = 0x10,
+        BLE_GATT_CHAR_PROPERTIES_INDICATE               = 0x20,
+    };
+
+    GattCharacteristic(const UUID &uuid, uint8_t *valuePtr = NULL, uint16_t len = 0,
+                       uint16_t maxLen = 0, uint8_t props = BLE_GATT_CHAR_PROPERTIES_NONE,
+                       GattAttribute *descriptors[] = NULL, unsigned numDescriptors = 0,
+                       bool hasVariableLen = true)
+        : _valueAttribute(uuid, valuePtr, len, maxLen, hasVariableLen),
+          _properties(props), _descriptors(descriptors), _descriptorCount(numDescriptors)
+    {
+    }
+
+    void requireSecurity(int securityMode)
+    {
+        _securityMode = securityMode;
+    }
+
+    GattAttribute::Handle_t getValueHandle() const
+    {
+        return _valueAttribute.getHandle();
+    }
+
+    GattAttribute &getValueAttribute()
+    {
+        return _valueAttribute;
+    }
+
+    uint8_t getProperties() const
+    {
+        return _properties;
+    }
+
+    unsigned getDescriptorCount() const
+    {
+        return _descriptorCount;
+    }
+
+    GattAttribute *getDescriptor(unsigned index)
+    {
+        return _descriptors[index];
+    }
+
+private:
+    GattAttribute _valueAttribute;
+    uint8_t _properties;
+    GattAttribute **_descriptors;
+    unsigned _descriptorCount;
+    int _securityMode;
+};
+
+template <typename T>
+class ReadOnlyGattCharacteristic : public GattCharacteristic {
+public:
+    ReadOnlyGattCharacteristic(const UUID &uuid, T *valuePtr, uint8_t additionalProperties = 0,
+                               GattAttribute *descriptors[] = NULL, unsigned numDescriptors = 0)
+        : GattCharacteristic(uuid, reinterpret_cast<uint8_t *>(valuePtr), sizeof(T), sizeof(T),
+                             BLE_GATT_CHAR_PROPERTIES_READ | additionalProperties,
+                             descriptors, numDescriptors, false)
+    {
+    }
+};
+
+class GattService {
+public:
+    enum {
+        UUID_HUMAN_INTERFACE_DEVICE_SERVICE = 0x1812,
+    };
+
+    GattService(const UUID &uuid, GattCharacteristic *characteristics[], unsigned numCharacteristics)
+        : _uuid(uuid), _characteristics(characteristics), _characteristicCount(numCharacteristics)
+    {
+    }
+
+    unsigned getCharacteristicCount() const
+    {
+        return _characteristicCount;
+    }
+
+    GattCharacteristic *getCharacteristic(unsigned index)
+    {
+        return _characteristics[index];
+    }
+
+private:
+    UUID _uuid;
+    GattCharacteristic **_characteristics;
+    unsigned _characteristicCount;
+};
+
+struct GattWriteCallbackParams {
+    enum WriteOp_t {
+        OP_INVALID      = 0x00,
+        OP_WRITE_REQ    = 0x01,
+        OP_WRITE_CMD    = 0x02,
+    };
+
+    ble::connection_handle_t connHandle;
+    GattAttribute::Handle_t handle;
+    WriteOp_t writeOp;
+    uint16_t offset;
+    uint16_t len;
+    const uint8_t *data;
+};
+
+class GattServer {
+public:
+    typedef FunctionPointerWithContext<unsigned> DataSentCallback_t;
+    typedef FunctionPointerWithContext<const GattWriteCallbackParams *> DataWrittenCallback_t;
+    typedef FunctionPointerWithContext<GattAttribute::Handle_t> EventCallback_t;
+
+    GattServer();
+
+    ble_error_t addService(GattService &service);
+
+    ble_error_t write(GattAttribute::Handle_t attributeHandle, const uint8_t *value,
+                      uint16_t size, bool localOnly = false);
+    ble_error_t read(GattAttribute::Handle_t attributeHandle, uint8_t *buffer, uint16_t *lengthP);
+
+    void onDataSent(void (*callback)(unsigned count))
+    {
+        _dataSentCallbacks.push_back(DataSentCallback_t(callback));
+    }
+
+    template <typename T>
+    void onDataSent(T *objPtr, void (T::*memberPtr)(unsigned count))
+    {
+        _dataSentCallbacks.push_back(DataSentCallback_t(objPtr, memberPtr));
+    }
+
+    void onDataWritten(void (*callback)(const GattWriteCallbackParams *eventDataP))
+    {
+        _dataWrittenCallbacks.push_back(DataWrittenCallback_t(callback));
+    }
+
+    template <typename T>
+    void onDataWritten(T *objPtr, void (T::*memberPtr)(const GattWriteCallbackParams *context))
+    {
+        _dataWrittenCallbacks.push_back(DataWrittenCallback_t(objPtr, memberPtr));
+    }
+
+    /** The host enabled notifications on a characteristic, by its value handle */
+    void onUpdatesEnabled(EventCallback_t callback)
+    {
+        _updatesEnabledCallback = callback;
+    }
+
+    /** The host disabled notifications on a characteristic, by its value handle */
+    void onUpdatesDisabled(EventCallback_t callback)
+    {
+        _updatesDisabledCallback = callback;
+    }
+
+    /* Simulator interface */
+    void sim_dataSent(unsigned count);
+    void sim_dataWritten(const GattWriteCallbackParams *params);
+    void sim_updatesEnabled(GattAttribute::Handle_t handle);
+    void sim_updatesDisabled(GattAttribute::Handle_t handle);
+    GattAttribute *sim_findAttribute(GattAttribute::Handle_t handle);
+
+private:
+    std::vector<GattAttribute *> _attributes;
+    std::vector<DataSentCallback_t> _dataSentCallbacks;
+    std::vector<DataWrittenCallback_t> _dataWrittenCallbacks;
+    EventCallback_t _updatesEnabledCallback;
+    EventCallback_t _updatesDisabledCallback;
+};
+
+class SecurityManager {
+public:
+    enum SecurityMode_t {
+        SECURITY_MODE_NO_ACCESS,
+        SECURITY_MODE_ENCRYPTION_OPEN_LINK,
+        SECURITY_MODE_ENCRYPTION_NO_MITM,
+        SECURITY_MODE_ENCRYPTION_WITH_MITM,
+        SECURITY_MODE_SIGNED_NO_MITM,
+        SECURITY_MODE_SIGNED_WITH_MITM,
+    };
+
+    enum SecurityIOCapabilities_t {
+        IO_CAPS_DISPLAY_ONLY     = 0x00,
+        IO_CAPS_DISPLAY_YESNO    = 0x01,
+        IO_CAPS_KEYBOARD_ONLY    = 0x02,
+        IO_CAPS_NONE             = 0x03,
+        IO_CAPS_KEYBOARD_DISPLAY = 0x04,
+    };
+
+    enum SecurityCompletionStatus_t {
+        SEC_STATUS_SUCCESS              = 0x00,
+        SEC_STATUS_TIMEOUT              = 0x01,
+        SEC_STATUS_PDU_INVALID          = 0x02,
+        SEC_STATUS_UNSPECIFIED          = 0x88,
+    };
+
+    typedef uint8_t Passkey_t[6];
+
+    class EventHandler {
+    public:
+        virtual ~EventHandler() {}
+
+        virtual void pairingRequest(ble::connection_handle_t connectionHandle)
+        {
+        }
+
+        virtual void pairingResult(ble::connection_handle_t connectionHandle,
+                                   SecurityCompletionStatus_t result)
+        {
+        }
+
+        virtual void linkEncryptionResult(ble::connection_handle_t connectionHandle,
+                                          ble::link_encryption_t result)
+        {
+        }
+
+        virtual void whitelistFromBondTable(Gap::Whitelist_t *whitelist)
+        {
+            if (whitelist) {
+                delete [] whitelist->addresses;
+                delete whitelist;
+            }
+        }
+    };
+
+    SecurityManager();
+
+    ble_error_t init(bool enableBonding = true, bool requireMITM = true,
+                     SecurityIOCapabilities_t iocaps = IO_CAPS_NONE,
+                     const uint8_t *passkey = NULL, bool signing = true,
+                     const char *dbFilepath = NULL);
+
+    void setSecurityManagerEventHandler(EventHandler *handler)
+    {
+        _handler = handler ? handler : &_defaultHandler;
+    }
+
+    ble_error_t setPairingRequestAuthorisation(bool required = true);
+    ble_error_t acceptPairingRequest(ble::connection_handle_t connectionHandle);
+    ble_error_t cancelPairingRequest(ble::connection_handle_t connectionHandle);
+    ble_error_t setLinkSecurity(ble::connection_handle_t connectionHandle,
+                                SecurityMode_t securityMode);
+    ble_error_t preserveBondingStateOnReset(bool enable);
+    ble_error_t generateWhitelistFromBondTable(Gap::Whitelist_t *whitelist) const;
+
+    /* Simulator interface */
+    EventHandler *sim_handler()
+    {
+        return _handler;
+    }
+
+    bool pairingAuthorisationRequired;
+    bool bonded;
+
+private:
+    void storeBond();
+
+    EventHandler _defaultHandler;
+    EventHandler *_handler;
+    bool _bonding;
+    bool _preserveBonds;
+    const char *_dbFilepath;
+};
+
+class BLE {
+public:
+    struct InitializationCompleteCallbackContext {
+        BLE &ble;
+        ble_error_t error;
+    };
+
+    struct OnEventsToProcessCallbackContext {
+        BLE &ble;
+    };
+
+    typedef void (*InitializationCompleteCallback_t)(InitializationCompleteCallbackContext *context);
+    typedef FunctionPointerWithContext<OnEventsToProcessCallbackContext *> OnEventsToProcessCallback_t;
+
+    static BLE &Instance();
+
+    ble_error_t init(InitializationCompleteCallback_t completion_cb = NULL);
+    bool hasInitialized() const
+    {
+        return _initialized;
+    }
+    ble_error_t shutdown();
+
+    void onEventsToProcess(const OnEventsToProcessCallback_t &on_event_cb)
+    {
+        _onEventsToProcess = on_event_cb;
+    }
+    void processEvents();
+
+    Gap &gap()
+    {
+        return _gap;
+    }
+    GattServer &gattServer()
+    {
+        return _gattServer;
+    }
+    SecurityManager &securityManager()
+    {
+        return _securityManager;
+    }
+
+    /* Simulator interface */
+    void sim_signalEvents();
+    void sim_setInitialized()
+    {
+        _initialized = true;
+    }
+    InitializationCompleteCallback_t sim_initCallback;
+
+private:
+    BLE();
+
+    bool _initialized;
+    Gap _gap;
+    GattServer _gattServer;
+    SecurityManager _securityManager;
+    OnEventsToProcessCallback_t _onEventsToProcess;
+};
+
+#endif // SIM_BLE_H
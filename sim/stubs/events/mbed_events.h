@@ -0,0 +1,155 @@
+/* Host simulator stand-in for events/mbed_events.h
+ *
+ * EventQueue keeps its pending events in virtual time and is dispatched by the simulation
+ * kernel. The allocation pool is modelled as a fixed number of event slots, so posts fail the
+ * same way they do on target when the queue is exhausted.
+ */
+
+#ifndef SIM_MBED_EVENTS_H
+#define SIM_MBED_EVENTS_H
+
+#include "mbed.h"
+
+#include <vector>
+
+#define EVENTS_EVENT_SIZE   64
+#define EVENTS_QUEUE_SIZE   (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+template <typename F>
+class Event;
+
+class EventQueue : private mbed::NonCopyable<EventQueue> {
+public:
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL);
+    ~EventQueue();
+
+    void dispatch(int ms = -1);
+    void dispatch_forever()
+    {
+        dispatch(-1);
+    }
+    void break_dispatch();
+
+    void cancel(int id);
+    int time_left(int id);
+
+    void chain(EventQueue *target);
+
+    template <typename F>
+    int call(F f)
+    {
+        return post(mbed::Callback<void()>(f), 0, -1);
+    }
+
+    template <typename T, typename R>
+    int call(T *obj, R (T::*method)())
+    {
+        return post(mbed::Callback<void()>(obj, method), 0, -1);
+    }
+
+    template <typename F>
+    int call_in(int ms, F f)
+    {
+        return post(mbed::Callback<void()>(f), ms, -1);
+    }
+
+    template <typename T, typename R>
+    int call_in(int ms, T *obj, R (T::*method)())
+    {
+        return post(mbed::Callback<void()>(obj, method), ms, -1);
+    }
+
+    template <typename F>
+    int call_every(int ms, F f)
+    {
+        return post(mbed::Callback<void()>(f), ms, ms);
+    }
+
+    template <typename T, typename R>
+    int call_every(int ms, T *obj, R (T::*method)())
+    {
+        return post(mbed::Callback<void()>(obj, method), ms, ms);
+    }
+
+    template <typename T, typename R>
+    Event<void()> event(T *obj, R (T::*method)());
+
+    template <typename R>
+    Event<void()> event(R (*func)());
+
+    /* Simulator interface */
+    int post(mbed::Callback<void()> cb, int delay_ms, int period_ms);
+    unsigned sim_capacity() const
+    {
+        return _capacity;
+    }
+    unsigned sim_pending() const
+    {
+        return _events.size();
+    }
+    bool sim_next_due(us_timestamp_t *when) const;
+    void sim_dispatch_one();
+    int sim_priority;
+
+private:
+    struct PendingEvent {
+        int id;
+        us_timestamp_t due;
+        int period_us;
+        uint32_t seq;
+        mbed::Callback<void()> cb;
+    };
+
+    unsigned _capacity;
+    std::vector<PendingEvent> _events;
+    int _nextId;
+    uint32_t _seq;
+    EventQueue *_chained;
+};
+
+template <>
+class Event<void()> {
+public:
+    Event(EventQueue *q, mbed::Callback<void()> cb) : _queue(q), _cb(cb)
+    {
+    }
+
+    int post() const
+    {
+        return _queue->post(_cb, 0, -1);
+    }
+
+    int call() const
+    {
+        return post();
+    }
+
+    void operator()() const
+    {
+        post();
+    }
+
+private:
+    EventQueue *_queue;
+    mbed::Callback<void()> _cb;
+};
+
+template <typename T, typename R>
+Event<void()> EventQueue::event(T *obj, R (T::*method)())
+{
+    return Event<void()>(this, mbed::Callback<void()>(obj, method));
+}
+
+template <typename R>
+Event<void()> EventQueue::event(R (*func)())
+{
+    return Event<void()>(this, mbed::Callback<void()>(func));
+}
+
+} // namespace events
+
+using namespace events;
+
+#endif // SIM_MBED_EVENTS_H
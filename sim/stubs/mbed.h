@@ -0,0 +1,414 @@
+/* Host simulator stand-in for mbed.h
+ *
+ * Only the parts of the mbed OS 5 API used by the gamepad firmware are provided. Peripherals
+ * are backed by the simulation kernel (see SimKernel.h), which runs on a virtual microsecond
+ * clock so that timing results are deterministic and independent of the host machine.
+ */
+
+#ifndef SIM_MBED_H
+#define SIM_MBED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <functional>
+
+typedef uint64_t us_timestamp_t;
+
+typedef enum {
+    P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7,
+    P0_8, P0_9, P0_10, P0_11, P0_12, P0_13, P0_14, P0_15,
+    P0_16, P0_17, P0_18, P0_19, P0_20, P0_21, P0_22, P0_23,
+    P0_24, P0_25, P0_26, P0_27, P0_28, P0_29, P0_30, P0_31,
+
+    LED1 = P0_17,
+    LED2 = P0_18,
+    LED3 = P0_19,
+    LED4 = P0_20,
+
+    USBTX = P0_6,
+    USBRX = P0_8,
+
+    A0 = P0_3,
+    A1 = P0_4,
+    A2 = P0_28,
+    A3 = P0_29,
+    A4 = P0_30,
+    A5 = P0_31,
+
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+typedef enum {
+    PullNone = 0,
+    PullDown = 1,
+    PullUp = 3,
+    PullDefault = PullUp
+} PinMode;
+
+typedef enum {
+    Port0 = 0
+} PortName;
+
+void error(const char *format, ...);
+
+#define MBED_ASSERT(expr) assert(expr)
+
+/* platform/mbed_critical.h */
+inline bool core_util_atomic_cas_u32(volatile uint32_t *ptr, uint32_t *expectedCurrentValue,
+                                     uint32_t desiredValue)
+{
+    return __atomic_compare_exchange_n(ptr, expectedCurrentValue, desiredValue, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline bool core_util_atomic_cas_ptr(void *volatile *ptr, void **expectedCurrentValue,
+                                     void *desiredValue)
+{
+    return __atomic_compare_exchange_n(ptr, expectedCurrentValue, desiredValue, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_decr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_sub_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+/* The simulator runs one thread or interrupt at a time and only switches in sim::consume(), so
+ * there is nothing to mask */
+inline void core_util_critical_section_enter(void)
+{
+}
+
+inline void core_util_critical_section_exit(void)
+{
+}
+
+/* CMSIS data memory barrier */
+#define __DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+void wait_ms(int ms);
+void wait_us(int us);
+uint32_t us_ticker_read(void);
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+/** Minimal Callback built on std::function; only what the firmware needs. */
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> {
+public:
+    Callback() {}
+
+    Callback(R (*func)(ArgTs...))
+    {
+        if (func) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R (T::*method)(ArgTs...))
+        : _func([obj, method](ArgTs... args) { return (obj->*method)(args...); })
+    {
+    }
+
+    template <typename F>
+    Callback(F f) : _func(f)
+    {
+    }
+
+    R call(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    operator bool() const
+    {
+        return (bool)_func;
+    }
+
+private:
+    std::function<R(ArgTs...)> _func;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R (*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R (T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template <typename T>
+class NonCopyable {
+protected:
+    NonCopyable() {}
+    ~NonCopyable() {}
+
+private:
+    NonCopyable(const NonCopyable &);
+    NonCopyable &operator=(const NonCopyable &);
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, int value = 0);
+
+    void write(int value);
+    int read();
+
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+class PwmOut {
+public:
+    PwmOut(PinName pin);
+
+    /** Duty cycle, 0.0 - 1.0 */
+    void write(float value);
+    float read();
+
+    PwmOut &operator=(float value)
+    {
+        write(value);
+        return *this;
+    }
+
+private:
+    PinName _pin;
+};
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin, PinMode mode = PullDefault);
+
+    int read();
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+/** Port 0 only; bit n of the port value is pin P0_n */
+class PortIn {
+public:
+    PortIn(PortName port, int mask = 0xFFFFFFFF);
+
+    int read();
+    void mode(PinMode pull);
+
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    uint32_t _mask;
+};
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin);
+
+    float read();
+    unsigned short read_u16();
+
+    operator float()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin, PinMode mode = PullDefault);
+    virtual ~InterruptIn();
+
+    int read();
+
+    void rise(Callback<void()> func);
+    void fall(Callback<void()> func);
+
+    void enable_irq();
+    void disable_irq();
+
+    operator int()
+    {
+        return read();
+    }
+
+    /* Simulator: called by the kernel when the pin level changes */
+    void sim_edge(int level);
+
+private:
+    PinName _pin;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+    bool _irqEnabled;
+};
+
+class RawSerial {
+public:
+    enum IrqType {
+        RxIrq = 0,
+        TxIrq
+    };
+
+    RawSerial(PinName tx, PinName rx, int baud = 9600);
+    virtual ~RawSerial();
+
+    void baud(int baudrate) {}
+
+    void attach(Callback<void()> func, IrqType type = RxIrq);
+
+    int readable();
+    int getc();
+    /* Output goes to stdout, like printf() */
+    int putc(int c);
+
+    /* Simulator: called by the kernel when a character arrives */
+    void sim_receive(char c);
+
+private:
+    Callback<void()> _rxIrq;
+    char _rxBuffer[16];
+    unsigned _rxHead;
+    unsigned _rxTail;
+};
+
+class Ticker {
+public:
+    Ticker();
+    virtual ~Ticker();
+
+    void attach(Callback<void()> func, float t)
+    {
+        attach_us(func, (us_timestamp_t)(t * 1000000.0f));
+    }
+
+    void attach_us(Callback<void()> func, us_timestamp_t t);
+
+    template <typename T, typename M>
+    void attach_us(T *obj, M method, us_timestamp_t t)
+    {
+        attach_us(Callback<void()>(obj, method), t);
+    }
+
+    void detach();
+
+private:
+    int _id;
+};
+
+class Timer {
+public:
+    Timer();
+
+    void start();
+    void stop();
+    void reset();
+    int read_us();
+    int read_ms();
+    float read();
+
+private:
+    us_timestamp_t _start;
+    us_timestamp_t _elapsed;
+    bool _running;
+};
+
+} // namespace mbed
+
+/* CMSIS-RTOS2 priorities */
+typedef enum {
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+typedef int32_t osStatus;
+#define osOK 0
+
+#ifndef OS_STACK_SIZE
+#define OS_STACK_SIZE 4096
+#endif
+
+namespace rtos {
+
+/**
+ * A thread of the given priority. The only body the simulator runs is an EventQueue's
+ * dispatch loop: start() hands the queue to the kernel, which dispatches it at the thread's
+ * priority, preempting lower priority queues as soon as one of its events falls due.
+ */
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char *stack_mem = NULL, const char *name = NULL)
+        : _priority(priority)
+    {
+    }
+
+    osStatus start(mbed::Callback<void()> task);
+
+    osPriority get_priority() const
+    {
+        return _priority;
+    }
+
+private:
+    osPriority _priority;
+};
+
+} // namespace rtos
+
+using namespace mbed;
+using namespace rtos;
+using namespace std;
+
+#endif // SIM_MBED_H
@@ -0,0 +1,76 @@
+/* Tests for the Advertiser phase sequence and its reconnect statistics */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "SimBLE.h"
+#include "Advertiser.h"
+
+namespace {
+
+events::EventQueue queue;
+Advertiser advertiser(&queue);
+
+void onConnection(const Gap::ConnectionCallbackParams_t *params)
+{
+    advertiser.connected();
+}
+
+void scheduleBleEvents(BLE::OnEventsToProcessCallbackContext *context)
+{
+    queue.call(mbed::callback(&context->ble, &BLE::processEvents));
+}
+
+void testPhases()
+{
+    sim::bleHostAway(3600000000u);
+    advertiser.start();
+    CHECK(advertiser.phase() == Advertiser::PHASE_FAST);
+    CHECK(BLE::Instance().gap().advInterval == ADV_FAST_INTERVAL_MS);
+
+    queue.dispatch(ADV_FAST_MS + 10);
+    CHECK(advertiser.phase() == Advertiser::PHASE_SLOW);
+    CHECK(BLE::Instance().gap().advInterval == ADV_SLOW_INTERVAL_MS);
+    CHECK(BLE::Instance().gap().advertising);
+
+    advertiser.stop();
+    CHECK(advertiser.phase() == Advertiser::PHASE_OFF);
+    CHECK(!BLE::Instance().gap().advertising);
+}
+
+void testStackRefusesDirected()
+{
+    // No peer address can be given, so the stack has nothing to direct at
+    Gap &gap = BLE::Instance().gap();
+    gap.setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_DIRECTED);
+    CHECK(gap.startAdvertising() == BLE_ERROR_NOT_IMPLEMENTED);
+    CHECK(!gap.advertising);
+    gap.setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+}
+
+void testReconnectStats()
+{
+    sim::bleHostAway(0);
+    uint32_t entered = advertiser.stats[Advertiser::PHASE_FAST].entered;
+    advertiser.start();
+    queue.dispatch(500);
+    CHECK(advertiser.phase() == Advertiser::PHASE_OFF);
+    CHECK(advertiser.stats[Advertiser::PHASE_FAST].entered == entered + 1);
+    CHECK(advertiser.stats[Advertiser::PHASE_FAST].connections == 1);
+    CHECK(advertiser.stats[Advertiser::PHASE_FAST].maxMs < 200);
+}
+
+} // namespace
+
+int main()
+{
+    BLE::Instance().gap().onConnection(&onConnection);
+    FunctionPointerWithContext<BLE::OnEventsToProcessCallbackContext*> scheduleFp(scheduleBleEvents);
+    BLE::Instance().onEventsToProcess(scheduleFp);
+
+    testPhases();
+    testStackRefusesDirected();
+    testReconnectStats();
+
+    return simtest::report();
+}
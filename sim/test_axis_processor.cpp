@@ -0,0 +1,231 @@
+/* Tests for AxisProcessor calibration, radial deadzone and response curves */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "AxisProcessor.h"
+
+namespace {
+
+void process(AxisProcessor &processor, uint16_t x, uint16_t y, int32_t *outX, int32_t *outY)
+{
+    uint16_t raw[AxisProcessor::AXES] = {x, y, 32768, 32768};
+    int32_t out[AxisProcessor::AXES];
+    processor.process(raw, out);
+    *outX = out[0];
+    *outY = out[1];
+}
+
+void testSqrt()
+{
+    CHECK(AxisProcessor::isqrt(0) == 0);
+    CHECK(AxisProcessor::isqrt(1) == 1);
+    CHECK(AxisProcessor::isqrt(15) == 3);
+    CHECK(AxisProcessor::isqrt(16) == 4);
+    CHECK(AxisProcessor::isqrt(0xFFFFFFFF) == 65535);
+
+    uint32_t seed = 11;
+    for (unsigned i = 0; i < 1000000; i++) {
+        seed = seed * 1664525 + 1013904223;
+        uint32_t value = seed >> (i % 32);
+        uint32_t exact = AxisProcessor::isqrt(value);
+        uint32_t approx = AxisProcessor::sqrt(value);
+        CHECK(approx >= exact && approx <= exact + 1);
+        if (approx < exact || approx > exact + 1) {
+            printf("  sqrt(%u) = %u, exact %u\n", (unsigned)value, (unsigned)approx, (unsigned)exact);
+            return;
+        }
+    }
+}
+
+void testLinearIsIdentity()
+{
+    AxisProcessor processor;
+    int32_t x, y;
+    for (unsigned i = 0; i < 65536; i += 97) {
+        process(processor, i, 65535 - i, &x, &y);
+        int32_t expectedX = i >= 32768 ? (i - 32768) * 32767 / 32767 : -(int32_t)((32768 - i) * 32767 / 32768);
+        CHECK(abs(x - expectedX) <= 1);
+        CHECK(x >= -AxisProcessor::FULL_SCALE && x <= AxisProcessor::FULL_SCALE);
+    }
+
+    /* Both axes at full deflection keep their square-gate corner */
+    process(processor, 65535, 0, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+    CHECK(y == -AxisProcessor::FULL_SCALE);
+}
+
+void testCalibrationClampsWithoutWrapping()
+{
+    AxisProcessor processor;
+    processor.setCalibration(0, 10000, 30000, 50000);
+    int32_t x, y;
+
+    process(processor, 30000, 32768, &x, &y);
+    CHECK(x == 0);
+    process(processor, 10000, 32768, &x, &y);
+    CHECK(x == -AxisProcessor::FULL_SCALE);
+    process(processor, 50000, 32768, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+
+    /* Readings past the calibrated range saturate */
+    process(processor, 0, 32768, &x, &y);
+    CHECK(x == -AxisProcessor::FULL_SCALE);
+    process(processor, 65535, 32768, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+
+    /* Halfway either side uses that side's own range */
+    process(processor, 20000, 32768, &x, &y);
+    CHECK(abs(x + 16384) <= 1);
+    process(processor, 40000, 32768, &x, &y);
+    CHECK(abs(x - 16384) <= 1);
+}
+
+void testRadialDeadzone()
+{
+    AxisProcessor processor;
+    processor.setDeadzone(4000);
+    int32_t x, y;
+
+    /* 3000 on each axis is inside the deadzone per axis but outside it radially (4243) */
+    process(processor, 32768 + 3000, 32768 + 3000, &x, &y);
+    CHECK(x > 0 && y > 0);
+    CHECK(x == y);
+
+    /* 2800 on both axes is inside radially (3960) */
+    process(processor, 32768 + 2800, 32768 - 2800, &x, &y);
+    CHECK(x == 0 && y == 0);
+
+    /* The range outside the deadzone is stretched back to full scale */
+    process(processor, 65535, 32768, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+    CHECK(y == 0);
+    process(processor, 32768 + 4100, 32768, &x, &y);
+    CHECK(x > 0 && x < 200);
+}
+
+void testCurves()
+{
+    AxisProcessor processor;
+    int32_t linear, square, cube, root, y;
+
+    process(processor, 32768 + 16384, 32768, &linear, &y);
+    processor.setCurve(AxisProcessor::CURVE_SQUARE);
+    process(processor, 32768 + 16384, 32768, &square, &y);
+    processor.setCurve(AxisProcessor::CURVE_CUBE);
+    process(processor, 32768 + 16384, 32768, &cube, &y);
+    processor.setCurve(AxisProcessor::CURVE_SQRT);
+    process(processor, 32768 + 16384, 32768, &root, &y);
+
+    CHECK(abs(linear - 16384) <= 1);
+    CHECK(abs(square - 8192) <= 2);
+    CHECK(abs(cube - 4096) <= 2);
+    CHECK(abs(root - 23170) <= 2);
+
+    /* Monotonic, and the direction is preserved */
+    processor.setCurve(AxisProcessor::CURVE_CUBE);
+    int32_t previous = -1;
+    for (unsigned i = 32768; i < 65536; i += 61) {
+        int32_t x;
+        process(processor, i, 32768 - (i - 32768) / 2, &x, &y);
+        CHECK(x >= previous);
+        CHECK(y <= 0);
+        previous = x;
+    }
+}
+
+/* The calibration holds min < centre < max with STICK_MIN_SPAN either side, and readings map
+ * without wrapping or flipping sign */
+void checkCalibration(AxisProcessor &processor, const char *what)
+{
+    uint16_t min, centre, max;
+    processor.calibration(0, &min, &centre, &max);
+    bool spans = centre - min >= STICK_MIN_SPAN && max - centre >= STICK_MIN_SPAN;
+    if (!spans) {
+        printf("%s: calibrated to %u %u %u\n", what, min, centre, max);
+    }
+    CHECK(spans);
+
+    int32_t x, y;
+    process(processor, centre, 32768, &x, &y);
+    CHECK(x == 0);
+    process(processor, 0, 32768, &x, &y);
+    CHECK(x == -AxisProcessor::FULL_SCALE);
+    process(processor, 65535, 32768, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+
+    /* One count off the centre moves by no more than a minimum span allows */
+    process(processor, centre + 1, 32768, &x, &y);
+    CHECK(x >= 0 && x <= AxisProcessor::FULL_SCALE / STICK_MIN_SPAN + 1);
+    process(processor, centre - 1, 32768, &x, &y);
+    CHECK(x <= 0 && x >= -(AxisProcessor::FULL_SCALE / STICK_MIN_SPAN + 1));
+}
+
+void testCalibrationEdges()
+{
+    static const uint16_t cases[][3] = {
+        {0, 0, 0}, {65535, 65535, 65535}, {0, 1, 2}, {30000, 30001, 30002},
+        {65533, 65534, 65535}, {0, 0, 65535}, {0, 65535, 65535}, {40000, 30000, 20000},
+    };
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        AxisProcessor processor;
+        CHECK(!processor.setCalibration(0, cases[i][0], cases[i][1], cases[i][2]));
+        char what[32];
+        snprintf(what, sizeof(what), "%u %u %u", cases[i][0], cases[i][1], cases[i][2]);
+        checkCalibration(processor, what);
+    }
+
+    /* A sound calibration is kept as it is */
+    AxisProcessor processor;
+    CHECK(processor.setCalibration(0, 0, 32768, 65535));
+    CHECK(processor.setCalibration(0, 10000, 10000 + STICK_MIN_SPAN, 10000 + 2 * STICK_MIN_SPAN));
+}
+
+void testLearnRangeAtTheEnds()
+{
+    static const uint16_t centres[] = {0, 1, 65534, 65535};
+    for (unsigned i = 0; i < sizeof(centres) / sizeof(centres[0]); i++) {
+        AxisProcessor processor;
+        processor.setCentre(0, centres[i]);
+        processor.learnRange(true);
+        char what[32];
+        snprintf(what, sizeof(what), "learning from %u", centres[i]);
+        checkCalibration(processor, what);
+        processor.learnRange(false);
+    }
+}
+
+void testLearnRange()
+{
+    AxisProcessor processor;
+    processor.setCentre(0, 30000);
+    processor.learnRange(true);
+
+    int32_t x, y;
+    process(processor, 20000, 32768, &x, &y);
+    process(processor, 45000, 32768, &x, &y);
+    processor.learnRange(false);
+
+    uint16_t min, centre, max;
+    processor.calibration(0, &min, &centre, &max);
+    CHECK(min == 20000);
+    CHECK(centre == 30000);
+    CHECK(max == 45000);
+    process(processor, 45000, 32768, &x, &y);
+    CHECK(x == AxisProcessor::FULL_SCALE);
+}
+
+} // namespace
+
+int main()
+{
+    testSqrt();
+    testLinearIsIdentity();
+    testCalibrationClampsWithoutWrapping();
+    testRadialDeadzone();
+    testCurves();
+    testLearnRange();
+    testCalibrationEdges();
+    testLearnRangeAtTheEnds();
+
+    return simtest::report();
+}
@@ -0,0 +1,214 @@
+/* Tests for the ConfigStore record format, its lazy change-only saving and persistence */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "ConfigStore.h"
+#include "LittleFileSystem.h"
+#include "HeapBlockDevice.h"
+#include "FileBlockDevice.h"
+
+#include <stddef.h>
+
+namespace {
+
+GamepadSettings sampleSettings()
+{
+    GamepadSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    for (unsigned axis = 0; axis < GamepadSettings::AXES; axis++) {
+        settings.axisMin[axis] = 1000 + axis;
+        settings.axisCentre[axis] = 32000 + axis;
+        settings.axisMax[axis] = 64000 + axis;
+    }
+    settings.deadzone = 1500;
+    settings.curve = 2;
+    settings.pollMinMs = 3;
+    settings.pollIdleMs = 50;
+    for (unsigned input = 0; input < GamepadSettings::INPUTS; input++) {
+        settings.setTicks(input, 1 + input % 15);
+    }
+    return settings;
+}
+
+bool same(const GamepadSettings &a, const GamepadSettings &b)
+{
+    return !memcmp(&a, &b, sizeof(a));
+}
+
+void testRoundTrip()
+{
+    GamepadSettings settings = sampleSettings();
+    uint8_t record[ConfigStore::RECORD_SIZE];
+    CHECK(ConfigStore::encode(settings, record) == ConfigStore::RECORD_SIZE);
+
+    GamepadSettings decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    CHECK(ConfigStore::decode(record, sizeof(record), &decoded));
+    CHECK(same(settings, decoded));
+    CHECK(decoded.ticks(3) == 4);
+    CHECK(decoded.ticks(14) == 15);
+}
+
+void testCrcRejectsCorruption()
+{
+    CHECK(ConfigStore::crc32((const uint8_t *)"123456789", 9) == 0xCBF43926);
+
+    GamepadSettings settings = sampleSettings();
+    uint8_t record[ConfigStore::RECORD_SIZE];
+    ConfigStore::encode(settings, record);
+    GamepadSettings decoded;
+    for (size_t i = 0; i < sizeof(record); i++) {
+        record[i] ^= 0x10;
+        CHECK(!ConfigStore::decode(record, sizeof(record), &decoded));
+        record[i] ^= 0x10;
+    }
+    CHECK(!ConfigStore::decode(record, sizeof(record) - 1, &decoded));
+}
+
+/* Rewrite the header length and CRC as another firmware version would have */
+size_t reencode(uint8_t *record, uint16_t length)
+{
+    memcpy(record + 6, &length, 2);
+    uint32_t crc = ConfigStore::crc32(record, ConfigStore::HEADER_SIZE + length);
+    memcpy(record + ConfigStore::HEADER_SIZE + length, &crc, 4);
+    return ConfigStore::HEADER_SIZE + length + 4;
+}
+
+void testOtherVersions()
+{
+    GamepadSettings settings = sampleSettings();
+    uint8_t record[ConfigStore::MAX_RECORD_SIZE];
+    ConfigStore::encode(settings, record);
+
+    // An older record without the debounce times leaves them at their defaults
+    GamepadSettings decoded;
+    memset(&decoded, 0xAA, sizeof(decoded));
+    size_t size = reencode(record, offsetof(GamepadSettings, debounceTicks));
+    CHECK(ConfigStore::decode(record, size, &decoded));
+    CHECK(decoded.axisCentre[3] == 32003);
+    CHECK(decoded.pollIdleMs == 50);
+    CHECK(decoded.debounceTicks[0] == 0xAA);
+
+    // A newer record with fields appended still yields the known ones
+    ConfigStore::encode(settings, record);
+    memset(record + ConfigStore::HEADER_SIZE + sizeof(settings), 0x55, 10);
+    size = reencode(record, sizeof(settings) + 10);
+    memset(&decoded, 0, sizeof(decoded));
+    CHECK(ConfigStore::decode(record, size, &decoded));
+    CHECK(same(settings, decoded));
+}
+
+void testRecordFraming()
+{
+    // Other files share the framing under a magic of their own
+    const uint32_t magic = 0x54534554; // "TEST"
+    const uint8_t payload[5] = {1, 2, 3, 4, 5};
+    uint8_t record[ConfigStore::FRAME_SIZE + sizeof(payload)];
+    CHECK(ConfigStore::encodeRecord(magic, 3, payload, sizeof(payload), record) == sizeof(record));
+
+    const uint8_t *decoded;
+    uint16_t length;
+    CHECK(ConfigStore::decodeRecord(magic, record, sizeof(record), &decoded, &length));
+    CHECK(length == sizeof(payload));
+    CHECK(!memcmp(decoded, payload, sizeof(payload)));
+    CHECK(!ConfigStore::decodeRecord(ConfigStore::MAGIC, record, sizeof(record), &decoded, &length));
+
+    GamepadSettings settings;
+    CHECK(!ConfigStore::decode(record, sizeof(record), &settings));
+}
+
+void testLazySave()
+{
+    HeapBlockDevice bd(8192, 512);
+    LittleFileSystem fs("fs");
+    CHECK(!fs.reformat(&bd));
+    events::EventQueue queue;
+    ConfigStore store(&queue, &fs, "gamepad.cfg");
+
+    GamepadSettings settings = sampleSettings();
+    GamepadSettings loaded;
+    CHECK(!store.load(&loaded));
+
+    // A burst of changes makes one write, after the quiet period
+    for (unsigned i = 0; i < 5; i++) {
+        settings.deadzone = 1000 + i;
+        store.requestSave(settings);
+        queue.dispatch(100);
+    }
+    CHECK(store.saves == 0);
+    queue.dispatch(CONFIG_SAVE_DELAY_MS);
+    CHECK(store.saves == 1);
+    CHECK(!store.pending());
+
+    // Saving what is already stored does not write
+    store.requestSave(settings);
+    CHECK(!store.pending());
+    CHECK(store.unchanged == 1);
+
+    // The next write waits for the minimum interval
+    settings.curve = 1;
+    store.requestSave(settings);
+    queue.dispatch(CONFIG_SAVE_DELAY_MS * 2);
+    CHECK(store.saves == 1);
+    queue.dispatch(CONFIG_MIN_SAVE_INTERVAL_MS);
+    CHECK(store.saves == 2);
+
+    // A change undone before it was written costs nothing
+    GamepadSettings changed = settings;
+    changed.pollMinMs = 9;
+    store.requestSave(changed);
+    store.requestSave(settings);
+    CHECK(!store.pending());
+    queue.dispatch(CONFIG_MIN_SAVE_INTERVAL_MS * 2);
+    CHECK(store.saves == 2);
+
+    // A pending change can be forced out, and a fresh store reads it back
+    store.requestSave(changed);
+    store.flush();
+    CHECK(store.saves == 3);
+    ConfigStore other(&queue, &fs, "gamepad.cfg");
+    CHECK(other.load(&loaded));
+    CHECK(same(loaded, changed));
+}
+
+/* A record saved before a reset is found by the next boot */
+void testSurvivesReset()
+{
+    const char *path = "build/test_config_store.bin";
+    remove(path);
+    events::EventQueue queue;
+    GamepadSettings settings = sampleSettings();
+    {
+        FileBlockDevice bd(path, 8192);
+        LittleFileSystem fs("fs");
+        CHECK(fs.mount(&bd));
+        CHECK(!fs.reformat(&bd));
+        ConfigStore store(&queue, &fs, "gamepad.cfg");
+        store.requestSave(settings);
+        store.flush();
+    }
+
+    FileBlockDevice bd(path, 8192);
+    LittleFileSystem fs("fs");
+    CHECK(!fs.mount(&bd));
+    ConfigStore store(&queue, &fs, "gamepad.cfg");
+    GamepadSettings loaded;
+    CHECK(store.load(&loaded));
+    CHECK(same(loaded, settings));
+    remove(path);
+}
+
+} // namespace
+
+int main()
+{
+    testRoundTrip();
+    testCrcRejectsCorruption();
+    testOtherVersions();
+    testRecordFraming();
+    testLazySave();
+    testSurvivesReset();
+
+    return simtest::report();
+}
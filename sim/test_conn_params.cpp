@@ -0,0 +1,158 @@
+/* Tests for the ConnParamManager activity modes and how it settles update requests */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "SimBLE.h"
+#include "ConnParamManager.h"
+
+namespace {
+
+events::EventQueue queue;
+ConnParamManager manager(&queue);
+uint16_t g_interval;
+
+void onInterval(uint16_t interval)
+{
+    g_interval = interval;
+}
+
+void onConnection(const Gap::ConnectionCallbackParams_t *params)
+{
+    manager.connected(params->handle, params->connectionParams);
+}
+
+void scheduleBleEvents(BLE::OnEventsToProcessCallbackContext *context)
+{
+    queue.call(mbed::callback(&context->ble, &BLE::processEvents));
+}
+
+/* A report written now and reported sent delayMs later; the link itself is not involved */
+void report(unsigned delayMs)
+{
+    manager.reportWritten();
+    queue.dispatch(delayMs);
+    manager.reportsSent(1);
+}
+
+void testConnectsActive()
+{
+    Gap &gap = BLE::Instance().gap();
+    gap.setPreferredConnectionParams(&manager.params(ConnParamManager::MODE_ACTIVE));
+    gap.setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+    gap.setAdvertisingInterval(20);
+    gap.startAdvertising();
+    queue.dispatch(200);
+
+    CHECK(manager.liveInterval() == CONN_ACTIVE_MIN_INTERVAL);
+    CHECK(manager.liveLatency() == 0);
+    CHECK(g_interval == CONN_ACTIVE_MIN_INTERVAL);
+    CHECK(manager.mode() == ConnParamManager::MODE_ACTIVE);
+    CHECK(manager.settled());
+    CHECK(manager.requests == 0);
+}
+
+void testRelaxesWhenQuiet()
+{
+    // Reports keep the link active
+    for (unsigned i = 0; i < 10; i++) {
+        report(5);
+        queue.dispatch(CONN_IDLE_AFTER_MS / 5);
+    }
+    CHECK(manager.requests == 0);
+
+    queue.dispatch(CONN_IDLE_AFTER_MS);
+    CHECK(manager.mode() == ConnParamManager::MODE_IDLE);
+    CHECK(manager.requests == 1);
+    CHECK(!manager.settled());
+    // Not known to be applied yet
+    CHECK(manager.liveInterval() == CONN_ACTIVE_MIN_INTERVAL);
+}
+
+void testLongDelayConfirmsIdle()
+{
+    // The first report after the quiet spell took longer than an active interval
+    queue.dispatch(ConnParamManager::SETTLE_MS);
+    report(20);
+    CHECK(manager.accepted == 1);
+    CHECK(manager.liveInterval() == CONN_IDLE_MIN_INTERVAL);
+    CHECK(manager.liveLatency() == CONN_IDLE_LATENCY);
+    CHECK(g_interval == CONN_IDLE_MIN_INTERVAL);
+
+    // ... and asked for the active parameters back at once
+    CHECK(manager.mode() == ConnParamManager::MODE_ACTIVE);
+    CHECK(manager.requests == 2);
+    CHECK(manager.idleTimeMs() >= ConnParamManager::SETTLE_MS);
+}
+
+void testShortDelaysConfirmActive()
+{
+    queue.dispatch(ConnParamManager::SETTLE_MS);
+    for (unsigned i = 0; i < ConnParamManager::CONFIRM_SAMPLES - 1; i++) {
+        report(5);
+    }
+    CHECK(!manager.settled());
+    report(5);
+    CHECK(manager.settled());
+    CHECK(manager.accepted == 2);
+    CHECK(manager.liveInterval() == CONN_ACTIVE_MIN_INTERVAL);
+    CHECK(manager.liveLatency() == 0);
+}
+
+void testLongDelayRejectsActive()
+{
+    queue.dispatch(CONN_IDLE_AFTER_MS + 100);
+    queue.dispatch(ConnParamManager::SETTLE_MS);
+    report(20);
+    CHECK(manager.accepted == 3);
+    CHECK(manager.liveInterval() == CONN_IDLE_MIN_INTERVAL);
+
+    // Still idle well after asking for the active parameters: turned down
+    queue.dispatch(ConnParamManager::SETTLE_MS);
+    report(25);
+    CHECK(manager.rejected == 1);
+    CHECK(manager.liveInterval() == CONN_IDLE_MIN_INTERVAL);
+
+    // Not asked for again until the retry time is up, however busy the gamepad is
+    uint32_t requests = manager.requests;
+    for (unsigned ms = 0; ms < CONN_RETRY_MS - 1000; ms += 500) {
+        report(5);
+        queue.dispatch(495);
+    }
+    CHECK(manager.requests == requests);
+    for (unsigned ms = 0; ms < 2000; ms += 500) {
+        report(5);
+        queue.dispatch(495);
+    }
+    CHECK(manager.requests == requests + 1);
+}
+
+void testDisconnect()
+{
+    BLE::Instance().gap().disconnect(1, Gap::LOCAL_HOST_TERMINATED_CONNECTION);
+    manager.disconnected();
+    CHECK(manager.liveInterval() == 0);
+    CHECK(manager.liveLatency() == 0);
+    uint32_t requests = manager.requests;
+    queue.dispatch(CONN_RETRY_MS);
+    CHECK(manager.requests == requests);
+}
+
+} // namespace
+
+int main()
+{
+    BLE::Instance().gap().onConnection(&onConnection);
+    FunctionPointerWithContext<BLE::OnEventsToProcessCallbackContext*> scheduleFp(scheduleBleEvents);
+    BLE::Instance().onEventsToProcess(scheduleFp);
+    manager.onIntervalChange(&onInterval);
+
+    testConnectsActive();
+    testRelaxesWhenQuiet();
+    testLongDelayConfirmsIdle();
+    testShortDelaysConfirmActive();
+    testLongDelayRejectsActive();
+    testDisconnect();
+
+    return simtest::report();
+}
@@ -0,0 +1,138 @@
+/* Bounce rejection tests for Debouncer */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "Debouncer.h"
+
+namespace {
+
+/* Feed raw for ticks samples and return the tick index of the first change, or -1 */
+int firstChange(Debouncer &debouncer, uint16_t raw, unsigned ticks, uint16_t *changedMask)
+{
+    for (unsigned i = 0; i < ticks; i++) {
+        uint16_t changed = debouncer.tick(raw);
+        if (changed) {
+            *changedMask = changed;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+void testCleanPressChangesAfterThreshold()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(4);
+    debouncer.reset(0xFFFF);
+
+    uint16_t changed = 0;
+    CHECK(firstChange(debouncer, 0xFFFE, 10, &changed) == 4);
+    CHECK(changed == 0x0001);
+    CHECK(debouncer.state() == 0xFFFE);
+    CHECK(debouncer.settled());
+}
+
+void testShortBouncesRejected()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(4);
+    debouncer.reset(0xFFFF);
+
+    /* Contact chatter: never 4 consecutive samples low */
+    const uint16_t chatter[] = {0xFFFE, 0xFFFE, 0xFFFF, 0xFFFE, 0xFFFE, 0xFFFE, 0xFFFF, 0xFFFE, 0xFFFF};
+    for (unsigned i = 0; i < sizeof(chatter) / sizeof(chatter[0]); i++) {
+        CHECK(debouncer.tick(chatter[i]) == 0);
+    }
+    CHECK(debouncer.state() == 0xFFFF);
+    CHECK(debouncer.settled());
+}
+
+void testSingleSampleGlitchRejected()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(2);
+    debouncer.reset(0x0000);
+
+    CHECK(debouncer.tick(0x8421) == 0);
+    CHECK(debouncer.tick(0x0000) == 0);
+    CHECK(debouncer.tick(0x0000) == 0);
+    CHECK(debouncer.state() == 0x0000);
+}
+
+void testBounceThenSettle()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(3);
+    debouncer.reset(0xFFFF);
+
+    /* Bounce restarts the count; the change lands 3 ticks after the last bounce */
+    CHECK(debouncer.tick(0xFFFD) == 0);
+    CHECK(debouncer.tick(0xFFFF) == 0);
+    CHECK(debouncer.tick(0xFFFD) == 0);
+    CHECK(debouncer.tick(0xFFFD) == 0);
+    CHECK(debouncer.tick(0xFFFD) == 0x0002);
+    CHECK(debouncer.state() == 0xFFFD);
+}
+
+void testPerInputThresholds()
+{
+    Debouncer debouncer;
+    debouncer.reset(0xFFFF);
+    for (unsigned input = 0; input < 16; input++) {
+        debouncer.setTicks(input, input + 1 > Debouncer::MAX_TICKS ? Debouncer::MAX_TICKS : input + 1);
+    }
+    CHECK(debouncer.ticks(0) == 1);
+    CHECK(debouncer.ticks(9) == 10);
+    CHECK(debouncer.ticks(15) == 15);
+
+    /* Press everything at once; input n must flip on tick n + 1 */
+    for (unsigned tick = 1; tick <= 15; tick++) {
+        uint16_t changed = debouncer.tick(0x0000);
+        uint16_t expected = tick < 15 ? (1 << (tick - 1)) : 0xC000;
+        CHECK(changed == expected);
+    }
+    CHECK(debouncer.state() == 0x0000);
+}
+
+void testInputsIndependent()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(4);
+    debouncer.reset(0xFFFF);
+
+    /* Input 0 is pressed cleanly while input 1 chatters */
+    uint16_t samples[] = {0xFFFC, 0xFFFE, 0xFFFC, 0xFFFE};
+    uint16_t changed = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        changed |= debouncer.tick(samples[i]);
+    }
+    CHECK(changed == 0x0001);
+    CHECK(debouncer.state() == 0xFFFE);
+    CHECK(debouncer.settled());
+}
+
+void testRelease()
+{
+    Debouncer debouncer;
+    debouncer.setAllTicks(5);
+    debouncer.reset(0xFFFE);
+
+    uint16_t changed = 0;
+    CHECK(firstChange(debouncer, 0xFFFF, 10, &changed) == 5);
+    CHECK(changed == 0x0001);
+}
+
+} // namespace
+
+int main()
+{
+    testCleanPressChangesAfterThreshold();
+    testShortBouncesRejected();
+    testSingleSampleGlitchRejected();
+    testBounceThenSettle();
+    testPerInputThresholds();
+    testInputsIndependent();
+    testRelease();
+
+    return simtest::report();
+}
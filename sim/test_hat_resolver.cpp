@@ -0,0 +1,167 @@
+/* Tests for the HatResolver table and SOCD policies */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "HatButton.h"
+#include "HatResolver.h"
+#include "HIDDescriptor.h"
+
+namespace {
+
+enum {
+    N = 0, NE, E, SE, S, SW, W, NW,
+    CENTRE = hid::HatSwitch::NULL_STATE
+};
+
+const uint8_t UP = 1 << HatButton::UP;
+const uint8_t RIGHT = 1 << HatButton::RIGHT;
+const uint8_t DOWN = 1 << HatButton::DOWN;
+const uint8_t LEFT = 1 << HatButton::LEFT;
+
+void testTable()
+{
+    CHECK(HatResolver::lookup(0) == CENTRE);
+    CHECK(HatResolver::lookup(UP) == N);
+    CHECK(HatResolver::lookup(UP | RIGHT) == NE);
+    CHECK(HatResolver::lookup(RIGHT) == E);
+    CHECK(HatResolver::lookup(DOWN | RIGHT) == SE);
+    CHECK(HatResolver::lookup(DOWN) == S);
+    CHECK(HatResolver::lookup(DOWN | LEFT) == SW);
+    CHECK(HatResolver::lookup(LEFT) == W);
+    CHECK(HatResolver::lookup(UP | LEFT) == NW);
+
+    /* Opposing directions cancel on their axis only */
+    CHECK(HatResolver::lookup(UP | DOWN) == CENTRE);
+    CHECK(HatResolver::lookup(LEFT | RIGHT) == CENTRE);
+    CHECK(HatResolver::lookup(UP | DOWN | RIGHT) == E);
+    CHECK(HatResolver::lookup(UP | LEFT | RIGHT) == N);
+    CHECK(HatResolver::lookup(UP | DOWN | LEFT | RIGHT) == CENTRE);
+}
+
+void testNeutral()
+{
+    HatResolver hat;
+    hat.setPolicy(HatResolver::SOCD_NEUTRAL);
+
+    CHECK(hat.update(HatButton::LEFT, true) == W);
+    CHECK(hat.update(HatButton::RIGHT, true) == CENTRE);
+    CHECK(hat.update(HatButton::UP, true) == N);
+    CHECK(hat.update(HatButton::LEFT, false) == NE);
+    CHECK(hat.update(HatButton::RIGHT, false) == N);
+    CHECK(hat.update(HatButton::UP, false) == CENTRE);
+    CHECK(hat.held() == 0);
+}
+
+void testLastWins()
+{
+    HatResolver hat;
+    hat.setPolicy(HatResolver::SOCD_LAST_WINS);
+
+    CHECK(hat.update(HatButton::LEFT, true) == W);
+    CHECK(hat.update(HatButton::RIGHT, true) == E);
+    CHECK(hat.suppressed() == LEFT);
+    CHECK(hat.update(HatButton::LEFT, false) == E);
+    CHECK(hat.update(HatButton::LEFT, true) == W);
+
+    /* Releasing the winner hands the axis back to the one still held */
+    CHECK(hat.update(HatButton::LEFT, false) == E);
+    CHECK(hat.suppressed() == 0);
+
+    /* The axes resolve independently */
+    CHECK(hat.update(HatButton::UP, true) == NE);
+    CHECK(hat.update(HatButton::DOWN, true) == SE);
+    CHECK(hat.update(HatButton::LEFT, true) == SW);
+    CHECK(hat.update(HatButton::DOWN, false) == NW);
+    CHECK(hat.update(HatButton::LEFT, false) == NE);
+}
+
+void testFirstWins()
+{
+    HatResolver hat;
+    hat.setPolicy(HatResolver::SOCD_FIRST_WINS);
+
+    CHECK(hat.update(HatButton::UP, true) == N);
+    CHECK(hat.update(HatButton::DOWN, true) == N);
+    CHECK(hat.suppressed() == DOWN);
+    CHECK(hat.update(HatButton::RIGHT, true) == NE);
+    CHECK(hat.update(HatButton::LEFT, true) == NE);
+
+    /* The first released, the other takes over */
+    CHECK(hat.update(HatButton::UP, false) == SE);
+    CHECK(hat.update(HatButton::RIGHT, false) == SW);
+    CHECK(hat.update(HatButton::UP, true) == SW);
+    CHECK(hat.update(HatButton::DOWN, false) == NW);
+}
+
+/* The if/else chain update_hat_direction() used before HatResolver */
+uint8_t chainValue(uint8_t mask)
+{
+    bool up = mask & UP, right = mask & RIGHT, down = mask & DOWN, left = mask & LEFT;
+    if (up) {
+        return right ? NE : (left ? NW : N);
+    } else if (down) {
+        return right ? SE : (left ? SW : S);
+    } else if (left) {
+        return W;
+    } else if (right) {
+        return E;
+    }
+    return CENTRE;
+}
+
+void testFixedPriority()
+{
+    /* Every combination, reached by pressing the buttons held in every order */
+    for (uint8_t mask = 0; mask < 16; mask++) {
+        for (unsigned first = 0; first < 4; first++) {
+            HatResolver hat;
+            hat.setPolicy(HatResolver::SOCD_FIXED_PRIORITY);
+            uint8_t value = CENTRE;
+            for (unsigned i = 0; i < 4; i++) {
+                unsigned direction = (first + i) % 4;
+                if (mask & (1 << direction)) {
+                    value = hat.update(direction, true);
+                }
+            }
+            if (value != chainValue(mask)) {
+                printf("buttons %x from direction %u: %u, was %u\n", mask, first, value,
+                       chainValue(mask));
+            }
+            CHECK(value == chainValue(mask));
+        }
+    }
+}
+
+void testPolicyChange()
+{
+    HatResolver hat;
+    CHECK(hat.policy() == HAT_SOCD_POLICY);
+    CHECK(hat.policy() == HatResolver::SOCD_FIXED_PRIORITY);
+
+    hat.setPolicy(HatResolver::SOCD_LAST_WINS);
+    hat.update(HatButton::UP, true);
+    hat.update(HatButton::DOWN, true);
+    CHECK(hat.value() == S);
+
+    /* Held buttons cancel until one is released */
+    hat.setPolicy(HatResolver::SOCD_FIRST_WINS);
+    CHECK(hat.value() == CENTRE);
+    CHECK(hat.update(HatButton::DOWN, false) == N);
+
+    hat.setPolicy(HatResolver::SOCD_POLICIES);
+    CHECK(hat.policy() == HatResolver::SOCD_NEUTRAL);
+}
+
+} // namespace
+
+int main()
+{
+    testTable();
+    testNeutral();
+    testLastWins();
+    testFirstWins();
+    testFixedPriority();
+    testPolicyChange();
+
+    return simtest::report();
+}
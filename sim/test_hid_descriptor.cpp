@@ -0,0 +1,261 @@
+/* Tests for the compile-time HID report descriptors and the report packer */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "HIDDescriptor.h"
+#include "ReportSnapshot.h"
+
+namespace {
+
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    hid::Axes<hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ> > Gamepad;
+
+static_assert(Gamepad::LENGTH == 6, "");
+static_assert(Gamepad::offset(hid::FIELD_BUTTONS) == 0, "");
+static_assert(Gamepad::offset(hid::FIELD_HAT) == 12, "");
+static_assert(Gamepad::offset(hid::FIELD_AXES) == 16, "");
+static_assert(Gamepad::count(hid::FIELD_PADDING) == 0, "");
+
+/* Eight buttons and padding, so the axes start on a byte */
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::Buttons<6>,
+                    hid::Padding<2>,
+                    hid::Axes<hid::USAGE_RX, hid::USAGE_RY> > Padded;
+
+constexpr uint8_t PADDED_DESCRIPTOR[] = {
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x00, 0xa1, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x06, 0x15, 0x00, 0x25, 0x01, 0x95, 0x06, 0x75, 0x01, 0x81, 0x02,
+    0x75, 0x02, 0x95, 0x01, 0x81, 0x03,
+    0x05, 0x01, 0x09, 0x33, 0x09, 0x34, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x02,
+    0x81, 0x02,
+    0xc0, 0xc0
+};
+
+static_assert(hid::equal(Padded::DESCRIPTOR, PADDED_DESCRIPTOR, sizeof(PADDED_DESCRIPTOR)), "");
+static_assert(Padded::LENGTH == 3, "");
+static_assert(Padded::offset(hid::FIELD_AXES) == 8, "");
+
+/* Wide axes straddling bytes, and 16-bit triggers on the Simulation Controls page */
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    hid::WideAxes<12, hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ>,
+                    hid::Triggers<16> > Extended;
+
+constexpr uint8_t EXTENDED_VALUES_DESCRIPTOR[] = {
+    0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35,
+    0x15, 0x00, 0x26, 0xff, 0x0f, 0x75, 0x0c, 0x95, 0x04, 0x81, 0x02,
+    0x05, 0x02, 0x09, 0xc5, 0x09, 0xc4,
+    0x15, 0x00, 0x27, 0xff, 0xff, 0x00, 0x00, 0x75, 0x10, 0x95, 0x02, 0x81, 0x02,
+    0xc0, 0xc0
+};
+
+/* The items after the hat switch, which end with the unit being cleared */
+constexpr bool extendedValuesMatch() {
+    unsigned start = Extended::DESCRIPTOR_LENGTH - sizeof(EXTENDED_VALUES_DESCRIPTOR);
+    for (unsigned i = 0; i < sizeof(EXTENDED_VALUES_DESCRIPTOR); i++) {
+        if (Extended::DESCRIPTOR.bytes[start + i] != EXTENDED_VALUES_DESCRIPTOR[i]) {
+            return false;
+        }
+    }
+    return Extended::DESCRIPTOR.bytes[start - 2] == UNIT(1) && Extended::DESCRIPTOR.bytes[start - 1] == 0;
+}
+
+static_assert(extendedValuesMatch(), "");
+static_assert(Extended::LENGTH == 12, "");
+static_assert(Extended::LENGTH <= 20, "fits one notification at the default ATT MTU");
+static_assert(Extended::offset(hid::FIELD_TRIGGERS) == 64, "");
+
+/* The gamepad as two reports: buttons and hat under ID 1, the axes under ID 2 */
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::ReportId<1>,
+                    hid::Buttons<12>,
+                    hid::HatSwitch,
+                    hid::ReportId<2>,
+                    hid::Axes<hid::USAGE_X, hid::USAGE_Y, hid::USAGE_Z, hid::USAGE_RZ> > Split;
+
+constexpr uint8_t SPLIT_DESCRIPTOR[] = {
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x00, 0xa1, 0x01,
+    0x85, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x0c, 0x15, 0x00, 0x25, 0x01, 0x95, 0x0c, 0x75, 0x01, 0x81, 0x02,
+    0x05, 0x01, 0x09, 0x39, 0x65, 0x14, 0x15, 0x00, 0x25, 0x07, 0x35, 0x00, 0x46, 0x3b, 0x01,
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x42, 0x65, 0x00,
+    0x85, 0x02,
+    0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35,
+    0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x04, 0x81, 0x02,
+    0xc0, 0xc0
+};
+
+static_assert(hid::equal(Split::DESCRIPTOR, SPLIT_DESCRIPTOR, sizeof(SPLIT_DESCRIPTOR)), "");
+static_assert(Split::LENGTH == Gamepad::LENGTH, "report IDs take no space in the layout");
+static_assert(Split::offset(hid::FIELD_AXES) == Gamepad::offset(hid::FIELD_AXES), "");
+static_assert(Split::reports() == 2 && Gamepad::reports() == 1, "");
+static_assert(Split::reportId(0) == 1 && Split::reportId(1) == 2 && Gamepad::reportId(0) == 0, "");
+static_assert(Split::reportOffset(0) == 0 && Split::reportLength(0) == 2, "");
+static_assert(Split::reportOffset(1) == 2 && Split::reportLength(1) == 4, "");
+static_assert(Gamepad::reportOffset(0) == 0 && Gamepad::reportLength(0) == 6, "");
+static_assert(Split::reportOf(hid::FIELD_HAT) == 0 && Split::reportOf(hid::FIELD_AXES) == 1, "");
+static_assert(Gamepad::reportOf(hid::FIELD_AXES) == 0, "");
+
+/* A vendor output and feature report after the input fields, with a two byte usage page */
+typedef hid::Report<hid::PAGE_GENERIC_DESKTOP, hid::USAGE_GAME_PAD,
+                    hid::ReportId<1>,
+                    hid::Buttons<8>,
+                    hid::VendorReport<hid::VENDOR_OUTPUT, 2, 0x01, 4>,
+                    hid::VendorReport<hid::VENDOR_FEATURE, 3, 0x02, 8> > Vendor;
+
+constexpr uint8_t VENDOR_DESCRIPTOR[] = {
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x00, 0xa1, 0x01,
+    0x85, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02,
+    0x85, 0x02, 0x06, 0x00, 0xff, 0x09, 0x01, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x04,
+    0x91, 0x02,
+    0x85, 0x03, 0x09, 0x02, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x08, 0xb1, 0x02,
+    0xc0, 0xc0
+};
+
+static_assert(hid::equal(Vendor::DESCRIPTOR, VENDOR_DESCRIPTOR, sizeof(VENDOR_DESCRIPTOR)), "");
+static_assert(Vendor::LENGTH == 1 && Vendor::reports() == 1 && Vendor::reportLength(0) == 1,
+              "vendor reports take no room in the input report");
+
+/* Records the calls the packer makes, applied to a plain buffer */
+struct Target {
+    uint8_t bytes[Gamepad::LENGTH];
+    unsigned calls;
+
+    void setBits(unsigned index, uint8_t mask, uint8_t value) {
+        bytes[index] = (bytes[index] & ~mask) | (value & mask);
+        calls++;
+    }
+
+    void write(unsigned index, const uint8_t *data, unsigned length) {
+        memcpy(bytes + index, data, length);
+        calls++;
+    }
+};
+
+void testButtons()
+{
+    Target target = {};
+    hid::ReportPacker<Gamepad, Target> packer(target);
+
+    packer.setButton(0, true);
+    packer.setButton(7, true);
+    packer.setButton(8, true);
+    packer.setButton(11, true);
+    CHECK(target.bytes[0] == 0x81);
+    CHECK(target.bytes[1] == 0x09);
+
+    packer.setButton(7, false);
+    packer.setButton(11, false);
+    CHECK(target.bytes[0] == 0x01);
+    CHECK(target.bytes[1] == 0x01);
+    CHECK(target.calls == 6);
+}
+
+void testHatKeepsButtons()
+{
+    Target target = {};
+    hid::ReportPacker<Gamepad, Target> packer(target);
+
+    packer.setButton(9, true);
+    packer.setHat(3);
+    CHECK(target.bytes[1] == 0x32);
+
+    packer.setHat(hid::HatSwitch::NULL_STATE);
+    CHECK(target.bytes[1] == 0xF2);
+
+    // Buttons 9-12 do not clobber the hat either
+    packer.setButton(9, false);
+    packer.setButton(10, true);
+    CHECK(target.bytes[1] == 0xF4);
+}
+
+void testAxes()
+{
+    Target target = {};
+    hid::ReportPacker<Gamepad, Target> packer(target);
+    const uint8_t values[4] = {0x10, 0x20, 0x30, 0x40};
+
+    packer.setButton(0, true);
+    packer.setHat(5);
+    packer.setAxes(values);
+    CHECK(memcmp(target.bytes + 2, values, sizeof(values)) == 0);
+    CHECK(target.bytes[0] == 0x01);
+    CHECK(target.bytes[1] == 0x50);
+
+    packer.setAxis(3, 0xFF);
+    CHECK(target.bytes[5] == 0xFF);
+    CHECK(target.bytes[4] == 0x30);
+}
+
+void testWideValues()
+{
+    struct WideTarget {
+        uint8_t bytes[Extended::LENGTH];
+        unsigned calls;
+
+        void setBits(unsigned index, uint8_t mask, uint8_t value) {
+            bytes[index] = (bytes[index] & ~mask) | (value & mask);
+            calls++;
+        }
+
+        void write(unsigned index, const uint8_t *data, unsigned length) {
+            memcpy(bytes + index, data, length);
+            calls++;
+        }
+    } target = {};
+    typedef hid::ReportPacker<Extended, WideTarget> Packer;
+    Packer packer(target);
+
+    const uint16_t axes[4] = {0x123, 0xABC, 0x000, 0xFFF};
+    const uint16_t triggers[2] = {0xBEEF, 0x0001};
+    packer.setHat(2);
+    packer.setAxes(axes);
+    packer.setTriggers(triggers);
+    CHECK(target.calls == 3);
+
+    /* LSB first: X fills byte 2 and the low nibble of byte 3, Y the high nibble and byte 4 */
+    const uint8_t expected[Extended::LENGTH] = {0x00, 0x20, 0x23, 0xC1, 0xAB, 0x00, 0xF0, 0xFF,
+                                                0xEF, 0xBE, 0x01, 0x00};
+    CHECK(memcmp(target.bytes, expected, sizeof(expected)) == 0);
+
+    for (unsigned i = 0; i < 4; i++) {
+        CHECK(Packer::unpack(target.bytes + Packer::AXIS_OFFSET / 8, i, Packer::AXIS_BITS) == axes[i]);
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        CHECK(Packer::unpack(target.bytes + Packer::TRIGGER_OFFSET / 8, i, Packer::TRIGGER_BITS) == triggers[i]);
+    }
+}
+
+void testSnapshotTarget()
+{
+    /* Zero-initialised, as the firmware's is */
+    static ReportSnapshot<Gamepad::LENGTH> snapshot;
+    hid::ReportPacker<Gamepad, ReportSnapshot<Gamepad::LENGTH> > packer(snapshot);
+    const uint8_t values[4] = {1, 2, 3, 4};
+
+    packer.setButton(11, true);
+    packer.setHat(0);
+    packer.setAxes(values);
+
+    uint8_t report[Gamepad::LENGTH];
+    snapshot.read(report);
+    const uint8_t expected[Gamepad::LENGTH] = {0x00, 0x08, 1, 2, 3, 4};
+    CHECK(memcmp(report, expected, sizeof(expected)) == 0);
+}
+
+} // namespace
+
+int main()
+{
+    testButtons();
+    testHatKeepsButtons();
+    testAxes();
+    testWideValues();
+    testSnapshotTarget();
+
+    return simtest::report();
+}
@@ -0,0 +1,192 @@
+/* Tests for HIDServiceBase report flow across connections and with the stack out of buffers
+ *
+ * The host only subscribes to input reports once the link is encrypted. Changes signalled
+ * before that must not leave a report in flight, or coalesced sends wait forever for an
+ * onDataSent() that never comes. Like the nRF5x port, the simulated stack refuses writes with
+ * BLE_STACK_BUSY when its buffers are full.
+ *
+ * As in the firmware, reports are driven from a high priority input thread and the stack's
+ * events are handed off to it; when its queue is full they wait rather than run on the BLE
+ * thread.
+ */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "SimBLE.h"
+#include "JoystickService.h"
+#include "QueueStats.h"
+
+#include <vector>
+
+namespace {
+
+events::EventQueue queue;
+events::EventQueue inputQueue(16 * EVENTS_EVENT_SIZE);
+Thread inputThread(osPriorityHigh);
+JoystickService *service;
+unsigned g_button;
+unsigned g_buttonsOnAir;
+unsigned g_disconnections;
+uint8_t g_lastButtons[JOYSTICK_REPORT_LENGTH];
+
+const unsigned BUTTONS_REPORT = JoystickReportMap::reportOf(hid::FIELD_BUTTONS);
+
+void scheduleBleEvents(BLE::OnEventsToProcessCallbackContext *context)
+{
+    queue.call(mbed::callback(&context->ble, &BLE::processEvents));
+}
+
+void pressNext()
+{
+    JoystickService::packer().setButton(g_button % 8, !(g_button & 8));
+    g_button++;
+    service->buttonsChanged();
+}
+
+void press()
+{
+    inputQueue.call(&pressNext);
+}
+
+void onConnection(const Gap::ConnectionCallbackParams_t *params)
+{
+    /* Input changes while the host is still pairing */
+    press();
+    BLE::Instance().securityManager().setLinkSecurity(
+        params->handle, SecurityManager::SECURITY_MODE_ENCRYPTION_NO_MITM);
+}
+
+void onDisconnection(const Gap::DisconnectionCallbackParams_t *params)
+{
+    g_disconnections++;
+    BLE::Instance().gap().startAdvertising();
+}
+
+void onAir(GattAttribute::Handle_t handle, const uint8_t *data, uint16_t len)
+{
+    if (handle == service->inputReportHandle(BUTTONS_REPORT)) {
+        g_buttonsOnAir++;
+        memcpy(g_lastButtons, data, len);
+    }
+}
+
+/* Connect, wait for the subscription, then change a button every 50 ms for a second */
+void checkReportsFlow(const char *when)
+{
+    uint32_t deadline = 0;
+    while (!service->isConnected() && deadline++ < 100) {
+        queue.dispatch(10);
+    }
+    CHECK(service->isConnected());
+
+    /* Pairing done and subscribed: the state changed during pairing goes out unprompted */
+    queue.dispatch(500);
+    CHECK(g_buttonsOnAir >= 1);
+
+    g_buttonsOnAir = 0;
+    for (unsigned i = 0; i < 20; i++) {
+        press();
+        queue.dispatch(50);
+    }
+    if (g_buttonsOnAir < 20) {
+        printf("%s: %u of 20 button changes notified\n", when, g_buttonsOnAir);
+    }
+    CHECK(g_buttonsOnAir == 20);
+}
+
+void testReportsFlowAfterConnect()
+{
+    g_buttonsOnAir = 0;
+    BLE::Instance().gap().startAdvertising();
+    checkReportsFlow("first connection");
+}
+
+void testReportsFlowAfterReconnect()
+{
+    for (unsigned i = 0; i < 3; i++) {
+        sim::bleDisconnect();
+        queue.dispatch(10);
+        CHECK(g_disconnections == i + 1);
+        g_buttonsOnAir = 0;
+        checkReportsFlow("reconnection");
+    }
+}
+
+void testBusyStackSendsLatest()
+{
+    const input_report_t &buttons = joystickInputReports[BUTTONS_REPORT];
+    unsigned txBuffers = sim::config().txBuffers;
+    sim::config().txBuffers = 1;
+    service->setSendMode(SEND_IMMEDIATE);
+    uint32_t retried = service->reportsRetried;
+    uint32_t dropped = service->statesDropped;
+    uint32_t failed = service->failedReports;
+
+    /* Faster than one notification per connection event: all but the first are refused */
+    for (unsigned i = 0; i < 5; i++) {
+        press();
+    }
+    queue.dispatch(200);
+    uint8_t latest[JOYSTICK_REPORT_LENGTH];
+    JoystickService::reportState().read(latest);
+
+    CHECK(service->failedReports == failed + 1);
+    CHECK(service->statesDropped == dropped + 3);
+    CHECK(service->reportsRetried == retried + 1);
+    CHECK(!memcmp(g_lastButtons, latest + JoystickService::reportOffset(BUTTONS_REPORT),
+                  buttons.length));
+
+    sim::config().txBuffers = txBuffers;
+    service->setSendMode(SEND_COALESCED);
+}
+
+void testFullQueueDefersStackEvents()
+{
+    /* The input queue is taken up by events due much later */
+    std::vector<int> fillers;
+    while (int id = inputQueue.call_in(60000, &pressNext)) {
+        fillers.push_back(id);
+    }
+    uint32_t deferred = QueueStats::stats(&inputQueue, QueueStats::EVENT_HANDOFF).deferred;
+    unsigned disconnections = g_disconnections;
+
+    sim::bleDisconnect();
+    queue.dispatch(1000);
+    CHECK(g_disconnections == disconnections + 1);
+    /* Nothing ran on the BLE thread: the service has not heard of the disconnection yet */
+    CHECK(service->isConnected());
+    CHECK(QueueStats::stats(&inputQueue, QueueStats::EVENT_HANDOFF).deferred > deferred);
+
+    /* Once there is room, the next report change posts the latched events */
+    for (size_t i = 0; i < fillers.size(); i++) {
+        inputQueue.cancel(fillers[i]);
+    }
+    g_buttonsOnAir = 0;
+    press();
+    checkReportsFlow("after a full queue");
+}
+
+} // namespace
+
+int main()
+{
+    BLE &ble = BLE::Instance();
+    FunctionPointerWithContext<BLE::OnEventsToProcessCallbackContext*> scheduleFp(scheduleBleEvents);
+    ble.onEventsToProcess(scheduleFp);
+    sim::bleHooks().onAir = &onAir;
+
+    service = new JoystickService(ble);
+    service->setEventQueue(&inputQueue, true);
+    inputThread.start(callback(&inputQueue, &events::EventQueue::dispatch_forever));
+    service->setSendMode(SEND_COALESCED);
+    ble.gap().onConnection(&onConnection);
+    ble.gap().onDisconnection(&onDisconnection);
+
+    testReportsFlowAfterConnect();
+    testReportsFlowAfterReconnect();
+    testBusyStackSendsLatest();
+    testFullQueueDefersStackEvents();
+
+    return simtest::report();
+}
@@ -0,0 +1,245 @@
+/* Tests for the InputMap layouts, chords, macros and profile records */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "InputMap.h"
+#include "LittleFileSystem.h"
+#include "HeapBlockDevice.h"
+
+namespace {
+
+events::EventQueue queue;
+
+/* Output changes seen by the handler */
+uint16_t g_outputs;
+unsigned g_changes;
+
+void onOutput(unsigned output, bool pressed)
+{
+    uint16_t bit = 1 << output;
+    CHECK(((g_outputs & bit) != 0) != pressed);
+    g_outputs ^= bit;
+    g_changes++;
+}
+
+void testIdentity()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        map.input(input, true);
+        CHECK(g_outputs == (1 << input));
+        map.input(input, false);
+        CHECK(g_outputs == 0);
+    }
+
+    /* Repeated edges change nothing */
+    g_changes = 0;
+    map.input(2, true);
+    map.input(2, true);
+    map.input(2, false);
+    map.input(2, false);
+    CHECK(g_changes == 2);
+    CHECK(g_outputs == 0);
+}
+
+void testPermutation()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    /* Every input shifted up by one, the last wrapping round to button 0; input 3 unused */
+    InputProfile profile;
+    profile.setIdentity();
+    for (unsigned input = 0; input < InputProfile::INPUTS; input++) {
+        profile.map[input] = (input + 1) % InputMap::OUTPUTS;
+    }
+    profile.map[3] = InputProfile::NONE;
+    CHECK(map.compile(profile));
+
+    map.input(0, true);
+    CHECK(g_outputs == 0x0002);
+    map.input(15, true);
+    CHECK(g_outputs == 0x0003);
+    map.input(3, true);
+    CHECK(g_outputs == 0x0003);
+    map.input(0, false);
+    map.input(15, false);
+    map.input(3, false);
+    CHECK(g_outputs == 0);
+    CHECK(map.held() == 0);
+}
+
+void testSharedOutput()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    InputProfile profile;
+    profile.setIdentity();
+    profile.map[1] = 0;
+    CHECK(map.compile(profile));
+
+    /* Button 0 stays pressed until both inputs driving it are released */
+    g_changes = 0;
+    map.input(0, true);
+    map.input(1, true);
+    map.input(0, false);
+    CHECK(g_outputs == 0x0001);
+    map.input(1, false);
+    CHECK(g_outputs == 0);
+    CHECK(g_changes == 2);
+}
+
+void testChord()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    /* Inputs 6 and 7 together press button 11 as well */
+    InputProfile profile;
+    profile.setIdentity();
+    profile.chords[0].inputs = (1 << 6) | (1 << 7);
+    profile.chords[0].output = 11;
+    CHECK(map.compile(profile));
+
+    map.input(6, true);
+    CHECK(g_outputs == 0x0040);
+    map.input(7, true);
+    CHECK(g_outputs == 0x08C0);
+    map.input(6, false);
+    CHECK(g_outputs == 0x0080);
+    map.input(7, false);
+    CHECK(g_outputs == 0);
+
+    /* An input in two chords is refused, and the layout kept */
+    profile.chords[1].inputs = (1 << 7) | (1 << 8);
+    profile.chords[1].output = 10;
+    CHECK(!map.compile(profile));
+    map.input(6, true);
+    map.input(7, true);
+    CHECK(g_outputs == 0x08C0);
+    map.input(6, false);
+    map.input(7, false);
+}
+
+void testMacro()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    /* Input 5 taps button 0, then holds buttons 1 and 2, then releases */
+    InputProfile profile;
+    profile.setIdentity();
+    profile.map[5] = InputProfile::MACRO | 2;
+    profile.macros[2][0].outputs = 0x0001;
+    profile.macros[2][0].ticks = 3;
+    profile.macros[2][1].outputs = 0x0006;
+    profile.macros[2][1].ticks = 5;
+    CHECK(map.compile(profile));
+
+    map.input(5, true);
+    CHECK(map.playing(2));
+    CHECK(g_outputs == 0x0001);
+    map.input(5, false);
+    map.input(5, true);
+    queue.dispatch(3 * INPUT_MACRO_TICK_MS + 1);
+    CHECK(g_outputs == 0x0006);
+    queue.dispatch(5 * INPUT_MACRO_TICK_MS);
+    CHECK(g_outputs == 0);
+    CHECK(!map.playing(2));
+    map.input(5, false);
+
+    /* A button held by a macro step stays held by the input driving it too */
+    map.input(5, true);
+    map.input(0, true);
+    queue.dispatch(3 * INPUT_MACRO_TICK_MS + 1);
+    CHECK(g_outputs == 0x0007);
+    map.input(5, false);
+    map.input(0, false);
+
+    /* Changing layout stops the macro and releases its outputs */
+    InputProfile identity;
+    identity.setIdentity();
+    CHECK(map.compile(identity));
+    CHECK(!map.playing(2));
+    CHECK(g_outputs == 0);
+
+    /* Macros that do not exist are refused */
+    profile.map[5] = InputProfile::MACRO | InputProfile::MACROS;
+    CHECK(!map.compile(profile));
+}
+
+void testRecompileWhileHeld()
+{
+    InputMap map(&queue, &onOutput);
+    g_outputs = 0;
+
+    map.input(4, true);
+    CHECK(g_outputs == 0x0010);
+
+    InputProfile profile;
+    profile.setIdentity();
+    profile.map[4] = 9;
+    CHECK(map.compile(profile));
+    CHECK(g_outputs == 0x0200);
+    map.input(4, false);
+    CHECK(g_outputs == 0);
+}
+
+void testRecords()
+{
+    InputProfile profile;
+    profile.setIdentity();
+    profile.map[0] = 12;
+    profile.chords[3].inputs = 0x0300;
+    profile.chords[3].output = InputProfile::MACRO | 1;
+    profile.macros[1][0].outputs = 0x8000;
+    profile.macros[1][0].ticks = 20;
+
+    uint8_t record[InputMap::RECORD_SIZE];
+    CHECK(InputMap::encode(profile, record) == InputMap::RECORD_SIZE);
+
+    InputProfile decoded;
+    CHECK(InputMap::decode(record, sizeof(record), &decoded));
+    CHECK(!memcmp(&decoded, &profile, sizeof(profile)));
+
+    record[ConfigStore::HEADER_SIZE + 5] ^= 1;
+    CHECK(!InputMap::decode(record, sizeof(record), &decoded));
+    CHECK(!InputMap::decode(record, ConfigStore::HEADER_SIZE, &decoded));
+
+    /* Through the file system, as at boot */
+    HeapBlockDevice bd(8192, 512);
+    LittleFileSystem fs("fs");
+    CHECK(!fs.reformat(&bd));
+    InputProfile loaded;
+    CHECK(!InputMap::load(&fs, "profile0.map", &loaded));
+
+    InputMap::encode(profile, record);
+    File file;
+    CHECK(!file.open(&fs, "profile0.map", O_WRONLY | O_CREAT | O_TRUNC));
+    CHECK(file.write(record, sizeof(record)) == (ssize_t)sizeof(record));
+    CHECK(!file.close());
+
+    CHECK(InputMap::load(&fs, "profile0.map", &loaded));
+    CHECK(!memcmp(&loaded, &profile, sizeof(profile)));
+}
+
+} // namespace
+
+int main()
+{
+    sim::config().dispatchCostUs = 0;
+
+    testIdentity();
+    testPermutation();
+    testSharedOutput();
+    testChord();
+    testMacro();
+    testRecompileWhileHeld();
+    testRecords();
+
+    return simtest::report();
+}
@@ -0,0 +1,93 @@
+/* Tests for InputPin edge handling when the edge ring overflows */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "InputPin.h"
+
+namespace {
+
+events::EventQueue queue;
+
+/* Debounced levels as seen by the handlers, one bit per input, set while released */
+uint16_t g_levels = 0xFFFF;
+
+class TestPin : public InputPin {
+    public:
+        TestPin(PinName pin, unsigned index) : InputPin(pin, index) {
+        }
+
+        virtual void onRise() {
+            g_levels |= 1 << _index;
+        }
+
+        virtual void onFall() {
+            g_levels &= ~(1 << _index);
+        }
+};
+
+TestPin pin0(P0_11, 0);
+TestPin pin1(P0_12, 1);
+
+/* Toggle a pin more often than the ring holds before the queue runs, ending at level */
+void chatter(PinName pin, int level)
+{
+    for (unsigned i = 0; i < 2 * INPUT_EVENT_RING_SIZE; i++) {
+        sim::setPin(pin, i % 2 ? level : !level);
+    }
+}
+
+void testEdgesFollowPins()
+{
+    sim::setPin(P0_11, 0);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFE);
+    sim::setPin(P0_11, 1);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFF);
+    CHECK(InputPin::events.drops() == 0);
+}
+
+void testDroppedReleaseIsRecovered()
+{
+    sim::setPin(P0_11, 0);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFE);
+
+    /* The release is among the edges dropped */
+    uint32_t drops = InputPin::events.drops();
+    chatter(P0_11, 1);
+    CHECK(InputPin::events.drops() > drops);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFF);
+    CHECK(InputPin::debouncer.settled());
+}
+
+void testDroppedPressIsRecovered()
+{
+    uint32_t drops = InputPin::events.drops();
+    chatter(P0_12, 0);
+    CHECK(InputPin::events.drops() > drops);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFD);
+
+    /* Edges after the overflow are handled as usual */
+    sim::setPin(P0_12, 1);
+    queue.dispatch(20);
+    CHECK(g_levels == 0xFFFF);
+}
+
+} // namespace
+
+int main()
+{
+    sim::setPin(P0_11, 1);
+    sim::setPin(P0_12, 1);
+    InputPin::start(&queue);
+
+    testEdgesFollowPins();
+    testDroppedReleaseIsRecovered();
+    testDroppedPressIsRecovered();
+
+    return simtest::report();
+}
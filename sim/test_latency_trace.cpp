@@ -0,0 +1,119 @@
+/* Tests for the LatencyTrace stage ordering, log2 buckets and percentiles */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "LatencyTrace.h"
+
+namespace {
+
+/* One edge through every stage, with the given gaps in microseconds */
+void trace(const uint32_t gaps[LatencyTrace::STAGES - 1])
+{
+    LatencyTrace::point(LatencyTrace::EDGE_ISR);
+    for (unsigned stage = LatencyTrace::DRAIN; stage < LatencyTrace::STAGES; stage++) {
+        sim::consume(gaps[stage - 1]);
+        LatencyTrace::point((LatencyTrace::Stage)stage);
+    }
+}
+
+void testBuckets()
+{
+    CHECK(LatencyTrace::bucket(0) == 0);
+    CHECK(LatencyTrace::bucket(1) == 1);
+    CHECK(LatencyTrace::bucket(2) == 2);
+    CHECK(LatencyTrace::bucket(3) == 2);
+    CHECK(LatencyTrace::bucket(4) == 3);
+    CHECK(LatencyTrace::bucket(1023) == 10);
+    CHECK(LatencyTrace::bucket(1024) == 11);
+    CHECK(LatencyTrace::bucket(0xFFFFFFFF) == LatencyTrace::BUCKETS - 1);
+}
+
+void testStages()
+{
+    LatencyTrace::reset();
+    const uint32_t gaps[] = {5, 4000, 0, 300, 20, 7000};
+    trace(gaps);
+
+    CHECK(LatencyTrace::traces == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::DRAIN)[3] == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::HANDLER)[12] == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::UPDATE)[0] == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::COPY)[9] == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::WRITE)[5] == 1);
+    CHECK(LatencyTrace::histogram(LatencyTrace::SENT)[13] == 1);
+    /* The whole path: 11325 us */
+    CHECK(LatencyTrace::histogram(LatencyTrace::EDGE_ISR)[14] == 1);
+}
+
+void testOutOfOrderIgnored()
+{
+    LatencyTrace::reset();
+
+    /* Nothing in flight: later stages alone are not traced */
+    LatencyTrace::point(LatencyTrace::WRITE);
+    LatencyTrace::point(LatencyTrace::SENT);
+    CHECK(LatencyTrace::count(LatencyTrace::WRITE) == 0);
+
+    /* A second edge, a report of someone else's and a skipped stage leave the trace alone */
+    LatencyTrace::point(LatencyTrace::EDGE_ISR);
+    sim::consume(10);
+    LatencyTrace::point(LatencyTrace::EDGE_ISR);
+    LatencyTrace::point(LatencyTrace::SENT);
+    LatencyTrace::point(LatencyTrace::HANDLER);
+    sim::consume(10);
+    LatencyTrace::point(LatencyTrace::DRAIN);
+    CHECK(LatencyTrace::count(LatencyTrace::HANDLER) == 0);
+    CHECK(LatencyTrace::count(LatencyTrace::SENT) == 0);
+    CHECK(LatencyTrace::histogram(LatencyTrace::DRAIN)[5] == 1);
+}
+
+void testStaleTraceAbandoned()
+{
+    LatencyTrace::reset();
+
+    /* A bounce the debouncer rejects never reaches the handler */
+    LatencyTrace::point(LatencyTrace::EDGE_ISR);
+    LatencyTrace::point(LatencyTrace::DRAIN);
+    sim::consume(LATENCY_TRACE_STALE_US);
+
+    const uint32_t gaps[] = {1, 1, 1, 1, 1, 1};
+    trace(gaps);
+    CHECK(LatencyTrace::abandoned == 1);
+    CHECK(LatencyTrace::traces == 1);
+    CHECK(LatencyTrace::count(LatencyTrace::DRAIN) == 2);
+    CHECK(LatencyTrace::histogram(LatencyTrace::EDGE_ISR)[3] == 1);
+}
+
+void testPercentiles()
+{
+    LatencyTrace::reset();
+    CHECK(LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 50) == 0);
+
+    /* 98 fast traces and two slow ones */
+    const uint32_t fast[] = {1, 1, 1, 1, 1, 1};
+    const uint32_t slow[] = {1, 1, 1, 1, 1, 5000};
+    for (unsigned i = 0; i < 98; i++)
+        trace(fast);
+    trace(slow);
+    trace(slow);
+
+    CHECK(LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 50) == 8);
+    CHECK(LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 98) == 8);
+    CHECK(LatencyTrace::percentile(LatencyTrace::EDGE_ISR, 99) == 8192);
+    CHECK(LatencyTrace::percentile(LatencyTrace::SENT, 100) == 8192);
+    CHECK(LatencyTrace::percentile(LatencyTrace::DRAIN, 99) == 2);
+}
+
+} // namespace
+
+int main()
+{
+    testBuckets();
+    testStages();
+    testOutOfOrderIgnored();
+    testStaleTraceAbandoned();
+    testPercentiles();
+
+    return simtest::report();
+}
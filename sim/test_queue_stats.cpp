@@ -0,0 +1,141 @@
+/* Tests for the QueueStats depth, lag, run time and failed post accounting, per queue */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "QueueStats.h"
+
+namespace {
+
+events::EventQueue queue(4 * EVENTS_EVENT_SIZE);
+unsigned g_runs;
+
+void work()
+{
+    g_runs++;
+    sim::consume(300);
+}
+
+/* A busy event that holds up whatever falls due meanwhile */
+void block()
+{
+    sim::consume(5000);
+}
+
+void testDepthAndFailures()
+{
+    QueueStats::reset();
+    CHECK(QueueStats::depth(&queue) == 0);
+
+    int first = QueueStats::call_in(&queue, QueueStats::EVENT_OTHER, 10, &work);
+    QueueStats::call_in(&queue, QueueStats::EVENT_OTHER, 20, &work);
+    QueueStats::call_in(&queue, QueueStats::EVENT_OTHER, 30, &work);
+    CHECK(QueueStats::depth(&queue) == 3);
+
+    /* Cancelled events leave the queue too */
+    queue.cancel(first);
+    CHECK(QueueStats::depth(&queue) == 2);
+
+    QueueStats::call(&queue, QueueStats::EVENT_INPUT, &work);
+    QueueStats::call(&queue, QueueStats::EVENT_INPUT, &work);
+    CHECK(QueueStats::depth(&queue) == 4);
+    CHECK(QueueStats::highWater(&queue) == 4);
+
+    /* The queue holds four events: the fifth post fails and is counted against its type */
+    CHECK(QueueStats::call(&queue, QueueStats::EVENT_BLE, &work) == 0);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_BLE).failed == 1);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_INPUT).posted == 2);
+    CHECK(QueueStats::failedPosts(&queue) == 1);
+    CHECK(QueueStats::depth(&queue) == 4);
+
+    g_runs = 0;
+    queue.dispatch(50);
+    CHECK(g_runs == 4);
+    CHECK(QueueStats::depth(&queue) == 0);
+    CHECK(QueueStats::highWater(&queue) == 4);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_OTHER).runs == 2);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_OTHER).maxRunUs == 300);
+}
+
+void testLag()
+{
+    QueueStats::reset();
+
+    /* The input event falls due while the BLE event runs */
+    QueueStats::call(&queue, QueueStats::EVENT_BLE, &block);
+    QueueStats::call_in(&queue, QueueStats::EVENT_INPUT, 2, &work);
+    queue.dispatch(20);
+
+    const QueueStats::TypeStats &ble = QueueStats::stats(&queue, QueueStats::EVENT_BLE);
+    const QueueStats::TypeStats &input = QueueStats::stats(&queue, QueueStats::EVENT_INPUT);
+    CHECK(ble.runs == 1);
+    CHECK(ble.maxLagUs == 0);
+    CHECK(ble.maxRunUs == 5000);
+    CHECK(input.runs == 1);
+    CHECK(input.maxLagUs == 3000);
+    CHECK(input.totalLagUs == 3000);
+}
+
+void testPeriodic()
+{
+    QueueStats::reset();
+
+    int handle = QueueStats::call_every(&queue, QueueStats::EVENT_DEBOUNCE, 1, &work);
+    CHECK(QueueStats::depth(&queue) == 1);
+    queue.dispatch(10);
+
+    const QueueStats::TypeStats &debounce = QueueStats::stats(&queue, QueueStats::EVENT_DEBOUNCE);
+    CHECK(debounce.posted == 1);
+    CHECK(debounce.runs >= 9);
+    CHECK(debounce.maxLagUs == 0);
+    CHECK(QueueStats::depth(&queue) == 1);
+
+    queue.cancel(handle);
+    CHECK(QueueStats::depth(&queue) == 0);
+}
+
+/* Two queues, as with the input thread: each keeps its own depth, high water and types */
+void testQueuesCountedSeparately()
+{
+    events::EventQueue other(8 * EVENTS_EVENT_SIZE);
+    QueueStats::reset();
+
+    QueueStats::call(&queue, QueueStats::EVENT_BLE, &work);
+    QueueStats::call(&other, QueueStats::EVENT_INPUT, &work);
+    QueueStats::call(&other, QueueStats::EVENT_INPUT, &work);
+    QueueStats::call(&other, QueueStats::EVENT_INPUT, &work);
+    CHECK(QueueStats::depth(&queue) == 1);
+    CHECK(QueueStats::depth(&other) == 3);
+    CHECK(QueueStats::highWater(&queue) == 1);
+    CHECK(QueueStats::highWater(&other) == 3);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_INPUT).posted == 0);
+    CHECK(QueueStats::stats(&other, QueueStats::EVENT_INPUT).posted == 3);
+
+    /* The kernel runs every queue it knows of; other joins them at its first dispatch() */
+    g_runs = 0;
+    other.dispatch(10);
+    CHECK(g_runs == 4);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_BLE).runs == 1);
+    CHECK(QueueStats::stats(&other, QueueStats::EVENT_BLE).runs == 0);
+    CHECK(QueueStats::stats(&other, QueueStats::EVENT_INPUT).runs == 3);
+    CHECK(QueueStats::depth(&other) == 0);
+
+    /* Resetting one queue leaves the other's counters */
+    QueueStats::reset(&other);
+    CHECK(QueueStats::stats(&other, QueueStats::EVENT_INPUT).runs == 0);
+    CHECK(QueueStats::stats(&queue, QueueStats::EVENT_BLE).runs == 1);
+}
+
+} // namespace
+
+int main()
+{
+    sim::config().dispatchCostUs = 0;
+
+    testDepthAndFailures();
+    testLag();
+    testPeriodic();
+    testQueuesCountedSeparately();
+
+    return simtest::report();
+}
@@ -0,0 +1,140 @@
+/* Stress test for ReportSnapshot
+ *
+ * Host threads stand in for the interrupt handlers and event queue callbacks that write the
+ * report concurrently, while a reader takes snapshots as the sender does:
+ *
+ *  - the axes writer stores the same counter into bytes 2-5, which straddle two words, so a
+ *    torn snapshot shows up as unequal axis bytes;
+ *  - the button writer owns byte 0, and the hat and extra-button writers share byte 1 through
+ *    nibble masks, so a lost update shows up in the final state.
+ *
+ * The same reader checks run against a plain byte-by-byte copy for comparison.
+ */
+
+#include "mbed.h"
+#include "ReportSnapshot.h"
+
+#include <thread>
+#include <atomic>
+
+namespace {
+
+const unsigned ITERATIONS = 2000000;
+
+typedef ReportSnapshot<6> Report;
+
+Report g_report;
+volatile uint8_t g_plainReport[6];
+std::atomic<bool> g_done;
+
+bool axesConsistent(const uint8_t *report)
+{
+    return report[2] == report[3] && report[3] == report[4] && report[4] == report[5];
+}
+
+void axesWriter(bool plain)
+{
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        uint8_t axes[4] = {(uint8_t)i, (uint8_t)i, (uint8_t)i, (uint8_t)i};
+        if (plain) {
+            for (unsigned j = 0; j < 4; j++) {
+                g_plainReport[2 + j] = axes[j];
+            }
+        } else {
+            g_report.write(2, axes, 4);
+        }
+    }
+}
+
+void buttonWriter()
+{
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        g_report.setByte(0, i);
+    }
+}
+
+void nibbleWriter(uint8_t mask, unsigned shift)
+{
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        g_report.setBits(1, mask, (i & 0xF) << shift);
+    }
+}
+
+unsigned reader(bool plain, unsigned *reads, unsigned *retries)
+{
+    unsigned torn = 0;
+    uint8_t snapshot[6];
+    while (!g_done) {
+        if (plain) {
+            for (unsigned j = 0; j < 6; j++) {
+                snapshot[j] = g_plainReport[j];
+            }
+        } else {
+            *retries += g_report.read(snapshot);
+        }
+        (*reads)++;
+        if (!axesConsistent(snapshot)) {
+            torn++;
+        }
+    }
+    return torn;
+}
+
+} // namespace
+
+int main()
+{
+    unsigned reads = 0;
+    unsigned retries = 0;
+    unsigned torn = 0;
+    int failures = 0;
+
+    /* Plain copy, as JoystickService::copyReport used to do */
+    g_done = false;
+    std::thread plainReader([&]() { torn = reader(true, &reads, &retries); });
+    std::thread plainWriter(axesWriter, true);
+    plainWriter.join();
+    g_done = true;
+    plainReader.join();
+    printf("plain copy    : %u reads, %u torn\n", reads, torn);
+
+    reads = 0;
+    retries = 0;
+    g_done = false;
+    std::thread snapshotReader([&]() { torn = reader(false, &reads, &retries); });
+    std::thread writers[] = {
+        std::thread(axesWriter, false),
+        std::thread(buttonWriter),
+        std::thread(nibbleWriter, 0xF0, 4),
+        std::thread(nibbleWriter, 0x0F, 0),
+    };
+    for (unsigned i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+        writers[i].join();
+    }
+    g_done = true;
+    snapshotReader.join();
+    printf("ReportSnapshot: %u reads, %u retries, %u torn\n", reads, retries, torn);
+
+    if (torn) {
+        printf("FAIL: torn snapshot\n");
+        failures++;
+    }
+
+    uint8_t final[6];
+    g_report.read(final);
+    uint8_t last = (uint8_t)(ITERATIONS - 1);
+    uint8_t nibble = (ITERATIONS - 1) & 0xF;
+    if (final[0] != last || final[1] != ((nibble << 4) | nibble) || final[2] != last ||
+            !axesConsistent(final)) {
+        printf("FAIL: lost update, final report %02x %02x %02x %02x %02x %02x\n",
+               final[0], final[1], final[2], final[3], final[4], final[5]);
+        failures++;
+    }
+    if (g_report.version() != 4 * ITERATIONS) {
+        printf("FAIL: version %u, expected %u\n", (unsigned)g_report.version(), 4 * ITERATIONS);
+        failures++;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
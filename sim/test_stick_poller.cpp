@@ -0,0 +1,162 @@
+/* Tests for the StickPoller backoff and how it recovers from a queue with no room for a poll */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "StickPoller.h"
+
+#include <vector>
+
+namespace {
+
+events::EventQueue queue(4 * EVENTS_EVENT_SIZE);
+bool g_moving;
+bool g_fillOnPoll;
+std::vector<int> g_fillers;
+
+void nothing()
+{
+}
+
+/* Take every slot left on the queue with events due much later */
+void fillQueue()
+{
+    while (int id = queue.call_in(60000, &nothing)) {
+        g_fillers.push_back(id);
+    }
+}
+
+void emptyQueue()
+{
+    for (size_t i = 0; i < g_fillers.size(); i++) {
+        queue.cancel(g_fillers[i]);
+    }
+    g_fillers.clear();
+}
+
+bool poll()
+{
+    if (g_fillOnPoll) {
+        g_fillOnPoll = false;
+        fillQueue();
+    }
+    return g_moving;
+}
+
+StickPoller poller(&queue, &poll);
+
+void testBacksOffWhenStill()
+{
+    poller.start();
+    g_moving = true;
+    queue.dispatch(50);
+    CHECK(poller.periodMs() == poller.fastPeriodMs());
+
+    g_moving = false;
+    queue.dispatch(1000);
+    CHECK(poller.periodMs() == STICK_POLL_IDLE_MS);
+
+    g_moving = true;
+    queue.dispatch(STICK_POLL_IDLE_MS + 10);
+    CHECK(poller.periodMs() == poller.fastPeriodMs());
+    poller.stop();
+}
+
+void testResumesAfterFailedPost()
+{
+    g_moving = true;
+    poller.start();
+    uint32_t failures = poller.scheduleFailures;
+
+    /* Other events take up the queue while a poll runs: it cannot post the next one */
+    g_fillOnPoll = true;
+    queue.dispatch(50);
+    CHECK(poller.scheduleFailures == failures + 1);
+    uint32_t wakeups = poller.wakeups;
+    queue.dispatch(50);
+    CHECK(poller.wakeups == wakeups);
+
+    /* Still no room: resume() fails again and counts it */
+    poller.resume();
+    CHECK(poller.scheduleFailures == failures + 2);
+
+    emptyQueue();
+    poller.resume();
+    queue.dispatch(50);
+    CHECK(poller.scheduleFailures == failures + 2);
+    CHECK(poller.wakeups > wakeups);
+
+    /* Once posted, resume() does not post a second poll */
+    poller.resume();
+    wakeups = poller.wakeups;
+    queue.dispatch(10 * poller.fastPeriodMs() + poller.fastPeriodMs() / 2);
+    CHECK(poller.wakeups - wakeups == 10);
+    poller.stop();
+}
+
+void testStartWithFullQueue()
+{
+    fillQueue();
+    uint32_t failures = poller.scheduleFailures;
+    poller.start();
+    CHECK(poller.scheduleFailures == failures + 1);
+    emptyQueue();
+
+    /* A rate change posts the poll too */
+    uint32_t wakeups = poller.wakeups;
+    poller.setRates(STICK_POLL_MIN_MS, STICK_POLL_IDLE_MS);
+    queue.dispatch(50);
+    CHECK(poller.wakeups > wakeups);
+    poller.stop();
+}
+
+void testRequestStartWithFullQueue()
+{
+    fillQueue();
+    uint32_t failures = poller.startFailures;
+    poller.requestStart();
+    CHECK(poller.startFailures == failures + 1);
+    emptyQueue();
+    uint32_t wakeups = poller.wakeups;
+    queue.dispatch(50);
+    CHECK(poller.wakeups == wakeups);
+
+    /* The next resume() makes the start that could not be posted */
+    poller.resume();
+    queue.dispatch(50);
+    CHECK(poller.wakeups > wakeups);
+
+    /* A stop before the retry drops the request */
+    fillQueue();
+    poller.requestStart();
+    emptyQueue();
+    poller.stop();
+    wakeups = poller.wakeups;
+    poller.resume();
+    queue.dispatch(50);
+    CHECK(poller.wakeups == wakeups);
+}
+
+void testStoppedDoesNotResume()
+{
+    poller.start();
+    poller.stop();
+    uint32_t wakeups = poller.wakeups;
+    poller.resume();
+    poller.setConnectionInterval(12);
+    queue.dispatch(100);
+    CHECK(poller.wakeups == wakeups);
+}
+
+} // namespace
+
+int main()
+{
+    testBacksOffWhenStill();
+    testResumesAfterFailedPost();
+    testStartWithFullQueue();
+    testRequestStartWithFullQueue();
+    testStoppedDoesNotResume();
+
+    return simtest::report();
+}
@@ -0,0 +1,211 @@
+/* Tests for the StickSampler filter, quantiser and packed change detector */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "StickSampler.h"
+
+namespace {
+
+AnalogIn stickX0(A5);
+AnalogIn stickY0(A4);
+AnalogIn stickX1(A3);
+AnalogIn stickY1(A2);
+AnalogIn *const sticks[StickSampler::AXES] = {&stickX0, &stickY0, &stickX1, &stickY1};
+
+uint64_t pack(const uint16_t *values)
+{
+    uint64_t packed = 0;
+    for (unsigned lane = 0; lane < 4; lane++) {
+        packed |= (uint64_t)values[lane] << (16 * lane);
+    }
+    return packed;
+}
+
+uint64_t scalarChanged(const uint16_t *current, const uint16_t *previous, uint8_t threshold)
+{
+    uint64_t expected = 0;
+    for (unsigned lane = 0; lane < 4; lane++) {
+        if (abs((int)current[lane] - previous[lane]) >= threshold) {
+            expected |= 0x8000ULL << (16 * lane);
+        }
+    }
+    return expected;
+}
+
+void testPackedDetectorMatchesScalar()
+{
+    uint32_t seed = 7;
+    for (unsigned i = 0; i < 200000; i++) {
+        /* Lanes hold up to 15 bits; every other round uses 8-bit values */
+        uint16_t range = (i & 2) ? 0x7FFF : 0xFF;
+        uint16_t current[4];
+        uint16_t previous[4];
+        for (unsigned lane = 0; lane < 4; lane++) {
+            seed = seed * 1664525 + 1013904223;
+            current[lane] = (seed >> 16) & range;
+            previous[lane] = (i & 1) ? (current[lane] + (int8_t)(seed >> 8) % 8) & range
+                                     : (seed >> 8) & range;
+        }
+        uint8_t threshold = 1 + (i % 10);
+
+        uint64_t expected = scalarChanged(current, previous, threshold);
+        uint64_t lanes = StickSampler::changedLanes(pack(current), pack(previous), threshold);
+        CHECK(lanes == expected);
+        if (lanes != expected) {
+            return;
+        }
+    }
+}
+
+/* Full-scale swings next to lanes that differ by exactly the threshold, in every pair of
+ * neighbouring lanes and either direction */
+void testPackedDetectorAtFullScale()
+{
+    static const uint8_t thresholds[] = {1, 2, 3, 16, 255};
+    for (unsigned t = 0; t < sizeof(thresholds); t++) {
+        uint8_t threshold = thresholds[t];
+        const uint16_t edges[] = {
+            0, 1, (uint16_t)(threshold - 1), threshold, (uint16_t)(threshold + 1),
+            (uint16_t)(0x7FFF - threshold), (uint16_t)(0x7FFF - threshold + 1), 0x7FFE, 0x7FFF
+        };
+        const unsigned count = sizeof(edges) / sizeof(edges[0]);
+
+        for (unsigned low = 0; low < 3; low++) {
+            for (unsigned i = 0; i < count * count * count * count; i++) {
+                uint16_t current[4] = {0, 0, 0, 0};
+                uint16_t previous[4] = {0, 0, 0, 0};
+                current[low] = edges[i % count];
+                previous[low] = edges[i / count % count];
+                current[low + 1] = edges[i / (count * count) % count];
+                previous[low + 1] = edges[i / (count * count * count)];
+
+                uint64_t expected = scalarChanged(current, previous, threshold);
+                uint64_t lanes = StickSampler::changedLanes(pack(current), pack(previous), threshold);
+                CHECK(lanes == expected);
+                if (lanes != expected) {
+                    printf("threshold %u: lanes %u-%u from %u,%u to %u,%u\n", threshold, low,
+                           low + 1, previous[low], previous[low + 1], current[low],
+                           current[low + 1]);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/* 16-bit reading of a report count with the default calibration: 0, 32768 and 65535 read as 0, 128 and 255 */
+int rawFor(int counts)
+{
+    if (counts < 128) {
+        return 32768 - (128 - counts) * 256;
+    }
+    return 32768 + (counts - 128) * 32767 / 127;
+}
+
+void setAll(uint16_t raw[StickSampler::AXES], uint16_t value)
+{
+    for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+        raw[axis] = value;
+    }
+}
+
+void testCalibrationCentres()
+{
+    for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+        sim::setAnalog((PinName)(A5 - axis), 0.3f);
+    }
+    StickSampler sampler(sticks);
+    sampler.calibrate();
+    for (unsigned axis = 0; axis < StickSampler::AXES; axis++) {
+        CHECK(sampler.values()[axis] == 128);
+    }
+}
+
+void testQuantiserHysteresis()
+{
+    StickSampler sampler(sticks);
+    sampler.setFilter(0, 0, 1);
+    uint16_t raw[StickSampler::AXES];
+
+    /* 256 16-bit units per report count below the centre */
+    setAll(raw, rawFor(100));
+    CHECK(sampler.update(raw));
+    CHECK(sampler.values()[0] == 100);
+
+    /* Within 3/4 of a count of the current value: no change either way */
+    setAll(raw, rawFor(100) + 180);
+    CHECK(!sampler.update(raw));
+    setAll(raw, rawFor(100) - 180);
+    CHECK(!sampler.update(raw));
+    CHECK(sampler.values()[0] == 100);
+
+    /* Past it, rounds to the nearest count */
+    setAll(raw, rawFor(100) + 200);
+    CHECK(sampler.update(raw));
+    CHECK(sampler.values()[0] == 101);
+}
+
+void testFilterRejectsNoise()
+{
+    StickSampler sampler(sticks);
+    uint16_t raw[StickSampler::AXES];
+    setAll(raw, rawFor(128));
+    for (unsigned i = 0; i < 20; i++) {
+        sampler.update(raw);
+    }
+
+    /* Alternating half-count noise never changes the output */
+    unsigned changes = 0;
+    for (unsigned i = 0; i < 1000; i++) {
+        setAll(raw, rawFor(128) + ((i & 1) ? 128 : -128));
+        changes += sampler.update(raw);
+    }
+    CHECK(changes == 0);
+}
+
+void testFilterFollowsFastMotion()
+{
+    StickSampler sampler(sticks);
+    uint16_t raw[StickSampler::AXES];
+    setAll(raw, rawFor(20));
+    for (unsigned i = 0; i < 20; i++) {
+        sampler.update(raw);
+    }
+
+    /* A full-speed move is tracked without smoothing on the first burst */
+    setAll(raw, rawFor(230));
+    CHECK(sampler.update(raw));
+    CHECK(sampler.values()[0] == 230);
+}
+
+void testChangeThreshold()
+{
+    StickSampler sampler(sticks);
+    sampler.setFilter(0, 0, 1);
+    sampler.setChangeThreshold(3);
+    uint16_t raw[StickSampler::AXES];
+
+    setAll(raw, rawFor(100));
+    CHECK(sampler.update(raw));
+    setAll(raw, rawFor(102));
+    CHECK(!sampler.update(raw));
+    setAll(raw, rawFor(103));
+    CHECK(sampler.update(raw));
+    CHECK(sampler.values()[3] == 103);
+}
+
+} // namespace
+
+int main()
+{
+    testPackedDetectorMatchesScalar();
+    testPackedDetectorAtFullScale();
+    testCalibrationCentres();
+    testQuantiserHysteresis();
+    testFilterRejectsNoise();
+    testFilterFollowsFastMotion();
+    testChangeThreshold();
+
+    return simtest::report();
+}
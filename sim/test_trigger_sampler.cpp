@@ -0,0 +1,98 @@
+/* Tests for the TriggerSampler rest calibration, travel mapping and change threshold */
+
+#include "mbed.h"
+#include "SimTest.h"
+#include "SimKernel.h"
+#include "TriggerSampler.h"
+
+namespace {
+
+AnalogIn leftTrigger(A0);
+AnalogIn rightTrigger(A1);
+AnalogIn *const triggers[TriggerSampler::TRIGGERS] = {&leftTrigger, &rightTrigger};
+
+/* The 16-bit reading the trigger rests at in these tests */
+const uint16_t REST = 4096;
+
+/* Feed one reading to both triggers until the filter has settled on it */
+bool settle(TriggerSampler &sampler, uint16_t reading)
+{
+    uint16_t raw[TriggerSampler::TRIGGERS] = {reading, reading};
+    bool changed = false;
+    for (unsigned i = 0; i < 40; i++) {
+        changed |= sampler.update(raw);
+    }
+    return changed;
+}
+
+/* Reading for a fraction of the travel past the deadzone */
+uint16_t readingAt(double fraction)
+{
+    double start = REST + TRIGGER_DEADZONE;
+    return (uint16_t)(start + fraction * (TRIGGER_FULL_READING - start) + 0.5);
+}
+
+void calibrate(TriggerSampler &sampler)
+{
+    sim::config().adcNoiseLsb = 0;
+    sim::setAnalog(A0, REST / 65535.0f);
+    sim::setAnalog(A1, REST / 65535.0f);
+    sampler.calibrate();
+}
+
+void testRestReadsReleased()
+{
+    TriggerSampler sampler(triggers);
+    calibrate(sampler);
+    CHECK(sampler.values()[0] == 0);
+    CHECK(sampler.values()[1] == 0);
+
+    /* Within the deadzone the trigger still reads released */
+    CHECK(!settle(sampler, REST + TRIGGER_DEADZONE / 2));
+    CHECK(sampler.values()[0] == 0);
+}
+
+void testTravelMapsToFullScale()
+{
+    TriggerSampler sampler(triggers);
+    calibrate(sampler);
+
+    CHECK(settle(sampler, 0xFFFF));
+    CHECK(sampler.values()[0] == TriggerSampler::MAX);
+    CHECK(sampler.values()[1] == TriggerSampler::MAX);
+
+    settle(sampler, readingAt(0.5));
+    CHECK(abs((int)sampler.values()[0] - TriggerSampler::MAX / 2) <= 1);
+
+    /* Letting go reads exactly 0 whatever the threshold */
+    CHECK(settle(sampler, REST));
+    CHECK(sampler.values()[0] == 0);
+}
+
+void testChangeThreshold()
+{
+    TriggerSampler sampler(triggers);
+    calibrate(sampler);
+    sampler.setChangeThreshold(8);
+
+    settle(sampler, readingAt(0.25));
+    uint16_t value = sampler.values()[0];
+
+    /* Six counts on is not enough, nine is */
+    double count = 1.0 / TriggerSampler::MAX;
+    CHECK(!settle(sampler, readingAt(0.25 + 6 * count)));
+    CHECK(sampler.values()[0] == value);
+    CHECK(settle(sampler, readingAt(0.25 + 9 * count)));
+    CHECK(abs((int)sampler.values()[0] - (value + 9)) <= 1);
+}
+
+} // namespace
+
+int main()
+{
+    testRestReadsReleased();
+    testTravelMapsToFullScale();
+    testChangeThreshold();
+
+    return simtest::report();
+}